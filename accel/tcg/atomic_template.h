@@ -59,6 +59,95 @@
 # define ABI_TYPE  uint32_t
 #endif
 
+#if (DATA_SIZE == 2 || DATA_SIZE == 4) && defined(CONFIG_ATOMIC64)
+/*
+ * atomic_mmu_lookup() lets through a misaligned access that stays within
+ * an aligned 8-byte word; see atomic_can_widen().  Do it as a read or a
+ * compare-and-swap of that whole word, so that it stays atomic against
+ * whatever the other vCPUs do to the same bytes in parallel.
+ */
+static inline uint64_t *glue(atomic_wide_word_, SUFFIX)(DATA_TYPE *haddr,
+                                                        int *shift)
+{
+    uintptr_t ofs = (uintptr_t)haddr & 7;
+
+#ifdef HOST_WORDS_BIGENDIAN
+    *shift = (8 - DATA_SIZE - ofs) * 8;
+#else
+    *shift = ofs * 8;
+#endif
+    return (uint64_t *)((uintptr_t)haddr - ofs);
+}
+
+static inline DATA_TYPE glue(atomic_wide_read_, SUFFIX)(DATA_TYPE *haddr)
+{
+    int shift;
+    uint64_t *p = glue(atomic_wide_word_, SUFFIX)(haddr, &shift);
+
+    return qatomic_read__nocheck(p) >> shift;
+}
+
+static inline DATA_TYPE glue(atomic_wide_cmpxchg_, SUFFIX)(DATA_TYPE *haddr,
+                                                           DATA_TYPE cmpv,
+                                                           DATA_TYPE newv)
+{
+    int shift;
+    uint64_t *p = glue(atomic_wide_word_, SUFFIX)(haddr, &shift);
+    uint64_t mask = MAKE_64BIT_MASK(shift, DATA_SIZE * 8);
+    uint64_t cmp, old;
+
+    /* A full barrier even when the comparison fails, like cmpxchg */
+    smp_mb();
+    old = qatomic_read__nocheck(p);
+    do {
+        if ((DATA_TYPE)(old >> shift) != cmpv) {
+            return old >> shift;
+        }
+        cmp = old;
+        old = qatomic_cmpxchg__nocheck(p, cmp, (cmp & ~mask) |
+                                       (uint64_t)newv << shift);
+    } while (old != cmp);
+    return cmpv;
+}
+
+# define ATOMIC_WIDE(H)  unlikely((uintptr_t)(H) & (DATA_SIZE - 1))
+# define ATOMIC_READ(H)                                             \
+    (ATOMIC_WIDE(H) ?                                               \
+     (typeof(*(H)))glue(atomic_wide_read_, SUFFIX)((DATA_TYPE *)(H)) : \
+     qatomic_read__nocheck(H))
+# define ATOMIC_CMPXCHG(H, C, N)                                    \
+    (ATOMIC_WIDE(H) ?                                               \
+     (typeof(*(H)))glue(atomic_wide_cmpxchg_, SUFFIX)((DATA_TYPE *)(H), \
+                                                      C, N) :       \
+     qatomic_cmpxchg__nocheck(H, C, N))
+#else
+# define ATOMIC_WIDE(H)           false
+# define ATOMIC_READ(H)           qatomic_read__nocheck(H)
+# define ATOMIC_CMPXCHG(H, C, N)  qatomic_cmpxchg__nocheck(H, C, N)
+#endif
+
+/*
+ * Apply FN to the value at HADDR with a compare-and-swap loop and
+ * return RET, which is either old or new.  This is how the helpers below
+ * that have a host atomic of their own deal with a widened access.
+ */
+#define ATOMIC_RMW_LOOP(HADDR, FN, VAL, RET) ({                     \
+    DATA_TYPE cmp_, old, new;                                       \
+    smp_mb();                                                       \
+    cmp_ = ATOMIC_READ(HADDR);                                      \
+    do {                                                            \
+        old = cmp_; new = FN(old, (DATA_TYPE)(VAL));                \
+        cmp_ = ATOMIC_CMPXCHG(HADDR, old, new);                     \
+    } while (cmp_ != old);                                          \
+    RET;                                                            \
+})
+
+#define ADD(X, Y)   (X + Y)
+#define AND(X, Y)   (X & Y)
+#define OR(X, Y)    (X | Y)
+#define XOR(X, Y)   (X ^ Y)
+#define XCHG(X, Y)  (Y)
+
 /* Define host-endian atomic operations.  Note that END is used within
    the ATOMIC_NAME macro, and redefined below.  */
 #if DATA_SIZE == 1
@@ -80,7 +169,7 @@ ABI_TYPE ATOMIC_NAME(cmpxchg)(CPUArchState *env, target_ulong addr,
 #if DATA_SIZE == 16
     ret = atomic16_cmpxchg(haddr, cmpv, newv);
 #else
-    ret = qatomic_cmpxchg__nocheck(haddr, cmpv, newv);
+    ret = ATOMIC_CMPXCHG(haddr, cmpv, newv);
 #endif
     ATOMIC_MMU_CLEANUP;
     atomic_trace_rmw_post(env, addr, oi);
@@ -121,33 +210,41 @@ ABI_TYPE ATOMIC_NAME(xchg)(CPUArchState *env, target_ulong addr, ABI_TYPE val,
                                          PAGE_READ | PAGE_WRITE, retaddr);
     DATA_TYPE ret;
 
-    ret = qatomic_xchg__nocheck(haddr, val);
+    if (ATOMIC_WIDE(haddr)) {
+        ret = ATOMIC_RMW_LOOP(haddr, XCHG, val, old);
+    } else {
+        ret = qatomic_xchg__nocheck(haddr, val);
+    }
     ATOMIC_MMU_CLEANUP;
     atomic_trace_rmw_post(env, addr, oi);
     return ret;
 }
 
-#define GEN_ATOMIC_HELPER(X)                                        \
+#define GEN_ATOMIC_HELPER(X, FN, RET)                               \
 ABI_TYPE ATOMIC_NAME(X)(CPUArchState *env, target_ulong addr,       \
                         ABI_TYPE val, MemOpIdx oi, uintptr_t retaddr) \
 {                                                                   \
     DATA_TYPE *haddr = atomic_mmu_lookup(env, addr, oi, DATA_SIZE,  \
                                          PAGE_READ | PAGE_WRITE, retaddr); \
     DATA_TYPE ret;                                                  \
-    ret = qatomic_##X(haddr, val);                                  \
+    if (ATOMIC_WIDE(haddr)) {                                       \
+        ret = ATOMIC_RMW_LOOP(haddr, FN, val, RET);                 \
+    } else {                                                        \
+        ret = qatomic_##X(haddr, val);                              \
+    }                                                               \
     ATOMIC_MMU_CLEANUP;                                             \
     atomic_trace_rmw_post(env, addr, oi);                           \
     return ret;                                                     \
 }
 
-GEN_ATOMIC_HELPER(fetch_add)
-GEN_ATOMIC_HELPER(fetch_and)
-GEN_ATOMIC_HELPER(fetch_or)
-GEN_ATOMIC_HELPER(fetch_xor)
-GEN_ATOMIC_HELPER(add_fetch)
-GEN_ATOMIC_HELPER(and_fetch)
-GEN_ATOMIC_HELPER(or_fetch)
-GEN_ATOMIC_HELPER(xor_fetch)
+GEN_ATOMIC_HELPER(fetch_add, ADD, old)
+GEN_ATOMIC_HELPER(fetch_and, AND, old)
+GEN_ATOMIC_HELPER(fetch_or, OR, old)
+GEN_ATOMIC_HELPER(fetch_xor, XOR, old)
+GEN_ATOMIC_HELPER(add_fetch, ADD, new)
+GEN_ATOMIC_HELPER(and_fetch, AND, new)
+GEN_ATOMIC_HELPER(or_fetch, OR, new)
+GEN_ATOMIC_HELPER(xor_fetch, XOR, new)
 
 #undef GEN_ATOMIC_HELPER
 
@@ -167,10 +264,10 @@ ABI_TYPE ATOMIC_NAME(X)(CPUArchState *env, target_ulong addr,       \
                                           PAGE_READ | PAGE_WRITE, retaddr); \
     XDATA_TYPE cmp, old, new, val = xval;                           \
     smp_mb();                                                       \
-    cmp = qatomic_read__nocheck(haddr);                             \
+    cmp = ATOMIC_READ(haddr);                                       \
     do {                                                            \
         old = cmp; new = FN(old, val);                              \
-        cmp = qatomic_cmpxchg__nocheck(haddr, old, new);            \
+        cmp = ATOMIC_CMPXCHG(haddr, old, new);                      \
     } while (cmp != old);                                           \
     ATOMIC_MMU_CLEANUP;                                             \
     atomic_trace_rmw_post(env, addr, oi);                           \
@@ -213,7 +310,7 @@ ABI_TYPE ATOMIC_NAME(cmpxchg)(CPUArchState *env, target_ulong addr,
 #if DATA_SIZE == 16
     ret = atomic16_cmpxchg(haddr, BSWAP(cmpv), BSWAP(newv));
 #else
-    ret = qatomic_cmpxchg__nocheck(haddr, BSWAP(cmpv), BSWAP(newv));
+    ret = ATOMIC_CMPXCHG(haddr, BSWAP(cmpv), BSWAP(newv));
 #endif
     ATOMIC_MMU_CLEANUP;
     atomic_trace_rmw_post(env, addr, oi);
@@ -255,31 +352,39 @@ ABI_TYPE ATOMIC_NAME(xchg)(CPUArchState *env, target_ulong addr, ABI_TYPE val,
                                          PAGE_READ | PAGE_WRITE, retaddr);
     ABI_TYPE ret;
 
-    ret = qatomic_xchg__nocheck(haddr, BSWAP(val));
+    if (ATOMIC_WIDE(haddr)) {
+        ret = ATOMIC_RMW_LOOP(haddr, XCHG, BSWAP(val), old);
+    } else {
+        ret = qatomic_xchg__nocheck(haddr, BSWAP(val));
+    }
     ATOMIC_MMU_CLEANUP;
     atomic_trace_rmw_post(env, addr, oi);
     return BSWAP(ret);
 }
 
-#define GEN_ATOMIC_HELPER(X)                                        \
+#define GEN_ATOMIC_HELPER(X, FN, RET)                               \
 ABI_TYPE ATOMIC_NAME(X)(CPUArchState *env, target_ulong addr,       \
                         ABI_TYPE val, MemOpIdx oi, uintptr_t retaddr) \
 {                                                                   \
     DATA_TYPE *haddr = atomic_mmu_lookup(env, addr, oi, DATA_SIZE,  \
                                          PAGE_READ | PAGE_WRITE, retaddr); \
     DATA_TYPE ret;                                                  \
-    ret = qatomic_##X(haddr, BSWAP(val));                           \
+    if (ATOMIC_WIDE(haddr)) {                                       \
+        ret = ATOMIC_RMW_LOOP(haddr, FN, BSWAP(val), RET);          \
+    } else {                                                        \
+        ret = qatomic_##X(haddr, BSWAP(val));                       \
+    }                                                               \
     ATOMIC_MMU_CLEANUP;                                             \
     atomic_trace_rmw_post(env, addr, oi);                           \
     return BSWAP(ret);                                              \
 }
 
-GEN_ATOMIC_HELPER(fetch_and)
-GEN_ATOMIC_HELPER(fetch_or)
-GEN_ATOMIC_HELPER(fetch_xor)
-GEN_ATOMIC_HELPER(and_fetch)
-GEN_ATOMIC_HELPER(or_fetch)
-GEN_ATOMIC_HELPER(xor_fetch)
+GEN_ATOMIC_HELPER(fetch_and, AND, old)
+GEN_ATOMIC_HELPER(fetch_or, OR, old)
+GEN_ATOMIC_HELPER(fetch_xor, XOR, old)
+GEN_ATOMIC_HELPER(and_fetch, AND, new)
+GEN_ATOMIC_HELPER(or_fetch, OR, new)
+GEN_ATOMIC_HELPER(xor_fetch, XOR, new)
 
 #undef GEN_ATOMIC_HELPER
 
@@ -298,10 +403,10 @@ ABI_TYPE ATOMIC_NAME(X)(CPUArchState *env, target_ulong addr,       \
                                           PAGE_READ | PAGE_WRITE, retaddr); \
     XDATA_TYPE ldo, ldn, old, new, val = xval;                      \
     smp_mb();                                                       \
-    ldn = qatomic_read__nocheck(haddr);                             \
+    ldn = ATOMIC_READ(haddr);                                       \
     do {                                                            \
         ldo = ldn; old = BSWAP(ldo); new = FN(old, val);            \
-        ldn = qatomic_cmpxchg__nocheck(haddr, ldo, BSWAP(new));     \
+        ldn = ATOMIC_CMPXCHG(haddr, ldo, BSWAP(new));               \
     } while (ldo != ldn);                                           \
     ATOMIC_MMU_CLEANUP;                                             \
     atomic_trace_rmw_post(env, addr, oi);                           \
@@ -320,10 +425,8 @@ GEN_ATOMIC_HELPER_FN(umax_fetch, MAX,  DATA_TYPE, new)
 
 /* Note that for addition, we need to use a separate cmpxchg loop instead
    of bswaps for the reverse-host-endian helpers.  */
-#define ADD(X, Y)   (X + Y)
 GEN_ATOMIC_HELPER_FN(fetch_add, ADD, DATA_TYPE, old)
 GEN_ATOMIC_HELPER_FN(add_fetch, ADD, DATA_TYPE, new)
-#undef ADD
 
 #undef GEN_ATOMIC_HELPER_FN
 #endif /* DATA_SIZE >= 16 */
@@ -331,6 +434,15 @@ GEN_ATOMIC_HELPER_FN(add_fetch, ADD, DATA_TYPE, new)
 #undef END
 #endif /* DATA_SIZE > 1 */
 
+#undef ADD
+#undef AND
+#undef OR
+#undef XOR
+#undef XCHG
+#undef ATOMIC_RMW_LOOP
+#undef ATOMIC_WIDE
+#undef ATOMIC_READ
+#undef ATOMIC_CMPXCHG
 #undef BSWAP
 #undef ABI_TYPE
 #undef DATA_TYPE
@@ -46,6 +46,9 @@
 #include "tb-hash.h"
 #include "tb-context.h"
 #include "internal.h"
+#ifndef CONFIG_USER_ONLY
+#include "../../mydebug.hpp"
+#endif
 
 /* -icount align implementation. */
 
@@ -171,33 +174,43 @@ uint32_t curr_cflags(CPUState *cpu)
     return cflags;
 }
 
+/* Geometry of the tb_jmp_cache, see tb-hash.h */
+unsigned int tb_jmp_cache_bits = 12;
+unsigned int tb_jmp_cache_ways = 1;
+
 /* Might cause an exception, so have a longjmp destination ready */
 static inline TranslationBlock *tb_lookup(CPUState *cpu, target_ulong pc,
                                           target_ulong cs_base,
                                           uint32_t flags, uint32_t cflags)
 {
-    TranslationBlock *tb;
-    uint32_t hash;
+    TranslationBlock *tb, **set;
+    unsigned int way;
 
     /* we should never be trying to look up an INVALID tb */
     tcg_debug_assert(!(cflags & CF_INVALID));
 
-    hash = tb_jmp_cache_hash_func(pc);
-    tb = qatomic_rcu_read(&cpu->tb_jmp_cache[hash]);
-
-    if (likely(tb &&
-               tb->pc == pc &&
-               tb->cs_base == cs_base &&
-               tb->flags == flags &&
-               tb->trace_vcpu_dstate == *cpu->trace_dstate &&
-               tb_cflags(tb) == cflags)) {
-        return tb;
+    set = tb_jmp_cache_set(cpu->tb_jmp_cache, pc);
+    for (way = 0; way < tb_jmp_cache_ways; way++) {
+        tb = qatomic_rcu_read(&set[way]);
+        if (likely(tb &&
+                   tb->pc == pc &&
+                   tb->cs_base == cs_base &&
+                   tb->flags == flags &&
+                   tb->trace_vcpu_dstate == *cpu->trace_dstate &&
+                   tb_cflags(tb) == cflags)) {
+            cpu_exec_stats_add(&cpu->exec_stats.jmp_cache_hits, 1);
+            if (way) {
+                tb_jmp_cache_insert(cpu, pc, tb);
+            }
+            return tb;
+        }
     }
+    cpu_exec_stats_add(&cpu->exec_stats.jmp_cache_misses, 1);
     tb = tb_htable_lookup(cpu, pc, cs_base, flags, cflags);
     if (tb == NULL) {
         return NULL;
     }
-    qatomic_set(&cpu->tb_jmp_cache[hash], tb);
+    tb_jmp_cache_insert(cpu, pc, tb);
     return tb;
 }
 
@@ -301,15 +314,11 @@ static bool check_for_breakpoints(CPUState *cpu, target_ulong pc,
     return false;
 }
 
-/**
- * helper_lookup_tb_ptr: quick check for next tb
- * @env: current cpu state
- *
- * Look for an existing TB matching the current cpu state.
- * If found, return the code pointer.  If not found, return
- * the tcg epilogue so that we return into cpu_tb_exec.
+/*
+ * The TB that generated code may jump to directly for the current cpu
+ * state, or NULL if it has to return into cpu_tb_exec.
  */
-const void *HELPER(lookup_tb_ptr)(CPUArchState *env)
+static inline TranslationBlock *lookup_tb_for_ptr(CPUArchState *env)
 {
     CPUState *cpu = env_cpu(env);
     TranslationBlock *tb;
@@ -325,11 +334,57 @@ const void *HELPER(lookup_tb_ptr)(CPUArchState *env)
 
     tb = tb_lookup(cpu, pc, cs_base, flags, cflags);
     if (tb == NULL) {
-        return tcg_code_gen_epilogue;
+        return NULL;
     }
 
+    cpu_exec_stats_add(&cpu->exec_stats.tbs, 1);
+    cpu_exec_stats_add(&cpu->exec_stats.insns, tb->icount);
     log_cpu_exec(pc, cpu, tb);
 
+    return tb;
+}
+
+/**
+ * helper_lookup_tb_ptr: quick check for next tb
+ * @env: current cpu state
+ *
+ * Look for an existing TB matching the current cpu state.
+ * If found, return the code pointer.  If not found, return
+ * the tcg epilogue so that we return into cpu_tb_exec.
+ */
+const void *HELPER(lookup_tb_ptr)(CPUArchState *env)
+{
+    TranslationBlock *tb = lookup_tb_for_ptr(env);
+
+    return tb ? tb->tc.ptr : tcg_code_gen_epilogue;
+}
+
+/* Empty tb_ibtc slots, see tb-hash.h */
+TranslationBlock tb_ibtc_miss = { .cflags = CF_INVALID };
+
+/**
+ * helper_lookup_tb_ptr_cached: miss path of a predicted indirect branch
+ * @env: current cpu state
+ * @slot: tb_ibtc slot of the branch
+ * @cflags: cflags of the TB the branch is in
+ *
+ * As helper_lookup_tb_ptr, and make the TB found the prediction for
+ * @slot.  The inline check only accepts a TB with the cflags of the
+ * branch, and skips check_for_breakpoints(), so nothing is recorded
+ * while breakpoints are set.
+ */
+const void *HELPER(lookup_tb_ptr_cached)(CPUArchState *env, uint32_t slot,
+                                         uint32_t cflags)
+{
+    CPUState *cpu = env_cpu(env);
+    TranslationBlock *tb = lookup_tb_for_ptr(env);
+
+    if (tb == NULL) {
+        return tcg_code_gen_epilogue;
+    }
+    if (tb_cflags(tb) == cflags && QTAILQ_EMPTY(&cpu->breakpoints)) {
+        qatomic_set(&cpu->tb_ibtc[slot], tb);
+    }
     return tb->tc.ptr;
 }
 
@@ -369,6 +424,24 @@ cpu_tb_exec(CPUState *cpu, TranslationBlock *itb, int *tb_exit)
 
     trace_exec_tb_exit(last_tb, *tb_exit);
 
+    /* Chained blocks run in between are not visible from here. */
+    if (last_tb != itb || *tb_exit <= TB_EXIT_IDX1) {
+        cpu_exec_stats_add(&cpu->exec_stats.tbs, 1);
+        cpu_exec_stats_add(&cpu->exec_stats.insns, itb->icount);
+    }
+
+#ifndef CONFIG_USER_ONLY
+    /*
+     * The profiler's exit request stops the chain in front of last_tb,
+     * which is where this vCPU spends its time right now.
+     */
+    if (*tb_exit == TB_EXIT_REQUESTED &&
+        unlikely(qatomic_read(&cpu->tb_sample_pending))) {
+        qatomic_set(&cpu->tb_sample_pending, false);
+        OnTBSample(cpu->cpu_index, last_tb->pc, last_tb->size, 0);
+    }
+#endif
+
     if (*tb_exit > TB_EXIT_IDX1) {
         /* We didn't start executing this TB (eg because the instruction
          * counter hit zero); we must restore the guest PC to the address
@@ -402,6 +475,49 @@ cpu_tb_exec(CPUState *cpu, TranslationBlock *itb, int *tb_exit)
 }
 
 
+/* Translate a new TB, charging the host time it takes to @cpu. */
+static TranslationBlock *cpu_exec_gen_code(CPUState *cpu, target_ulong pc,
+                                           target_ulong cs_base,
+                                           uint32_t flags, uint32_t cflags)
+{
+    TranslationBlock *tb;
+    int64_t ti = get_clock();
+
+    mmap_lock();
+    tb = tb_gen_code(cpu, pc, cs_base, flags, cflags);
+    mmap_unlock();
+    cpu_exec_stats_add(&cpu->exec_stats.translate_ns, get_clock() - ti);
+    return tb;
+}
+
+/*
+ * Replace the cold @tb with an optimized translation once its code has
+ * counted tcg_tier_threshold executions.  The vCPU that resets the
+ * count does the work; the others keep running the cold TB meanwhile.
+ */
+static TranslationBlock *cpu_exec_tier_up(CPUState *cpu,
+                                          TranslationBlock *tb,
+                                          target_ulong pc,
+                                          target_ulong cs_base,
+                                          uint32_t flags, uint32_t cflags)
+{
+    uint32_t n = qatomic_read(&tb->exec_count);
+    int64_t ti;
+
+    if (n < tcg_tier_threshold ||
+        qatomic_cmpxchg(&tb->exec_count, n, 0) != n) {
+        return tb;
+    }
+
+    ti = get_clock();
+    mmap_lock();
+    tb = tb_tier_up(cpu, tb, pc, cs_base, flags, cflags);
+    mmap_unlock();
+    cpu_exec_stats_add(&cpu->exec_stats.translate_ns, get_clock() - ti);
+    tb_jmp_cache_insert(cpu, pc, tb);
+    return tb;
+}
+
 static void cpu_exec_enter(CPUState *cpu)
 {
     CPUClass *cc = CPU_GET_CLASS(cpu);
@@ -433,6 +549,7 @@ void cpu_exec_step_atomic(CPUState *cpu)
         g_assert(cpu == current_cpu);
         g_assert(!cpu->running);
         cpu->running = true;
+        tb_reclaim_enter(cpu);
 
         cpu_get_tb_cpu_state(env, &pc, &cs_base, &flags);
 
@@ -450,9 +567,7 @@ void cpu_exec_step_atomic(CPUState *cpu)
 
         tb = tb_lookup(cpu, pc, cs_base, flags, cflags);
         if (tb == NULL) {
-            mmap_lock();
-            tb = tb_gen_code(cpu, pc, cs_base, flags, cflags);
-            mmap_unlock();
+            tb = cpu_exec_gen_code(cpu, pc, cs_base, flags, cflags);
         }
 
         cpu_exec_enter(cpu);
@@ -482,6 +597,7 @@ void cpu_exec_step_atomic(CPUState *cpu)
      * the execution.
      */
     g_assert(cpu_in_exclusive_context(cpu));
+    tb_reclaim_exit(cpu);
     cpu->running = false;
     end_exclusive();
 }
@@ -845,12 +961,16 @@ static inline void cpu_loop_exec_tb(CPUState *cpu, TranslationBlock *tb,
 
     trace_exec_tb(tb, tb->pc);
     tb = cpu_tb_exec(cpu, tb, tb_exit);
-    if (*tb_exit != TB_EXIT_REQUESTED) {
+    if (*tb_exit <= TB_EXIT_IDXMAX) {
         *last_tb = tb;
         return;
     }
 
     *last_tb = NULL;
+    if (*tb_exit == TB_EXIT_TIER_UP) {
+        /* See gen_tb_tier_count(); the loop will call cpu_exec_tier_up() */
+        return;
+    }
     insns_left = qatomic_read(&cpu_neg(cpu)->icount_decr.u32);
     if (insns_left < 0) {
         /* Something asked us to stop executing chained TBs; just
@@ -901,6 +1021,7 @@ int cpu_exec(CPUState *cpu)
     }
 
     rcu_read_lock();
+    tb_reclaim_enter(cpu);
 
     cpu_exec_enter(cpu);
 
@@ -977,14 +1098,15 @@ int cpu_exec(CPUState *cpu)
 
             tb = tb_lookup(cpu, pc, cs_base, flags, cflags);
             if (tb == NULL) {
-                mmap_lock();
-                tb = tb_gen_code(cpu, pc, cs_base, flags, cflags);
-                mmap_unlock();
+                tb = cpu_exec_gen_code(cpu, pc, cs_base, flags, cflags);
                 /*
                  * We add the TB in the virtual pc hash table
                  * for the fast lookup
                  */
-                qatomic_set(&cpu->tb_jmp_cache[tb_jmp_cache_hash_func(pc)], tb);
+                tb_jmp_cache_insert(cpu, pc, tb);
+            }
+            if (unlikely(tb->cold)) {
+                tb = cpu_exec_tier_up(cpu, tb, pc, cs_base, flags, cflags);
             }
 
 #ifndef CONFIG_USER_ONLY
@@ -1012,6 +1134,7 @@ int cpu_exec(CPUState *cpu)
     }
 
     cpu_exec_exit(cpu);
+    tb_reclaim_exit(cpu);
     rcu_read_unlock();
 
     return ret;
@@ -1027,6 +1150,11 @@ void tcg_exec_realizefn(CPUState *cpu, Error **errp)
         tcg_target_initialized = true;
     }
     tlb_init(cpu);
+    qatomic_rcu_set(&cpu->tb_jmp_cache,
+                    g_malloc0(sizeof(CPUJumpCache) +
+                              TB_JMP_CACHE_SIZE * tb_jmp_cache_ways *
+                              sizeof(TranslationBlock *)));
+    tb_ibtc_clear(cpu);
     qemu_plugin_vcpu_init_hook(cpu);
 
 #ifndef CONFIG_USER_ONLY
@@ -1037,14 +1165,33 @@ void tcg_exec_realizefn(CPUState *cpu, Error **errp)
 /* undo the initializations in reverse order */
 void tcg_exec_unrealizefn(CPUState *cpu)
 {
+    CPUJumpCache *jc;
+
 #ifndef CONFIG_USER_ONLY
     tcg_iommu_free_notifier_list(cpu);
 #endif /* !CONFIG_USER_ONLY */
 
     qemu_plugin_vcpu_exit_hook(cpu);
+    jc = cpu->tb_jmp_cache;
+    qatomic_rcu_set(&cpu->tb_jmp_cache, NULL);
+    g_free_rcu(jc, rcu);
     tlb_destroy(cpu);
 }
 
+void cpu_tb_jmp_cache_clear(CPUState *cpu)
+{
+    CPUJumpCache *jc = qatomic_rcu_read(&cpu->tb_jmp_cache);
+    size_t i;
+
+    tb_ibtc_clear(cpu);
+    if (jc == NULL) {
+        return;
+    }
+    for (i = 0; i < TB_JMP_CACHE_SIZE * tb_jmp_cache_ways; i++) {
+        qatomic_set(&jc->array[i], NULL);
+    }
+}
+
 #ifndef CONFIG_USER_ONLY
 
 void dump_drift_info(GString *buf)
@@ -1066,6 +1213,43 @@ void dump_drift_info(GString *buf)
     }
 }
 
+static void dump_vcpu_exec_info(GString *buf)
+{
+    CPUState *cpu;
+
+    g_string_append_printf(buf, "\nvCPU host time (ms)  exec / translate / "
+                           "BQL wait / halted\n");
+    CPU_FOREACH(cpu) {
+        CPUExecStats *s = &cpu->exec_stats;
+
+        g_string_append_printf(buf, "cpu %-3d TBs %-12" PRIu64
+                               " insns %-14" PRIu64 " %" PRIu64 " / %" PRIu64
+                               " / %" PRIu64 " / %" PRIu64 "\n",
+                               cpu->cpu_index, qatomic_read_u64(&s->tbs),
+                               qatomic_read_u64(&s->insns),
+                               qatomic_read_u64(&s->exec_ns) / SCALE_MS,
+                               qatomic_read_u64(&s->translate_ns) / SCALE_MS,
+                               qatomic_read_u64(&s->bql_wait_ns) / SCALE_MS,
+                               qatomic_read_u64(&s->halted_ns) / SCALE_MS);
+    }
+
+    g_string_append_printf(buf, "\nTB jump cache       %u sets x %u ways\n",
+                           TB_JMP_CACHE_SIZE, tb_jmp_cache_ways);
+    CPU_FOREACH(cpu) {
+        CPUExecStats *s = &cpu->exec_stats;
+        uint64_t hits = qatomic_read_u64(&s->jmp_cache_hits);
+        uint64_t misses = qatomic_read_u64(&s->jmp_cache_misses);
+
+        g_string_append_printf(buf, "cpu %-3d hits %-12" PRIu64
+                               " misses %-10" PRIu64 " (%" PRIu64 "%%)"
+                               " conflicts %" PRIu64 "\n",
+                               cpu->cpu_index, hits, misses,
+                               hits + misses ?
+                               misses * 100 / (hits + misses) : 0,
+                               qatomic_read_u64(&s->jmp_cache_conflicts));
+    }
+}
+
 HumanReadableText *qmp_x_query_jit(Error **errp)
 {
     g_autoptr(GString) buf = g_string_new("");
@@ -1077,6 +1261,7 @@ HumanReadableText *qmp_x_query_jit(Error **errp)
 
     dump_exec_info(buf);
     dump_drift_info(buf);
+    dump_vcpu_exec_info(buf);
 
     return human_readable_text_from_str(buf);
 }
@@ -1095,6 +1280,73 @@ HumanReadableText *qmp_x_query_opcount(Error **errp)
     return human_readable_text_from_str(buf);
 }
 
+static gboolean tb_hot_iter(gpointer key, gpointer value, gpointer data)
+{
+    const TranslationBlock *tb = value;
+    GArray *blocks = data;
+    uint64_t n = qatomic_read_u64(&tb->run_count);
+    JitHotBlock b;
+
+    if (n) {
+        b.pc = tb->pc;
+        b.insns = tb->icount;
+        b.guest_size = tb->size;
+        b.host_size = tb->tc.size;
+        b.executions = n;
+        b.host_code = n * tb->tc.size;
+        b.invalid = tb_cflags(tb) & CF_INVALID;
+        g_array_append_val(blocks, b);
+    }
+    return false;
+}
+
+static gint tb_hot_cmp_executions(gconstpointer a, gconstpointer b)
+{
+    const JitHotBlock *x = a, *y = b;
+
+    return x->executions < y->executions ? 1 :
+           x->executions > y->executions ? -1 : 0;
+}
+
+static gint tb_hot_cmp_host_code(gconstpointer a, gconstpointer b)
+{
+    const JitHotBlock *x = a, *y = b;
+
+    return x->host_code < y->host_code ? 1 :
+           x->host_code > y->host_code ? -1 : 0;
+}
+
+JitHotBlockList *qmp_x_query_jit_hot(bool has_count, uint32_t count,
+                                     bool has_sort, JitHotSort sort,
+                                     Error **errp)
+{
+    g_autoptr(GArray) blocks = NULL;
+    JitHotBlockList *head = NULL, **tail = &head;
+    guint i;
+
+    if (!tcg_enabled() || !tb_counters_enabled) {
+        error_setg(errp, "Execution counts are only available with "
+                   "-accel tcg,tb-counters=on");
+        return NULL;
+    }
+    if (!has_count) {
+        count = 10;
+    }
+
+    blocks = g_array_new(false, false, sizeof(JitHotBlock));
+    tcg_tb_foreach(tb_hot_iter, blocks);
+    g_array_sort(blocks, has_sort && sort == JIT_HOT_SORT_HOST_CODE ?
+                 tb_hot_cmp_host_code : tb_hot_cmp_executions);
+
+    for (i = 0; i < MIN(count, blocks->len); i++) {
+        JitHotBlock *b = g_new(JitHotBlock, 1);
+
+        *b = g_array_index(blocks, JitHotBlock, i);
+        QAPI_LIST_APPEND(tail, b);
+    }
+    return head;
+}
+
 #ifdef CONFIG_PROFILER
 
 int64_t dev_time;
@@ -24,6 +24,7 @@
 #include "exec/memory.h"
 #include "exec/cpu_ldst.h"
 #include "exec/cputlb.h"
+#include "qemu/bitmap.h"
 #include "exec/memory-internal.h"
 #include "exec/ram_addr.h"
 #include "tcg/tcg.h"
@@ -81,6 +82,10 @@ QEMU_BUILD_BUG_ON(sizeof(target_ulong) > sizeof(run_on_cpu_data));
 QEMU_BUILD_BUG_ON(NB_MMU_MODES > 16);
 #define ALL_MMUIDX_BITS ((1 << NB_MMU_MODES) - 1)
 
+/* Set from -accel tcg,vtlb-size=N and -accel tcg,tlb-prefetch=N */
+unsigned int tlb_vtlb_max_size = CPU_VTLB_MIN_SIZE;
+unsigned int tlb_prefetch_pages;
+
 static inline size_t tlb_n_entries(CPUTLBDescFast *fast)
 {
     return (fast->mask >> CPU_TLB_ENTRY_BITS) + 1;
@@ -98,12 +103,61 @@ static void tlb_window_reset(CPUTLBDesc *desc, int64_t ns,
     desc->window_max_entries = max_entries;
 }
 
+static inline void tlb_stat_inc(size_t *counter)
+{
+    qatomic_set(counter, *counter + 1);
+}
+
+/* Called with tlb_c.lock held, after (re)allocating the main tlb */
+static void tlb_resident_alloc(CPUTLBDesc *desc, size_t n_entries)
+{
+    size_t n_words = BITS_TO_LONGS(n_entries);
+
+    g_free(desc->resident);
+    g_free(desc->resident_words);
+    desc->resident = bitmap_new(n_entries);
+    desc->resident_words = bitmap_new(n_words);
+
+    /* The table is not initialized yet, so any entry may be live */
+    bitmap_fill(desc->resident, n_entries);
+    bitmap_fill(desc->resident_words, n_words);
+    desc->n_resident = n_entries;
+}
+
+/* Called with tlb_c.lock held */
+static inline void tlb_resident_set(CPUTLBDesc *desc, size_t index)
+{
+    if (!test_bit(index, desc->resident)) {
+        set_bit(index, desc->resident);
+        set_bit(BIT_WORD(index), desc->resident_words);
+        desc->n_resident++;
+    }
+}
+
 static void tb_jmp_cache_clear_page(CPUState *cpu, target_ulong page_addr)
 {
-    unsigned int i, i0 = tb_jmp_cache_hash_page(page_addr);
+    TranslationBlock **sets = cpu->tb_jmp_cache->array +
+                              tb_jmp_cache_hash_page(page_addr) *
+                              tb_jmp_cache_ways;
+    unsigned int i;
+
+    /* The sets of a page are contiguous */
+    for (i = 0; i < TB_JMP_PAGE_SIZE * tb_jmp_cache_ways; i++) {
+        qatomic_set(&sets[i], NULL);
+    }
+}
+
+/* Drop the predicted indirect-branch targets starting in the two pages */
+static void tb_ibtc_clear_pages(CPUState *cpu, target_ulong page_addr)
+{
+    unsigned int i;
+
+    for (i = 0; i < TB_IBTC_SIZE; i++) {
+        TranslationBlock *tb = qatomic_read(&cpu->tb_ibtc[i]);
 
-    for (i = 0; i < TB_JMP_PAGE_SIZE; i++) {
-        qatomic_set(&cpu->tb_jmp_cache[i0 + i], NULL);
+        if (tb->pc - page_addr < 2 * TARGET_PAGE_SIZE) {
+            qatomic_set(&cpu->tb_ibtc[i], &tb_ibtc_miss);
+        }
     }
 }
 
@@ -113,6 +167,45 @@ static void tb_flush_jmp_cache(CPUState *cpu, target_ulong addr)
        overlap the flushed page.  */
     tb_jmp_cache_clear_page(cpu, addr - TARGET_PAGE_SIZE);
     tb_jmp_cache_clear_page(cpu, addr);
+    tb_ibtc_clear_pages(cpu, addr - TARGET_PAGE_SIZE);
+}
+
+/**
+ * tlb_vtlb_resize_locked() - resize the victim TLB of an mmu_idx
+ * @desc: The CPUTLBDesc portion of the TLB
+ * @rate: The maximum use rate of the main TLB in the current window, in %
+ * @window_expired: Whether the current window is over
+ *
+ * Called with tlb_lock_held, on a flush, before the victim TLB is emptied.
+ *
+ * A main TLB that is more than 70% full suffers conflict misses, so the
+ * victim TLB doubles together with it; unlike the main TLB it keeps doing
+ * so once the main TLB has reached CPU_TLB_DYN_MAX_BITS, up to
+ * tlb_vtlb_max_size entries.  It shrinks back by half when a window
+ * expires with a use rate below 30%, since the linear search in
+ * victim_tlb_hit() then costs more than the rare conflicts it resolves.
+ */
+static void tlb_vtlb_resize_locked(CPUTLBDesc *desc, size_t rate,
+                                   bool window_expired)
+{
+    size_t new_size = desc->vsize;
+
+    if (rate > 70) {
+        new_size = MIN(new_size << 1, tlb_vtlb_max_size);
+    } else if (rate < 30 && window_expired) {
+        new_size = MAX(new_size >> 1, CPU_VTLB_MIN_SIZE);
+    }
+    /* tlb_vtlb_max_size may be below the current size on the first flush */
+    new_size = MAX(MIN(new_size, tlb_vtlb_max_size), CPU_VTLB_MIN_SIZE);
+
+    if (new_size == desc->vsize) {
+        return;
+    }
+
+    /* desc->vtable is cleared by the caller */
+    qatomic_set(&desc->vsize, new_size);
+    desc->vtable = g_renew(CPUTLBEntry, desc->vtable, new_size);
+    desc->viotlb = g_renew(CPUIOTLBEntry, desc->viotlb, new_size);
 }
 
 /**
@@ -154,6 +247,9 @@ static void tb_flush_jmp_cache(CPUState *cpu, target_ulong addr)
  * is direct mapped, so we want the use rate to be low (or at least not too
  * high), since otherwise we are likely to have a significant amount of
  * conflict misses.
+ *
+ * The victim tlb, which catches those conflict misses, follows the same
+ * window: see tlb_vtlb_resize_locked().
  */
 static void tlb_mmu_resize_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast,
                                   int64_t now)
@@ -170,6 +266,8 @@ static void tlb_mmu_resize_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast,
     }
     rate = desc->window_max_entries * 100 / old_size;
 
+    tlb_vtlb_resize_locked(desc, rate, window_expired);
+
     if (rate > 70) {
         new_size = MIN(old_size << 1, 1 << CPU_TLB_DYN_MAX_BITS);
     } else if (rate < 30 && window_expired) {
@@ -228,16 +326,46 @@ static void tlb_mmu_resize_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast,
         fast->table = g_try_new(CPUTLBEntry, new_size);
         desc->iotlb = g_try_new(CPUIOTLBEntry, new_size);
     }
+
+    tlb_resident_alloc(desc, new_size);
 }
 
 static void tlb_mmu_flush_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast)
 {
+    size_t n_entries = tlb_n_entries(fast);
+    size_t n_words = BITS_TO_LONGS(n_entries);
+
     desc->n_used_entries = 0;
     desc->large_page_addr = -1;
     desc->large_page_mask = -1;
     desc->vindex = 0;
-    memset(fast->table, -1, sizeof_tlb(fast));
-    memset(desc->vtable, -1, sizeof(desc->vtable));
+
+    /*
+     * A large tlb is often nearly empty when it is flushed again, e.g.
+     * when the guest switches address spaces often; then only clear the
+     * entries that may be live.
+     */
+    if (desc->n_resident < n_entries / 8) {
+        size_t w;
+
+        for (w = find_first_bit(desc->resident_words, n_words); w < n_words;
+             w = find_next_bit(desc->resident_words, n_words, w + 1)) {
+            unsigned long bits;
+
+            for (bits = desc->resident[w]; bits; bits &= bits - 1) {
+                memset(&fast->table[w * BITS_PER_LONG + ctzl(bits)], -1,
+                       sizeof(CPUTLBEntry));
+            }
+            desc->resident[w] = 0;
+        }
+    } else {
+        memset(fast->table, -1, sizeof_tlb(fast));
+        bitmap_zero(desc->resident, n_entries);
+    }
+    bitmap_zero(desc->resident_words, n_words);
+    desc->n_resident = 0;
+
+    memset(desc->vtable, -1, desc->vsize * sizeof(CPUTLBEntry));
 }
 
 static void tlb_flush_one_mmuidx_locked(CPUArchState *env, int mmu_idx,
@@ -259,6 +387,10 @@ static void tlb_mmu_init(CPUTLBDesc *desc, CPUTLBDescFast *fast, int64_t now)
     fast->mask = (n_entries - 1) << CPU_TLB_ENTRY_BITS;
     fast->table = g_new(CPUTLBEntry, n_entries);
     desc->iotlb = g_new(CPUIOTLBEntry, n_entries);
+    desc->vsize = CPU_VTLB_MIN_SIZE;
+    desc->vtable = g_new(CPUTLBEntry, CPU_VTLB_MIN_SIZE);
+    desc->viotlb = g_new(CPUIOTLBEntry, CPU_VTLB_MIN_SIZE);
+    tlb_resident_alloc(desc, n_entries);
     tlb_mmu_flush_locked(desc, fast);
 }
 
@@ -300,6 +432,10 @@ void tlb_destroy(CPUState *cpu)
 
         g_free(fast->table);
         g_free(desc->iotlb);
+        g_free(desc->vtable);
+        g_free(desc->viotlb);
+        g_free(desc->resident);
+        g_free(desc->resident_words);
     }
 }
 
@@ -339,6 +475,47 @@ void tlb_flush_counts(size_t *pfull, size_t *ppart, size_t *pelide)
     *pelide = elide;
 }
 
+void tlb_dump_mmu_stats(GString *buf)
+{
+    CPUState *cpu;
+    size_t sparse = 0, code_writes = 0, code_locked = 0;
+    int mmu_idx;
+
+    CPU_FOREACH(cpu) {
+        CPUArchState *env = cpu->env_ptr;
+
+        sparse += qatomic_read(&env_tlb(env)->c.sparse_flush_count);
+        code_writes += qatomic_read(&env_tlb(env)->c.code_write_count);
+        code_locked += qatomic_read(&env_tlb(env)->c.code_write_locked_count);
+    }
+    g_string_append_printf(buf, "TLB sparse flushes  %zu\n", sparse);
+    g_string_append_printf(buf, "code page writes    %zu (%zu locked)\n",
+                           code_writes, code_locked);
+
+    g_string_append_printf(buf, "\nTLB per mmu_idx     fills / prefetches / "
+                           "victim hits / victim misses\n");
+    CPU_FOREACH(cpu) {
+        CPUArchState *env = cpu->env_ptr;
+
+        for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
+            CPUTLBDesc *d = &env_tlb(env)->d[mmu_idx];
+            size_t fills = qatomic_read(&d->fill_count);
+            size_t hits = qatomic_read(&d->vtlb_hit_count);
+            size_t misses = qatomic_read(&d->vtlb_miss_count);
+
+            if (!fills && !hits && !misses) {
+                continue;
+            }
+            g_string_append_printf(buf, "cpu %-3d idx %-2d vtlb %-3zu "
+                                   "%zu / %zu / %zu / %zu\n",
+                                   cpu->cpu_index, mmu_idx,
+                                   qatomic_read(&d->vsize), fills,
+                                   qatomic_read(&d->prefetch_count),
+                                   hits, misses);
+        }
+    }
+}
+
 static void tlb_flush_by_mmuidx_async_work(CPUState *cpu, run_on_cpu_data data)
 {
     CPUArchState *env = cpu->env_ptr;
@@ -477,10 +654,10 @@ static void tlb_flush_vtlb_page_mask_locked(CPUArchState *env, int mmu_idx,
                                             target_ulong mask)
 {
     CPUTLBDesc *d = &env_tlb(env)->d[mmu_idx];
-    int k;
+    size_t k;
 
     assert_cpu_is_self(env_cpu(env));
-    for (k = 0; k < CPU_VTLB_SIZE; k++) {
+    for (k = 0; k < d->vsize; k++) {
         if (tlb_flush_entry_mask_locked(&d->vtable[k], page, mask)) {
             tlb_n_used_entries_dec(env, mmu_idx);
         }
@@ -707,6 +884,81 @@ void tlb_flush_page_all_cpus_synced(CPUState *src, target_ulong addr)
     tlb_flush_page_by_mmuidx_all_cpus_synced(src, addr, ALL_MMUIDX_BITS);
 }
 
+static bool tlb_addr_in_range(target_ulong tlb_addr, target_ulong addr,
+                              target_ulong len, target_ulong mask)
+{
+    return !(tlb_addr & TLB_INVALID_MASK) &&
+           ((tlb_addr - addr) & mask & TARGET_PAGE_MASK) < len;
+}
+
+/*
+ * Return true if @tlb_entry maps a page that, under @mask, lies within
+ * [@addr, @addr + @len).  @addr is page aligned.
+ */
+static bool tlb_entry_in_range(CPUTLBEntry *tlb_entry, target_ulong addr,
+                               target_ulong len, target_ulong mask)
+{
+    return (tlb_addr_in_range(tlb_entry->addr_read, addr, len, mask) ||
+            tlb_addr_in_range(tlb_addr_write(tlb_entry), addr, len, mask) ||
+            tlb_addr_in_range(tlb_entry->addr_code, addr, len, mask));
+}
+
+/*
+ * Called with tlb_c.lock held.
+ * Flush the entries of the main tlb of @midx in the range, visiting only
+ * the resident ones, and drop those found empty from the resident set.
+ */
+static void tlb_flush_resident_range_locked(CPUArchState *env, int midx,
+                                            target_ulong addr,
+                                            target_ulong len,
+                                            target_ulong mask)
+{
+    CPUTLBDesc *d = &env_tlb(env)->d[midx];
+    CPUTLBDescFast *f = &env_tlb(env)->f[midx];
+    size_t n_words = BITS_TO_LONGS(tlb_n_entries(f));
+    size_t w;
+
+    for (w = find_first_bit(d->resident_words, n_words); w < n_words;
+         w = find_next_bit(d->resident_words, n_words, w + 1)) {
+        unsigned long live = d->resident[w];
+        unsigned long bits;
+
+        for (bits = live; bits; bits &= bits - 1) {
+            unsigned int b = ctzl(bits);
+            CPUTLBEntry *te = &f->table[w * BITS_PER_LONG + b];
+
+            if (tlb_entry_in_range(te, addr, len, mask)) {
+                memset(te, -1, sizeof(*te));
+                tlb_n_used_entries_dec(env, midx);
+            } else if (!tlb_entry_is_empty(te)) {
+                continue;
+            }
+            live &= ~BIT_MASK(b);
+            d->n_resident--;
+        }
+        d->resident[w] = live;
+        if (!live) {
+            clear_bit(w, d->resident_words);
+        }
+    }
+}
+
+/* Called with tlb_c.lock held */
+static void tlb_flush_vtlb_range_locked(CPUArchState *env, int midx,
+                                        target_ulong addr, target_ulong len,
+                                        target_ulong mask)
+{
+    CPUTLBDesc *d = &env_tlb(env)->d[midx];
+    size_t k;
+
+    for (k = 0; k < d->vsize; k++) {
+        if (tlb_entry_in_range(&d->vtable[k], addr, len, mask)) {
+            memset(&d->vtable[k], -1, sizeof(CPUTLBEntry));
+            tlb_n_used_entries_dec(env, midx);
+        }
+    }
+}
+
 static void tlb_flush_range_locked(CPUArchState *env, int midx,
                                    target_ulong addr, target_ulong len,
                                    unsigned bits)
@@ -715,24 +967,6 @@ static void tlb_flush_range_locked(CPUArchState *env, int midx,
     CPUTLBDescFast *f = &env_tlb(env)->f[midx];
     target_ulong mask = MAKE_64BIT_MASK(0, bits);
 
-    /*
-     * If @bits is smaller than the tlb size, there may be multiple entries
-     * within the TLB; otherwise all addresses that match under @mask hit
-     * the same TLB entry.
-     * TODO: Perhaps allow bits to be a few bits less than the size.
-     * For now, just flush the entire TLB.
-     *
-     * If @len is larger than the tlb size, then it will take longer to
-     * test all of the entries in the TLB than it will to flush it all.
-     */
-    if (mask < f->mask || len > f->mask) {
-        tlb_debug("forcing full flush midx %d ("
-                  TARGET_FMT_lx "/" TARGET_FMT_lx "+" TARGET_FMT_lx ")\n",
-                  midx, addr, mask, len);
-        tlb_flush_one_mmuidx_locked(env, midx, get_clock_realtime());
-        return;
-    }
-
     /*
      * Check if we need to flush due to large pages.
      * Because large_page_mask contains all 1's from the msb,
@@ -746,15 +980,34 @@ static void tlb_flush_range_locked(CPUArchState *env, int midx,
         return;
     }
 
-    for (target_ulong i = 0; i < len; i += TARGET_PAGE_SIZE) {
-        target_ulong page = addr + i;
-        CPUTLBEntry *entry = tlb_entry(env, midx, page);
-
-        if (tlb_flush_entry_mask_locked(entry, page, mask)) {
-            tlb_n_used_entries_dec(env, midx);
+    /*
+     * If @bits is smaller than the tlb size, there may be multiple entries
+     * within the TLB; otherwise all addresses that match under @mask hit
+     * the same TLB entry, and a short range is flushed page by page.
+     * Each page costs one tlb entry plus a search of the victim tlb, so
+     * for longer ranges it is cheaper to test the resident entries once.
+     */
+    if (mask >= f->mask &&
+        (len >> TARGET_PAGE_BITS) * d->vsize <= d->n_resident) {
+        for (target_ulong i = 0; i < len; i += TARGET_PAGE_SIZE) {
+            target_ulong page = addr + i;
+            CPUTLBEntry *entry = tlb_entry(env, midx, page);
+
+            if (tlb_flush_entry_mask_locked(entry, page, mask)) {
+                tlb_n_used_entries_dec(env, midx);
+            }
+            tlb_flush_vtlb_page_mask_locked(env, midx, page, mask);
         }
-        tlb_flush_vtlb_page_mask_locked(env, midx, page, mask);
+        return;
     }
+
+    tlb_debug("sparse flush midx %d ("
+              TARGET_FMT_lx "/" TARGET_FMT_lx "+" TARGET_FMT_lx ")\n",
+              midx, addr, mask, len);
+    tlb_flush_resident_range_locked(env, midx, addr, len, mask);
+    tlb_flush_vtlb_range_locked(env, midx, addr, len, mask);
+    qatomic_set(&env_tlb(env)->c.sparse_flush_count,
+                env_tlb(env)->c.sparse_flush_count + 1);
 }
 
 typedef struct {
@@ -1030,7 +1283,7 @@ void tlb_reset_dirty(CPUState *cpu, ram_addr_t start1, ram_addr_t length)
                                          start1, length);
         }
 
-        for (i = 0; i < CPU_VTLB_SIZE; i++) {
+        for (i = 0; i < env_tlb(env)->d[mmu_idx].vsize; i++) {
             tlb_reset_dirty_range_locked(&env_tlb(env)->d[mmu_idx].vtable[i],
                                          start1, length);
         }
@@ -1063,8 +1316,8 @@ void tlb_set_dirty(CPUState *cpu, target_ulong vaddr)
     }
 
     for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
-        int k;
-        for (k = 0; k < CPU_VTLB_SIZE; k++) {
+        size_t k;
+        for (k = 0; k < env_tlb(env)->d[mmu_idx].vsize; k++) {
             tlb_set_dirty1_locked(&env_tlb(env)->d[mmu_idx].vtable[k], vaddr);
         }
     }
@@ -1214,7 +1467,7 @@ void tlb_set_page_with_attrs(CPUState *cpu, target_ulong vaddr,
      * different page; otherwise just overwrite the stale data.
      */
     if (!tlb_hit_page_anyprot(te, vaddr_page) && !tlb_entry_is_empty(te)) {
-        unsigned vidx = desc->vindex++ % CPU_VTLB_SIZE;
+        unsigned vidx = desc->vindex++ & (desc->vsize - 1);
         CPUTLBEntry *tv = &desc->vtable[vidx];
 
         /* Evict the old entry into the victim tlb.  */
@@ -1268,6 +1521,7 @@ void tlb_set_page_with_attrs(CPUState *cpu, target_ulong vaddr,
     }
 
     copy_tlb_helper_locked(te, &tn);
+    tlb_resident_set(desc, index);
     tlb_n_used_entries_inc(env, mmu_idx);
     qemu_spin_unlock(&tlb->c.lock);
 }
@@ -1296,22 +1550,85 @@ static inline ram_addr_t qemu_ram_addr_from_host_nofail(void *ptr)
 }
 
 /*
- * Note: tlb_fill() can trigger a resize of the TLB. This means that all of the
- * caller's prior references to the TLB table (e.g. CPUTLBEntry pointers) must
- * be discarded and looked up again (e.g. via tlb_entry()).
+ * Fill the TLB entries of the tlb_prefetch_pages pages that follow ADDR,
+ * so that a sequential walk through memory takes one slow path instead
+ * of one per page.  The neighbours are probed as loads, which do not
+ * fault and do not set dirty bits in guest page tables; a page that is
+ * not readable ends the walk.  A later store to a neighbour still takes
+ * the slow path if the page is not yet marked dirty.
+ *
+ * The probes do walk the guest page tables, and targets that maintain
+ * accessed bits, such as x86, set them on pages the guest may never
+ * touch.  Guests that reclaim pages by their accessed bits then see
+ * these pages as in use, which is why prefetching is opt-in.
  */
+static void tlb_prefetch(CPUState *cpu, target_ulong addr, int mmu_idx,
+                         uintptr_t retaddr)
+{
+    CPUClass *cc = CPU_GET_CLASS(cpu);
+    CPUArchState *env = cpu->env_ptr;
+    CPUTLBDesc *desc = &env_tlb(env)->d[mmu_idx];
+    target_ulong page = addr & TARGET_PAGE_MASK;
+    unsigned int i;
+
+    for (i = 1; i <= tlb_prefetch_pages; i++) {
+        target_ulong next = page + i * TARGET_PAGE_SIZE;
+        CPUTLBEntry *entry;
+
+        if (next < page) {
+            break;
+        }
+        entry = tlb_entry(env, mmu_idx, next);
+        if (tlb_hit(entry->addr_read, next)) {
+            continue;
+        }
+        if (!cc->tcg_ops->tlb_fill(cpu, next, 1, MMU_DATA_LOAD,
+                                   mmu_idx, true, retaddr)) {
+            break;
+        }
+        tlb_stat_inc(&desc->prefetch_count);
+    }
+}
+
+/*
+ * Fill the TLB entry for ADDR through the target's tlb_fill hook, which
+ * with PROBE set returns false instead of raising the fault, and count
+ * the fill.
+ *
+ * Note: tlb_try_fill() and tlb_fill() can trigger a resize of the TLB.
+ * This means that all of the caller's prior references to the TLB table
+ * (e.g. CPUTLBEntry pointers) must be discarded and looked up again
+ * (e.g. via tlb_entry()).
+ */
+static bool tlb_try_fill(CPUState *cpu, target_ulong addr, int size,
+                         MMUAccessType access_type, int mmu_idx, bool probe,
+                         uintptr_t retaddr)
+{
+    CPUClass *cc = CPU_GET_CLASS(cpu);
+    CPUTLBDesc *desc = &env_tlb(cpu->env_ptr)->d[mmu_idx];
+
+    if (!cc->tcg_ops->tlb_fill(cpu, addr, size,
+                               access_type, mmu_idx, probe, retaddr)) {
+        return false;
+    }
+    tlb_stat_inc(&desc->fill_count);
+
+    if (tlb_prefetch_pages && access_type != MMU_INST_FETCH) {
+        tlb_prefetch(cpu, addr, mmu_idx, retaddr);
+    }
+    return true;
+}
+
 static void tlb_fill(CPUState *cpu, target_ulong addr, int size,
                      MMUAccessType access_type, int mmu_idx, uintptr_t retaddr)
 {
-    CPUClass *cc = CPU_GET_CLASS(cpu);
     bool ok;
 
     /*
      * This is not a probe, so only valid return is success; failure
      * should result in exception + longjmp to the cpu loop.
      */
-    ok = cc->tcg_ops->tlb_fill(cpu, addr, size,
-                               access_type, mmu_idx, false, retaddr);
+    ok = tlb_try_fill(cpu, addr, size, access_type, mmu_idx, false, retaddr);
     assert(ok);
 }
 
@@ -1452,15 +1769,19 @@ static inline target_ulong tlb_read_ofs(CPUTLBEntry *entry, size_t ofs)
 }
 
 /* Return true if ADDR is present in the victim tlb, and has been copied
-   back to the main tlb.  */
+   back to the main tlb.  The most recently evicted entries are searched
+   first, as they are the most likely to be wanted back.  */
 static bool victim_tlb_hit(CPUArchState *env, size_t mmu_idx, size_t index,
                            size_t elt_ofs, target_ulong page)
 {
-    size_t vidx;
+    CPUTLBDesc *desc = &env_tlb(env)->d[mmu_idx];
+    size_t vmask = desc->vsize - 1;
+    size_t i;
 
     assert_cpu_is_self(env_cpu(env));
-    for (vidx = 0; vidx < CPU_VTLB_SIZE; ++vidx) {
-        CPUTLBEntry *vtlb = &env_tlb(env)->d[mmu_idx].vtable[vidx];
+    for (i = 1; i <= desc->vsize; ++i) {
+        size_t vidx = (desc->vindex - i) & vmask;
+        CPUTLBEntry *vtlb = &desc->vtable[vidx];
         target_ulong cmp;
 
         /* elt_ofs might correspond to .addr_write, so use qatomic_read */
@@ -1478,14 +1799,17 @@ static bool victim_tlb_hit(CPUArchState *env, size_t mmu_idx, size_t index,
             copy_tlb_helper_locked(&tmptlb, tlb);
             copy_tlb_helper_locked(tlb, vtlb);
             copy_tlb_helper_locked(vtlb, &tmptlb);
+            tlb_resident_set(desc, index);
             qemu_spin_unlock(&env_tlb(env)->c.lock);
 
-            CPUIOTLBEntry tmpio, *io = &env_tlb(env)->d[mmu_idx].iotlb[index];
-            CPUIOTLBEntry *vio = &env_tlb(env)->d[mmu_idx].viotlb[vidx];
+            CPUIOTLBEntry tmpio, *io = &desc->iotlb[index];
+            CPUIOTLBEntry *vio = &desc->viotlb[vidx];
             tmpio = *io; *io = *vio; *vio = tmpio;
+            tlb_stat_inc(&desc->vtlb_hit_count);
             return true;
         }
     }
+    tlb_stat_inc(&desc->vtlb_miss_count);
     return false;
 }
 
@@ -1557,10 +1881,17 @@ static void notdirty_write(CPUState *cpu, vaddr mem_vaddr, unsigned size,
     trace_memory_notdirty_write_access(mem_vaddr, ram_addr, size);
 
     if (!cpu_physical_memory_get_dirty_flag(ram_addr, DIRTY_MEMORY_CODE)) {
-        struct page_collection *pages
-            = page_collection_lock(ram_addr, ram_addr + size);
-        tb_invalidate_phys_page_fast(pages, ram_addr, size, retaddr);
-        page_collection_unlock(pages);
+        CPUTLBCommon *c = &env_tlb(cpu->env_ptr)->c;
+
+        qatomic_set(&c->code_write_count, c->code_write_count + 1);
+        if (tb_page_write_needs_invalidate(ram_addr, size)) {
+            struct page_collection *pages
+                = page_collection_lock(ram_addr, ram_addr + size);
+            tb_invalidate_phys_page_fast(pages, ram_addr, size, retaddr);
+            page_collection_unlock(pages);
+            qatomic_set(&c->code_write_locked_count,
+                        c->code_write_locked_count + 1);
+        }
     }
 
     /*
@@ -1605,11 +1936,8 @@ static int probe_access_internal(CPUArchState *env, target_ulong addr,
     page_addr = addr & TARGET_PAGE_MASK;
     if (!tlb_hit_page(tlb_addr, page_addr)) {
         if (!victim_tlb_hit(env, mmu_idx, index, elt_ofs, page_addr)) {
-            CPUState *cs = env_cpu(env);
-            CPUClass *cc = CPU_GET_CLASS(cs);
-
-            if (!cc->tcg_ops->tlb_fill(cs, addr, fault_size, access_type,
-                                       mmu_idx, nonfault, retaddr)) {
+            if (!tlb_try_fill(env_cpu(env), addr, fault_size, access_type,
+                              mmu_idx, nonfault, retaddr)) {
                 /* Non-faulting page table read failed.  */
                 *phost = NULL;
                 return TLB_INVALID_MASK;
@@ -1704,6 +2032,86 @@ void *tlb_vaddr_to_host(CPUArchState *env, abi_ptr addr,
     return flags ? NULL : host;
 }
 
+/*
+ * Return the host address of [addr, addr + len), which lies within one
+ * page, for a bulk access, or NULL if the range is not RAM, if it is a
+ * page with translated code or if it has watchpoints.  The caller then
+ * accesses it piecewise, so that notdirty_write() invalidates exactly the
+ * TBs that are hit and a watchpoint fires after the iteration that hits it.
+ */
+static void *probe_bulk(CPUArchState *env, target_ulong addr, size_t len,
+                        MMUAccessType access_type, int mmu_idx,
+                        uintptr_t retaddr)
+{
+    void *host;
+    int flags;
+
+    flags = probe_access_internal(env, addr, len, access_type, mmu_idx,
+                                  false, &host, retaddr);
+    if (unlikely(flags & (TLB_MMIO | TLB_WATCHPOINT))) {
+        return NULL;
+    }
+
+    /* Handle clean RAM pages.  */
+    if (unlikely(flags & TLB_NOTDIRTY)) {
+        uintptr_t index = tlb_index(env, mmu_idx, addr);
+        CPUIOTLBEntry *iotlbentry = &env_tlb(env)->d[mmu_idx].iotlb[index];
+
+        if (!cpu_physical_memory_get_dirty_flag(addr + iotlbentry->addr,
+                                                DIRTY_MEMORY_CODE)) {
+            return NULL;
+        }
+        notdirty_write(env_cpu(env), addr, len, iotlbentry, retaddr);
+    }
+
+    return host;
+}
+
+size_t cpu_memset_mmuidx_ra(CPUArchState *env, abi_ptr addr, uint8_t val,
+                            size_t len, int mmu_idx, uintptr_t ra)
+{
+    size_t done = 0;
+
+    while (done < len) {
+        size_t n = MIN(len - done, -(addr | TARGET_PAGE_MASK));
+        void *host = probe_bulk(env, addr, n, MMU_DATA_STORE, mmu_idx, ra);
+
+        if (!host) {
+            break;
+        }
+        memset(host, val, n);
+        addr += n;
+        done += n;
+    }
+    return done;
+}
+
+size_t cpu_memcpy_mmuidx_ra(CPUArchState *env, abi_ptr dst, abi_ptr src,
+                            size_t len, int mmu_idx, uintptr_t ra)
+{
+    size_t done = 0;
+
+    while (done < len) {
+        size_t n = MIN(-(dst | TARGET_PAGE_MASK), -(src | TARGET_PAGE_MASK));
+        void *hsrc, *hdst;
+
+        n = MIN(n, len - done);
+        hsrc = probe_bulk(env, src, n, MMU_DATA_LOAD, mmu_idx, ra);
+        if (!hsrc) {
+            break;
+        }
+        hdst = probe_bulk(env, dst, n, MMU_DATA_STORE, mmu_idx, ra);
+        if (!hdst) {
+            break;
+        }
+        copy_forward(hdst, hsrc, n);
+        dst += n;
+        src += n;
+        done += n;
+    }
+    return done;
+}
+
 #ifdef CONFIG_PLUGIN
 /*
  * Perform a TLB lookup and populate the qemu_plugin_hwaddr structure.
@@ -1752,8 +2160,9 @@ bool tlb_plugin_lookup(CPUState *cpu, target_ulong addr, int mmu_idx,
 #endif
 
 /*
- * Probe for an atomic operation.  Do not allow unaligned operations,
- * or io operations to proceed.  Return the host address.
+ * Probe for an atomic operation.  Do not allow io operations, or unaligned
+ * operations that the atomic helpers cannot widen, to proceed.  Return the
+ * host address.
  *
  * @prot may be PAGE_READ, PAGE_WRITE, or PAGE_READ|PAGE_WRITE.
  */
@@ -1783,9 +2192,12 @@ static void *atomic_mmu_lookup(CPUArchState *env, target_ulong addr,
     if (unlikely(addr & (size - 1))) {
         /* We get here if guest alignment was not requested,
            or was not enforced by cpu_unaligned_access above.
-           We might widen the access and emulate, but for now
-           mark an exception and exit the cpu loop.  */
-        goto stop_the_world;
+           The atomic helpers widen the access if it fits in an
+           aligned 8-byte word; otherwise mark an exception and
+           exit the cpu loop.  */
+        if (!atomic_can_widen(addr, size)) {
+            goto stop_the_world;
+        }
     }
 
     index = tlb_index(env, mmu_idx, addr);
@@ -2,13 +2,71 @@
 #include "qemu/error-report.h"
 #include "qapi/error.h"
 #include "qapi/qapi-commands-machine.h"
+#include "qapi/qmp/qdict.h"
 #include "exec/exec-all.h"
+#include "monitor/hmp.h"
 #include "monitor/monitor.h"
 #include "sysemu/tcg.h"
 
+static bool hmp_info_jit_hot(Monitor *mon, const char *title,
+                             uint32_t count, JitHotSort sort)
+{
+    Error *err = NULL;
+    g_autoptr(JitHotBlockList) list = qmp_x_query_jit_hot(true, count, true,
+                                                          sort, &err);
+    JitHotBlockList *l;
+
+    if (hmp_handle_error(mon, err)) {
+        return false;
+    }
+
+    monitor_printf(mon, "%s\n%-18s %14s %16s %6s %6s %6s %6s\n",
+                   title, "guest pc", "executions", "host bytes run", "insns",
+                   "guest", "host", "ratio");
+    for (l = list; l; l = l->next) {
+        JitHotBlock *b = l->value;
+
+        monitor_printf(mon, "0x%016" PRIx64 " %14" PRIu64 " %16" PRIu64
+                       " %6u %6u %6" PRIu64 " %6.1f%s\n",
+                       b->pc, b->executions, b->host_code, b->insns,
+                       b->guest_size, b->host_size,
+                       (double)b->host_size / b->guest_size,
+                       b->invalid ? " invalid" : "");
+    }
+    return true;
+}
+
+static void hmp_info_jit(Monitor *mon, const QDict *qdict)
+{
+    const char *report = qdict_get_try_str(qdict, "report");
+    int64_t count = qdict_get_try_int(qdict, "count", 10);
+    Error *err = NULL;
+
+    if (report && strcmp(report, "hot") == 0) {
+        if (count < 1 || count > UINT32_MAX) {
+            monitor_printf(mon, "Invalid count %" PRId64 "\n", count);
+            return;
+        }
+        if (hmp_info_jit_hot(mon, "Most executed translation blocks",
+                             count, JIT_HOT_SORT_EXECUTIONS)) {
+            hmp_info_jit_hot(mon, "\nTranslation blocks that ran the most "
+                             "host code", count, JIT_HOT_SORT_HOST_CODE);
+        }
+    } else if (report) {
+        monitor_printf(mon, "Unknown report '%s', try 'hot'\n", report);
+    } else {
+        g_autoptr(HumanReadableText) info = qmp_x_query_jit(&err);
+
+        if (hmp_handle_error(mon, err)) {
+            return;
+        }
+        monitor_printf(mon, "%s", info->human_readable_text);
+    }
+}
+
 static void hmp_tcg_register(void)
 {
-    monitor_register_hmp_info_hrt("jit", qmp_x_query_jit);
+    monitor_register_hmp("jit", true, hmp_info_jit);
     monitor_register_hmp_info_hrt("opcount", qmp_x_query_opcount);
 }
 
@@ -14,9 +14,80 @@
 TranslationBlock *tb_gen_code(CPUState *cpu, target_ulong pc,
                               target_ulong cs_base, uint32_t flags,
                               int cflags);
+TranslationBlock *tb_tier_up(CPUState *cpu, TranslationBlock *tb,
+                             target_ulong pc, target_ulong cs_base,
+                             uint32_t flags, int cflags);
 
 void QEMU_NORETURN cpu_io_recompile(CPUState *cpu, uintptr_t retaddr);
 void page_init(void);
 void tb_htable_init(void);
+#ifdef CONFIG_SOFTMMU
+void tb_reclaim_enter(CPUState *cpu);
+void tb_reclaim_exit(CPUState *cpu);
+bool tb_profile_open(const char *path, Error **errp);
+bool tb_profile_lookup(tb_page_addr_t phys_pc, target_ulong pc,
+                       target_ulong cs_base, uint32_t flags, uint32_t cflags,
+                       uint32_t *exit_count);
+void tb_profile_record(const TranslationBlock *tb, const uint32_t *exit_count);
+#else
+static inline void tb_reclaim_enter(CPUState *cpu) { }
+static inline void tb_reclaim_exit(CPUState *cpu) { }
+static inline bool tb_profile_lookup(tb_page_addr_t phys_pc, target_ulong pc,
+                                     target_ulong cs_base, uint32_t flags,
+                                     uint32_t cflags, uint32_t *exit_count)
+{
+    return false;
+}
+static inline void tb_profile_record(const TranslationBlock *tb,
+                                     const uint32_t *exit_count) { }
+#endif
+
+/*
+ * Copy @n bytes from @src to @dst like a loop of byte moves from low to
+ * high addresses: if @dst overlaps the end of @src, the bytes already
+ * copied are copied again, as for a guest string move.
+ */
+static inline void copy_forward(void *dst, const void *src, size_t n)
+{
+    uint8_t *d = dst;
+    const uint8_t *s = src;
+    uintptr_t k = (uintptr_t)d - (uintptr_t)s;
+
+    if (d <= s || k >= n) {
+        memmove(d, s, n);
+        return;
+    }
+    while (n) {
+        size_t c = MIN(n, k);
+
+        memcpy(d, s, c);
+        d += c;
+        s += c;
+        n -= c;
+    }
+}
+
+/*
+ * Whether the atomic helpers can do a misaligned access of @size bytes at
+ * @addr as a compare-and-swap of the aligned 8-byte word around it, see
+ * atomic_template.h, instead of stopping all other vCPUs.
+ */
+static inline bool atomic_can_widen(target_ulong addr, int size)
+{
+#ifdef CONFIG_ATOMIC64
+    return size <= 4 && (addr & 7) + size <= 8;
+#else
+    return false;
+#endif
+}
+
+extern bool tb_reuse_enabled;
+extern uint32_t tcg_tier_threshold;
+extern bool tb_superblocks_enabled;
+extern bool tb_counters_enabled;
+#ifdef CONFIG_SOFTMMU
+extern unsigned int tlb_vtlb_max_size;
+extern unsigned int tlb_prefetch_pages;
+#endif
 
 #endif /* ACCEL_TCG_INTERNAL_H */
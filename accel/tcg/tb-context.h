@@ -31,10 +31,25 @@ typedef struct TBContext TBContext;
 struct TBContext {
 
     struct qht htable;
+    /* invalidated TBs that tb_gen_code() may revive, see tb_revive() */
+    struct qht retired;
 
     /* statistics */
     unsigned tb_flush_count;
     unsigned tb_phys_invalidate_count;
+    unsigned tb_retire_count;
+    unsigned tb_reuse_count;
+    unsigned tb_tier_up_count;
+    unsigned tb_profile_hit_count;
+    unsigned tb_trace_branch_count;
+    unsigned tb_reclaim_count;
+    unsigned tb_reclaim_regions;
+    unsigned tb_reclaim_tbs;
+    /* pauses in ns, read and written with qatomic_{read,set}_u64 */
+    uint64_t tb_flush_ns;
+    uint64_t tb_flush_max_ns;
+    uint64_t tb_reclaim_ns;
+    uint64_t tb_reclaim_max_ns;
 };
 
 extern TBContext tb_ctx;
@@ -22,14 +22,38 @@
 
 #include "exec/cpu-defs.h"
 #include "exec/exec-all.h"
+#include "qemu/rcu.h"
 #include "qemu/xxhash.h"
 
+/*
+ * The tb_jmp_cache has TB_JMP_CACHE_SIZE sets of tb_jmp_cache_ways
+ * entries each, stored set after set.  Both are fixed by the
+ * jmp-cache-bits and jmp-cache-ways accelerator properties before the
+ * first vCPU is created.  Within a set, entries are kept in most
+ * recently used order.  Other threads only clear entries; freeing is
+ * deferred with RCU so that they may do so while a vCPU is unplugged.
+ */
+extern unsigned int tb_jmp_cache_bits;
+extern unsigned int tb_jmp_cache_ways;
+
+#define TB_JMP_CACHE_BITS tb_jmp_cache_bits
+#define TB_JMP_CACHE_SIZE (1u << TB_JMP_CACHE_BITS)
+
+struct CPUJumpCache {
+    struct rcu_head rcu;
+    TranslationBlock *array[];
+};
+
 #ifdef CONFIG_SOFTMMU
 
 /* Only the bottom TB_JMP_PAGE_BITS of the jump cache hash bits vary for
    addresses on the same page.  The top bits are the same.  This allows
-   TLB invalidation to quickly clear a subset of the hash table.  */
-#define TB_JMP_PAGE_BITS (TB_JMP_CACHE_BITS / 2)
+   TLB invalidation to quickly clear a subset of the hash table.
+   The hash functions below shift by TARGET_PAGE_BITS - TB_JMP_PAGE_BITS,
+   so that must stay positive even with small pages (1K on Arm, 256 bytes
+   on AVR) and a large jmp-cache-bits: a negative shift is undefined, and
+   a zero one would hash every pc to set 0.  */
+#define TB_JMP_PAGE_BITS MIN(TB_JMP_CACHE_BITS / 2, TARGET_PAGE_BITS - 1)
 #define TB_JMP_PAGE_SIZE (1 << TB_JMP_PAGE_BITS)
 #define TB_JMP_ADDR_MASK (TB_JMP_PAGE_SIZE - 1)
 #define TB_JMP_PAGE_MASK (TB_JMP_CACHE_SIZE - TB_JMP_PAGE_SIZE)
@@ -59,6 +83,56 @@ static inline unsigned int tb_jmp_cache_hash_func(target_ulong pc)
 
 #endif /* CONFIG_SOFTMMU */
 
+/* The entries of the set @pc maps to */
+static inline TranslationBlock **tb_jmp_cache_set(CPUJumpCache *jc,
+                                                  target_ulong pc)
+{
+    return jc->array + tb_jmp_cache_hash_func(pc) * tb_jmp_cache_ways;
+}
+
+/*
+ * Make @tb the most recently used entry for @pc in @cpu's cache,
+ * evicting the least recently used one if needed.  Only the vCPU
+ * thread itself may call this.
+ */
+static inline void tb_jmp_cache_insert(CPUState *cpu, target_ulong pc,
+                                       TranslationBlock *tb)
+{
+    TranslationBlock **set = tb_jmp_cache_set(cpu->tb_jmp_cache, pc);
+    TranslationBlock *old;
+    unsigned int i;
+
+    for (i = 0; i < tb_jmp_cache_ways - 1; i++) {
+        if (qatomic_read(&set[i]) == tb) {
+            break;
+        }
+    }
+    old = qatomic_read(&set[i]);
+    if (old && old != tb) {
+        cpu_exec_stats_add(&cpu->exec_stats.jmp_cache_conflicts, 1);
+    }
+    for (; i > 0; i--) {
+        qatomic_set(&set[i], qatomic_read(&set[i - 1]));
+    }
+    qatomic_set(&set[0], tb);
+}
+
+/*
+ * Empty slots of the tb_ibtc point to tb_ibtc_miss rather than NULL.
+ * Its cflags have CF_INVALID, which no branch expects, so that the
+ * generated code checks the slot without testing for NULL first.
+ */
+extern TranslationBlock tb_ibtc_miss;
+
+static inline void tb_ibtc_clear(CPUState *cpu)
+{
+    unsigned int i;
+
+    for (i = 0; i < TB_IBTC_SIZE; i++) {
+        qatomic_set(&cpu->tb_ibtc[i], &tb_ibtc_miss);
+    }
+}
+
 static inline
 uint32_t tb_hash_func(tb_page_addr_t phys_pc, target_ulong pc, uint32_t flags,
                       uint32_t cf_mask, uint32_t trace_vcpu_dstate)
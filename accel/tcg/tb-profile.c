@@ -0,0 +1,242 @@
+/*
+ * Translation profile kept across runs (-accel tcg,tb-profile=file)
+ *
+ * With tiered translation, every TB starts cold and only the ones that
+ * run tier-threshold times are translated again with the optimizer.  A
+ * guest that boots the same firmware over and over pays for both
+ * translations of its hot code on every boot.  The profile file lists
+ * the TBs that tiered up in earlier runs, with the exit counts their
+ * cold versions collected for superblock formation, so that the next
+ * run translates them hot straight away.  This only takes back what
+ * tiering costs: the next run still translates every block it runs
+ * once, as it would without tiering.
+ *
+ * Host code is not saved: it embeds absolute host pointers (helpers,
+ * TranslationBlocks, target structures such as Arm cpreg descriptors)
+ * that TCG does not tag and so could not relocate.  An entry only says
+ * how to translate.  It applies when its key matches and the guest code
+ * at its physical address has the same CRC-32C as when it was recorded;
+ * a stale or colliding entry therefore costs time, never correctness.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/crc32c.h"
+#include "qemu/error-report.h"
+#include "qemu/notify.h"
+#include "qemu/thread.h"
+#include "qapi/error.h"
+#include "exec/exec-all.h"
+#include "exec/memory.h"
+#include "sysemu/sysemu.h"
+#include "tb-hash.h"
+#include "tb-context.h"
+#include "internal.h"
+
+#define TB_PROFILE_MAGIC "QEMUTBP1"
+
+typedef struct TBProfileHeader {
+    char magic[8];
+    char build[48];     /* TARGET_NAME and QEMU_VERSION, NUL padded */
+    uint32_t entry_size;
+    uint32_t nb_entries;
+} TBProfileHeader;
+
+typedef struct TBProfileEntry {
+    uint64_t phys_pc;
+    uint64_t pc;
+    uint64_t cs_base;
+    uint32_t flags;
+    uint32_t cflags;
+    uint32_t size;
+    uint32_t code_crc;
+    uint32_t exit_count[2];
+} TBProfileEntry;
+
+QEMU_BUILD_BUG_ON(sizeof(TBProfileHeader) != 64);
+QEMU_BUILD_BUG_ON(sizeof(TBProfileEntry) != 48);
+
+static char *profile_path;
+static GHashTable *profile;     /* TBProfileEntry -> itself */
+static QemuMutex profile_lock;
+static Notifier profile_exit_notifier;
+
+static guint tb_profile_hash(gconstpointer p)
+{
+    const TBProfileEntry *e = p;
+
+    return tb_hash_func(e->phys_pc, e->pc, e->flags, e->cflags, 0);
+}
+
+static gboolean tb_profile_equal(gconstpointer ap, gconstpointer bp)
+{
+    const TBProfileEntry *a = ap;
+    const TBProfileEntry *b = bp;
+
+    return a->phys_pc == b->phys_pc && a->pc == b->pc &&
+           a->cs_base == b->cs_base && a->flags == b->flags &&
+           a->cflags == b->cflags;
+}
+
+static void tb_profile_build(char *build)
+{
+    memset(build, 0, sizeof_field(TBProfileHeader, build));
+    snprintf(build, sizeof_field(TBProfileHeader, build), "%s %s",
+             TARGET_NAME, QEMU_VERSION);
+}
+
+/* CRC of the guest code at @phys_pc, or false if it is not all in RAM */
+static bool tb_profile_crc(tb_page_addr_t phys_pc, uint32_t size,
+                           uint32_t *crc)
+{
+    if (size == 0 ||
+        (phys_pc & ~TARGET_PAGE_MASK) + size > TARGET_PAGE_SIZE) {
+        return false;
+    }
+    *crc = crc32c(0xffffffff, qemu_map_ram_ptr(NULL, phys_pc), size);
+    return true;
+}
+
+static void tb_profile_save(Notifier *n, void *data)
+{
+    g_autoptr(GByteArray) buf = g_byte_array_new();
+    g_autoptr(GError) err = NULL;
+    TBProfileHeader hdr = { .magic = TB_PROFILE_MAGIC };
+    GHashTableIter iter;
+    gpointer e;
+
+    qemu_mutex_lock(&profile_lock);
+    tb_profile_build(hdr.build);
+    hdr.entry_size = sizeof(TBProfileEntry);
+    hdr.nb_entries = g_hash_table_size(profile);
+    g_byte_array_append(buf, (guint8 *)&hdr, sizeof(hdr));
+    g_hash_table_iter_init(&iter, profile);
+    while (g_hash_table_iter_next(&iter, &e, NULL)) {
+        g_byte_array_append(buf, e, sizeof(TBProfileEntry));
+    }
+    qemu_mutex_unlock(&profile_lock);
+
+    if (!g_file_set_contents(profile_path, (const gchar *)buf->data,
+                             buf->len, &err)) {
+        warn_report("tb-profile: %s", err->message);
+    }
+}
+
+/*
+ * Load the profile at @path, if there is one, and save it back when QEMU
+ * exits.  A file from another target or QEMU version is ignored.
+ */
+bool tb_profile_open(const char *path, Error **errp)
+{
+    g_autofree gchar *contents = NULL;
+    g_autoptr(GError) err = NULL;
+    const TBProfileHeader *hdr;
+    char build[sizeof_field(TBProfileHeader, build)];
+    gsize len;
+    uint32_t i;
+
+    qemu_mutex_init(&profile_lock);
+    profile = g_hash_table_new_full(tb_profile_hash, tb_profile_equal,
+                                    g_free, NULL);
+    profile_path = g_strdup(path);
+    profile_exit_notifier.notify = tb_profile_save;
+    qemu_add_exit_notifier(&profile_exit_notifier);
+
+    if (!g_file_get_contents(path, &contents, &len, &err)) {
+        if (g_error_matches(err, G_FILE_ERROR, G_FILE_ERROR_NOENT)) {
+            return true;
+        }
+        error_setg(errp, "tb-profile: %s", err->message);
+        return false;
+    }
+
+    hdr = (const TBProfileHeader *)contents;
+    tb_profile_build(build);
+    if (len < sizeof(*hdr) ||
+        memcmp(hdr->magic, TB_PROFILE_MAGIC, sizeof(hdr->magic)) ||
+        memcmp(hdr->build, build, sizeof(build)) ||
+        hdr->entry_size != sizeof(TBProfileEntry) ||
+        (len - sizeof(*hdr)) / sizeof(TBProfileEntry) != hdr->nb_entries) {
+        warn_report("tb-profile: ignoring '%s', written by another build",
+                    path);
+        return true;
+    }
+
+    for (i = 0; i < hdr->nb_entries; i++) {
+        TBProfileEntry *e = g_new(TBProfileEntry, 1);
+
+        memcpy(e, contents + sizeof(*hdr) + i * sizeof(*e), sizeof(*e));
+        g_hash_table_replace(profile, e, e);
+    }
+    return true;
+}
+
+/*
+ * Whether the TB for this key tiered up in an earlier run and the guest
+ * code it was translated from is still there.  If so, return the exit
+ * counts its cold version collected in @exit_count.
+ */
+bool tb_profile_lookup(tb_page_addr_t phys_pc, target_ulong pc,
+                       target_ulong cs_base, uint32_t flags, uint32_t cflags,
+                       uint32_t *exit_count)
+{
+    TBProfileEntry key = {
+        .phys_pc = phys_pc, .pc = pc, .cs_base = cs_base,
+        .flags = flags, .cflags = cflags,
+    };
+    const TBProfileEntry *e;
+    uint32_t crc;
+    bool hit = false;
+
+    if (!profile) {
+        return false;
+    }
+    qemu_mutex_lock(&profile_lock);
+    e = g_hash_table_lookup(profile, &key);
+    if (e && tb_profile_crc(phys_pc, e->size, &crc) && crc == e->code_crc) {
+        exit_count[0] = e->exit_count[0];
+        exit_count[1] = e->exit_count[1];
+        hit = true;
+    }
+    qemu_mutex_unlock(&profile_lock);
+
+    if (hit) {
+        qatomic_inc(&tb_ctx.tb_profile_hit_count);
+    }
+    return hit;
+}
+
+/*
+ * Record that @tb tiered up, with the exit counts of its cold version.
+ * TBs spanning two pages are not recorded.
+ */
+void tb_profile_record(const TranslationBlock *tb, const uint32_t *exit_count)
+{
+    tb_page_addr_t phys_pc;
+    TBProfileEntry *e;
+
+    if (!profile || tb->page_addr[1] != -1) {
+        return;
+    }
+    phys_pc = tb->page_addr[0] + (tb->pc & ~TARGET_PAGE_MASK);
+
+    e = g_new(TBProfileEntry, 1);
+    e->phys_pc = phys_pc;
+    e->pc = tb->pc;
+    e->cs_base = tb->cs_base;
+    e->flags = tb->flags;
+    e->cflags = tb_cflags(tb) & ~CF_INVALID;
+    e->size = tb->size;
+    e->exit_count[0] = qatomic_read(&exit_count[0]);
+    e->exit_count[1] = qatomic_read(&exit_count[1]);
+    if (!tb_profile_crc(phys_pc, tb->size, &e->code_crc)) {
+        g_free(e);
+        return;
+    }
+
+    qemu_mutex_lock(&profile_lock);
+    g_hash_table_replace(profile, e, e);
+    qemu_mutex_unlock(&profile_lock);
+}
@@ -0,0 +1,78 @@
+/*
+ * Sampling profiler for the debug buddy
+ *
+ * A QEMU_CLOCK_REALTIME timer asks every running vCPU to leave its chain
+ * of translation blocks at the next block boundary, the same way an
+ * interrupt does.  cpu_tb_exec() then reports the guest pc of the block it
+ * was about to run, which is where the vCPU was when the timer fired even
+ * if it had been looping through directly chained blocks.  Halted vCPUs
+ * are reported from the timer itself.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/main-loop.h"
+#include "qemu/timer.h"
+#include "hw/core/cpu.h"
+#include "sysemu/runstate.h"
+#include "sysemu/tcg.h"
+
+#include "../../mydebug.hpp"
+
+static QEMUTimer *sample_timer;
+static int64_t sample_period_ns;
+
+static void tb_sampler_tick(void *opaque)
+{
+    int64_t period = qatomic_read(&sample_period_ns);
+    CPUState *cpu;
+
+    if (period == 0) {
+        return;
+    }
+    if (runstate_is_running()) {
+        CPU_FOREACH(cpu) {
+            if (cpu->halted || cpu->stopped) {
+                qatomic_set(&cpu->tb_sample_pending, false);
+                OnTBSample(cpu->cpu_index, 0, 0, BUDDY_SAMPLE_HALTED);
+                continue;
+            }
+            qatomic_set(&cpu->tb_sample_pending, true);
+            /* Pairs with the exit check at the start of every TB */
+            smp_wmb();
+            qatomic_set(&cpu->icount_decr_ptr->u16.high, -1);
+        }
+    }
+    timer_mod_ns(sample_timer,
+                 qemu_clock_get_ns(QEMU_CLOCK_REALTIME) + period);
+}
+
+/*
+ * Called from the buddy thread.  Returns -1 until TCG is up, so that the
+ * buddy can ask again later, and for other accelerators.
+ */
+int SetTBSamplingForMyDebug(int hz);
+int SetTBSamplingForMyDebug(int hz)
+{
+    if (!tcg_enabled()) {
+        return -1;
+    }
+    if (hz <= 0) {
+        qatomic_set(&sample_period_ns, 0);
+        if (sample_timer) {
+            timer_del(sample_timer);
+        }
+        return 0;
+    }
+    if (!sample_timer) {
+        sample_timer = timer_new_ns(QEMU_CLOCK_REALTIME, tb_sampler_tick,
+                                    NULL);
+    }
+    qatomic_set(&sample_period_ns, NANOSECONDS_PER_SECOND / hz);
+    timer_mod_ns(sample_timer,
+                 qemu_clock_get_ns(QEMU_CLOCK_REALTIME) +
+                 NANOSECONDS_PER_SECOND / hz);
+    return 0;
+}
@@ -51,7 +51,7 @@ static void mttcg_force_rcu(Notifier *notify, void *data)
 {
     AddLogEntry("Started an MTTCG CPU thread");
     CPUState *cpu = container_of(notify, MttcgForceRcuNotifier, notifier)->cpu;
-    UpdateCPUICount(cpu, 0);
+    UpdateCPUICount(cpu->cpu_index, 0);
 
     /*
      * Called with rcu_registry_lock held, using async_run_on_cpu() ensures
@@ -56,6 +56,10 @@ void tcg_cpus_destroy(CPUState *cpu)
 int tcg_cpus_exec(CPUState *cpu)
 {
     int ret;
+    CPUExecStats *stats = &cpu->exec_stats;
+    uint64_t translate_ns = qatomic_read_u64(&stats->translate_ns);
+    uint64_t bql_wait_ns = qatomic_read_u64(&stats->bql_wait_ns);
+    int64_t start, busy;
 #ifdef CONFIG_PROFILER
     int64_t ti;
 #endif
@@ -63,9 +67,18 @@ int tcg_cpus_exec(CPUState *cpu)
 #ifdef CONFIG_PROFILER
     ti = profile_getclock();
 #endif
+    start = get_clock();
     cpu_exec_start(cpu);
     ret = cpu_exec(cpu);
     cpu_exec_end(cpu);
+
+    /* Translation and BQL waits inside cpu_exec() have their own counters */
+    busy = get_clock() - start;
+    busy -= qatomic_read_u64(&stats->translate_ns) - translate_ns;
+    busy -= qatomic_read_u64(&stats->bql_wait_ns) - bql_wait_ns;
+    if (busy > 0) {
+        cpu_exec_stats_add(&stats->exec_ns, busy);
+    }
 #ifdef CONFIG_PROFILER
     qatomic_set(&tcg_ctx->prof.cpu_exec_time,
                 tcg_ctx->prof.cpu_exec_time + profile_getclock() - ti);
@@ -37,6 +37,7 @@
 #include "hw/boards.h"
 #endif
 #include "internal.h"
+#include "tb-hash.h"
 
 struct TCGState {
     AccelState parent_obj;
@@ -44,6 +45,18 @@ struct TCGState {
     bool mttcg_enabled;
     int splitwx_enabled;
     unsigned long tb_size;
+    bool tb_reuse;
+    uint32_t tier_threshold;
+    bool superblocks;
+    uint32_t jmp_cache_bits;
+    uint32_t jmp_cache_ways;
+    uint32_t vtlb_size;
+    uint32_t tlb_prefetch;
+    bool spill_next_use;
+    char *op_corpus;
+    char *tb_profile;
+    bool code_reclaim;
+    bool tb_counters;
 };
 typedef struct TCGState TCGState;
 
@@ -106,6 +119,10 @@ static void tcg_accel_instance_init(Object *obj)
 #else
     s->splitwx_enabled = 0;
 #endif
+
+    s->jmp_cache_bits = 12;
+    s->jmp_cache_ways = 1;
+    s->vtlb_size = 8;
 }
 
 bool mttcg_enabled;
@@ -121,6 +138,48 @@ static int tcg_init_machine(MachineState *ms)
 
     tcg_allowed = true;
     mttcg_enabled = s->mttcg_enabled;
+    tb_reuse_enabled = s->tb_reuse;
+    tcg_tier_threshold = s->tier_threshold;
+    tb_superblocks_enabled = s->superblocks;
+    tb_counters_enabled = s->tb_counters;
+    tb_jmp_cache_bits = s->jmp_cache_bits;
+    tb_jmp_cache_ways = s->jmp_cache_ways;
+    tcg_spill_next_use = s->spill_next_use;
+    if (s->op_corpus && *s->op_corpus) {
+        Error *local_err = NULL;
+
+        if (!tcg_corpus_open(s->op_corpus, &local_err)) {
+            error_report_err(local_err);
+            return -EINVAL;
+        }
+    }
+#ifdef CONFIG_SOFTMMU
+    tlb_vtlb_max_size = s->vtlb_size;
+    tlb_prefetch_pages = s->tlb_prefetch;
+    if (s->code_reclaim && s->tb_reuse) {
+        /* Retired TBs would outlive the regions they live in */
+        error_report("tb-reuse cannot be combined with code-reclaim");
+        return -EINVAL;
+    }
+    tcg_region_reclaim = s->code_reclaim;
+#endif
+    if (s->tb_profile && *s->tb_profile) {
+#ifdef CONFIG_SOFTMMU
+        Error *local_err = NULL;
+
+        if (!s->tier_threshold) {
+            error_report("tb-profile needs tier-threshold");
+            return -EINVAL;
+        }
+        if (!tb_profile_open(s->tb_profile, &local_err)) {
+            error_report_err(local_err);
+            return -EINVAL;
+        }
+#else
+        error_report("tb-profile is only supported in system emulation");
+        return -EINVAL;
+#endif
+    }
 
     page_init();
     tb_htable_init();
@@ -208,6 +267,241 @@ static void tcg_set_splitwx(Object *obj, bool value, Error **errp)
     s->splitwx_enabled = value;
 }
 
+static bool tcg_get_tb_reuse(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    return s->tb_reuse;
+}
+
+static void tcg_set_tb_reuse(Object *obj, bool value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    s->tb_reuse = value;
+}
+
+static void tcg_get_tier_threshold(Object *obj, Visitor *v,
+                                   const char *name, void *opaque,
+                                   Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value = s->tier_threshold;
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
+static void tcg_set_tier_threshold(Object *obj, Visitor *v,
+                                   const char *name, void *opaque,
+                                   Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+
+    s->tier_threshold = value;
+}
+
+static void tcg_get_jmp_cache_bits(Object *obj, Visitor *v,
+                                   const char *name, void *opaque,
+                                   Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value = s->jmp_cache_bits;
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
+static void tcg_set_jmp_cache_bits(Object *obj, Visitor *v,
+                                   const char *name, void *opaque,
+                                   Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+    if (value < 8 || value > 20) {
+        error_setg(errp, "jmp-cache-bits must be between 8 and 20");
+        return;
+    }
+
+    s->jmp_cache_bits = value;
+}
+
+static void tcg_get_jmp_cache_ways(Object *obj, Visitor *v,
+                                   const char *name, void *opaque,
+                                   Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value = s->jmp_cache_ways;
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
+static void tcg_set_jmp_cache_ways(Object *obj, Visitor *v,
+                                   const char *name, void *opaque,
+                                   Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+    if (value != 1 && value != 2 && value != 4) {
+        error_setg(errp, "jmp-cache-ways must be 1, 2 or 4");
+        return;
+    }
+
+    s->jmp_cache_ways = value;
+}
+
+static char *tcg_get_spill_heuristic(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    return g_strdup(s->spill_next_use ? "next-use" : "first");
+}
+
+static void tcg_set_spill_heuristic(Object *obj, const char *value,
+                                    Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    if (strcmp(value, "next-use") == 0) {
+        s->spill_next_use = true;
+    } else if (strcmp(value, "first") == 0) {
+        s->spill_next_use = false;
+    } else {
+        error_setg(errp, "Invalid 'spill-heuristic' setting %s", value);
+    }
+}
+
+static char *tcg_get_op_corpus(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    return g_strdup(s->op_corpus ? s->op_corpus : "");
+}
+
+static void tcg_set_op_corpus(Object *obj, const char *value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    g_free(s->op_corpus);
+    s->op_corpus = g_strdup(value);
+}
+
+static char *tcg_get_tb_profile(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    return g_strdup(s->tb_profile ? s->tb_profile : "");
+}
+
+static void tcg_set_tb_profile(Object *obj, const char *value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    g_free(s->tb_profile);
+    s->tb_profile = g_strdup(value);
+}
+
+static void tcg_get_vtlb_size(Object *obj, Visitor *v,
+                              const char *name, void *opaque,
+                              Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value = s->vtlb_size;
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
+static void tcg_set_vtlb_size(Object *obj, Visitor *v,
+                              const char *name, void *opaque,
+                              Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+    if (value < 8 || value > 256 || !is_power_of_2(value)) {
+        error_setg(errp, "vtlb-size must be a power of 2 between 8 and 256");
+        return;
+    }
+
+    s->vtlb_size = value;
+}
+
+static void tcg_get_tlb_prefetch(Object *obj, Visitor *v,
+                                 const char *name, void *opaque,
+                                 Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value = s->tlb_prefetch;
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
+static void tcg_set_tlb_prefetch(Object *obj, Visitor *v,
+                                 const char *name, void *opaque,
+                                 Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+    if (value > 16) {
+        error_setg(errp, "tlb-prefetch must be between 0 and 16");
+        return;
+    }
+
+    s->tlb_prefetch = value;
+}
+
+static bool tcg_get_superblocks(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    return s->superblocks;
+}
+
+static void tcg_set_superblocks(Object *obj, bool value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    s->superblocks = value;
+}
+
+static bool tcg_get_code_reclaim(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    return s->code_reclaim;
+}
+
+static void tcg_set_code_reclaim(Object *obj, bool value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    s->code_reclaim = value;
+}
+
+static bool tcg_get_tb_counters(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    return s->tb_counters;
+}
+
+static void tcg_set_tb_counters(Object *obj, bool value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    s->tb_counters = value;
+}
+
 static void tcg_accel_class_init(ObjectClass *oc, void *data)
 {
     AccelClass *ac = ACCEL_CLASS(oc);
@@ -229,6 +523,81 @@ static void tcg_accel_class_init(ObjectClass *oc, void *data)
         tcg_get_splitwx, tcg_set_splitwx);
     object_class_property_set_description(oc, "split-wx",
         "Map jit pages into separate RW and RX regions");
+
+    object_class_property_add_bool(oc, "code-reclaim",
+        tcg_get_code_reclaim, tcg_set_code_reclaim);
+    object_class_property_set_description(oc, "code-reclaim",
+        "Evict the oldest translations when the translation block cache "
+        "fills up instead of flushing it");
+
+    object_class_property_add_bool(oc, "tb-reuse",
+        tcg_get_tb_reuse, tcg_set_tb_reuse);
+    object_class_property_set_description(oc, "tb-reuse",
+        "Revive invalidated translation blocks whose guest code is "
+        "written back unchanged");
+
+    object_class_property_add(oc, "tier-threshold", "int",
+        tcg_get_tier_threshold, tcg_set_tier_threshold,
+        NULL, NULL);
+    object_class_property_set_description(oc, "tier-threshold",
+        "Translate blocks without optimization first and optimize the "
+        "ones executed this many times (0 to disable)");
+
+    object_class_property_add_bool(oc, "superblocks",
+        tcg_get_superblocks, tcg_set_superblocks);
+    object_class_property_set_description(oc, "superblocks",
+        "Extend optimized translation blocks along the branches they "
+        "mostly took before (needs tier-threshold)");
+
+    object_class_property_add(oc, "jmp-cache-bits", "int",
+        tcg_get_jmp_cache_bits, tcg_set_jmp_cache_bits,
+        NULL, NULL);
+    object_class_property_set_description(oc, "jmp-cache-bits",
+        "log2 of the number of sets in the per-vCPU TB lookup cache");
+
+    object_class_property_add(oc, "jmp-cache-ways", "int",
+        tcg_get_jmp_cache_ways, tcg_set_jmp_cache_ways,
+        NULL, NULL);
+    object_class_property_set_description(oc, "jmp-cache-ways",
+        "Associativity of the per-vCPU TB lookup cache (1, 2 or 4)");
+
+    object_class_property_add_str(oc, "spill-heuristic",
+                                  tcg_get_spill_heuristic,
+                                  tcg_set_spill_heuristic);
+    object_class_property_set_description(oc, "spill-heuristic",
+        "How TCG picks a register to spill (first or next-use)");
+
+    object_class_property_add_bool(oc, "tb-counters",
+        tcg_get_tb_counters, tcg_set_tb_counters);
+    object_class_property_set_description(oc, "tb-counters",
+        "Count the executions of every translation block, "
+        "for info jit hot");
+
+    object_class_property_add_str(oc, "op-corpus",
+                                  tcg_get_op_corpus,
+                                  tcg_set_op_corpus);
+    object_class_property_set_description(oc, "op-corpus",
+        "File to write the TCG ops of every translation block to, "
+        "for tests/bench/tcg-replay-bench.c");
+
+    object_class_property_add_str(oc, "tb-profile",
+                                  tcg_get_tb_profile,
+                                  tcg_set_tb_profile);
+    object_class_property_set_description(oc, "tb-profile",
+        "File that keeps which translation blocks tiered up across runs "
+        "(needs tier-threshold)");
+
+    object_class_property_add(oc, "vtlb-size", "int",
+        tcg_get_vtlb_size, tcg_set_vtlb_size,
+        NULL, NULL);
+    object_class_property_set_description(oc, "vtlb-size",
+        "Maximum number of victim TLB entries per MMU mode");
+
+    object_class_property_add(oc, "tlb-prefetch", "int",
+        tcg_get_tlb_prefetch, tcg_set_tlb_prefetch,
+        NULL, NULL);
+    object_class_property_set_description(oc, "tlb-prefetch",
+        "Number of following pages to map on each TLB miss of a load or store");
 }
 
 static const TypeInfo tcg_accel_type = {
@@ -48,6 +48,7 @@
 #include "exec/cputlb.h"
 #include "exec/translate-all.h"
 #include "qemu/bitmap.h"
+#include "qemu/rcu.h"
 #include "qemu/qemu-print.h"
 #include "qemu/timer.h"
 #include "qemu/main-loop.h"
@@ -104,13 +105,26 @@
 
 #define SMC_BITMAP_USE_THRESHOLD 10
 
+#ifdef CONFIG_SOFTMMU
+/*
+ * The bytes of a page that hold translated code.  Bits are only ever
+ * added in place; when a TB leaves the page, the whole bitmap is
+ * replaced and the old one freed after an RCU grace period, so that
+ * tb_page_write_needs_invalidate() can read it without the page lock.
+ */
+typedef struct CodeBitmap {
+    struct rcu_head rcu;
+    unsigned long map[];
+} CodeBitmap;
+#endif
+
 typedef struct PageDesc {
     /* list of TBs intersecting this ram page */
     uintptr_t first_tb;
 #ifdef CONFIG_SOFTMMU
     /* in order to optimize self modifying code, we count the number
        of lookups we do to a given page to use a bitmap */
-    unsigned long *code_bitmap;
+    CodeBitmap *code_bitmap;
     unsigned int code_write_count;
 #else
     unsigned long flags;
@@ -900,21 +914,65 @@ static bool tb_cmp(const void *ap, const void *bp)
         a->page_addr[1] == b->page_addr[1];
 }
 
+/*
+ * TB reuse (-accel tcg,tb-reuse=on).
+ *
+ * An invalidated TB keeps its host code in the code buffer until the next
+ * tb_flush().  When the guest writes the very same code back -- firmware
+ * that copies itself to RAM again after a reset, a boot loader reloading
+ * an unchanged image -- translating it again would produce that TB once
+ * more.  So TBs invalidated with their page list entries removed go to
+ * tb_ctx.retired, hashed like tb_ctx.htable, and tb_gen_code() revives
+ * one whose copy of the guest code still matches guest memory instead of
+ * translating.
+ *
+ * Besides the lookup key and the guest code, translation depends on the
+ * vCPU's breakpoints and on plugin instrumentation.  TBs translated with
+ * either are never kept, and no TB is revived for a vCPU that has them.
+ * TBs spanning two pages are not kept either.
+ */
+bool tb_reuse_enabled;
+
+static bool tb_ptr_cmp(const void *ap, const void *bp)
+{
+    return ap == bp;
+}
+
+static bool tb_reuse_allowed(CPUState *cpu)
+{
+#ifdef CONFIG_SOFTMMU
+    return tb_reuse_enabled && QTAILQ_EMPTY(&cpu->breakpoints) &&
+           !test_bit(QEMU_PLUGIN_EV_VCPU_TB_TRANS, cpu->plugin_mask);
+#else
+    return false;
+#endif
+}
+
 void tb_htable_init(void)
 {
     unsigned int mode = QHT_MODE_AUTO_RESIZE;
 
     qht_init(&tb_ctx.htable, tb_cmp, CODE_GEN_HTABLE_SIZE, mode);
+    /* Equal keys are expected, with different guest code */
+    qht_init(&tb_ctx.retired, tb_ptr_cmp, CODE_GEN_HTABLE_SIZE, mode);
 }
 
-/* call with @p->lock held */
+/*
+ * call with @p->lock held
+ *
+ * The write count is kept, so that the next write to the page rebuilds
+ * the bitmap right away if it had one before.
+ */
 static inline void invalidate_page_bitmap(PageDesc *p)
 {
     assert_page_locked(p);
 #ifdef CONFIG_SOFTMMU
-    g_free(p->code_bitmap);
-    p->code_bitmap = NULL;
-    p->code_write_count = 0;
+    CodeBitmap *bitmap = p->code_bitmap;
+
+    if (bitmap) {
+        qatomic_set(&p->code_bitmap, NULL);
+        g_free_rcu(bitmap, rcu);
+    }
 #endif
 }
 
@@ -933,6 +991,9 @@ static void page_flush_tb_1(int level, void **lp)
             page_lock(&pd[i]);
             pd[i].first_tb = (uintptr_t)NULL;
             invalidate_page_bitmap(pd + i);
+#ifdef CONFIG_SOFTMMU
+            pd[i].code_write_count = 0;
+#endif
             page_unlock(&pd[i]);
         }
     } else {
@@ -962,10 +1023,159 @@ static gboolean tb_host_size_iter(gpointer key, gpointer value, gpointer data)
     return false;
 }
 
+/* Add a pause of @ns to the total and maximum of tb_ctx */
+static void tb_pause_account(uint64_t *total, uint64_t *max, int64_t ns)
+{
+    qatomic_set_u64(total, qatomic_read_u64(total) + ns);
+    if (ns > qatomic_read_u64(max)) {
+        qatomic_set_u64(max, ns);
+    }
+}
+
+#ifdef CONFIG_SOFTMMU
+/*
+ * Code reclaim (-accel tcg,code-reclaim=on).
+ *
+ * Before the code buffer runs out, tcg_region_alloc() asks for its oldest
+ * regions to be reclaimed.  The first vCPU to leave cpu_exec() after that
+ * invalidates their TBs, which removes them from tb_ctx.htable and the
+ * page lists and resets every goto_tb jump into them, while the other
+ * vCPUs keep running.  The regions can only be reused once no vCPU may
+ * still be executing their code, hold one of their TBs as last_tb, or
+ * find one in its tb_jmp_cache: that is, once every vCPU has left
+ * cpu_exec() since, or entered it anew.  Those still inside are kicked
+ * out, and the last one to leave hands the regions back.
+ *
+ * tb_reclaim_epoch is bumped each time TBs have been invalidated that
+ * way; vCPUs publish the epoch they entered cpu_exec() at in
+ * cpu->tb_epoch, 0 outside of it, and clear their tb_jmp_cache when
+ * entering at a new epoch.
+ */
+static unsigned tb_reclaim_epoch = 1;
+/* Epoch the reclaim under way waits for, or 0 */
+static unsigned tb_reclaim_pending;
+
+/* Have all vCPUs left cpu_exec() since @epoch began? */
+static bool tb_reclaim_quiescent(unsigned epoch)
+{
+    CPUState *cpu;
+
+    CPU_FOREACH(cpu) {
+        unsigned e = qatomic_read(&cpu->tb_epoch);
+
+        if (e && e != epoch) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void tb_reclaim_finish(unsigned epoch)
+{
+    /* Only one of the vCPUs that find it quiescent gets to finish it */
+    if (qatomic_cmpxchg(&tb_reclaim_pending, epoch, 0) == epoch) {
+        size_t n = tcg_region_reclaim_finish();
+
+        qatomic_set(&tb_ctx.tb_reclaim_regions,
+                    tb_ctx.tb_reclaim_regions + n);
+    }
+}
+
+static void tb_reclaim_code(CPUState *cpu)
+{
+    GPtrArray *tbs;
+    CPUState *other;
+    unsigned epoch;
+    int64_t ti;
+    guint i;
+
+    ti = get_clock();
+    tbs = tcg_region_reclaim_start();
+    if (tbs == NULL) {
+        return;
+    }
+    qemu_thread_jit_write();
+    for (i = 0; i < tbs->len; i++) {
+        tb_phys_invalidate(g_ptr_array_index(tbs, i), -1);
+    }
+    qemu_thread_jit_execute();
+
+    epoch = tb_reclaim_epoch + 1;
+    if (epoch == 0) {
+        /* 0 stands for outside of cpu_exec() */
+        epoch = 1;
+    }
+    qatomic_set(&tb_reclaim_pending, epoch);
+    smp_mb();
+    qatomic_set(&tb_reclaim_epoch, epoch);
+    smp_mb();
+    CPU_FOREACH(other) {
+        unsigned e = qatomic_read(&other->tb_epoch);
+
+        if (e && e != epoch) {
+            cpu_exit(other);
+        }
+    }
+
+    qatomic_set(&tb_ctx.tb_reclaim_count, tb_ctx.tb_reclaim_count + 1);
+    qatomic_set(&tb_ctx.tb_reclaim_tbs, tb_ctx.tb_reclaim_tbs + tbs->len);
+    tb_pause_account(&tb_ctx.tb_reclaim_ns, &tb_ctx.tb_reclaim_max_ns,
+                     get_clock() - ti);
+    g_ptr_array_free(tbs, true);
+
+    if (tb_reclaim_quiescent(epoch)) {
+        tb_reclaim_finish(epoch);
+    }
+}
+
+/* Called by a vCPU entering cpu_exec(), before it looks up any TB */
+void tb_reclaim_enter(CPUState *cpu)
+{
+    unsigned epoch;
+
+    if (!tcg_region_reclaim) {
+        return;
+    }
+    /* Don't let a reclaim finish without waiting for us */
+    do {
+        epoch = qatomic_read(&tb_reclaim_epoch);
+        qatomic_set(&cpu->tb_epoch, epoch);
+        smp_mb();
+    } while (epoch != qatomic_read(&tb_reclaim_epoch));
+
+    if (cpu->tb_epoch_seen != epoch) {
+        /* The cache may point into regions reclaimed since */
+        cpu_tb_jmp_cache_clear(cpu);
+        cpu->tb_epoch_seen = epoch;
+    }
+}
+
+/* Called by a vCPU leaving cpu_exec(), once it holds no TB any more */
+void tb_reclaim_exit(CPUState *cpu)
+{
+    unsigned pending;
+
+    if (!tcg_region_reclaim) {
+        return;
+    }
+    qatomic_set(&cpu->tb_epoch, 0);
+    smp_mb();
+
+    pending = qatomic_read(&tb_reclaim_pending);
+    if (pending && tb_reclaim_quiescent(pending)) {
+        tb_reclaim_finish(pending);
+    }
+    if (tcg_region_reclaim_wanted()) {
+        tb_reclaim_code(cpu);
+    }
+}
+#endif
+
 /* flush all the translation blocks */
 static void do_tb_flush(CPUState *cpu, run_on_cpu_data tb_flush_count)
 {
     bool did_flush = false;
+    int64_t ti;
 
     mmap_lock();
     /* If it is already been done on request of another CPU,
@@ -975,6 +1185,7 @@ static void do_tb_flush(CPUState *cpu, run_on_cpu_data tb_flush_count)
         goto done;
     }
     did_flush = true;
+    ti = get_clock();
 
     if (DEBUG_TB_FLUSH_GATE) {
         size_t nb_tbs = tcg_nb_tbs();
@@ -990,11 +1201,18 @@ static void do_tb_flush(CPUState *cpu, run_on_cpu_data tb_flush_count)
     }
 
     qht_reset_size(&tb_ctx.htable, CODE_GEN_HTABLE_SIZE);
+    qht_reset(&tb_ctx.retired);
     page_flush_tb();
 
     tcg_region_reset_all();
+#ifdef CONFIG_SOFTMMU
+    /* A reclaim under way has nothing left to wait for */
+    qatomic_set(&tb_reclaim_pending, 0);
+#endif
     /* XXX: flush processor icache at this point if cache flush is
        expensive */
+    tb_pause_account(&tb_ctx.tb_flush_ns, &tb_ctx.tb_flush_max_ns,
+                     get_clock() - ti);
     qatomic_mb_set(&tb_ctx.tb_flush_count, tb_ctx.tb_flush_count + 1);
 
 done:
@@ -1174,7 +1392,7 @@ static void do_tb_phys_invalidate(TranslationBlock *tb, bool rm_from_page_list)
 {
     CPUState *cpu;
     PageDesc *p;
-    uint32_t h;
+    uint32_t tb_h;
     tb_page_addr_t phys_pc;
     uint32_t orig_cflags = tb_cflags(tb);
 
@@ -1187,9 +1405,9 @@ static void do_tb_phys_invalidate(TranslationBlock *tb, bool rm_from_page_list)
 
     /* remove the TB from the hash list */
     phys_pc = tb->page_addr[0] + (tb->pc & ~TARGET_PAGE_MASK);
-    h = tb_hash_func(phys_pc, tb->pc, tb->flags, orig_cflags,
-                     tb->trace_vcpu_dstate);
-    if (!qht_remove(&tb_ctx.htable, tb, h)) {
+    tb_h = tb_hash_func(phys_pc, tb->pc, tb->flags, orig_cflags,
+                        tb->trace_vcpu_dstate);
+    if (!qht_remove(&tb_ctx.htable, tb, tb_h)) {
         return;
     }
 
@@ -1206,10 +1424,20 @@ static void do_tb_phys_invalidate(TranslationBlock *tb, bool rm_from_page_list)
     }
 
     /* remove the TB from the hash list */
-    h = tb_jmp_cache_hash_func(tb->pc);
     CPU_FOREACH(cpu) {
-        if (qatomic_read(&cpu->tb_jmp_cache[h]) == tb) {
-            qatomic_set(&cpu->tb_jmp_cache[h], NULL);
+        CPUJumpCache *jc = qatomic_rcu_read(&cpu->tb_jmp_cache);
+        TranslationBlock **set;
+        unsigned int way;
+
+        /* Not yet realized */
+        if (jc == NULL) {
+            continue;
+        }
+        set = tb_jmp_cache_set(jc, tb->pc);
+        for (way = 0; way < tb_jmp_cache_ways; way++) {
+            if (qatomic_read(&set[way]) == tb) {
+                qatomic_set(&set[way], NULL);
+            }
         }
     }
 
@@ -1222,6 +1450,11 @@ static void do_tb_phys_invalidate(TranslationBlock *tb, bool rm_from_page_list)
 
     qatomic_set(&tb_ctx.tb_phys_invalidate_count,
                 tb_ctx.tb_phys_invalidate_count + 1);
+
+    if (tb->code_copy && rm_from_page_list) {
+        qht_insert(&tb_ctx.retired, tb, tb_h, NULL);
+        qatomic_inc(&tb_ctx.tb_retire_count);
+    }
 }
 
 static void tb_phys_invalidate__locked(TranslationBlock *tb)
@@ -1247,31 +1480,43 @@ void tb_phys_invalidate(TranslationBlock *tb, tb_page_addr_t page_addr)
 }
 
 #ifdef CONFIG_SOFTMMU
+/* Mark the bytes of page @n of @tb in @bitmap.  */
+static void code_bitmap_add_tb(CodeBitmap *bitmap, TranslationBlock *tb,
+                               int n)
+{
+    int tb_start, tb_end;
+
+    /* NOTE: this is subtle as a TB may span two physical pages */
+    if (n == 0) {
+        /* NOTE: tb_end may be after the end of the page, but
+           it is not a problem */
+        tb_start = tb->pc & ~TARGET_PAGE_MASK;
+        tb_end = tb_start + tb->size;
+        if (tb_end > TARGET_PAGE_SIZE) {
+            tb_end = TARGET_PAGE_SIZE;
+        }
+    } else {
+        tb_start = 0;
+        tb_end = ((tb->pc + tb->size) & ~TARGET_PAGE_MASK);
+    }
+    bitmap_set_atomic(bitmap->map, tb_start, tb_end - tb_start);
+}
+
 /* call with @p->lock held */
 static void build_page_bitmap(PageDesc *p)
 {
-    int n, tb_start, tb_end;
+    CodeBitmap *bitmap;
     TranslationBlock *tb;
+    int n;
 
     assert_page_locked(p);
-    p->code_bitmap = bitmap_new(TARGET_PAGE_SIZE);
+    bitmap = g_malloc0(sizeof(CodeBitmap) +
+                       BITS_TO_LONGS(TARGET_PAGE_SIZE) * sizeof(long));
 
     PAGE_FOR_EACH_TB(p, tb, n) {
-        /* NOTE: this is subtle as a TB may span two physical pages */
-        if (n == 0) {
-            /* NOTE: tb_end may be after the end of the page, but
-               it is not a problem */
-            tb_start = tb->pc & ~TARGET_PAGE_MASK;
-            tb_end = tb_start + tb->size;
-            if (tb_end > TARGET_PAGE_SIZE) {
-                tb_end = TARGET_PAGE_SIZE;
-             }
-        } else {
-            tb_start = 0;
-            tb_end = ((tb->pc + tb->size) & ~TARGET_PAGE_MASK);
-        }
-        bitmap_set(p->code_bitmap, tb_start, tb_end - tb_start);
+        code_bitmap_add_tb(bitmap, tb, n);
     }
+    qatomic_rcu_set(&p->code_bitmap, bitmap);
 }
 #endif
 
@@ -1295,7 +1540,12 @@ static inline void tb_page_add(PageDesc *p, TranslationBlock *tb,
     page_already_protected = p->first_tb != (uintptr_t)NULL;
 #endif
     p->first_tb = (uintptr_t)tb | n;
-    invalidate_page_bitmap(p);
+#ifdef CONFIG_SOFTMMU
+    /* Keep the bitmap of pages that guest code writes to.  */
+    if (p->code_bitmap) {
+        code_bitmap_add_tb(p->code_bitmap, tb, n);
+    }
+#endif
 
 #if defined(CONFIG_USER_ONLY)
     /* translator_loop() must have made all TB pages non-writable */
@@ -1378,17 +1628,135 @@ tb_link_page(TranslationBlock *tb, tb_page_addr_t phys_pc,
     return tb;
 }
 
-/* Called with mmap_lock held for user mode emulation.  */
-TranslationBlock *tb_gen_code(CPUState *cpu,
-                              target_ulong pc, target_ulong cs_base,
-                              uint32_t flags, int cflags)
+#ifdef CONFIG_SOFTMMU
+struct tb_reuse_desc {
+    target_ulong pc;
+    target_ulong cs_base;
+    uint32_t flags;
+    uint32_t cflags;
+    uint32_t trace_vcpu_dstate;
+    tb_page_addr_t page_addr0;
+    const uint8_t *code;    /* current guest code at pc */
+};
+
+static bool tb_reuse_cmp(const void *p, const void *d)
+{
+    const TranslationBlock *tb = p;
+    const struct tb_reuse_desc *desc = d;
+
+    return tb->pc == desc->pc &&
+        tb->cs_base == desc->cs_base &&
+        tb->flags == desc->flags &&
+        (tb_cflags(tb) & ~CF_INVALID) == desc->cflags &&
+        tb->trace_vcpu_dstate == desc->trace_vcpu_dstate &&
+        tb->page_addr[0] == desc->page_addr0 &&
+        memcmp(tb->code_copy, desc->code, tb->size) == 0;
+}
+
+/*
+ * Look for a retired TB translated from the guest code now at @phys_pc
+ * under the same key, and link it back in.  Called with the same locks
+ * as tb_gen_code(); returns NULL if there is none.
+ */
+static TranslationBlock *tb_revive(CPUState *cpu, tb_page_addr_t phys_pc,
+                                   target_ulong pc, target_ulong cs_base,
+                                   uint32_t flags, uint32_t cflags)
+{
+    struct tb_reuse_desc desc;
+    TranslationBlock *tb, *existing_tb;
+    uint32_t h;
+    int n;
+
+    desc.pc = pc;
+    desc.cs_base = cs_base;
+    desc.flags = flags;
+    desc.cflags = cflags;
+    desc.trace_vcpu_dstate = *cpu->trace_dstate;
+    desc.page_addr0 = phys_pc & TARGET_PAGE_MASK;
+    desc.code = qemu_map_ram_ptr(NULL, phys_pc);
+    h = tb_hash_func(phys_pc, pc, flags, cflags, desc.trace_vcpu_dstate);
+
+    tb = qht_lookup_custom(&tb_ctx.retired, &desc, h, tb_reuse_cmp);
+    /* Another vCPU may be reviving it too */
+    if (tb == NULL || !qht_remove(&tb_ctx.retired, tb, h)) {
+        return NULL;
+    }
+
+    /* Undo what do_tb_phys_invalidate() did to the jump lists */
+    for (n = 0; n < 2; n++) {
+        if (tb->jmp_reset_offset[n] != TB_JMP_RESET_OFFSET_INVALID) {
+            tb_reset_jump(tb, n);
+        }
+        tb->jmp_list_next[n] = (uintptr_t)NULL;
+        qatomic_set(&tb->jmp_dest[n], (uintptr_t)NULL);
+    }
+    qemu_spin_lock(&tb->jmp_lock);
+    tb->jmp_list_head = (uintptr_t)NULL;
+    qatomic_set(&tb->cflags, cflags);
+    qemu_spin_unlock(&tb->jmp_lock);
+
+    existing_tb = tb_link_page(tb, phys_pc, -1);
+    if (unlikely(existing_tb != tb)) {
+        /* Translated by another vCPU in the meantime; drop ours */
+        qemu_spin_lock(&tb->jmp_lock);
+        qatomic_set(&tb->cflags, cflags | CF_INVALID);
+        qemu_spin_unlock(&tb->jmp_lock);
+        return existing_tb;
+    }
+    qatomic_inc(&tb_ctx.tb_reuse_count);
+    return tb;
+}
+#endif
+
+/*
+ * Tiered translation (-accel tcg,tier-threshold=N).
+ *
+ * Most TBs run a handful of times, for which the time tcg_optimize()
+ * spends on them is never paid back.  With a non-zero threshold, full
+ * length TBs are first translated cold, without the optimizer.  Cold
+ * TBs are chained and looked up like any other, and count their own
+ * executions and, with superblocks, their goto_tb exits, inline.  On the
+ * Nth execution a cold TB exits to the execution loop, which calls
+ * tb_tier_up().
+ *
+ * There is no background translation: the vCPU that finds a TB hot
+ * translates it again itself, so hot code is translated twice.  This
+ * only pays off when skipping tcg_optimize() on the code that never gets
+ * hot saves more than the second translations and the cold runs cost.
+ */
+uint32_t tcg_tier_threshold;
+
+/*
+ * Superblocks (-accel tcg,superblocks=on) extend optimized translations
+ * past direct branches along the paths their cold versions took, see
+ * translator_trace_branch().
+ */
+bool tb_superblocks_enabled;
+
+/*
+ * With -accel tcg,tb-counters=on, every TB counts its executions in
+ * tb->run_count, see gen_tb_count() and qmp_x_query_jit_hot().
+ */
+bool tb_counters_enabled;
+
+/*
+ * Translate a TB; cold if tiering is on, unless @from is the cold TB
+ * this one replaces or the TB tiered up in a run the tb-profile file
+ * recorded.
+ */
+static TranslationBlock *do_tb_gen_code(CPUState *cpu, target_ulong pc,
+                                        target_ulong cs_base, uint32_t flags,
+                                        int cflags,
+                                        const TranslationBlock *from)
 {
     CPUArchState *env = cpu->env_ptr;
     TranslationBlock *tb, *existing_tb;
     tb_page_addr_t phys_pc, phys_page2;
     target_ulong virt_page2;
     tcg_insn_unit *gen_code_buf;
-    int gen_code_size, search_size, max_insns;
+    int gen_code_size, search_size, copy_size, max_insns;
+    uint32_t exit_count[2] = { 0, 0 };
+    bool cold, hot;
 #ifdef CONFIG_PROFILER
     TCGProfile *prof = &tcg_ctx->prof;
     int64_t ti;
@@ -1409,6 +1777,26 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
         max_insns = TCG_MAX_INSNS;
     }
     QEMU_BUILD_BUG_ON(CF_COUNT_MASK + 1 != TCG_MAX_INSNS);
+    cold = !from && tcg_tier_threshold && (cflags & CF_COUNT_MASK) == 0;
+    hot = from != NULL;
+    if (from) {
+        exit_count[0] = qatomic_read(&from->exit_count[0]);
+        exit_count[1] = qatomic_read(&from->exit_count[1]);
+    } else if (cold && phys_pc != -1 &&
+               tb_profile_lookup(phys_pc, pc, cs_base, flags, cflags,
+                                 exit_count)) {
+        cold = false;
+        hot = true;
+    }
+
+#ifdef CONFIG_SOFTMMU
+    if (phys_pc != -1 && tb_reuse_allowed(cpu)) {
+        tb = tb_revive(cpu, phys_pc, pc, cs_base, flags, cflags);
+        if (tb) {
+            return tb;
+        }
+    }
+#endif
 
  buffer_overflow:
     tb = tcg_tb_alloc(tcg_ctx);
@@ -1420,6 +1808,12 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
         cpu->exception_index = EXCP_INTERRUPT;
         cpu_loop_exit(cpu);
     }
+#ifdef CONFIG_SOFTMMU
+    if (unlikely(tcg_region_reclaim_wanted())) {
+        /* Leave cpu_exec() to reclaim code, see tb_reclaim_exit() */
+        cpu_exit(cpu);
+    }
+#endif
 
     gen_code_buf = tcg_ctx->code_gen_ptr;
     tb->tc.ptr = tcg_splitwx_to_rx(gen_code_buf);
@@ -1428,7 +1822,18 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     tb->flags = flags;
     tb->cflags = cflags;
     tb->trace_vcpu_dstate = *cpu->trace_dstate;
+    tb->code_copy = NULL;
+    tb->cold = cold;
+    tb->exec_count = 0;
+    tb->exit_count[0] = exit_count[0];
+    tb->exit_count[1] = exit_count[1];
+    tb->run_count = 0;
     tcg_ctx->tb_cflags = cflags;
+    tcg_ctx->tb_cold = cold;
+    tcg_ctx->tb_trace = hot && tb_superblocks_enabled;
+    tcg_ctx->tb_counted = tb_counters_enabled;
+    tcg_ctx->tb_exit_count = cold && tb_superblocks_enabled ?
+                             tb->exit_count : NULL;
  tb_overflow:
 
 #ifdef CONFIG_PROFILER
@@ -1518,6 +1923,21 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     }
     tb->tc.size = gen_code_size;
 
+    copy_size = 0;
+#ifdef CONFIG_SOFTMMU
+    if (phys_pc != -1 && !cold && tb_reuse_allowed(cpu) &&
+        (pc & TARGET_PAGE_MASK) == ((pc + tb->size - 1) & TARGET_PAGE_MASK)) {
+        uint8_t *copy = (void *)gen_code_buf + gen_code_size + search_size;
+
+        if (unlikely((void *)copy + tb->size > tcg_ctx->code_gen_highwater)) {
+            goto buffer_overflow;
+        }
+        memcpy(copy, qemu_map_ram_ptr(NULL, phys_pc), tb->size);
+        tb->code_copy = copy;
+        copy_size = tb->size;
+    }
+#endif
+
 #ifdef CONFIG_PROFILER
     qatomic_set(&prof->code_time, prof->code_time + profile_getclock() - ti);
     qatomic_set(&prof->code_in_len, prof->code_in_len + tb->size);
@@ -1595,8 +2015,8 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
 #endif
 
     qatomic_set(&tcg_ctx->code_gen_ptr, (void *)
-        ROUND_UP((uintptr_t)gen_code_buf + gen_code_size + search_size,
-                 CODE_GEN_ALIGN));
+        ROUND_UP((uintptr_t)gen_code_buf + gen_code_size + search_size +
+                 copy_size, CODE_GEN_ALIGN));
 
     /* init jump list */
     qemu_spin_init(&tb->jmp_lock);
@@ -1655,6 +2075,32 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     return tb;
 }
 
+/* Called with mmap_lock held for user mode emulation.  */
+TranslationBlock *tb_gen_code(CPUState *cpu,
+                              target_ulong pc, target_ulong cs_base,
+                              uint32_t flags, int cflags)
+{
+    return do_tb_gen_code(cpu, pc, cs_base, flags, cflags, NULL);
+}
+
+/*
+ * Replace the cold @tb, which the execution loop found to be hot, with
+ * an optimized translation for the same key.  Called with mmap_lock
+ * held for user mode emulation.
+ */
+TranslationBlock *tb_tier_up(CPUState *cpu, TranslationBlock *tb,
+                             target_ulong pc, target_ulong cs_base,
+                             uint32_t flags, int cflags)
+{
+    TranslationBlock *new_tb;
+
+    tb_phys_invalidate(tb, -1);
+    qatomic_inc(&tb_ctx.tb_tier_up_count);
+    new_tb = do_tb_gen_code(cpu, pc, cs_base, flags, cflags, tb);
+    tb_profile_record(new_tb, tb->exit_count);
+    return new_tb;
+}
+
 /*
  * @p must be non-NULL.
  * user-mode: call with mmap_lock held.
@@ -1836,7 +2282,7 @@ void tb_invalidate_phys_page_fast(struct page_collection *pages,
         unsigned long b;
 
         nr = start & ~TARGET_PAGE_MASK;
-        b = p->code_bitmap[BIT_WORD(nr)] >> (nr & (BITS_PER_LONG - 1));
+        b = p->code_bitmap->map[BIT_WORD(nr)] >> (nr & (BITS_PER_LONG - 1));
         if (b & ((1 << len) - 1)) {
             goto do_invalidate;
         }
@@ -1846,6 +2292,37 @@ void tb_invalidate_phys_page_fast(struct page_collection *pages,
                                               retaddr);
     }
 }
+
+/*
+ * Return whether a write of @len bytes at @start, with the same
+ * constraints as for tb_invalidate_phys_page_fast(), must go through it.
+ * It need not if the code bitmap of the page shows that the write
+ * misses all of its TBs.  This takes no lock: the bitmap is read under
+ * RCU, and a TB being added to the page concurrently races with the
+ * write exactly as it would if the page lock were taken here, since the
+ * TB was translated from guest memory without it.
+ */
+bool tb_page_write_needs_invalidate(tb_page_addr_t start, int len)
+{
+    PageDesc *p = page_find(start >> TARGET_PAGE_BITS);
+    CodeBitmap *bitmap;
+    unsigned int nr;
+    unsigned long b;
+
+    if (!p) {
+        return false;
+    }
+
+    RCU_READ_LOCK_GUARD();
+    bitmap = qatomic_rcu_read(&p->code_bitmap);
+    if (!bitmap) {
+        return true;
+    }
+    nr = start & ~TARGET_PAGE_MASK;
+    b = qatomic_read(&bitmap->map[BIT_WORD(nr)]) >>
+        (nr & (BITS_PER_LONG - 1));
+    return b & ((1 << len) - 1);
+}
 #else
 /* Called with mmap_lock held. If pc is not 0 then it indicates the
  * host PC of the faulting store instruction that caused this invalidate.
@@ -2109,13 +2586,47 @@ void dump_exec_info(GString *buf)
     g_string_append_printf(buf, "\nStatistics:\n");
     g_string_append_printf(buf, "TB flush count      %u\n",
                            qatomic_read(&tb_ctx.tb_flush_count));
+    g_string_append_printf(buf, "TB flush pause      %0.3f ms "
+                           "(max %0.3f ms)\n",
+                           qatomic_read_u64(&tb_ctx.tb_flush_ns) / 1e6,
+                           qatomic_read_u64(&tb_ctx.tb_flush_max_ns) / 1e6);
+    if (tcg_region_reclaim) {
+        g_string_append_printf(buf, "code reclaim count  %u "
+                               "(%u regions, %u TBs)\n",
+                               qatomic_read(&tb_ctx.tb_reclaim_count),
+                               qatomic_read(&tb_ctx.tb_reclaim_regions),
+                               qatomic_read(&tb_ctx.tb_reclaim_tbs));
+        g_string_append_printf(buf, "code reclaim pause  %0.3f ms "
+                               "(max %0.3f ms)\n",
+                               qatomic_read_u64(&tb_ctx.tb_reclaim_ns) / 1e6,
+                               qatomic_read_u64(&tb_ctx.tb_reclaim_max_ns) /
+                               1e6);
+    }
     g_string_append_printf(buf, "TB invalidate count %u\n",
                            qatomic_read(&tb_ctx.tb_phys_invalidate_count));
+    if (tb_reuse_enabled) {
+        g_string_append_printf(buf, "TB reuse count      %u (%u retired)\n",
+                               qatomic_read(&tb_ctx.tb_reuse_count),
+                               qatomic_read(&tb_ctx.tb_retire_count));
+    }
+    if (tcg_tier_threshold) {
+        g_string_append_printf(buf, "TB tier-up count    %u\n",
+                               qatomic_read(&tb_ctx.tb_tier_up_count));
+    }
+    if (qatomic_read(&tb_ctx.tb_profile_hit_count)) {
+        g_string_append_printf(buf, "TB tb-profile hits  %u\n",
+                               qatomic_read(&tb_ctx.tb_profile_hit_count));
+    }
+    if (tcg_tier_threshold && tb_superblocks_enabled) {
+        g_string_append_printf(buf, "TB trace branches   %u\n",
+                               qatomic_read(&tb_ctx.tb_trace_branch_count));
+    }
 
     tlb_flush_counts(&flush_full, &flush_part, &flush_elide);
     g_string_append_printf(buf, "TLB full flushes    %zu\n", flush_full);
     g_string_append_printf(buf, "TLB partial flushes %zu\n", flush_part);
     g_string_append_printf(buf, "TLB elided flushes  %zu\n", flush_elide);
+    tlb_dump_mmu_stats(buf);
     tcg_dump_info(buf);
 }
 
@@ -17,6 +17,8 @@
 #include "exec/translator.h"
 #include "exec/plugin-gen.h"
 #include "sysemu/replay.h"
+#include "tb-context.h"
+#include "internal.h"
 
 /* Pairs with tcg_clear_temp_count.
    To be called by #TranslatorOps.{translate_insn,tb_stop} if
@@ -42,6 +44,69 @@ bool translator_use_goto_tb(DisasContextBase *db, target_ulong dest)
     return ((db->pc_first ^ dest) & TARGET_PAGE_MASK) == 0;
 }
 
+/* Followed side of a conditional branch, in quarters of its exits */
+#define TRACE_BIAS_QUARTERS 3
+
+/* Backward branches a superblock follows, i.e. times it unrolls a loop */
+#define TRACE_MAX_BACKWARD 3
+
+TraceBranch translator_trace_branch(DisasContextBase *db, target_ulong dest,
+                                    bool conditional, int taken_exit)
+{
+    const TranslationBlock *tb = db->tb;
+    uint64_t taken, fallthrough, total;
+    bool follow;
+
+    if (!db->trace || db->singlestep_enabled ||
+        db->num_insns >= db->max_insns) {
+        return TRACE_END;
+    }
+    /* Loop heads before pc_first would lower the start of the guest code */
+    follow = dest >= db->pc_first &&
+             ((db->pc_first ^ dest) & TARGET_PAGE_MASK) == 0 &&
+             (dest >= db->pc_next || db->num_backward < TRACE_MAX_BACKWARD);
+    if (!conditional) {
+        if (!follow) {
+            return TRACE_END;
+        }
+        goto take;
+    }
+
+    /* The exit counts of the current block's own TB tell the bias */
+    if (db->block_pc != db->pc_first) {
+        tb = tb_htable_lookup(tcg_ctx->cpu, db->block_pc, tb->cs_base,
+                              tb->flags, tb_cflags(tb));
+        if (tb == NULL) {
+            return TRACE_END;
+        }
+    }
+    taken = qatomic_read(&tb->exit_count[taken_exit]);
+    fallthrough = qatomic_read(&tb->exit_count[!taken_exit]);
+    total = taken + fallthrough;
+    if (total == 0) {
+        return TRACE_END;
+    }
+    if (follow && taken * 4 >= total * TRACE_BIAS_QUARTERS) {
+        goto take;
+    }
+    if (fallthrough * 4 >= total * TRACE_BIAS_QUARTERS) {
+        qatomic_inc(&tb_ctx.tb_trace_branch_count);
+        db->block_pc = db->pc_next;
+        return TRACE_FALLTHROUGH;
+    }
+    return TRACE_END;
+
+ take:
+    if (dest < db->pc_next) {
+        /* Translating the loop again; keep the end of the guest code */
+        db->pc_max = MAX(db->pc_max, db->pc_next);
+        db->num_backward++;
+    }
+    qatomic_inc(&tb_ctx.tb_trace_branch_count);
+    db->block_pc = dest;
+    return TRACE_TAKEN;
+}
+
 static inline void translator_page_protect(DisasContextBase *dcbase,
                                            target_ulong pc)
 {
@@ -51,6 +116,45 @@ static inline void translator_page_protect(DisasContextBase *dcbase,
 #endif
 }
 
+/*
+ * Count the executions of @tb, the way a plugin inline counter does:
+ * a plain load, add and store, which may lose counts to other vCPUs.
+ */
+static void gen_tb_count(TranslationBlock *tb)
+{
+    TCGv_i64 val = tcg_temp_new_i64();
+    TCGv_ptr ptr = tcg_const_ptr(&tb->run_count);
+
+    tcg_gen_ld_i64(val, ptr, 0);
+    tcg_gen_addi_i64(val, val, 1);
+    tcg_gen_st_i64(val, ptr, 0);
+    tcg_temp_free_ptr(ptr);
+    tcg_temp_free_i64(val);
+}
+
+/*
+ * Count the executions of the cold @tb the same way, and leave it with
+ * TB_EXIT_TIER_UP once it has run tcg_tier_threshold times, so that
+ * the execution loop replaces it even when it is only entered through
+ * chained jumps.  The count is racy between vCPUs; it only decides when
+ * to leave, and cpu_exec_tier_up() copes with it having moved since.
+ */
+static void gen_tb_tier_count(TranslationBlock *tb)
+{
+    TCGv_i32 val = tcg_temp_new_i32();
+    TCGv_ptr ptr = tcg_const_ptr(&tb->exec_count);
+    TCGLabel *l = gen_new_label();
+
+    tcg_gen_ld_i32(val, ptr, 0);
+    tcg_gen_addi_i32(val, val, 1);
+    tcg_gen_st_i32(val, ptr, 0);
+    tcg_gen_brcondi_i32(TCG_COND_LTU, val, tcg_tier_threshold, l);
+    tcg_gen_exit_tb(tb, TB_EXIT_TIER_UP);
+    gen_set_label(l);
+    tcg_temp_free_ptr(ptr);
+    tcg_temp_free_i32(val);
+}
+
 void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
                      CPUState *cpu, TranslationBlock *tb, int max_insns)
 {
@@ -65,6 +169,10 @@ void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
     db->num_insns = 0;
     db->max_insns = max_insns;
     db->singlestep_enabled = cflags & CF_SINGLE_STEP;
+    db->trace = false;
+    db->block_pc = db->pc_first;
+    db->pc_max = db->pc_first;
+    db->num_backward = 0;
     translator_page_protect(db, db->pc_next);
 
     ops->init_disas_context(db, cpu);
@@ -74,12 +182,27 @@ void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
     tcg_clear_temp_count();
 
     /* Start translating.  */
+    if (tcg_ctx->tb_cold) {
+        /* Before gen_tb_start() charges the icount budget for the TB */
+        gen_tb_tier_count(tb);
+    }
     gen_tb_start(db->tb);
+    if (tcg_ctx->tb_counted) {
+        /* After the exit request check, so that only real runs count */
+        gen_tb_count(tb);
+    }
     ops->tb_start(db, cpu);
     tcg_debug_assert(db->is_jmp == DISAS_NEXT);  /* no early exit */
 
     plugin_enabled = plugin_gen_tb_start(cpu, tb, cflags & CF_MEMI_ONLY);
 
+    /*
+     * Plugins see instructions in program order, and icount charges the
+     * whole TB on entry; no superblocks for either.
+     */
+    db->trace = tcg_ctx->tb_trace && !plugin_enabled &&
+                !(cflags & CF_USE_ICOUNT);
+
     while (true) {
         db->num_insns++;
         ops->insn_start(db, cpu);
@@ -133,7 +256,7 @@ void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
     }
 
     /* The disas_log hook may use these values rather than recompute.  */
-    tb->size = db->pc_next - db->pc_first;
+    tb->size = MAX(db->pc_max, db->pc_next) - db->pc_first;
     tb->icount = db->num_insns;
 
 #ifdef DEBUG_DISAS
@@ -467,8 +467,27 @@ uint64_t cpu_ldq_code(CPUArchState *env, abi_ptr ptr)
 
 #include "ldst_common.c.inc"
 
+size_t cpu_memset_mmuidx_ra(CPUArchState *env, abi_ptr addr, uint8_t val,
+                            size_t len, int mmu_idx, uintptr_t ra)
+{
+    set_helper_retaddr(ra);
+    memset(g2h(env_cpu(env), addr), val, len);
+    clear_helper_retaddr();
+    return len;
+}
+
+size_t cpu_memcpy_mmuidx_ra(CPUArchState *env, abi_ptr dst, abi_ptr src,
+                            size_t len, int mmu_idx, uintptr_t ra)
+{
+    set_helper_retaddr(ra);
+    copy_forward(g2h(env_cpu(env), dst), g2h(env_cpu(env), src), len);
+    clear_helper_retaddr();
+    return len;
+}
+
 /*
- * Do not allow unaligned operations to proceed.  Return the host address.
+ * Do not allow unaligned operations to proceed, unless the atomic helpers
+ * can widen them.  Return the host address.
  *
  * @prot may be PAGE_READ, PAGE_WRITE, or PAGE_READ|PAGE_WRITE.
  */
@@ -487,7 +506,7 @@ static void *atomic_mmu_lookup(CPUArchState *env, target_ulong addr,
     }
 
     /* Enforce qemu required alignment.  */
-    if (unlikely(addr & (size - 1))) {
+    if (unlikely(addr & (size - 1)) && !atomic_can_widen(addr, size)) {
         cpu_loop_exit_atomic(env_cpu(env), retaddr);
     }
 
@@ -320,6 +320,11 @@ int cpu_breakpoint_insert(CPUState *cpu, vaddr pc, int flags,
         *breakpoint = bp;
     }
 
+    /* Predicted indirect branches skip the breakpoint check */
+    if (tcg_enabled()) {
+        cpu_tb_jmp_cache_clear(cpu);
+    }
+
     trace_breakpoint_insert(cpu->cpu_index, pc, flags);
     return 0;
 }
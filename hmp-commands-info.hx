@@ -256,15 +256,20 @@ ERST
 #if defined(CONFIG_TCG)
     {
         .name       = "jit",
-        .args_type  = "",
-        .params     = "",
-        .help       = "show dynamic compiler info",
+        .args_type  = "report:s?,count:i?",
+        .params     = "[hot [count]]",
+        .help       = "show dynamic compiler info, or with 'hot' the "
+                      "translation blocks that ran the most",
     },
 #endif
 
 SRST
-  ``info jit``
-    Show dynamic compiler info.
+  ``info jit`` [``hot`` [*count*]]
+    Show dynamic compiler info. With ``hot``, list the *count*
+    translation blocks (default 10) that were entered the most and those
+    that ran the most host code, with their guest pc, their numbers of
+    guest instructions and bytes, and the ratio of host code bytes to
+    guest code bytes. This needs ``-accel tcg,tb-counters=on``.
 ERST
 
 #if defined(CONFIG_TCG)
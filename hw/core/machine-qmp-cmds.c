@@ -74,6 +74,32 @@ CpuInfoFastList *qmp_query_cpus_fast(Error **errp)
     return head;
 }
 
+VcpuExecStatsList *qmp_x_query_vcpu_stats(Error **errp)
+{
+    VcpuExecStatsList *head = NULL, **tail = &head;
+    CPUState *cpu;
+
+    CPU_FOREACH(cpu) {
+        VcpuExecStats *value = g_new0(VcpuExecStats, 1);
+        CPUExecStats *stats = &cpu->exec_stats;
+
+        value->cpu_index = cpu->cpu_index;
+        value->tbs = qatomic_read_u64(&stats->tbs);
+        value->insns = qatomic_read_u64(&stats->insns);
+        value->exec_ns = qatomic_read_u64(&stats->exec_ns);
+        value->translate_ns = qatomic_read_u64(&stats->translate_ns);
+        value->bql_wait_ns = qatomic_read_u64(&stats->bql_wait_ns);
+        value->halted_ns = qatomic_read_u64(&stats->halted_ns);
+        value->jmp_cache_hits = qatomic_read_u64(&stats->jmp_cache_hits);
+        value->jmp_cache_misses = qatomic_read_u64(&stats->jmp_cache_misses);
+        value->jmp_cache_conflicts =
+            qatomic_read_u64(&stats->jmp_cache_conflicts);
+        QAPI_LIST_APPEND(tail, value);
+    }
+
+    return head;
+}
+
 MachineInfoList *qmp_query_machines(Error **errp)
 {
     GSList *el, *machines = object_class_get_list(TYPE_MACHINE, false);
@@ -9,10 +9,12 @@
 
 #include "qemu/osdep.h"
 #include "hw/i2c/i2c.h"
+#include "hw/i2c/i2c-fault.h"
 #include "hw/qdev-properties.h"
 #include "migration/vmstate.h"
 #include "qapi/error.h"
 #include "qemu/module.h"
+#include "qemu/timer.h"
 #include "trace.h"
 
 #include "../../mydebug.hpp"
@@ -76,6 +78,7 @@ I2CBus *i2c_init_bus(DeviceState *parent, const char *name)
         sprintf(buf, "Init I2C Bus #%d, name=%s", serial, name);
         AddLogEntry(buf);
         bus->has_serial_ = true;
+        i2c_fault_register_bus(bus);
     } else {
         sprintf(buf, "I2C Bus #%d re-inited", bus->serial_);
         AddLogEntry(buf);
@@ -119,6 +122,52 @@ bool i2c_scan_bus(I2CBus *bus, uint8_t address, bool broadcast,
     return broadcast;
 }
 
+/*
+ * Transaction timing for the debug buddy: a transaction runs from the
+ * start condition that selected the slaves to i2c_end_transfer(), so
+ * repeated starts (e.g. the SMBus write-then-read) stay part of it.
+ */
+static void i2c_debug_tx_begin(I2CBus *bus, uint8_t address, bool is_recv,
+                               bool new_transaction)
+{
+    if (!IsBuddyStarted()) {
+        return;
+    }
+    if (new_transaction || !bus->dbg_tx_active) {
+        bus->dbg_tx_active = true;
+        bus->dbg_tx_nack = false;
+        bus->dbg_tx_read_bytes = 0;
+        bus->dbg_tx_write_bytes = 0;
+        bus->dbg_tx_start_ns = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    }
+    bus->dbg_tx_addr = address;
+    bus->dbg_tx_recv = is_recv;
+}
+
+/* Forget the selected slaves without sending them I2C_FINISH */
+static void i2c_release_devs(I2CBus *bus)
+{
+    I2CNode *node, *next;
+
+    QLIST_FOREACH_SAFE(node, &bus->current_devs, next, next) {
+        QLIST_REMOVE(node, next);
+        g_free(node);
+    }
+    bus->broadcast = false;
+}
+
+static void i2c_debug_tx_finish(I2CBus *bus)
+{
+    if (!bus->dbg_tx_active) {
+        return;
+    }
+    bus->dbg_tx_active = false;
+    OnI2CTransactionDone(bus->serial_, bus->dbg_tx_addr, bus->dbg_tx_recv,
+                         bus->dbg_tx_nack, bus->dbg_tx_read_bytes,
+                         bus->dbg_tx_write_bytes, bus->dbg_tx_start_ns,
+                         qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL));
+}
+
 /* TODO: Make this handle multiple masters.  */
 /*
  * Start or continue an i2c transaction.  When this is called for the
@@ -138,14 +187,12 @@ bool i2c_scan_bus(I2CBus *bus, uint8_t address, bool broadcast,
 static int i2c_do_start_transfer(I2CBus *bus, uint8_t address,
                                  enum i2c_event event)
 {
-    char x[100], busname[100], is_inject = false;
-    sprintf(busname, "i2c_bus_%d", bus->serial_);
-    OnI2CTransactionStart(busname, &is_inject);
-
     I2CSlaveClass *sc;
     I2CNode *node;
     bool bus_scanned = false;
 
+    OnI2CTransactionStart(bus->serial_);
+
     if (address == I2C_BROADCAST) {
         /*
          * This is a broadcast, the current_devs will be all the devices of the
@@ -168,10 +215,32 @@ static int i2c_do_start_transfer(I2CBus *bus, uint8_t address,
         bus_scanned = true;
     }
 
+    i2c_debug_tx_begin(bus, address, event == I2C_START_RECV, bus_scanned);
+
     if (QLIST_EMPTY(&bus->current_devs)) {
+        /* Address NACK, the transaction never started */
+        bus->dbg_tx_nack = true;
+        i2c_debug_tx_finish(bus);
         return 1;
     }
 
+    if (bus_scanned) {
+        /* Slaves behind a mux sit on the mux channel's bus */
+        DeviceState *first = DEVICE(QLIST_FIRST(&bus->current_devs)->elt);
+
+        i2c_fault_start_transfer(bus, I2C_BUS(qdev_get_parent_bus(first)),
+                                 address);
+        if (bus->fault_active &&
+            (bus->fault_action == I2C_FAULT_ACTION_NACK ||
+             bus->fault_action == I2C_FAULT_ACTION_ARBITRATION_LOST)) {
+            /* The slaves never see the start condition */
+            i2c_release_devs(bus);
+            bus->dbg_tx_nack = true;
+            i2c_debug_tx_finish(bus);
+            return 1;
+        }
+    }
+
     QLIST_FOREACH(node, &bus->current_devs, next) {
         I2CSlave *s = node->elt;
         int rv;
@@ -181,36 +250,19 @@ static int i2c_do_start_transfer(I2CBus *bus, uint8_t address,
            start condition.  */
 
         if (sc->event) {
-
-            if (is_inject) {
-                sprintf(x, "Injected NACK to i2c-%d", bus->serial_);
-                AddLogEntry(x);
-                i2c_nack(bus);
-                return 0;
-            }
-
             trace_i2c_event("start", s->address);
             rv = sc->event(s, event);
             if (rv && !bus->broadcast) {
+                bus->dbg_tx_nack = true;
                 if (bus_scanned) {
                     /* First call, terminate the transfer. */
                     i2c_end_transfer(bus);
                 }
-
-                OnI2CTransactionEnd(busname);
                 return rv;
             }
         }
     }
 
-    if (is_inject) {
-        sprintf(x, "Injected NACK to i2c-%d", bus->serial_);
-        AddLogEntry(x);
-        i2c_nack(bus);
-        return 0;
-    }
-
-    OnI2CTransactionEnd(busname);
     return 0;
 }
 
@@ -247,6 +299,8 @@ void i2c_end_transfer(I2CBus *bus)
         g_free(node);
     }
     bus->broadcast = false;
+    bus->fault_active = false;
+    i2c_debug_tx_finish(bus);
 }
 
 int i2c_send(I2CBus *bus, uint8_t data)
@@ -256,6 +310,10 @@ int i2c_send(I2CBus *bus, uint8_t data)
     I2CNode *node;
     int ret = 0;
 
+    OnI2CWrite(bus->serial_);
+    if (bus->fault_active && bus->fault_action == I2C_FAULT_ACTION_BIT_FLIP) {
+        data ^= bus->fault_mask;
+    }
     QLIST_FOREACH(node, &bus->current_devs, next) {
         s = node->elt;
         sc = I2C_SLAVE_GET_CLASS(s);
@@ -266,6 +324,10 @@ int i2c_send(I2CBus *bus, uint8_t data)
             ret = -1;
         }
     }
+    bus->dbg_tx_write_bytes++;
+    if (ret) {
+        bus->dbg_tx_nack = true;
+    }
 
     return ret ? -1 : 0;
 }
@@ -276,11 +338,17 @@ uint8_t i2c_recv(I2CBus *bus)
     I2CSlaveClass *sc;
     I2CSlave *s;
 
+    OnI2CRead(bus->serial_);
+    bus->dbg_tx_read_bytes++;
     if (!QLIST_EMPTY(&bus->current_devs) && !bus->broadcast) {
         sc = I2C_SLAVE_GET_CLASS(QLIST_FIRST(&bus->current_devs)->elt);
         if (sc->recv) {
             s = QLIST_FIRST(&bus->current_devs)->elt;
             data = sc->recv(s);
+            if (bus->fault_active &&
+                bus->fault_action == I2C_FAULT_ACTION_BIT_FLIP) {
+                data ^= bus->fault_mask;
+            }
             trace_i2c_recv(s->address, data);
         }
     }
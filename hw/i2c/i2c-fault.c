@@ -0,0 +1,377 @@
+/*
+ * I2C/SMBus fault injection
+ *
+ * Rules are installed over QMP (x-i2c-fault-add) and evaluated once per
+ * bus transaction, when i2c_do_start_transfer() has selected the slaves.
+ * A rule names a bus (or any), a 7-bit address (or any), the first
+ * matching transaction it may fire on, how many times it fires, a
+ * probability and a QEMU_CLOCK_VIRTUAL window.
+ *
+ * Rules are kept in a hash table keyed by (bus serial, address) where
+ * either half may be the wildcard, so a transaction looks at no more than
+ * six buckets (four without a mux).  A rule leaves its bucket as soon as
+ * it can no longer fire, because its count is used up or its window has
+ * passed, so the buckets only hold rules that are live or not due yet;
+ * x-query-i2c-faults still lists it until it is removed.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "hw/i2c/i2c.h"
+#include "hw/i2c/i2c-fault.h"
+#include "qapi/error.h"
+#include "qapi/qapi-commands-i2c.h"
+#include "qapi/qapi-visit-i2c.h"
+#include "qapi/clone-visitor.h"
+#include "qemu/atomic.h"
+#include "qemu/main-loop.h"
+#include "qemu/queue.h"
+#include "qemu/timer.h"
+#include "trace.h"
+
+#include "../../mydebug.hpp"
+
+#define I2C_FAULT_ANY (-1)
+#define I2C_FAULT_DEFAULT_DELAY_NS (1 * SCALE_MS)
+
+typedef struct I2CFaultEntry {
+    I2CFaultRule *info;
+    int serial;             /* I2CBus::serial_ or I2C_FAULT_ANY */
+    int address;            /* 7-bit address or I2C_FAULT_ANY */
+    uint64_t rng;           /* xorshift64* state for info->probability */
+    bool linked;            /* still in its bucket, i.e. may fire again */
+    QTAILQ_ENTRY(I2CFaultEntry) bucket_next;
+    QTAILQ_ENTRY(I2CFaultEntry) next;
+} I2CFaultEntry;
+
+typedef QTAILQ_HEAD(, I2CFaultEntry) I2CFaultList;
+
+/* All of this is protected by the BQL */
+static GHashTable *i2c_fault_buckets;   /* key -> I2CFaultList * */
+static I2CFaultList i2c_fault_rules = QTAILQ_HEAD_INITIALIZER(i2c_fault_rules);
+static unsigned i2c_fault_nr_linked;    /* rules still in a bucket */
+static int64_t i2c_fault_next_id = 1;
+static I2CBus *i2c_fault_buses[I2C_FAULT_MAX_BUSES];
+
+/* Live rules per bus serial; read without the BQL by the debug buddy */
+static int i2c_fault_armed[I2C_FAULT_MAX_BUSES];
+
+static gpointer i2c_fault_key(int serial, int address)
+{
+    return GINT_TO_POINTER(((serial + 1) << 8) | (address + 1));
+}
+
+void i2c_fault_register_bus(I2CBus *bus)
+{
+    if (bus->serial_ >= 0 && bus->serial_ < I2C_FAULT_MAX_BUSES) {
+        i2c_fault_buses[bus->serial_] = bus;
+    }
+}
+
+static bool i2c_fault_live(I2CFaultEntry *e)
+{
+    return e->info->count == 0 || e->info->fired < e->info->count;
+}
+
+static void i2c_fault_arm(I2CFaultEntry *e, int delta)
+{
+    if (e->serial >= 0 && e->serial < I2C_FAULT_MAX_BUSES) {
+        qatomic_set(&i2c_fault_armed[e->serial],
+                    i2c_fault_armed[e->serial] + delta);
+    }
+}
+
+/* Take @e out of @list, its bucket; the caller drops the bucket if empty */
+static void i2c_fault_unlink(I2CFaultList *list, I2CFaultEntry *e)
+{
+    QTAILQ_REMOVE(list, e, bucket_next);
+    e->linked = false;
+    i2c_fault_nr_linked--;
+    i2c_fault_arm(e, -1);
+}
+
+static bool i2c_fault_roll(I2CFaultEntry *e)
+{
+    double p = e->info->probability;
+
+    if (p >= 1.0) {
+        return true;
+    }
+    e->rng ^= e->rng >> 12;
+    e->rng ^= e->rng << 25;
+    e->rng ^= e->rng >> 27;
+    return ((e->rng * 0x2545f4914f6cdd1dULL) >> 11) * 0x1.0p-53 < p;
+}
+
+/*
+ * Walk one bucket. Every rule whose window covers @now counts the
+ * transaction; the first one that is due and wins its roll is returned
+ * unless an earlier bucket already produced a hit.  Rules that are used
+ * up or whose window has ended are unlinked on the way.
+ */
+static I2CFaultEntry *i2c_fault_scan(int serial, int address, int64_t now,
+                                     I2CFaultEntry *hit)
+{
+    gpointer key = i2c_fault_key(serial, address);
+    I2CFaultList *list;
+    I2CFaultEntry *e, *next;
+
+    list = g_hash_table_lookup(i2c_fault_buckets, key);
+    if (!list) {
+        return hit;
+    }
+    QTAILQ_FOREACH_SAFE(e, list, bucket_next, next) {
+        I2CFaultRule *r = e->info;
+
+        if (r->has_end_ns && now >= r->end_ns) {
+            i2c_fault_unlink(list, e);
+            continue;
+        }
+        if (now < r->start_ns) {
+            continue;
+        }
+        r->matched++;
+        if (hit || r->matched < r->nth || !i2c_fault_roll(e)) {
+            continue;
+        }
+        r->fired++;
+        if (!i2c_fault_live(e)) {
+            i2c_fault_unlink(list, e);
+        }
+        hit = e;
+    }
+    if (QTAILQ_EMPTY(list)) {
+        g_hash_table_remove(i2c_fault_buckets, key);
+    }
+    return hit;
+}
+
+void i2c_fault_start_transfer(I2CBus *bus, I2CBus *dev_bus, uint8_t address)
+{
+    I2CFaultEntry *hit = NULL;
+    int64_t now;
+    char buf[100];
+
+    bus->fault_active = false;
+    if (!i2c_fault_nr_linked) {
+        return;
+    }
+
+    now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    hit = i2c_fault_scan(dev_bus->serial_, address, now, hit);
+    hit = i2c_fault_scan(dev_bus->serial_, I2C_FAULT_ANY, now, hit);
+    if (dev_bus != bus) {
+        hit = i2c_fault_scan(bus->serial_, address, now, hit);
+        hit = i2c_fault_scan(bus->serial_, I2C_FAULT_ANY, now, hit);
+    }
+    hit = i2c_fault_scan(I2C_FAULT_ANY, address, now, hit);
+    hit = i2c_fault_scan(I2C_FAULT_ANY, I2C_FAULT_ANY, now, hit);
+    if (!hit) {
+        return;
+    }
+
+    bus->fault_active = true;
+    bus->fault_action = hit->info->action;
+    bus->fault_mask = hit->info->mask;
+    bus->fault_delay_ns = hit->info->delay_ns;
+    trace_i2c_fault_inject(hit->info->id, dev_bus->serial_, address,
+                           I2CFaultAction_str(hit->info->action));
+    snprintf(buf, sizeof(buf), "Injected %s to i2c-%d addr 0x%02x (rule %"
+             PRId64 ")", I2CFaultAction_str(hit->info->action),
+             dev_bus->serial_, address, hit->info->id);
+    AddLogEntry(buf);
+}
+
+static I2CFaultEntry *i2c_fault_insert(I2CFaultRule *info, int serial)
+{
+    I2CFaultEntry *e = g_new0(I2CFaultEntry, 1);
+    gpointer key;
+    I2CFaultList *list;
+
+    e->info = info;
+    e->serial = serial;
+    e->address = info->has_address ? info->address : I2C_FAULT_ANY;
+    /* xorshift64* must not start from 0 */
+    e->rng = info->seed * 0x9e3779b97f4a7c15ULL ?: 1;
+
+    if (!i2c_fault_buckets) {
+        i2c_fault_buckets = g_hash_table_new_full(NULL, NULL, NULL, g_free);
+    }
+    key = i2c_fault_key(e->serial, e->address);
+    list = g_hash_table_lookup(i2c_fault_buckets, key);
+    if (!list) {
+        list = g_new0(I2CFaultList, 1);
+        QTAILQ_INIT(list);
+        g_hash_table_insert(i2c_fault_buckets, key, list);
+    }
+    QTAILQ_INSERT_TAIL(list, e, bucket_next);
+    e->linked = true;
+    i2c_fault_nr_linked++;
+    QTAILQ_INSERT_TAIL(&i2c_fault_rules, e, next);
+    i2c_fault_arm(e, 1);
+    return e;
+}
+
+static void i2c_fault_delete(I2CFaultEntry *e)
+{
+    if (e->linked) {
+        gpointer key = i2c_fault_key(e->serial, e->address);
+        I2CFaultList *list = g_hash_table_lookup(i2c_fault_buckets, key);
+
+        i2c_fault_unlink(list, e);
+        if (QTAILQ_EMPTY(list)) {
+            g_hash_table_remove(i2c_fault_buckets, key);
+        }
+    }
+    QTAILQ_REMOVE(&i2c_fault_rules, e, next);
+    qapi_free_I2CFaultRule(e->info);
+    g_free(e);
+}
+
+I2CFaultRule *qmp_x_i2c_fault_add(bool has_bus, const char *bus,
+                                  bool has_address, uint8_t address,
+                                  I2CFaultAction action,
+                                  bool has_nth, uint64_t nth,
+                                  bool has_count, uint64_t count,
+                                  bool has_probability, double probability,
+                                  bool has_seed, uint64_t seed,
+                                  bool has_start_ns, int64_t start_ns,
+                                  bool has_end_ns, int64_t end_ns,
+                                  bool has_delay_ns, int64_t delay_ns,
+                                  bool has_mask, uint8_t mask, Error **errp)
+{
+    I2CFaultRule *info;
+    int serial = I2C_FAULT_ANY;
+    Object *obj = NULL;
+    I2CFaultEntry *e;
+
+    if (has_bus) {
+        bool ambiguous = false;
+
+        obj = object_resolve_path_type(bus, TYPE_I2C_BUS, &ambiguous);
+        if (!obj) {
+            error_setg(errp, "'%s' is %s I2C bus", bus,
+                       ambiguous ? "an ambiguous path for an" : "not an");
+            return NULL;
+        }
+        serial = I2C_BUS(obj)->serial_;
+        if (serial < 0 || serial >= I2C_FAULT_MAX_BUSES) {
+            error_setg(errp, "I2C bus '%s' cannot have fault rules", bus);
+            return NULL;
+        }
+    }
+    if (has_address && address > 0x7f) {
+        error_setg(errp, "address 0x%x is not a 7-bit I2C address", address);
+        return NULL;
+    }
+    if (has_probability && !(probability >= 0 && probability <= 1)) {
+        error_setg(errp, "probability must be between 0 and 1");
+        return NULL;
+    }
+    if ((has_nth && nth == 0) || (has_delay_ns && delay_ns < 0)) {
+        error_setg(errp, "nth must be at least 1 and delay-ns not negative");
+        return NULL;
+    }
+
+    info = g_new0(I2CFaultRule, 1);
+    info->id = i2c_fault_next_id++;
+    if (obj) {
+        info->has_bus = true;
+        info->bus = object_get_canonical_path(obj);
+    }
+    info->has_address = has_address;
+    info->address = address;
+    info->action = action;
+    info->nth = has_nth ? nth : 1;
+    info->count = has_count ? count : 1;
+    info->probability = has_probability ? probability : 1.0;
+    info->seed = has_seed ? seed : info->id;
+    info->start_ns = has_start_ns ? start_ns : 0;
+    info->has_end_ns = has_end_ns;
+    info->end_ns = end_ns;
+    info->delay_ns = has_delay_ns ? delay_ns : I2C_FAULT_DEFAULT_DELAY_NS;
+    info->mask = has_mask ? mask : 0x01;
+
+    e = i2c_fault_insert(info, serial);
+    return QAPI_CLONE(I2CFaultRule, e->info);
+}
+
+void qmp_x_i2c_fault_remove(int64_t id, Error **errp)
+{
+    I2CFaultEntry *e;
+
+    QTAILQ_FOREACH(e, &i2c_fault_rules, next) {
+        if (e->info->id == id) {
+            i2c_fault_delete(e);
+            return;
+        }
+    }
+    error_setg(errp, "no I2C fault rule with id %" PRId64, id);
+}
+
+void qmp_x_i2c_fault_clear(Error **errp)
+{
+    I2CFaultEntry *e, *next;
+
+    QTAILQ_FOREACH_SAFE(e, &i2c_fault_rules, next, next) {
+        i2c_fault_delete(e);
+    }
+}
+
+I2CFaultRuleList *qmp_x_query_i2c_faults(Error **errp)
+{
+    I2CFaultRuleList *head = NULL, **tail = &head;
+    I2CFaultEntry *e;
+
+    QTAILQ_FOREACH(e, &i2c_fault_rules, next) {
+        QAPI_LIST_APPEND(tail, QAPI_CLONE(I2CFaultRule, e->info));
+    }
+    return head;
+}
+
+typedef struct I2CFaultRequest {
+    int serial;
+    I2CFaultAction action;
+} I2CFaultRequest;
+
+static void i2c_fault_inject_bh(void *opaque)
+{
+    I2CFaultRequest *req = opaque;
+    I2CBus *bus = i2c_fault_buses[req->serial];
+
+    if (bus) {
+        g_autofree char *path = object_get_canonical_path(OBJECT(bus));
+        I2CFaultRule *info = qmp_x_i2c_fault_add(true, path, false, 0,
+                                                 req->action, false, 0,
+                                                 false, 0, false, 0,
+                                                 false, 0, false, 0,
+                                                 false, 0, false, 0,
+                                                 false, 0, &error_abort);
+        qapi_free_I2CFaultRule(info);
+    }
+    g_free(req);
+}
+
+void i2c_fault_inject_async(int bus_serial, const char *action)
+{
+    I2CFaultRequest *req;
+    int a = qapi_enum_parse(&I2CFaultAction_lookup, action, -1, NULL);
+
+    if (bus_serial < 0 || bus_serial >= I2C_FAULT_MAX_BUSES || a < 0) {
+        return;
+    }
+    req = g_new(I2CFaultRequest, 1);
+    req->serial = bus_serial;
+    req->action = a;
+    aio_bh_schedule_oneshot(qemu_get_aio_context(), i2c_fault_inject_bh, req);
+}
+
+int i2c_fault_bus_armed(int bus_serial)
+{
+    if (bus_serial < 0 || bus_serial >= I2C_FAULT_MAX_BUSES) {
+        return 0;
+    }
+    return qatomic_read(&i2c_fault_armed[bus_serial]);
+}
@@ -126,18 +126,13 @@ static void pca954x_write(Pca954xState *s, uint8_t data)
 
     trace_pca954x_write_bytes(data);
 
-    for (i=0; i<mc->nchans; i++) {
+    /*
+     * Count channel selects on the channel buses. Faults for slaves behind
+     * the mux are picked by i2c_do_start_transfer() on the channel bus.
+     */
+    for (i = 0; i < mc->nchans; i++) {
         if (s->bus[i]) {
-            I2CBus* bus = s->bus[i];
-            char busname[100], x[100];
-            sprintf(busname, "i2c_bus_%d", bus->serial_);
-            char is_inject = false;
-            OnI2CTransactionStart(busname, &is_inject);
-            if (is_inject) {
-                sprintf(x, "Injected NACK to i2c-%d", bus->serial_);
-                i2c_nack(bus);
-                AddLogEntry(x);
-            }
+            OnI2CTransactionStart(s->bus[i]->serial_);
         }
     }
 }
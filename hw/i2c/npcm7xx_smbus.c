@@ -17,6 +17,7 @@
 #include "qemu/osdep.h"
 
 #include "hw/i2c/npcm7xx_smbus.h"
+#include "hw/i2c/i2c-fault.h"
 #include "migration/vmstate.h"
 #include "qemu/bitops.h"
 #include "qemu/guest-random.h"
@@ -227,8 +228,7 @@ static void npcm7xx_smbus_update_irq(NPCM7xxSMBusState *s)
     }
 }
 
-void npcm7xx_smbus_nack(NPCM7xxSMBusState *s);
-void npcm7xx_smbus_nack(NPCM7xxSMBusState *s)
+static void npcm7xx_smbus_nack(NPCM7xxSMBusState *s)
 {
     s->st &= ~NPCM7XX_SMBST_SDAST;
     s->st |= NPCM7XX_SMBST_NEGACK;
@@ -366,15 +366,60 @@ static void npcm7xx_smbus_start(NPCM7xxSMBusState *s)
     npcm7xx_smbus_update_irq(s);
 }
 
+/* The addressed slave has acknowledged and released SCL. */
+static void npcm7xx_smbus_address_acked(NPCM7xxSMBusState *s)
+{
+    bool recv = s->status == NPCM7XX_SMBUS_STATUS_RECEIVING;
+
+    if (s->ctl1 & NPCM7XX_SMBCTL1_STASTRE) {
+        s->st |= NPCM7XX_SMBST_STASTR;
+        if (!recv) {
+            s->st |= NPCM7XX_SMBST_SDAST;
+        }
+    } else if (recv) {
+        s->st |= NPCM7XX_SMBST_SDAST;
+        if (NPCM7XX_SMBUS_FIFO_ENABLED(s)) {
+            npcm7xx_smbus_recv_fifo(s);
+        } else {
+            npcm7xx_smbus_recv_byte(s);
+        }
+    } else if (NPCM7XX_SMBUS_FIFO_ENABLED(s)) {
+        s->st |= NPCM7XX_SMBST_SDAST;
+        s->fif_cts |= NPCM7XX_SMBFIF_CTS_RXF_TXE;
+    }
+    npcm7xx_smbus_update_irq(s);
+}
+
+/* An injected clock stretch after the address phase has ended. */
+static void npcm7xx_smbus_stretch_done(void *opaque)
+{
+    NPCM7xxSMBusState *s = opaque;
+
+    if (s->status == NPCM7XX_SMBUS_STATUS_SENDING ||
+        s->status == NPCM7XX_SMBUS_STATUS_RECEIVING) {
+        npcm7xx_smbus_address_acked(s);
+    }
+}
+
 static void npcm7xx_smbus_send_address(NPCM7xxSMBusState *s, uint8_t value)
 {
     int recv;
     int rv;
+    int64_t stretch_ns;
 
     recv = value & BIT(0);
     rv = i2c_start_transfer(s->bus, value >> 1, recv);
     trace_npcm7xx_smbus_send_address(DEVICE(s)->canonical_path,
                                      value >> 1, recv, !rv);
+    if (rv && i2c_fault_arbitration_lost(s->bus)) {
+        /* Lost arbitration: drop out of master mode with a bus error. */
+        s->st &= ~(NPCM7XX_SMBST_MODE | NPCM7XX_SMBST_SDAST);
+        s->st |= NPCM7XX_SMBST_BER;
+        s->cst &= ~NPCM7XX_SMBCST_BUSY;
+        s->status = NPCM7XX_SMBUS_STATUS_IDLE;
+        npcm7xx_smbus_update_irq(s);
+        return;
+    }
     if (rv) {
         qemu_log_mask(LOG_GUEST_ERROR,
                       "%s: requesting i2c bus for 0x%02x failed: %d\n",
@@ -399,27 +444,21 @@ static void npcm7xx_smbus_send_address(NPCM7xxSMBusState *s, uint8_t value)
         s->st |= NPCM7XX_SMBST_XMIT;
     }
 
-    if (s->ctl1 & NPCM7XX_SMBCTL1_STASTRE) {
-        s->st |= NPCM7XX_SMBST_STASTR;
-        if (!recv) {
-            s->st |= NPCM7XX_SMBST_SDAST;
-        }
-    } else if (recv) {
-        s->st |= NPCM7XX_SMBST_SDAST;
-        if (NPCM7XX_SMBUS_FIFO_ENABLED(s)) {
-            npcm7xx_smbus_recv_fifo(s);
-        } else {
-            npcm7xx_smbus_recv_byte(s);
-        }
-    } else if (NPCM7XX_SMBUS_FIFO_ENABLED(s)) {
-        s->st |= NPCM7XX_SMBST_SDAST;
-        s->fif_cts |= NPCM7XX_SMBFIF_CTS_RXF_TXE;
+    stretch_ns = i2c_fault_take_stretch_ns(s->bus);
+    if (stretch_ns) {
+        /* The slave holds SCL low: nothing is ready until it lets go. */
+        s->st &= ~NPCM7XX_SMBST_SDAST;
+        timer_mod(&s->stretch_timer,
+                  qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + stretch_ns);
+        npcm7xx_smbus_update_irq(s);
+        return;
     }
-    npcm7xx_smbus_update_irq(s);
+    npcm7xx_smbus_address_acked(s);
 }
 
 static void npcm7xx_smbus_execute_stop(NPCM7xxSMBusState *s)
 {
+    timer_del(&s->stretch_timer);
     i2c_end_transfer(s->bus);
     s->st = 0;
     s->cst = 0;
@@ -993,6 +1032,7 @@ static void npcm7xx_smbus_enter_reset(Object *obj, ResetType type)
 {
     NPCM7xxSMBusState *s = NPCM7XX_SMBUS(obj);
 
+    timer_del(&s->stretch_timer);
     s->st = NPCM7XX_SMB_ST_INIT_VAL;
     s->cst = NPCM7XX_SMB_CST_INIT_VAL;
     s->cst2 = NPCM7XX_SMB_CST2_INIT_VAL;
@@ -1041,8 +1081,28 @@ static void npcm7xx_smbus_init(Object *obj)
     sysbus_init_mmio(sbd, &s->iomem);
 
     s->bus = i2c_init_bus(DEVICE(s), "i2c-bus");
+    timer_init_ns(&s->stretch_timer, QEMU_CLOCK_VIRTUAL,
+                  npcm7xx_smbus_stretch_done, s);
 }
 
+static bool npcm7xx_smbus_stretch_needed(void *opaque)
+{
+    NPCM7xxSMBusState *s = opaque;
+
+    return timer_pending(&s->stretch_timer);
+}
+
+static const VMStateDescription vmstate_npcm7xx_smbus_stretch = {
+    .name = "npcm7xx-smbus/stretch",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .needed = npcm7xx_smbus_stretch_needed,
+    .fields = (VMStateField[]) {
+        VMSTATE_TIMER(stretch_timer, NPCM7xxSMBusState),
+        VMSTATE_END_OF_LIST(),
+    },
+};
+
 static const VMStateDescription vmstate_npcm7xx_smbus = {
     .name = "npcm7xx-smbus",
     .version_id = 0,
@@ -1074,6 +1134,10 @@ static const VMStateDescription vmstate_npcm7xx_smbus = {
         VMSTATE_UINT8(rx_cur, NPCM7xxSMBusState),
         VMSTATE_END_OF_LIST(),
     },
+    .subsections = (const VMStateDescription * []) {
+        &vmstate_npcm7xx_smbus_stretch,
+        NULL
+    },
 };
 
 static void npcm7xx_smbus_class_init(ObjectClass *klass, void *data)
@@ -29,6 +29,8 @@
 #include "qemu/units.h"
 #include "trace.h"
 
+#include "../../mydebug.hpp"
+
 /* 32-bit register indices. */
 enum NPCM7xxTimerRegisters {
     NPCM7XX_TIMER_TCSR0,
@@ -187,6 +189,24 @@ static void npcm7xx_watchdog_timer_reset(NPCM7xxWatchdogTimer *t)
     npcm7xx_watchdog_timer_reset_cycles(t, cycles);
 }
 
+/*
+ * Tell the debug buddy what just happened to the watchdog. The deadline is
+ * only meaningful while the watchdog is enabled.
+ */
+static void npcm7xx_watchdog_timer_notify(NPCM7xxWatchdogTimer *t, int kind)
+{
+    int64_t expires_ns = 0;
+
+    if (!IsBuddyStarted()) {
+        return;
+    }
+    if (t->wtcr & NPCM7XX_WTCR_WTE) {
+        expires_ns = t->base_timer.expires_ns;
+    }
+    OnWatchdogEvent(t->ctrl->index, kind, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL),
+                    expires_ns);
+}
+
 /*
  * Raise the interrupt line if there's a pending interrupt and interrupts are
  * enabled for this timer. If not, lower it.
@@ -351,16 +371,26 @@ static void npcm7xx_timer_write_wtcr(NPCM7xxWatchdogTimer *t, uint32_t new_wtcr)
     t->wtcr = new_wtcr;
 
     if (new_wtcr & NPCM7XX_WTCR_WTR) {
+        int kind = BUDDY_WDT_KICK;
+
         t->wtcr &= ~NPCM7XX_WTCR_WTR;
         npcm7xx_watchdog_timer_reset(t);
         if (new_wtcr & NPCM7XX_WTCR_WTE) {
             npcm7xx_timer_start(&t->base_timer);
         }
+        if (~old_wtcr & new_wtcr & NPCM7XX_WTCR_WTE) {
+            kind = BUDDY_WDT_ARM;
+        } else if (old_wtcr & ~new_wtcr & NPCM7XX_WTCR_WTE) {
+            kind = BUDDY_WDT_DISARM;
+        }
+        npcm7xx_watchdog_timer_notify(t, kind);
     } else if ((old_wtcr ^ new_wtcr) & NPCM7XX_WTCR_WTE) {
         if (new_wtcr & NPCM7XX_WTCR_WTE) {
             npcm7xx_timer_start(&t->base_timer);
+            npcm7xx_watchdog_timer_notify(t, BUDDY_WDT_ARM);
         } else {
             npcm7xx_timer_pause(&t->base_timer);
+            npcm7xx_watchdog_timer_notify(t, BUDDY_WDT_DISARM);
         }
     }
 
@@ -563,6 +593,7 @@ static void npcm7xx_timer_enter_reset(Object *obj, ResetType type)
      */
     s->watchdog_timer.wtcr = 0x00000400 | (s->watchdog_timer.wtcr &
             NPCM7XX_WTCR_WTRF);
+    npcm7xx_watchdog_timer_notify(&s->watchdog_timer, BUDDY_WDT_DEVICE_RESET);
 }
 
 static void npcm7xx_watchdog_timer_expired(void *opaque)
@@ -573,6 +604,7 @@ static void npcm7xx_watchdog_timer_expired(void *opaque)
         if (t->wtcr & NPCM7XX_WTCR_WTIF) {
             if (t->wtcr & NPCM7XX_WTCR_WTRE) {
                 t->wtcr |= NPCM7XX_WTCR_WTRF;
+                npcm7xx_watchdog_timer_notify(t, BUDDY_WDT_RESET);
                 /* send reset signal to CLK module*/
                 qemu_irq_raise(t->reset_signal);
             }
@@ -585,6 +617,7 @@ static void npcm7xx_watchdog_timer_expired(void *opaque)
             npcm7xx_watchdog_timer_reset_cycles(t,
                     NPCM7XX_WATCHDOG_INTERRUPT_TO_RESET_CYCLES);
             npcm7xx_timer_start(&t->base_timer);
+            npcm7xx_watchdog_timer_notify(t, BUDDY_WDT_EXPIRE);
         }
     }
 }
@@ -686,6 +719,11 @@ static const VMStateDescription vmstate_npcm7xx_timer_ctrl = {
     },
 };
 
+static Property npcm7xx_timer_properties[] = {
+    DEFINE_PROP_UINT32("index", NPCM7xxTimerCtrlState, index, 0),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
 static void npcm7xx_timer_class_init(ObjectClass *klass, void *data)
 {
     ResettableClass *rc = RESETTABLE_CLASS(klass);
@@ -697,6 +735,7 @@ static void npcm7xx_timer_class_init(ObjectClass *klass, void *data)
     dc->vmsd = &vmstate_npcm7xx_timer_ctrl;
     rc->phases.enter = npcm7xx_timer_enter_reset;
     rc->phases.hold = npcm7xx_timer_hold_reset;
+    device_class_set_props(dc, npcm7xx_timer_properties);
 }
 
 static const TypeInfo npcm7xx_timer_info = {
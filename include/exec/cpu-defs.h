@@ -76,8 +76,13 @@ typedef uint64_t target_ulong;
 
 #if !defined(CONFIG_USER_ONLY) && defined(CONFIG_TCG)
 
-/* use a fully associative victim tlb of 8 entries */
-#define CPU_VTLB_SIZE 8
+/*
+ * Use a fully associative victim tlb.  It starts with CPU_VTLB_MIN_SIZE
+ * entries per mmu_idx and grows along with the main tlb, up to the limit
+ * set with -accel tcg,vtlb-size (at most CPU_VTLB_MAX_SIZE).
+ */
+#define CPU_VTLB_MIN_SIZE 8
+#define CPU_VTLB_MAX_SIZE 256
 
 #if HOST_LONG_BITS == 32 && TARGET_LONG_BITS == 32
 #define CPU_TLB_ENTRY_BITS 4
@@ -170,11 +175,30 @@ typedef struct CPUTLBDesc {
     size_t n_used_entries;
     /* The next index to use in the tlb victim table.  */
     size_t vindex;
+    /* The number of entries in the tlb victim table, a power of 2.  */
+    size_t vsize;
     /* The tlb victim table, in two parts.  */
-    CPUTLBEntry vtable[CPU_VTLB_SIZE];
-    CPUIOTLBEntry viotlb[CPU_VTLB_SIZE];
+    CPUTLBEntry *vtable;
+    CPUIOTLBEntry *viotlb;
     /* The iotlb.  */
     CPUIOTLBEntry *iotlb;
+    /*
+     * A superset of the main tlb entries in use: bit N of @resident is
+     * set when entry N may be valid, and bit N of @resident_words when
+     * word N of @resident may be non-zero.  @n_resident counts the bits
+     * set in @resident.  Flushes use these to visit only live entries.
+     */
+    unsigned long *resident;
+    unsigned long *resident_words;
+    size_t n_resident;
+    /*
+     * Statistics.  Like those in CPUTLBCommon, these are only written
+     * by the owning vCPU, and read and written atomically.
+     */
+    size_t fill_count;
+    size_t prefetch_count;
+    size_t vtlb_hit_count;
+    size_t vtlb_miss_count;
 } CPUTLBDesc;
 
 /*
@@ -208,6 +232,13 @@ typedef struct CPUTLBCommon {
     size_t full_flush_count;
     size_t part_flush_count;
     size_t elide_flush_count;
+    size_t sparse_flush_count;
+    /*
+     * Writes to pages holding translated code, and how many of them
+     * had to lock the page to invalidate TBs.
+     */
+    size_t code_write_count;
+    size_t code_write_locked_count;
 } CPUTLBCommon;
 
 /*
@@ -205,6 +205,24 @@ void cpu_stl_le_mmuidx_ra(CPUArchState *env, abi_ptr ptr, uint32_t val,
 void cpu_stq_le_mmuidx_ra(CPUArchState *env, abi_ptr ptr, uint64_t val,
                           int mmu_idx, uintptr_t ra);
 
+/*
+ * Bulk stores and copies, for helpers that implement block operations.
+ * cpu_memset_mmuidx_ra() stores @len bytes of @val at @addr, and
+ * cpu_memcpy_mmuidx_ra() copies @len bytes from @src to @dst like a loop
+ * of byte moves from low to high addresses.  Each page is translated once
+ * and accessed with the host memset or memcpy; faults and watchpoints are
+ * raised as for byte accesses, and no plugin memory callbacks are made.
+ * The range must not wrap around the end of the address space.
+ *
+ * Both return the number of bytes done.  With softmmu this is less than
+ * @len if a page is not RAM, or holds translated code: the caller must
+ * then finish with the byte accessors, which handle those cases.
+ */
+size_t cpu_memset_mmuidx_ra(CPUArchState *env, abi_ptr addr, uint8_t val,
+                            size_t len, int mmu_idx, uintptr_t ra);
+size_t cpu_memcpy_mmuidx_ra(CPUArchState *env, abi_ptr dst, abi_ptr src,
+                            size_t len, int mmu_idx, uintptr_t ra);
+
 uint8_t cpu_ldb_mmu(CPUArchState *env, abi_ptr ptr, MemOpIdx oi, uintptr_t ra);
 uint16_t cpu_ldw_be_mmu(CPUArchState *env, abi_ptr ptr,
                         MemOpIdx oi, uintptr_t ra);
@@ -558,6 +558,32 @@ struct TranslationBlock {
     uintptr_t jmp_list_head;
     uintptr_t jmp_list_next[2];
     uintptr_t jmp_dest[2];
+
+    /*
+     * Copy of the guest code this TB was translated from, stored in the
+     * code buffer after the search data, for TBs that may be revived
+     * after being invalidated (see tb_revive()); NULL for other TBs.
+     */
+    const uint8_t *code_copy;
+
+    /*
+     * Cold TBs are translated without tcg_optimize() and count their
+     * executions in exec_count until they are translated again (see
+     * gen_tb_tier_count() and tb_tier_up()).  With superblocks, the
+     * cold TB's code also counts its exits through goto_tb slot n in
+     * exit_count[n]; the optimized TB inherits them to guide superblock
+     * formation.
+     */
+    bool cold;
+    uint32_t exec_count;
+    uint32_t exit_count[2];
+
+    /*
+     * With -accel tcg,tb-counters=on, the code of the TB increments
+     * run_count each time it is entered, whether from the execution
+     * loop or through a chained jump.  Racy like a plugin inline counter.
+     */
+    uint64_t run_count;
 };
 
 /* Hide the qatomic_read to make code a little easier on the eyes */
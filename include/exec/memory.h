@@ -73,6 +73,12 @@ static inline void fuzz_dma_read_cb(size_t addr,
 
 extern unsigned int global_dirty_tracking;
 
+/*
+ * DMA writes to RAM also mark DIRTY_MEMORY_DEBUG while this is set; TCG
+ * stores always do, via the notdirty path.
+ */
+extern bool debug_dirty_tracking;
+
 typedef struct MemoryRegionOps MemoryRegionOps;
 
 struct ReservedRegion {
@@ -2515,6 +2521,49 @@ MemTxResult address_space_rw(AddressSpace *as, hwaddr addr,
                              MemTxAttrs attrs, void *buf,
                              hwaddr len, bool is_write);
 
+/**
+ * address_space_read_snapshot: bulk-copy a range for inspection.
+ *
+ * Copies @len bytes starting at @addr into @buf, resolving the FlatView
+ * once and then walking it one #MemoryRegionSection at a time: RAM and
+ * ROMD sections are memcpy'd straight from their host mapping without
+ * taking the BQL.  I/O sections are dispatched (with the BQL) only if
+ * @read_io is true; otherwise they read as 0xff, as do unassigned ranges.
+ *
+ * Meant for debug viewers that snapshot large windows of guest memory
+ * every frame; guest-visible accesses should use address_space_read().
+ * The calling thread must be registered with RCU.
+ *
+ * @as: #AddressSpace to be accessed
+ * @addr: address within that address space
+ * @buf: buffer to fill
+ * @len: the number of bytes to copy
+ * @read_io: whether I/O regions may be dispatched
+ */
+MemTxResult address_space_read_snapshot(AddressSpace *as, hwaddr addr,
+                                        void *buf, hwaddr len, bool read_io);
+
+/**
+ * address_space_get_and_clear_dirty: collect dirty pages for inspection.
+ *
+ * For every target page of [@addr, @addr + @len) backed by RAM, sets the
+ * corresponding bit of @bitmap (bit 0 is the page containing @addr) if
+ * the page was written since the last call for @client, and clears the
+ * dirty state for @client so that the next write is caught again.
+ * Non-RAM pages are reported clean.  Returns the number of dirty pages.
+ *
+ * The calling thread must be registered with RCU.
+ *
+ * @as: #AddressSpace to be inspected
+ * @addr: start address, need not be page aligned
+ * @len: length of the range
+ * @client: dirty memory client, e.g. %DIRTY_MEMORY_DEBUG
+ * @bitmap: zeroed bitmap with one bit per target page in the range
+ */
+uint64_t address_space_get_and_clear_dirty(AddressSpace *as, hwaddr addr,
+                                           hwaddr len, unsigned client,
+                                           unsigned long *bitmap);
+
 /**
  * address_space_write: write to address space.
  *
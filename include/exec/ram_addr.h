@@ -240,7 +240,8 @@ static inline bool cpu_physical_memory_is_clean(ram_addr_t addr)
     bool code = cpu_physical_memory_get_dirty_flag(addr, DIRTY_MEMORY_CODE);
     bool migration =
         cpu_physical_memory_get_dirty_flag(addr, DIRTY_MEMORY_MIGRATION);
-    return !(vga && code && migration);
+    bool debug = cpu_physical_memory_get_dirty_flag(addr, DIRTY_MEMORY_DEBUG);
+    return !(vga && code && migration && debug);
 }
 
 static inline uint8_t cpu_physical_memory_range_includes_clean(ram_addr_t start,
@@ -261,6 +262,10 @@ static inline uint8_t cpu_physical_memory_range_includes_clean(ram_addr_t start,
         !cpu_physical_memory_all_dirty(start, length, DIRTY_MEMORY_MIGRATION)) {
         ret |= (1 << DIRTY_MEMORY_MIGRATION);
     }
+    if (mask & (1 << DIRTY_MEMORY_DEBUG) &&
+        !cpu_physical_memory_all_dirty(start, length, DIRTY_MEMORY_DEBUG)) {
+        ret |= (1 << DIRTY_MEMORY_DEBUG);
+    }
     return ret;
 }
 
@@ -322,6 +327,10 @@ static inline void cpu_physical_memory_set_dirty_range(ram_addr_t start,
                 bitmap_set_atomic(blocks[DIRTY_MEMORY_CODE]->blocks[idx],
                                   offset, next - page);
             }
+            if (unlikely(mask & (1 << DIRTY_MEMORY_DEBUG))) {
+                bitmap_set_atomic(blocks[DIRTY_MEMORY_DEBUG]->blocks[idx],
+                                  offset, next - page);
+            }
 
             page = next;
             idx++;
@@ -385,6 +394,11 @@ static inline void cpu_physical_memory_set_dirty_lebitmap(unsigned long *bitmap,
                         qatomic_or(&blocks[DIRTY_MEMORY_CODE][idx][offset],
                                    temp);
                     }
+
+                    if (debug_dirty_tracking) {
+                        qatomic_or(&blocks[DIRTY_MEMORY_DEBUG][idx][offset],
+                                   temp);
+                    }
                 }
 
                 if (++offset >= BITS_TO_LONGS(DIRTY_MEMORY_BLOCK_SIZE)) {
@@ -401,6 +415,9 @@ static inline void cpu_physical_memory_set_dirty_lebitmap(unsigned long *bitmap,
         if (!global_dirty_tracking) {
             clients &= ~(1 << DIRTY_MEMORY_MIGRATION);
         }
+        if (!debug_dirty_tracking) {
+            clients &= ~(1 << DIRTY_MEMORY_DEBUG);
+        }
 
         /*
          * bitmap-traveling is faster than memory-traveling (for addr...)
@@ -444,6 +461,7 @@ static inline void cpu_physical_memory_clear_dirty_range(ram_addr_t start,
     cpu_physical_memory_test_and_clear_dirty(start, length, DIRTY_MEMORY_MIGRATION);
     cpu_physical_memory_test_and_clear_dirty(start, length, DIRTY_MEMORY_VGA);
     cpu_physical_memory_test_and_clear_dirty(start, length, DIRTY_MEMORY_CODE);
+    cpu_physical_memory_test_and_clear_dirty(start, length, DIRTY_MEMORY_DEBUG);
 }
 
 
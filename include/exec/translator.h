@@ -64,6 +64,11 @@ typedef enum DisasJumpType {
  * @num_insns: Number of translated instructions (including current).
  * @max_insns: Maximum number of instructions to be translated in this TB.
  * @singlestep_enabled: "Hardware" single stepping enabled.
+ * @trace: Forming a superblock, see translator_trace_branch().
+ * @block_pc: Start of the guest block being translated within a superblock.
+ * @pc_max: End of the guest code translated before the last backward branch
+ *          the superblock followed; pc_next may be lower.
+ * @num_backward: Backward branches the superblock followed.
  *
  * Architecture-agnostic disassembly context.
  */
@@ -75,6 +80,10 @@ typedef struct DisasContextBase {
     int num_insns;
     int max_insns;
     bool singlestep_enabled;
+    bool trace;
+    target_ulong block_pc;
+    target_ulong pc_max;
+    int num_backward;
 #ifdef CONFIG_USER_ONLY
     /*
      * Guest address of the last byte of the last protected page.
@@ -156,6 +165,43 @@ void translator_loop_temp_check(DisasContextBase *db);
  */
 bool translator_use_goto_tb(DisasContextBase *db, target_ulong dest);
 
+/**
+ * TraceBranch:
+ * @TRACE_END: End the TB at the branch as usual.
+ * @TRACE_TAKEN: Continue translating at the branch target.
+ * @TRACE_FALLTHROUGH: Continue translating at db->pc_next.
+ *
+ * How a superblock continues past a direct branch.
+ */
+typedef enum TraceBranch {
+    TRACE_END,
+    TRACE_TAKEN,
+    TRACE_FALLTHROUGH,
+} TraceBranch;
+
+/**
+ * translator_trace_branch
+ * @db: Disassembly context
+ * @dest: target pc of a direct branch that would end the TB
+ * @conditional: whether the branch falls through to db->pc_next when
+ *               not taken
+ * @taken_exit: goto_tb slot the target uses for the taken side of the
+ *              branch; the fall-through uses the other one
+ *
+ * When the TB is a superblock, i.e. a hot TB translated again by
+ * tb_tier_up() with -accel tcg,superblocks=on, decide from the exit
+ * counts recorded while the current guest block was cold whether the
+ * branch ends the TB.
+ *
+ * Translation only continues within the first page and at or after
+ * db->pc_first.  A backward branch to a loop head translates the loop
+ * again, a few times at most; db->pc_max keeps the end of the guest
+ * code in the TB.  The caller emits an exit to the side not followed,
+ * without goto_tb, and moves db->pc_next to @dest for TRACE_TAKEN.
+ */
+TraceBranch translator_trace_branch(DisasContextBase *db, target_ulong dest,
+                                    bool conditional, int taken_exit);
+
 /*
  * Translator Load Functions
  *
@@ -217,14 +217,53 @@ typedef struct SavedIOTLB {
 } SavedIOTLB;
 #endif
 
+/**
+ * CPUExecStats:
+ * @tbs: Translation blocks entered from the execution loop or through an
+ *       indirect-branch lookup. Blocks reached by a direct (goto_tb)
+ *       chain are not seen, so this is a lower bound.
+ * @insns: Guest instructions of the blocks counted in @tbs.
+ * @exec_ns: Host time in the execution loop, translation and BQL waits
+ *           excluded.
+ * @translate_ns: Host time spent translating.
+ * @bql_wait_ns: Host time spent waiting for the BQL.
+ * @halted_ns: Host time spent asleep waiting for work.
+ * @jmp_cache_hits: Lookups answered by the tb_jmp_cache.
+ * @jmp_cache_misses: Lookups that fell back to the TB hash table.
+ * @jmp_cache_conflicts: Valid tb_jmp_cache entries evicted to make room.
+ *
+ * Where a vCPU thread spends its time. Only the vCPU thread writes these,
+ * with cpu_exec_stats_add(); anybody may read them with
+ * qatomic_read_u64().
+ */
+typedef struct CPUExecStats {
+    uint64_t tbs;
+    uint64_t insns;
+    uint64_t exec_ns;
+    uint64_t translate_ns;
+    uint64_t bql_wait_ns;
+    uint64_t halted_ns;
+    uint64_t jmp_cache_hits;
+    uint64_t jmp_cache_misses;
+    uint64_t jmp_cache_conflicts;
+} CPUExecStats;
+
+static inline void cpu_exec_stats_add(uint64_t *counter, uint64_t n)
+{
+    qatomic_set_u64(counter, qatomic_read_u64(counter) + n);
+}
+
 struct KVMState;
 struct kvm_run;
 
 struct hax_vcpu_state;
 struct hvf_vcpu_state;
 
-#define TB_JMP_CACHE_BITS 12
-#define TB_JMP_CACHE_SIZE (1 << TB_JMP_CACHE_BITS)
+typedef struct CPUJumpCache CPUJumpCache;
+
+/* Number of indirect-branch sites with a predicted target, per vCPU */
+#define TB_IBTC_BITS 7
+#define TB_IBTC_SIZE (1 << TB_IBTC_BITS)
 
 /* work queue */
 
@@ -304,6 +343,15 @@ struct qemu_work_item;
  *    ring is enabled.
  * @kvm_fetch_index: Keeps the index that we last fetched from the per-vCPU
  *    dirty ring structure.
+ * @exec_stats: Host time and executed block accounting.
+ * @tb_sample_pending: The debug buddy's profiler asked for the pc of the
+ *    next translation block; see accel/tcg/tb-sampler.c.
+ * @tb_epoch: Code reclaim epoch at which the vCPU entered cpu_exec(), 0
+ *    outside of it; see tb_reclaim_enter().
+ * @tb_epoch_seen: Last epoch the vCPU entered cpu_exec() at.
+ * @tb_ibtc: Last target of the indirect branches hashing to each slot,
+ *    checked inline by the generated code; see
+ *    tcg_gen_lookup_and_goto_ptr_cached().  Cleared with the tb_jmp_cache.
  *
  * State of one CPU core or thread.
  */
@@ -355,7 +403,8 @@ struct CPUState {
     IcountDecr *icount_decr_ptr;
 
     /* Accessed in parallel; all accesses must be atomic */
-    TranslationBlock *tb_jmp_cache[TB_JMP_CACHE_SIZE];
+    CPUJumpCache *tb_jmp_cache;
+    TranslationBlock *tb_ibtc[TB_IBTC_SIZE];
 
     struct GDBRegisterState *gdb_regs;
     int gdb_num_regs;
@@ -403,6 +452,11 @@ struct CPUState {
     uint32_t can_do_io;
     int32_t exception_index;
 
+    CPUExecStats exec_stats;
+    bool tb_sample_pending;
+    unsigned tb_epoch;
+    unsigned tb_epoch_seen;
+
     /* shared by kvm, hax and hvf */
     bool vcpu_dirty;
 
@@ -435,14 +489,11 @@ extern CPUTailQ cpus;
 
 extern __thread CPUState *current_cpu;
 
-static inline void cpu_tb_jmp_cache_clear(CPUState *cpu)
-{
-    unsigned int i;
-
-    for (i = 0; i < TB_JMP_CACHE_SIZE; i++) {
-        qatomic_set(&cpu->tb_jmp_cache[i], NULL);
-    }
-}
+/**
+ * cpu_tb_jmp_cache_clear:
+ * @cpu: The CPU whose translation block lookup cache to empty.
+ */
+void cpu_tb_jmp_cache_clear(CPUState *cpu);
 
 /**
  * qemu_tcg_mttcg_enabled:
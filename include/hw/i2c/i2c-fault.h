@@ -0,0 +1,73 @@
+/*
+ * I2C/SMBus fault injection
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef QEMU_I2C_FAULT_H
+#define QEMU_I2C_FAULT_H
+
+#include "hw/i2c/i2c.h"
+
+/* Bus serials beyond this cannot be targeted by fault rules */
+#define I2C_FAULT_MAX_BUSES 256
+
+/**
+ * i2c_fault_register_bus: make @bus addressable by its serial.
+ */
+void i2c_fault_register_bus(I2CBus *bus);
+
+/**
+ * i2c_fault_start_transfer: pick the fault for a new transaction.
+ *
+ * @bus: the bus the controller drives
+ * @dev_bus: the bus the addressed slave sits on; differs from @bus for
+ *           slaves behind an I2C mux
+ * @address: the 7-bit slave address
+ *
+ * Sets or clears bus->fault_active. Called with the BQL held.
+ */
+void i2c_fault_start_transfer(I2CBus *bus, I2CBus *dev_bus, uint8_t address);
+
+/**
+ * i2c_fault_arbitration_lost: whether the last start condition on @bus
+ * failed because of an injected arbitration loss.
+ *
+ * Controllers that model arbitration call this when
+ * i2c_start_transfer() fails and report a bus error instead of a NACK.
+ */
+static inline bool i2c_fault_arbitration_lost(I2CBus *bus)
+{
+    return bus->fault_active &&
+           bus->fault_action == I2C_FAULT_ACTION_ARBITRATION_LOST;
+}
+
+/**
+ * i2c_fault_take_stretch_ns: consume the injected clock stretch.
+ *
+ * Controllers that model clock stretching call this after a successful
+ * i2c_start_transfer() and hold the bus for the returned number of
+ * QEMU_CLOCK_VIRTUAL nanoseconds. Returns 0 when there is nothing to do.
+ */
+static inline int64_t i2c_fault_take_stretch_ns(I2CBus *bus)
+{
+    int64_t ns = 0;
+
+    if (bus->fault_active && bus->fault_action == I2C_FAULT_ACTION_STRETCH) {
+        ns = bus->fault_delay_ns;
+        bus->fault_delay_ns = 0;
+    }
+    return ns;
+}
+
+/*
+ * For the debug buddy, which runs in its own thread without the BQL.
+ * i2c_fault_inject_async() queues a one-shot rule for the next
+ * transaction on the bus; @action is an I2CFaultAction name such as
+ * "nack". i2c_fault_bus_armed() tells whether live rules target the bus.
+ */
+void i2c_fault_inject_async(int bus_serial, const char *action);
+int i2c_fault_bus_armed(int bus_serial);
+
+#endif
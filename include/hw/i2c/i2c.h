@@ -2,6 +2,7 @@
 #define QEMU_I2C_H
 
 #include "hw/qdev-core.h"
+#include "qapi/qapi-types-i2c.h"
 #include "qom/object.h"
 
 /* The QEMU I2C implementation only supports simple transfers that complete
@@ -78,6 +79,19 @@ struct I2CBus {
     bool broadcast;
     int serial_;
     bool has_serial_;
+    /* Debug buddy bookkeeping for the transaction in flight */
+    bool dbg_tx_active;
+    bool dbg_tx_recv;
+    bool dbg_tx_nack;
+    uint8_t dbg_tx_addr;
+    int dbg_tx_read_bytes;
+    int dbg_tx_write_bytes;
+    int64_t dbg_tx_start_ns;
+    /* Fault injected into the transaction in flight, see i2c-fault.h */
+    bool fault_active;
+    I2CFaultAction fault_action;
+    uint8_t fault_mask;
+    int64_t fault_delay_ns;
 };
 
 I2CBus *i2c_init_bus(DeviceState *parent, const char *name);
@@ -20,6 +20,7 @@
 #include "hw/i2c/i2c.h"
 #include "hw/irq.h"
 #include "hw/sysbus.h"
+#include "qemu/timer.h"
 
 /*
  * Number of addresses this module contains. Do not change this without
@@ -67,6 +68,7 @@ typedef enum NPCM7xxSMBusStatus {
  * @rx_fifo: The FIFO buffer for receiving in FIFO mode.
  * @rx_cur: The current position of rx_fifo.
  * @status: The current status of the SMBus.
+ * @stretch_timer: Ends an injected clock stretch, see hw/i2c/i2c-fault.h.
  */
 typedef struct NPCM7xxSMBusState {
     SysBusDevice parent;
@@ -104,6 +106,8 @@ typedef struct NPCM7xxSMBusState {
     uint8_t      rx_cur;
 
     NPCM7xxSMBusStatus status;
+
+    QEMUTimer    stretch_timer;
 } NPCM7xxSMBusState;
 
 #define TYPE_NPCM7XX_SMBUS "npcm7xx-smbus"
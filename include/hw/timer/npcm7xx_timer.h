@@ -99,6 +99,7 @@ struct NPCM7xxTimerCtrlState {
 
     MemoryRegion iomem;
 
+    uint32_t    index;
     uint32_t    tisr;
 
     Clock       *clock;
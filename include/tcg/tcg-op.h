@@ -830,6 +830,26 @@ void tcg_gen_goto_tb(unsigned idx);
  */
 void tcg_gen_lookup_and_goto_ptr(void);
 
+/**
+ * tcg_gen_lookup_and_goto_ptr_cached() - predicted indirect branch
+ * @site: Guest address of the branch instruction
+ * @pc: Guest address of the target TB
+ * @cs_base: cs_base of the target TB
+ * @flags: flags of the target TB
+ *
+ * As tcg_gen_lookup_and_goto_ptr(), but first check inline whether the
+ * TB last reached from a branch at @site (or one hashing to the same
+ * slot of CPUState.tb_ibtc) matches @pc, @cs_base, @flags, the cflags
+ * of the current TB and the vCPU's trace dstate, and jump to it without
+ * a helper call if so.
+ *
+ * The caller must know that @cs_base and @flags are exactly what
+ * cpu_get_tb_cpu_state() will return after the branch: a wrong guess
+ * does not merely miss, it runs a TB translated for another state.
+ */
+void tcg_gen_lookup_and_goto_ptr_cached(target_ulong site, TCGv pc,
+                                        TCGv cs_base, uint32_t flags);
+
 static inline void tcg_gen_plugin_cb_start(unsigned from, unsigned type,
                                            unsigned wr)
 {
@@ -469,6 +469,13 @@ typedef struct TCGTemp {
 
 typedef struct TCGContext TCGContext;
 
+/* Time spent in each pass of tcg_gen_code(), in nanoseconds.  */
+typedef struct TCGPassTimes {
+    int64_t opt_ns;     /* tcg_optimize */
+    int64_t la_ns;      /* reachable code and liveness passes */
+    int64_t code_ns;    /* register allocation and code emission */
+} TCGPassTimes;
+
 typedef struct TCGTempSet {
     unsigned long l[BITS_TO_LONGS(TCG_MAX_TEMPS)];
 } TCGTempSet;
@@ -550,6 +557,10 @@ struct TCGContext {
 
     TCGRegSet reserved_regs;
     uint32_t tb_cflags; /* cflags of the current TB */
+    bool tb_cold;       /* translate the current TB without tcg_optimize */
+    bool tb_trace;      /* the current TB may be formed as a superblock */
+    bool tb_counted;    /* count the executions of the current TB inline */
+    uint32_t *tb_exit_count; /* count goto_tb exits here, if non-NULL */
     intptr_t current_frame_offset;
     intptr_t frame_start;
     intptr_t frame_end;
@@ -617,6 +628,18 @@ struct TCGContext {
        It does not take into account fixed registers */
     TCGTemp *reg_to_temp[TCG_TARGET_NB_REGS];
 
+    /*
+     * spill-heuristic=next-use: the position of the op being allocated,
+     * and for each position the next op that drops the register state
+     * and the next helper call after it (INT_MAX if none).
+     */
+    int spill_pos;
+    int *spill_next_drop;
+    int *spill_next_call;
+
+    /* If set, tcg_gen_code() adds the time spent in each pass here.  */
+    TCGPassTimes *pass_times;
+
     uint16_t gen_insn_end_off[TCG_MAX_INSNS];
     target_ulong gen_insn_data[TCG_MAX_INSNS][TARGET_INSN_START_WORDS];
 
@@ -633,6 +656,9 @@ extern __thread TCGContext *tcg_ctx;
 extern const void *tcg_code_gen_epilogue;
 extern uintptr_t tcg_splitwx_diff;
 extern TCGv_env cpu_env;
+extern bool tcg_spill_next_use;
+extern bool tcg_corpus_enabled;
+extern bool tcg_region_reclaim;
 
 bool in_code_gen_buffer(const void *p);
 
@@ -804,6 +830,9 @@ void tcg_pool_reset(TCGContext *s);
 TranslationBlock *tcg_tb_alloc(TCGContext *s);
 
 void tcg_region_reset_all(void);
+bool tcg_region_reclaim_wanted(void);
+GPtrArray *tcg_region_reclaim_start(void);
+size_t tcg_region_reclaim_finish(void);
 
 size_t tcg_code_size(void);
 size_t tcg_code_capacity(void);
@@ -840,6 +869,39 @@ void tcg_func_start(TCGContext *s);
 
 int tcg_gen_code(TCGContext *s, TranslationBlock *tb);
 
+/* Op corpus, see tcg/corpus.c.  */
+typedef struct TCGCorpus TCGCorpus;
+
+bool tcg_corpus_open(const char *path, Error **errp);
+void tcg_corpus_record(TCGContext *s, const TranslationBlock *tb);
+
+/**
+ * tcg_corpus_load:
+ * @path: corpus file
+ * @errp: pointer to a NULL-initialized error object
+ *
+ * Read the corpus in @path and create its globals in tcg_ctx, which
+ * must be the context set up by tcg_init() and tcg_prologue_init(),
+ * before any thread is registered.
+ */
+TCGCorpus *tcg_corpus_load(const char *path, Error **errp);
+
+/**
+ * tcg_corpus_next:
+ * @c: corpus
+ * @tb: filled with the pc, cs_base, flags and cflags of the block
+ * @errp: pointer to a NULL-initialized error object
+ *
+ * Start a new function in tcg_ctx and emit the ops of the next block of
+ * the corpus, ready for tcg_gen_code().  Return 1 on success, 0 at the
+ * end of the corpus, -ENOTSUP if the block uses an op, type or helper
+ * that this host lacks, or -EINVAL with @errp set if the corpus is
+ * malformed.
+ */
+int tcg_corpus_next(TCGCorpus *c, TranslationBlock *tb, Error **errp);
+void tcg_corpus_rewind(TCGCorpus *c);
+void tcg_corpus_free(TCGCorpus *c);
+
 void tcg_set_frame(TCGContext *s, TCGReg reg, intptr_t start, intptr_t size);
 
 TCGTemp *tcg_global_mem_new_internal(TCGType, TCGv_ptr,
@@ -1166,11 +1228,10 @@ static inline size_t tcg_current_code_size(TCGContext *s)
  *        TB index (0 or 1). That is, we left the TB via (the equivalent
  *        of) "goto_tb <index>". The main loop uses this to determine
  *        how to link the TB just executed to the next.
- *  2:    we are using instruction counting code generation, and we
- *        did not start executing this TB because the instruction counter
- *        would hit zero midway through it. In this case the pointer
- *        returned is the TB we were about to execute, and the caller must
- *        arrange to execute the remaining count of instructions.
+ *  2:    we did not start executing this cold TB because it has run
+ *        often enough to be translated again with the optimizer (see
+ *        -accel tcg,tier-threshold). The pointer returned is the TB we
+ *        were about to execute.
  *  3:    we stopped because the CPU's exit_request flag was set
  *        (usually meaning that there is an interrupt that needs to be
  *        handled). The pointer returned is the TB we were about to execute
@@ -1193,6 +1254,7 @@ static inline size_t tcg_current_code_size(TCGContext *s)
 #define TB_EXIT_IDX0      0
 #define TB_EXIT_IDX1      1
 #define TB_EXIT_IDXMAX    1
+#define TB_EXIT_TIER_UP   2
 #define TB_EXIT_REQUESTED 3
 
 #ifdef CONFIG_TCG_INTERPRETER
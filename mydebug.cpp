@@ -4,6 +4,8 @@
 // g++ mydebug.cpp -lGL -lGLU -lGLEW -lglut -lX11 -DQEMU_BUDDY_STANDALONE
 
 // For usage with QEMU:
+// * Add "-buddy gui" for the GLUT window, or
+//   "-buddy headless,snapshot=/dev/shm/qemu-buddy" for display-less hosts.
 // * Add "-icount auto" for CPU Inst counts.
 
 #include "mydebug.hpp"
@@ -14,15 +16,29 @@
 #include <GL/glew.h>
 #include <GL/glut.h>
 #include <X11/Xlib.h>
+#include <inttypes.h>
 #include <stdio.h>
+#include <math.h>
 #include <string>
 #include <chrono>
 #include <algorithm>
 #include <set>
+#include <atomic>
+#include <condition_variable>
+#include <thread>
 
 extern "C" {
-  extern void InjectNpcm7xxSMBusNack(int i2cid);
-  extern void DumpPhysicalMemoryForMyDebug(int64_t addr, int64_t size, unsigned char* outbuf);
+  // hw/i2c/i2c-fault.c
+  extern void i2c_fault_inject_async(int bus_serial, const char* action);
+  extern int i2c_fault_bus_armed(int bus_serial);
+  extern void DumpPhysicalMemoryForMyDebug(int64_t addr, int64_t size, unsigned char* outbuf, int read_io);
+  extern int GetTargetPageBitsForMyDebug(void);
+  extern void SetDirtyTrackingForMyDebug(int on);
+  extern int64_t GetDirtyPagesForMyDebug(int64_t addr, int64_t size, unsigned long* bitmap);
+  extern int64_t GetVirtualClockNsForMyDebug(void);
+  extern int GetCPUExecStatsForMyDebug(BuddyCPUExecStats* out, int max);
+  // accel/tcg/tb-sampler.c
+  extern int SetTBSamplingForMyDebug(int hz);
 }
 
 int WIN_W = 960, WIN_H = 480;
@@ -37,6 +53,7 @@ CPUStateView* g_cpustateview;
 NPCM7XXStateView* g_npcm7xxstateview;
 I2CBusStateView* g_i2cbusstateview;
 MemView* g_memview;
+ProfileView* g_profileview;
 std::vector<MyView*> g_views;
 int g_highlighted_view_idx = -999;
 MyView* g_highlighted_view;
@@ -44,15 +61,105 @@ MyView* g_highlighted_view;
 long g_last_millis = 0;
 std::chrono::time_point<std::chrono::steady_clock> g_timepoint0;
 
-static bool g_buddy_started = false;
+// g_buddy_starting guards MyBuddyStart() against re-entry; g_buddy_started
+// is only published once the views exist.
+static std::atomic<bool> g_buddy_starting(false);
+static std::atomic<bool> g_buddy_started(false);
 int IsBuddyStarted() {
-  if (g_buddy_started) return 1;
+  if (g_buddy_started.load(std::memory_order_acquire)) return 1;
   else return 0;
 }
 
+static bool g_buddy_gui = true;
+static BuddySnapshotSink* g_snapshot_sink;
+static BuddySnapshotWriter g_snapshot_writer;
+static uint64_t g_frame_count = 0;
+static const size_t SNAPSHOT_CAPACITY = 1 << 20;
+
+static std::string g_i2c_trace_path = "qemu-i2c-trace.bin";
+static std::string g_wdt_trace_path = "qemu-wdt-trace.bin";
+static std::string g_profile_path = "qemu-profile.folded";
+static std::string g_symbols_path;
+static int g_profile_hz = 0;
+// MyBuddyStop() handshake: 0 = running, 1 = stop requested, 2 = exported
+static std::atomic<int> g_stop_state(0);
+static std::mutex g_stop_mtx;
+static std::condition_variable g_stop_cv;
+
 static bool g_flags[12]; // Keyboard flags: Up, Down, Right, Left, Tab, PgUp, PgDn
-static std::set<std::string> g_in_flight_i2c_txns;
-static bool g_inject_flag = false;
+
+// Matches I2C_FAULT_MAX_BUSES in hw/i2c/i2c-fault.h
+static const int MAX_I2C_BUSES = 256;
+
+std::atomic<BuddyEventRing*> g_buddy_rings[BUDDY_MAX_PRODUCERS];
+std::atomic<int> g_buddy_num_rings;
+static std::atomic<uint64_t> g_buddy_unregistered_drops;
+static thread_local BuddyEventRing* t_buddy_ring;
+
+void BuddyPostEvent(uint16_t type, int32_t id, int64_t value,
+                    int64_t value2, uint16_t flags, uint32_t arg) {
+  // Nobody drains the rings before -buddy is used; don't allocate them.
+  if (!g_buddy_started.load(std::memory_order_acquire)) return;
+  BuddyEventRing* r = t_buddy_ring;
+  if (r == nullptr) {
+    // First event from this thread: allocate and publish its ring.
+    const int slot = g_buddy_num_rings.load(std::memory_order_relaxed);
+    if (slot >= BUDDY_MAX_PRODUCERS) {
+      g_buddy_unregistered_drops.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    r = new BuddyEventRing();
+    const int idx = g_buddy_num_rings.fetch_add(1, std::memory_order_acq_rel);
+    if (idx >= BUDDY_MAX_PRODUCERS) {
+      delete r;
+      g_buddy_unregistered_drops.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    g_buddy_rings[idx].store(r, std::memory_order_release);
+    t_buddy_ring = r;
+  }
+  BuddyEvent e;
+  e.type = type;
+  e.flags = flags;
+  e.id = id;
+  e.value = value;
+  e.value2 = value2;
+  e.arg = arg;
+  e.reserved = 0;
+  r->Push(e);
+}
+
+uint64_t BuddyDroppedEvents() {
+  uint64_t n = g_buddy_unregistered_drops.load(std::memory_order_relaxed);
+  const int nr = g_buddy_num_rings.load(std::memory_order_acquire);
+  for (int i = 0; i < nr && i < BUDDY_MAX_PRODUCERS; i++) {
+    BuddyEventRing* r = g_buddy_rings[i].load(std::memory_order_acquire);
+    if (r) n += r->Dropped();
+  }
+  return n;
+}
+
+static void DispatchBuddyEvent(const BuddyEvent& e) {
+  switch (e.type) {
+    case BUDDY_EV_CPU_ICOUNT:
+      g_cpustateview->UpdateCPUICount(e.id, e.value); break;
+    case BUDDY_EV_I2C_BUS_ADD:
+      g_i2cbusstateview->AddI2CBus(e.id); break;
+    case BUDDY_EV_I2C_TX_START:
+      g_i2cbusstateview->OnI2CTransactionStart(e.id); break;
+    case BUDDY_EV_I2C_READ:
+      g_i2cbusstateview->OnI2CRead(e.id); break;
+    case BUDDY_EV_I2C_WRITE:
+      g_i2cbusstateview->OnI2CWrite(e.id); break;
+    case BUDDY_EV_I2C_TX_DONE:
+      g_i2cbusstateview->OnI2CTransactionDone(e); break;
+    case BUDDY_EV_WDT:
+      g_npcm7xxstateview->OnWatchdogEvent(e); break;
+    case BUDDY_EV_TB_SAMPLE:
+      g_profileview->OnTBSample(e); break;
+    default: break;
+  }
+}
 
 // ====================== To be called from QEMU side ================
 
@@ -61,46 +168,52 @@ int IsBuddNeedsUpdate() {
 }
 
 void AddLogEntry(const char* s) {
-  g_logview->AddLogEntry(std::string(s));
+  if (g_logview) g_logview->AddLogEntry(std::string(s));
 }
 
-void UpdateCPUICount(CPUState* cpu, int64_t executed) {
-  g_cpustateview->UpdateCPUICount(cpu, executed);
+void UpdateCPUICount(int cpu_index, int64_t executed) {
+  BuddyPostEvent(BUDDY_EV_CPU_ICOUNT, cpu_index, executed);
 }
 
-void UpdateWatchdogState(int idx_, const char* irq_, const char* reset_, int64_t rem_ns_, int64_t qemu_ns_) {
-  g_npcm7xxstateview->UpdateWatchdogState(idx_, std::string(irq_), std::string(reset_), rem_ns_, qemu_ns_);
+void OnWatchdogEvent(int index, int kind, int64_t now_ns, int64_t expires_ns) {
+  BuddyPostEvent(BUDDY_EV_WDT, index, now_ns, expires_ns, uint16_t(kind));
+}
+
+void OnTBSample(int cpu_index, uint64_t pc, int tb_size, int flags) {
+  BuddyPostEvent(BUDDY_EV_TB_SAMPLE, cpu_index, int64_t(pc), 0,
+                 uint16_t(flags), uint32_t(tb_size));
 }
 
 void AddI2CBus(const char* desc, void* opaque, int i2cid) {
-  g_i2cbusstateview->AddI2CBus(desc, opaque, i2cid);
+  BuddyPostEvent(BUDDY_EV_I2C_BUS_ADD, i2cid, 0);
 }
 
-void OnI2CTransactionStart(const char* desc, char* is_inject) {
-  g_in_flight_i2c_txns.insert(std::string(desc));
-  g_i2cbusstateview->OnI2CTransactionStart(desc, is_inject);
-  if (is_inject && (*is_inject)) {
-    g_inject_flag = true;
-  }
+void OnI2CTransactionStart(int serial) {
+  BuddyPostEvent(BUDDY_EV_I2C_TX_START, serial, 0);
 }
 
-void OnI2CTransactionEnd(const char* desc) {
-  g_in_flight_i2c_txns.clear();
-  g_inject_flag = false;
+void OnI2CRead(int serial) {
+  BuddyPostEvent(BUDDY_EV_I2C_READ, serial, 0);
 }
 
-int GetI2CSerial(void) {
-  return g_i2cbus_serial++;
+void OnI2CWrite(int serial) {
+  BuddyPostEvent(BUDDY_EV_I2C_WRITE, serial, 0);
 }
 
-int ShouldInjectNACK(const char* desc) {
-  if (g_inject_flag) {
-    if (g_in_flight_i2c_txns.find(std::string(desc)) !=
-        g_in_flight_i2c_txns.end()) {
-      return true;
-    }
-  }
-  return false;
+void OnI2CTransactionDone(int serial, int address, int is_recv, int nack,
+                          int read_bytes, int write_bytes,
+                          int64_t start_ns, int64_t end_ns) {
+  uint16_t flags = address & BUDDY_I2C_ADDR_MASK;
+  if (is_recv) flags |= BUDDY_I2C_RECV;
+  if (nack) flags |= BUDDY_I2C_NACK;
+  const uint32_t bytes = std::min(read_bytes, 0xffff) |
+                         (std::min(write_bytes, 0xffff) << 16);
+  BuddyPostEvent(BUDDY_EV_I2C_TX_DONE, serial, start_ns, end_ns - start_ns,
+                 flags, bytes);
+}
+
+int GetI2CSerial(void) {
+  return g_i2cbus_serial++;
 }
 
 // ============================================================
@@ -153,6 +266,13 @@ void fillRect(int canvas_x0, int canvas_y0, int canvas_x1, int canvas_y1) {
 
 #ifdef QEMU_BUDDY_STANDALONE
 int main(int argc, char** argv) {
+  g_buddy_started = true;
+  if (argc > 1 && std::string(argv[1]) == "headless") {
+    g_buddy_gui = false;
+    if (argc > 2) {
+      g_snapshot_sink = BuddyMmapSink::Create(argv[2], SNAPSHOT_CAPACITY);
+    }
+  }
   MyBuddyInit(nullptr);
   return 0;
 }
@@ -179,6 +299,39 @@ void keyboard(unsigned char key, int x, int y) {
   else if (key == 32) {
     g_memview->ReadMemoryFromQEMU();
   }
+
+  else if (key == 'l') {
+    g_memview->live_ = !g_memview->live_;
+    if (!g_memview->live_) g_memview->StopDirtyTracking();
+  }
+
+  else if (key == 'i') {
+    g_memview->read_io_ = !g_memview->read_io_;
+  }
+
+  else if (key == 'h') {
+    g_memview->show_heat_ = !g_memview->show_heat_;
+  }
+
+  else if (key == 'f') {
+    g_memview->SetFormat((g_memview->format_ + 1) % NUM_BYTES_TO_PIXEL_KINDS);
+  }
+
+  else if (key == 't') {
+    g_i2cbusstateview->ExportTrace(g_i2c_trace_path.c_str());
+  }
+
+  else if (key == 'w') {
+    g_npcm7xxstateview->ExportTrace(g_wdt_trace_path.c_str());
+  }
+
+  else if (key == 'p') {
+    g_profileview->Toggle();
+  }
+
+  else if (key == 'g') {
+    g_profileview->ExportFolded(g_profile_path.c_str());
+  }
 }
 
 void keyboardUp(unsigned char key, int x, int y) {
@@ -262,7 +415,53 @@ long millis() {
   return std::chrono::duration_cast<std::chrono::milliseconds>(n - g_timepoint0).count();
 }
 
+// Model update shared by the GUI and headless front-ends: apply everything
+// QEMU posted since the last frame, then publish a snapshot if asked to.
+void BuddyTick() {
+  const long ms = millis();
+  g_logview->FlushPending();
+  BuddyDrainEvents(DispatchBuddyEvent);
+  for (MyView* v : g_views) {
+    v->Update(ms);
+  }
+
+  ++ g_frame_count;
+  if (g_snapshot_sink) {
+    g_snapshot_writer.Begin(g_frame_count, ms, BuddyDroppedEvents());
+    for (MyView* v : g_views) {
+      v->Serialize(g_snapshot_writer);
+    }
+    g_snapshot_sink->Publish(g_snapshot_writer.Finish());
+  }
+
+  if (g_stop_state.load(std::memory_order_acquire) == 1) {
+    g_memview->StopDirtyTracking();
+    g_i2cbusstateview->ExportTrace(g_i2c_trace_path.c_str());
+    g_npcm7xxstateview->ExportTrace(g_wdt_trace_path.c_str());
+    if (g_profileview->total_ > 0) {
+      g_profileview->ExportFolded(g_profile_path.c_str());
+    }
+    std::lock_guard<std::mutex> lk(g_stop_mtx);
+    g_stop_state = 2;
+    g_stop_cv.notify_all();
+  }
+}
+
+// Sleeps for whatever is left of the current frame.
+static void WaitForNextFrame() {
+  long ms = millis();
+  long delta_ms = ms - g_last_millis;
+  g_last_millis = ms;
+
+  const long preferred_sleep_ms = 1000 / FRAME_RATE;
+  if (delta_ms < preferred_sleep_ms) {
+    usleep(1000 * (preferred_sleep_ms - delta_ms));
+  }
+}
+
 void render() {
+  BuddyTick();
+
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
   glClearColor(0.3f, 0.3f, 0.3f, 1.0f);
   SetOrthographicProjection();
@@ -303,14 +502,7 @@ void render() {
   glPopMatrix();
   glutSwapBuffers();
 
-  long ms = millis();
-  long delta_ms = ms - g_last_millis;
-  g_last_millis = ms;
-
-  const long preferred_sleep_ms = 1000 / FRAME_RATE;
-  if (delta_ms < preferred_sleep_ms) {
-    usleep(1000 * (preferred_sleep_ms - delta_ms));
-  }
+  WaitForNextFrame();
 
   glutPostRedisplay();
 }
@@ -333,12 +525,7 @@ static void passiveMotion(int x, int y) {
   g_mouse_x = x; g_mouse_y = y;
 }
 
-void* MyBuddyInit(void* x) {
-  if (g_buddy_started) return nullptr;
-  g_buddy_started = true;
-  g_timepoint0 = std::chrono::steady_clock::now();
-
-  // Set up
+static void CreateViews() {
   g_logview = new LogView();
   g_logview->SetPosition(0, 160);
   g_logview->SetSize(320, 320);
@@ -359,6 +546,47 @@ void* MyBuddyInit(void* x) {
   g_memview->SetPosition(320, 80);
   g_memview->SetSize(640, 320);
 
+  g_profileview = new ProfileView();
+  g_profileview->hz_ = g_profile_hz;
+  if (g_profile_hz > 0) g_profileview->last_hz_ = g_profile_hz;
+  if (!g_symbols_path.empty()) {
+    g_profileview->LoadSymbols(g_symbols_path.c_str());
+  }
+
+  g_views.push_back(g_cpustateview);
+  g_views.push_back(g_i2cbusstateview);
+  g_views.push_back(g_profileview);
+  g_views.push_back(g_npcm7xxstateview);
+  g_views.push_back(g_logview);
+  g_views.push_back(g_memview);
+}
+
+static void RunHeadless() {
+  printf("[MyBuddyInit] Running headless at %d FPS\n", FRAME_RATE);
+  for (;;) {
+    BuddyTick();
+    WaitForNextFrame();
+  }
+}
+
+void* MyBuddyInit(void* x) {
+  if (g_views.empty()) {
+    g_timepoint0 = std::chrono::steady_clock::now();
+    CreateViews();
+  }
+
+#ifdef QEMU_BUDDY_STANDALONE
+  for (int i=0;i<10;i++) {
+    g_logview->AddLogEntry("Log Entry #" + std::to_string(i));
+  }
+  UpdateCPUICount(0, 10000);
+#endif
+
+  if (!g_buddy_gui) {
+    RunHeadless();
+    return nullptr;
+  }
+
   XInitThreads();
   printf("[MyBuddyInit] Hey!\n");
   glutInitDisplayMode(GLUT_RGB | GLUT_DOUBLE);
@@ -384,23 +612,65 @@ void* MyBuddyInit(void* x) {
   printf("GL_MAJOR_VERSION=%d GL_MINOR_VERSION=%d\n", major_version, minor_version);
   printf("GL_VERSION=%s\n", glGetString(GL_VERSION));
 
-#ifdef QEMU_BUDDY_STANDALONE
-  for (int i=0;i<10;i++) {
-    g_logview->AddLogEntry("Log Entry #" + std::to_string(i));
-  }
-  g_cpustateview->UpdateCPUICount((CPUState*)0x1234, 10000);
-#endif
-
-  g_views.push_back(g_cpustateview);
-  g_views.push_back(g_i2cbusstateview);
-  g_views.push_back(g_npcm7xxstateview);
-  g_views.push_back(g_logview);
-  g_views.push_back(g_memview);
-  
   glutMainLoop();
   return nullptr;
 }
 
+int MyBuddyStart(const char* mode, const char* snapshot_path, int frame_rate) {
+  if (g_buddy_starting.exchange(true)) return 0;
+
+  const std::string m = mode ? mode : "gui";
+  if (m == "gui") {
+    g_buddy_gui = true;
+  } else if (m == "headless") {
+    g_buddy_gui = false;
+  } else {
+    fprintf(stderr, "[MyBuddyStart] unknown mode '%s'\n", m.c_str());
+    g_buddy_starting = false;
+    return -1;
+  }
+  if (frame_rate > 0) {
+    FRAME_RATE = frame_rate;
+  }
+  if (snapshot_path) {
+    g_snapshot_sink = BuddyMmapSink::Create(snapshot_path, SNAPSHOT_CAPACITY);
+    if (!g_snapshot_sink) {
+      g_buddy_starting = false;
+      return -1;
+    }
+  }
+
+  // Views exist before any QEMU thread can see IsBuddyStarted() == 1.
+  g_timepoint0 = std::chrono::steady_clock::now();
+  CreateViews();
+  g_buddy_started.store(true, std::memory_order_release);
+  std::thread(MyBuddyInit, nullptr).detach();
+  return 0;
+}
+
+void MyBuddySetI2CTraceFile(const char* path) {
+  if (path) g_i2c_trace_path = path;
+}
+
+void MyBuddySetWatchdogTraceFile(const char* path) {
+  if (path) g_wdt_trace_path = path;
+}
+
+void MyBuddySetProfiler(int hz, const char* symbols, const char* folded_path) {
+  if (hz > 0) g_profile_hz = hz;
+  if (symbols) g_symbols_path = symbols;
+  if (folded_path) g_profile_path = folded_path;
+}
+
+void MyBuddyStop(void) {
+  if (!g_buddy_started) return;
+  std::unique_lock<std::mutex> lk(g_stop_mtx);
+  int expected = 0;
+  if (!g_stop_state.compare_exchange_strong(expected, 1)) return;
+  g_stop_cv.wait_for(lk, std::chrono::seconds(1),
+                     [] { return g_stop_state.load() == 2; });
+}
+
 void MyView::SetPosition(int _x, int _y) {
   x = _x; y = _y;
 }
@@ -427,32 +697,143 @@ void MyView::DrawBorder() {
   glPopAttrib();
 }
 
+// Rates are recomputed over windows of at least this long
+static const long CPU_EXEC_WINDOW_MS = 500;
+static const int MAX_CPUS = 256;
+
 CPUStateView::CPUStateView() {
+  exec_prev_ms_ = 0;
   SetPosition(0, 0);
   SetSize(320, 40);
 }
 
-void CPUStateView::UpdateCPUICount(CPUState* cpu, int64_t executed) {
-  //mtx_.lock();
-  if (inst_counts_.find(cpu) == inst_counts_.end()) {
-    inst_counts_[cpu] = 0;
-    cpus_.push_back(cpu);
+void CPUStateView::Update(long ms) {
+  if (!exec_prev_.empty() && ms - exec_prev_ms_ < CPU_EXEC_WINDOW_MS) return;
+
+  exec_.resize(MAX_CPUS);
+  const int n = std::min(GetCPUExecStatsForMyDebug(exec_.data(), MAX_CPUS),
+                         MAX_CPUS);
+  exec_.resize(n);
+  ips_.assign(n, 0);
+  time_share_.assign(n * 4, 0);
+  const double dt_ns = (ms - exec_prev_ms_) * 1e6;
+  if (exec_prev_.size() == exec_.size() && dt_ns > 0) {
+    for (int i=0; i<n; i++) {
+      const BuddyCPUExecStats& a = exec_prev_[i];
+      const BuddyCPUExecStats& b = exec_[i];
+      if (a.cpu_index != b.cpu_index) continue;
+      ips_[i] = (b.insns - a.insns) * 1e9 / dt_ns;
+      time_share_[i*4+0] = float((b.exec_ns - a.exec_ns) / dt_ns);
+      time_share_[i*4+1] = float((b.translate_ns - a.translate_ns) / dt_ns);
+      time_share_[i*4+2] = float((b.bql_wait_ns - a.bql_wait_ns) / dt_ns);
+      time_share_[i*4+3] = float((b.halted_ns - a.halted_ns) / dt_ns);
+    }
   }
-  inst_counts_[cpu] += executed;
-  //mtx_.unlock();
+  exec_prev_ = exec_;
+  exec_prev_ms_ = ms;
 }
 
+void CPUStateView::UpdateCPUICount(int cpu_index, int64_t executed) {
+  if (cpu_index < 0) return;
+  if (cpu_index >= int(inst_counts_.size())) {
+    inst_counts_.resize(cpu_index + 1, 0);
+    seen_.resize(cpu_index + 1, false);
+  }
+  seen_[cpu_index] = true;
+  inst_counts_[cpu_index] += executed;
+}
+
+
+void CPUStateView::Serialize(BuddySnapshotWriter& w) {
+  w.BeginSection(BUDDY_SEC_CPU);
+  uint16_t n = 0;
+  for (int i=0; i<int(inst_counts_.size()); i++) {
+    if (!seen_[i]) continue;
+    BuddySnapshotCPU c;
+    c.cpu_index = i;
+    c.reserved = 0;
+    c.icount = inst_counts_[i];
+    w.AppendPOD(c);
+    ++ n;
+  }
+  w.EndSection(n);
+
+  w.BeginSection(BUDDY_SEC_CPU_EXEC);
+  for (const BuddyCPUExecStats& e : exec_) {
+    BuddySnapshotCPUExec c;
+    c.cpu_index = int32_t(e.cpu_index);
+    c.reserved = 0;
+    c.tbs = e.tbs;
+    c.insns = e.insns;
+    c.exec_ns = e.exec_ns;
+    c.translate_ns = e.translate_ns;
+    c.bql_wait_ns = e.bql_wait_ns;
+    c.halted_ns = e.halted_ns;
+    w.AppendPOD(c);
+  }
+  w.EndSection(uint16_t(exec_.size()));
+}
 
 void CPUStateView::Render() {
   const int TEXT_SIZE = 11;
   DrawBorder();
 
   int canvas_y = y + TEXT_SIZE;
-  std::string info = std::to_string(cpus_.size()) + " CPUs";
+  const int ncpus = std::max(int(exec_.size()),
+                             int(std::count(seen_.begin(), seen_.end(), true)));
+  std::string info = std::to_string(ncpus) + " CPUs";
+  if (!exec_.empty()) {
+    int64_t icount = 0;
+    for (const int64_t c : inst_counts_) icount += c;
+    if (icount > 0) info += ", icount " + std::to_string(icount / 1000000) + "M";
+  }
+  const uint64_t dropped = BuddyDroppedEvents();
+  if (dropped > 0) {
+    info += " (" + std::to_string(dropped) + " events dropped)";
+  }
   GlutBitmapString(x, canvas_y, info);
   canvas_y += TEXT_SIZE;
-  for (int i=0; i<int(cpus_.size()); i++) {
-    int64_t cnt = inst_counts_[cpus_[i]];
+
+  // Instructions per second of every vCPU, with a bar splitting its wall
+  // time into exec (green), translate (yellow), BQL wait (red) and halted
+  // (grey). Instructions are only counted for blocks entered from the
+  // execution loop or an indirect branch, hence the lower bound.
+  static const float kShareColors[4][3] = {
+    { 0, 1, 0 }, { 1, 1, 0 }, { 1, 0, 0 }, { 0.5f, 0.5f, 0.5f },
+  };
+  const int bar_x0 = x + 2, bar_x1 = x + w - 2;
+  for (int i=0; i<int(exec_.size()); i++) {
+    if (canvas_y + TEXT_SIZE + 4 >= y + h) {
+      GlutBitmapString(x, canvas_y, "...(omitted)");
+      break;
+    }
+    const int cpu_index = int(exec_[i].cpu_index);
+    char buf[160];
+    snprintf(buf, sizeof(buf), "#%d >=%.1f MIPS x%.0f t%.0f b%.0f h%.0f%%",
+             cpu_index, ips_[i] / 1e6, time_share_[i*4] * 100,
+             time_share_[i*4+1] * 100, time_share_[i*4+2] * 100,
+             time_share_[i*4+3] * 100);
+    GlutBitmapString(x, canvas_y, buf);
+    canvas_y += 2;
+
+    int bx = bar_x0;
+    for (int k=0; k<4; k++) {
+      const int bw = int(std::min(time_share_[i*4+k], 1.0f) * (bar_x1 - bar_x0));
+      if (bw <= 0) continue;
+      color(kShareColors[k][0], kShareColors[k][1], kShareColors[k][2]);
+      for (int yy = canvas_y; yy < canvas_y + 3; yy++) {
+        rect(bx, yy, std::min(bx + bw, bar_x1), yy);
+      }
+      bx = std::min(bx + bw, bar_x1);
+    }
+    color(1, 1, 1);
+    canvas_y += TEXT_SIZE - 2 + 4;
+  }
+
+  // Without vCPU threads (standalone builds) fall back to the icount view
+  if (!exec_.empty()) return;
+  for (int i=0; i<int(inst_counts_.size()); i++) {
+    int64_t cnt = inst_counts_[i];
     if (cnt > 0) {
       bool overflowed = false;
       if (canvas_y + TEXT_SIZE >= y+h) {
@@ -482,9 +863,35 @@ LogView::LogView() {
 }
 
 void LogView::AddLogEntry(const std::string& s) {
-  logs_[log_idx_] = s;
-  log_idx_ = (log_idx_ + 1) % (int(logs_.size()));
-  ++ num_entries_;
+  std::lock_guard<std::mutex> lk(pending_mtx_);
+  pending_.push_back(s);
+}
+
+void LogView::FlushPending() {
+  std::vector<std::string> entries;
+  {
+    std::lock_guard<std::mutex> lk(pending_mtx_);
+    entries.swap(pending_);
+  }
+  for (std::string& s : entries) {
+    logs_[log_idx_].swap(s);
+    log_idx_ = (log_idx_ + 1) % (int(logs_.size()));
+    ++ num_entries_;
+  }
+}
+
+// Only the most recent lines go into a snapshot; readers use the total
+// entry count to tell which ones they have not seen yet.
+void LogView::Serialize(BuddySnapshotWriter& w) {
+  const int MAX_SNAPSHOT_LINES = 32;
+  const int N = int(logs_.size());
+  const int n = std::min(std::min(num_entries_, N), MAX_SNAPSHOT_LINES);
+  w.BeginSection(BUDDY_SEC_LOG);
+  w.AppendPOD(uint32_t(num_entries_));
+  for (int i=n; i>=1; i--) {
+    w.AppendString(logs_[(log_idx_ - i + N) % N]);
+  }
+  w.EndSection(uint16_t(n));
 }
 
 void LogView::Render() {
@@ -523,89 +930,367 @@ void LogView::Render() {
   GlutBitmapString(x, y+TEXT_SIZE-1, stats);
 }
 
+// Writes `ring`, which has seen `total` records and wraps at `capacity`,
+// behind a BuddyI2CTraceHeader-style header, oldest record first.
+template <typename T>
+static bool WriteTraceFile(const char* path, const char* magic, uint16_t version,
+                           const std::vector<T>& ring, uint64_t total,
+                           size_t capacity) {
+  FILE* f = fopen(path, "wb");
+  if (f == nullptr) {
+    perror("[WriteTraceFile] fopen");
+    return false;
+  }
+  BuddyI2CTraceHeader hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.magic, magic, 4);
+  hdr.version = version;
+  hdr.record_size = sizeof(T);
+  hdr.count = uint32_t(ring.size());
+  hdr.total = total;
+
+  // Once the ring has wrapped, the oldest record is the next to go.
+  const size_t head = ring.size() < capacity ? 0 : size_t(total % capacity);
+  bool ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1;
+  ok = ok && fwrite(ring.data() + head, sizeof(T), ring.size() - head, f) ==
+             ring.size() - head;
+  ok = ok && fwrite(ring.data(), sizeof(T), head, f) == head;
+  ok = (fclose(f) == 0) && ok;
+  return ok;
+}
+
+// 16K watchdog events (384 KiB) of history
+static const int WDT_TRACE_CAPACITY = 16384;
+static const int MAX_WATCHDOGS = 64;
+
+NPCM7XXStateView::WatchdogState::WatchdogState() {
+  armed = false;
+  last_kind = 0;
+  expires_ns = 0;
+  last_kick_ns = -1;
+  kicks = expires = resets = intervals = 0;
+  interval_min_ns = interval_max_ns = 0;
+  interval_mean_ns = interval_m2 = 0;
+}
+
+double NPCM7XXStateView::WatchdogState::IntervalStddevNs() const {
+  return intervals > 1 ? sqrt(interval_m2 / (intervals - 1)) : 0;
+}
+
 NPCM7XXStateView::NPCM7XXStateView() {
+  qemu_ns = 0;
+  span_ns = 1000000000;
+  trace_total_ = 0;
+  trace_.reserve(WDT_TRACE_CAPACITY);
   SetPosition(0, 80);
   SetSize(320, 80);
 }
 
-void NPCM7XXStateView::UpdateWatchdogState(int idx_, std::string irq_, std::string reset_, int64_t exp_ns_, int64_t qemu_ns_) {
-  if (idx_ >= int(states_.size())) {
-    states_.resize(idx_+1);
+void NPCM7XXStateView::OnWatchdogEvent(const BuddyEvent& e) {
+  const int idx = e.id;
+  if (idx < 0 || idx >= MAX_WATCHDOGS) return;
+  if (idx >= int(states_.size())) {
+    states_.resize(idx+1);
+  }
+  WatchdogState& s = states_[idx];
+  const int kind = e.flags;
+  const int64_t now = e.value;
+
+  s.last_kind = kind;
+  s.expires_ns = e.value2;
+  switch (kind) {
+    case BUDDY_WDT_KICK:
+      if (s.armed && s.last_kick_ns >= 0) {
+        // Welford's update of the kick interval mean and variance
+        const int64_t d = now - s.last_kick_ns;
+        s.intervals ++;
+        if (s.intervals == 1 || d < s.interval_min_ns) s.interval_min_ns = d;
+        if (s.intervals == 1 || d > s.interval_max_ns) s.interval_max_ns = d;
+        const double delta = d - s.interval_mean_ns;
+        s.interval_mean_ns += delta / s.intervals;
+        s.interval_m2 += delta * (d - s.interval_mean_ns);
+      }
+      s.kicks ++;
+      s.last_kick_ns = now;
+      break;
+    case BUDDY_WDT_ARM:
+      s.armed = true;
+      s.last_kick_ns = now;
+      break;
+    case BUDDY_WDT_EXPIRE:
+      s.expires ++;
+      break;
+    case BUDDY_WDT_RESET:
+      s.resets ++;
+      s.armed = false;
+      s.expires_ns = 0;
+      break;
+    case BUDDY_WDT_DISARM:
+    case BUDDY_WDT_DEVICE_RESET:
+      s.armed = false;
+      s.last_kick_ns = -1;
+      break;
+  }
+  qemu_ns = std::max(qemu_ns, now);
+
+  BuddyWatchdogTraceRecord r;
+  memset(&r, 0, sizeof(r));
+  r.ns = now;
+  r.expires_ns = s.expires_ns;
+  r.index = idx;
+  r.kind = uint16_t(kind);
+  if (int(trace_.size()) < WDT_TRACE_CAPACITY) {
+    trace_.push_back(r);
+  } else {
+    trace_[trace_total_ % WDT_TRACE_CAPACITY] = r;
+  }
+  trace_total_ ++;
+}
+
+void NPCM7XXStateView::Update(long ms) {
+  // Events only say when something happened; the clock keeps running in
+  // between, and the timeline should scroll with it.
+  if (!states_.empty()) {
+    qemu_ns = std::max(qemu_ns, GetVirtualClockNsForMyDebug());
+  }
+
+  // Fit four of the slowest kick intervals on the timeline.
+  int64_t slowest = 0;
+  for (const WatchdogState& s : states_) {
+    if (s.intervals > 0) slowest = std::max(slowest, s.interval_max_ns);
+  }
+  if (slowest > 0) {
+    span_ns = std::min(std::max(slowest * 4, int64_t(1000000)),
+                       int64_t(60) * 1000000000);
+  }
+}
+
+bool NPCM7XXStateView::ExportTrace(const char* path) {
+  const bool ok = WriteTraceFile(path, BUDDY_WDT_TRACE_MAGIC,
+                                 BUDDY_WDT_TRACE_VERSION, trace_, trace_total_,
+                                 WDT_TRACE_CAPACITY);
+  char x[200];
+  snprintf(x, sizeof(x), "%s %u watchdog events to %s",
+           ok ? "Exported" : "Failed to export", unsigned(trace_.size()), path);
+  AddLogEntry(x);
+  return ok;
+}
+
+void NPCM7XXStateView::Serialize(BuddySnapshotWriter& w) {
+  w.BeginSection(BUDDY_SEC_WDT);
+  for (int i=0; i<int(states_.size()); i++) {
+    const WatchdogState& s = states_[i];
+    BuddySnapshotWatchdog d;
+    memset(&d, 0, sizeof(d));
+    d.index = i;
+    d.armed = s.armed;
+    d.last_kind = uint16_t(s.last_kind);
+    d.expires_ns = s.expires_ns;
+    d.qemu_ns = qemu_ns;
+    d.last_kick_ns = s.last_kick_ns;
+    d.kicks = s.kicks;
+    d.expires = s.expires;
+    d.resets = s.resets;
+    d.intervals = s.intervals;
+    d.interval_min_ns = s.interval_min_ns;
+    d.interval_max_ns = s.interval_max_ns;
+    d.interval_mean_ns = int64_t(s.interval_mean_ns);
+    d.interval_stddev_ns = int64_t(s.IntervalStddevNs());
+    w.AppendPOD(d);
+  }
+  w.EndSection(uint16_t(states_.size()));
+}
+
+static void WatchdogKindColor(int kind) {
+  switch (kind) {
+    case BUDDY_WDT_ARM: color(0, 1, 0); break;
+    case BUDDY_WDT_DISARM: color(0.5f, 0.5f, 0.5f); break;
+    case BUDDY_WDT_EXPIRE: color(1, 1, 0); break;
+    case BUDDY_WDT_RESET: color(1, 0, 0); break;
+    case BUDDY_WDT_DEVICE_RESET: color(0.3f, 0.6f, 1); break;
+    default: color(1, 1, 1); break;
+  }
+}
+
+static const char* WatchdogKindName(int kind) {
+  switch (kind) {
+    case BUDDY_WDT_ARM: return "armed";
+    case BUDDY_WDT_DISARM: return "off";
+    case BUDDY_WDT_KICK: return "kicked";
+    case BUDDY_WDT_EXPIRE: return "IRQ";
+    case BUDDY_WDT_RESET: return "RESET";
+    case BUDDY_WDT_DEVICE_RESET: return "off";
+    default: return "-";
   }
-  MyNPCM7XXWDState& s = states_[idx_];
-  s.irq = irq_; s.reset = reset_; s.expires_ns = exp_ns_;
-  qemu_ns = qemu_ns_;
 }
 
 void NPCM7XXStateView::Render() {
   const int TEXT_SIZE = 11;
+  const int ROW_H = 12;
   DrawBorder();
 
   int canvas_y = y+TEXT_SIZE;
-  GlutBitmapString(x, canvas_y, std::to_string(states_.size()) + " NPCM7XX WatchDogs (IRQ,Reset,Expire_ns,Approx.Rem)");
-  canvas_y += TEXT_SIZE;
+  char buf[160];
+  snprintf(buf, sizeof(buf), "%d NPCM7XX WatchDogs, last %.1f ms (virtual)",
+           int(states_.size()), span_ns / 1e6);
+  GlutBitmapString(x, canvas_y, buf);
+  canvas_y += 2;
+
+  // One row per watchdog: state and time left, then a tick per event.
+  const int tl_x0 = x + 110, tl_x1 = x + w - 4;
+  const int64_t t0 = qemu_ns - span_ns;
+  int hovered = -1;
   const int N = int(states_.size());
-  for (int i=0; i<N; i++) {
-    MyNPCM7XXWDState& s = states_[i];
-    std::string info = "#" + std::to_string(i) + ": ";
-    if (s.irq == "") {
-      info += "(null)";
+  for (int i=0; i<N && canvas_y + ROW_H < y + h - TEXT_SIZE; i++) {
+    const WatchdogState& s = states_[i];
+    const int row_y0 = canvas_y + 1, row_y1 = canvas_y + ROW_H - 1;
+    if (s.armed && s.expires_ns > 0) {
+      snprintf(buf, sizeof(buf), "#%d %s %.1fms", i,
+               WatchdogKindName(s.last_kind),
+               std::max<int64_t>(s.expires_ns - qemu_ns, 0) / 1e6);
     } else {
-      info += s.irq;
+      snprintf(buf, sizeof(buf), "#%d %s", i, WatchdogKindName(s.last_kind));
+    }
+    GlutBitmapString(x + 2, row_y1, buf);
+    rect(tl_x0, row_y0, tl_x1, row_y1);
+
+    // Newest first, stopping at the left edge of the window
+    for (size_t k=0; k<trace_.size(); k++) {
+      const BuddyWatchdogTraceRecord& r =
+          trace_[(trace_total_ - 1 - k) % WDT_TRACE_CAPACITY];
+      if (r.ns < t0) break;
+      if (r.index != i) continue;
+      const int px = tl_x0 + int((r.ns - t0) * (tl_x1 - tl_x0) / span_ns);
+      WatchdogKindColor(r.kind);
+      rect(px, row_y0 + 1, px, row_y1 - 1);
     }
-    info += ", ";
+    color(1, 1, 1);
 
-    if (s.reset == "") { info += "(null)"; }
-    else { info += s.reset; }
-    info += ", ";
+    if (g_mouse_x >= x && g_mouse_x <= x + w &&
+        g_mouse_y >= row_y0 && g_mouse_y <= row_y1) {
+      hovered = i;
+    }
+    canvas_y += ROW_H;
+  }
 
-    char buf[100];
-    sprintf(buf, "%.1fms, ", s.expires_ns/1000000.0f);
-    info += std::string(buf);
+  // Kick statistics of the hovered watchdog
+  if (hovered != -1) {
+    const WatchdogState& s = states_[hovered];
+    snprintf(buf, sizeof(buf),
+             "#%d kicks=%u every %.2f+-%.2fms [%.2f,%.2f] irq=%u rst=%u",
+             hovered, s.kicks, s.interval_mean_ns / 1e6,
+             s.IntervalStddevNs() / 1e6, s.interval_min_ns / 1e6,
+             s.interval_max_ns / 1e6, s.expires, s.resets);
+    GlutBitmapString(x, y + h - 2, buf);
+  }
+}
 
-    int64_t rem_ns = s.expires_ns - qemu_ns;
-    
-    if (rem_ns > 0) {
-      sprintf(buf, "%.1fms", rem_ns/1000000.0f);
-    } else {
-      sprintf(buf, " expired");
-    }
+// 64K transactions (2 MiB) of history
+static const int I2C_TRACE_CAPACITY = 65536;
+
+I2CBusStateView::LatencyHistogram::LatencyHistogram() {
+  memset(buckets, 0, sizeof(buckets));
+  count = nacks = 0;
+  max_ns = 0;
+}
 
-    info += std::string(buf);
+void I2CBusStateView::LatencyHistogram::Add(int64_t ns, bool nack) {
+  int b = 0;
+  if (ns > 1) {
+    b = std::min(63 - __builtin_clzll(uint64_t(ns)),
+                 BUDDY_I2C_LATENCY_BUCKETS - 1);
+  }
+  buckets[b] ++;
+  count ++;
+  if (nack) nacks ++;
+  max_ns = std::max(max_ns, ns);
+}
 
-    if (canvas_y + TEXT_SIZE >= y + h) {
-      info += " ... (omitted)";
+int64_t I2CBusStateView::LatencyHistogram::Quantile(double p) const {
+  const uint64_t rank = uint64_t(p * count);
+  uint64_t seen = 0;
+  for (int i=0; i<BUDDY_I2C_LATENCY_BUCKETS; i++) {
+    seen += buckets[i];
+    if (seen > rank || seen == count) {
+      return std::min(int64_t(2) << i, max_ns);
     }
-    GlutBitmapString(x, canvas_y, info);
-    canvas_y += TEXT_SIZE;
   }
+  return max_ns;
 }
 
 I2CBusStateView::I2CBusStateView() {
   hovered_i2c_idx = -999;
-  pending_i2c_nacks.resize(256);
+  last_update_millis = 0;
+  trace_.reserve(I2C_TRACE_CAPACITY);
+  trace_total_ = 0;
 }
 
-void I2CBusStateView::AddI2CBus(const char* desc, void* opaque, int i2c) {
-  I2CBusState bs;
-  states_.push_back(bs);
-  i2c2idx_[desc] = int(states_.size());
-  i2c2bus_[desc] = opaque;
-  tx_count_last_interval.push_back(0);
+void I2CBusStateView::AddI2CBus(int serial) {
+  if (serial < 0 || serial >= MAX_I2C_BUSES) return;
+  if (serial >= int(states_.size())) {
+    states_.resize(serial + 1);
+    tx_count_last_interval.resize(serial + 1, 0);
+    bus_latency_.resize(serial + 1);
+    addr_latency_.resize((serial + 1) * 128, nullptr);
+  }
 }
 
-void I2CBusStateView::Render() {
-  int tx_cnt_physical_buses = 0;
-  int tx_cnt_muxed_buses = 0;
+// Whether fault rules that can still fire target this bus
+bool I2CBusStateView::IsNACKPending(int serial) {
+  return i2c_fault_bus_armed(serial) > 0;
+}
 
-  const long ms = millis();
+void I2CBusStateView::Update(long ms) {
   if (last_update_millis + 1000 < ms) {
     last_update_millis = ms;
+    read_count_last_interval.resize(states_.size());
+    write_count_last_interval.resize(states_.size());
     for (int i=0; i<int(states_.size()); i++) {
       tx_count_last_interval[i] = states_[i].tx_count;
+      read_count_last_interval[i] = states_[i].read_count;
+      write_count_last_interval[i] = states_[i].write_count;
       states_[i].tx_count = 0;
+      states_[i].read_count = 0;
+      states_[i].write_count = 0;
     }
   }
+}
+
+void I2CBusStateView::Serialize(BuddySnapshotWriter& w) {
+  w.BeginSection(BUDDY_SEC_I2C);
+  for (int i=0; i<int(tx_count_last_interval.size()); i++) {
+    BuddySnapshotI2CBus b;
+    b.serial = i;
+    b.tx_per_sec = tx_count_last_interval[i];
+    b.reads_per_sec = i < int(read_count_last_interval.size()) ?
+        read_count_last_interval[i] : 0;
+    b.writes_per_sec = i < int(write_count_last_interval.size()) ?
+        write_count_last_interval[i] : 0;
+    w.AppendPOD(b);
+  }
+  w.EndSection(uint16_t(tx_count_last_interval.size()));
+
+  w.BeginSection(BUDDY_SEC_I2C_LATENCY);
+  uint16_t n = 0;
+  for (int i=0; i<int(bus_latency_.size()); i++) {
+    const LatencyHistogram& hist = bus_latency_[i];
+    if (hist.count == 0) continue;
+    BuddySnapshotI2CLatency l;
+    l.serial = i;
+    l.count = hist.count;
+    l.nacks = hist.nacks;
+    l.reserved = 0;
+    l.max_ns = hist.max_ns;
+    memcpy(l.buckets, hist.buckets, sizeof(l.buckets));
+    w.AppendPOD(l);
+    n ++;
+  }
+  w.EndSection(n);
+}
+
+void I2CBusStateView::Render() {
+  int tx_cnt_physical_buses = 0;
+  int tx_cnt_muxed_buses = 0;
 
   const int TEXT_SIZE = 11;
   DrawBorder();
@@ -622,7 +1307,7 @@ void I2CBusStateView::Render() {
   //  range *= 2;
   //}
 
-  int grid_y = canvas_y + 13;
+  int grid_y = canvas_y + 24;
   int grid_x0 = x + 16, grid_x = grid_x0;
   const int grid_h = 8, grid_w = 16;
   int idx = 0;
@@ -648,7 +1333,7 @@ void I2CBusStateView::Render() {
       fillRect(grid_x + 2, grid_y + 2, grid_x + 2 + fill_w, grid_y + grid_h - 2);
     }
 
-    if (pending_i2c_nacks[idx] == true) {
+    if (IsNACKPending(idx)) {
       color(1, 1, 0);
       rect(grid_x+1, grid_y+1, grid_x+grid_w-1, grid_y+grid_h-1);
       color(1, 1, 1);
@@ -677,70 +1362,338 @@ void I2CBusStateView::Render() {
     txt = txt + " Hover: i2c-" + std::to_string(hovered_i2c_idx);
   }
   GlutBitmapString(x, canvas_y + 11, txt);
-}
 
-void I2CBusStateView::OnI2CTransactionStart(const char* desc, char* is_inject) {
-  int idx = i2c2idx_.at(std::string(desc));
-  states_[idx].tx_count ++;
-  if (is_inject) {
-    if (pending_i2c_nacks[idx]) {
-      *is_inject = true;
-      pending_i2c_nacks[idx] = false;
+  // Latency of the hovered bus and its busiest slave
+  if (hovered_i2c_idx != -999 && bus_latency_[hovered_i2c_idx].count > 0) {
+    const LatencyHistogram& hist = bus_latency_[hovered_i2c_idx];
+    int top = -1;
+    for (int a=0; a<128; a++) {
+      const LatencyHistogram* l = addr_latency_[hovered_i2c_idx * 128 + a];
+      if (l && (top == -1 ||
+                l->count > addr_latency_[hovered_i2c_idx * 128 + top]->count)) {
+        top = a;
+      }
     }
+    char buf[160];
+    snprintf(buf, sizeof(buf),
+             "n=%u nack=%u p50<=%.1fus p99<=%.1fus max=%.1fus top=0x%02x",
+             hist.count, hist.nacks, hist.Quantile(0.5) / 1e3,
+             hist.Quantile(0.99) / 1e3, hist.max_ns / 1e3, top);
+    GlutBitmapString(x, canvas_y + 22, buf);
   }
 }
 
+void I2CBusStateView::OnI2CTransactionStart(int serial) {
+  AddI2CBus(serial);
+  if (serial < 0 || serial >= int(states_.size())) return;
+  states_[serial].tx_count ++;
+}
+
+void I2CBusStateView::OnI2CTransactionDone(const BuddyEvent& e) {
+  const int serial = e.id;
+  AddI2CBus(serial);
+  if (serial < 0 || serial >= int(states_.size())) return;
+  const int address = e.flags & BUDDY_I2C_ADDR_MASK;
+  const bool nack = (e.flags & BUDDY_I2C_NACK) != 0;
+
+  bus_latency_[serial].Add(e.value2, nack);
+  LatencyHistogram*& h = addr_latency_[serial * 128 + address];
+  if (h == nullptr) h = new LatencyHistogram();
+  h->Add(e.value2, nack);
+
+  BuddyI2CTraceRecord r;
+  memset(&r, 0, sizeof(r));
+  r.start_ns = e.value;
+  r.latency_ns = e.value2;
+  r.serial = serial;
+  r.address = uint8_t(address);
+  r.flags = ((e.flags & BUDDY_I2C_RECV) ? BUDDY_I2C_TRACE_RECV : 0) |
+            (nack ? BUDDY_I2C_TRACE_NACK : 0);
+  r.read_bytes = uint16_t(e.arg & 0xffff);
+  r.write_bytes = uint16_t(e.arg >> 16);
+  if (int(trace_.size()) < I2C_TRACE_CAPACITY) {
+    trace_.push_back(r);
+  } else {
+    trace_[trace_total_ % I2C_TRACE_CAPACITY] = r;
+  }
+  trace_total_ ++;
+}
+
+bool I2CBusStateView::ExportTrace(const char* path) {
+  const bool ok = WriteTraceFile(path, BUDDY_I2C_TRACE_MAGIC,
+                                 BUDDY_I2C_TRACE_VERSION, trace_, trace_total_,
+                                 I2C_TRACE_CAPACITY);
+  char x[200];
+  snprintf(x, sizeof(x), "%s %u I2C transactions to %s",
+           ok ? "Exported" : "Failed to export", unsigned(trace_.size()), path);
+  AddLogEntry(x);
+  return ok;
+}
+
+void I2CBusStateView::OnI2CRead(int serial) {
+  if (serial < 0 || serial >= int(states_.size())) return;
+  states_[serial].read_count ++;
+}
+
+void I2CBusStateView::OnI2CWrite(int serial) {
+  if (serial < 0 || serial >= int(states_.size())) return;
+  states_[serial].write_count ++;
+}
+
 void I2CBusStateView::OnMouseDown(int button) {
   char x[100];
   if (hovered_i2c_idx != -999) {
+    // One-shot rules for the next transaction on the bus; the same can be
+    // scripted with x-i2c-fault-add.
+    const char* action = nullptr;
     if (button == GLUT_LEFT_BUTTON) {
-      if (pending_i2c_nacks[hovered_i2c_idx] == false) {
-        sprintf(x, "pending NACK injection to i2c-%d\n", hovered_i2c_idx);
-        AddLogEntry(x);
-      }
-      pending_i2c_nacks[hovered_i2c_idx] = true;
+      action = "nack";
     } else if (button == GLUT_RIGHT_BUTTON) {
-      // Assuming we're using NPCM7XX
-      if (hovered_i2c_idx < 16) {
-        InjectNpcm7xxSMBusNack(hovered_i2c_idx);
-        sprintf(x, "Injected NACK to i2c-%d (SMBus)", hovered_i2c_idx);
-        AddLogEntry(x);
+      action = "arbitration-lost";
+    }
+    if (action) {
+      i2c_fault_inject_async(hovered_i2c_idx, action);
+      sprintf(x, "pending %s injection to i2c-%d", action, hovered_i2c_idx);
+      AddLogEntry(x);
+    }
+  }
+}
+
+// Samples per second when 'p' starts the profiler without profile=; off
+// the round number so that it does not beat with guest timer ticks.
+static const int PROFILE_DEFAULT_HZ = 99;
+static const long PROFILE_TOP_MS = 500;
+static const int PROFILE_TOP_N = 16;
+
+ProfileView::ProfileView() {
+  total_ = halted_total_ = 0;
+  hz_ = 0;
+  applied_hz_ = -1;
+  last_hz_ = PROFILE_DEFAULT_HZ;
+  top_ms_ = 0;
+  SetPosition(500, 0);
+  SetSize(460, 80);
+}
+
+void ProfileView::OnTBSample(const BuddyEvent& e) {
+  const int cpu = e.id;
+  if (cpu < 0 || cpu >= MAX_CPUS) return;
+  if (cpu >= int(per_cpu_.size())) {
+    per_cpu_.resize(cpu + 1);
+    halted_.resize(cpu + 1, 0);
+  }
+  total_ ++;
+  if (e.flags & BUDDY_SAMPLE_HALTED) {
+    halted_[cpu] ++;
+    halted_total_ ++;
+    return;
+  }
+  const uint64_t pc = uint64_t(e.value);
+  PCStats& s = per_cpu_[cpu][pc];
+  s.samples ++;
+  s.tb_size = e.arg;
+  PCStats& a = all_[pc];
+  a.samples ++;
+  a.tb_size = e.arg;
+}
+
+void ProfileView::LoadSymbols(const char* path) {
+  char x[300];
+  if (symbols_.LoadElf(path)) {
+    snprintf(x, sizeof(x), "Loaded %u symbols from %s",
+             unsigned(symbols_.size()), path);
+  } else {
+    snprintf(x, sizeof(x), "No symbols from %s: %s", path,
+             symbols_.error().c_str());
+  }
+  AddLogEntry(x);
+}
+
+void ProfileView::Toggle() {
+  if (hz_ > 0) {
+    last_hz_ = hz_;
+    hz_ = 0;
+  } else {
+    hz_ = last_hz_;
+  }
+}
+
+std::string ProfileView::Symbolize(uint64_t pc) const {
+  char buf[300];
+  uint64_t off = 0;
+  const char* name = symbols_.Lookup(pc, &off);
+  if (name == nullptr) {
+    snprintf(buf, sizeof(buf), "0x%" PRIx64, pc);
+  } else if (off == 0) {
+    snprintf(buf, sizeof(buf), "%s", name);
+  } else {
+    snprintf(buf, sizeof(buf), "%s+0x%" PRIx64, name, off);
+  }
+  return buf;
+}
+
+void ProfileView::Update(long ms) {
+  // The buddy starts before the accelerator does, so keep asking until
+  // QEMU takes the rate.
+  if (hz_ != applied_hz_ && SetTBSamplingForMyDebug(hz_) == 0) {
+    applied_hz_ = hz_;
+  }
+
+  if (ms - top_ms_ < PROFILE_TOP_MS) return;
+  top_ms_ = ms;
+  top_.assign(all_.begin(), all_.end());
+  const size_t n = std::min(top_.size(), size_t(PROFILE_TOP_N));
+  std::partial_sort(top_.begin(), top_.begin() + n, top_.end(),
+                    [](const std::pair<uint64_t, PCStats>& a,
+                       const std::pair<uint64_t, PCStats>& b) {
+                      if (a.second.samples != b.second.samples) {
+                        return a.second.samples > b.second.samples;
+                      }
+                      return a.first < b.first;
+                    });
+  top_.resize(n);
+}
+
+void ProfileView::Serialize(BuddySnapshotWriter& w) {
+  w.BeginSection(BUDDY_SEC_PROFILE);
+  w.AppendPOD(uint32_t(std::min<uint64_t>(total_, UINT32_MAX)));
+  w.AppendPOD(uint32_t(std::min<uint64_t>(halted_total_, UINT32_MAX)));
+  for (const std::pair<uint64_t, PCStats>& t : top_) {
+    BuddySnapshotProfileEntry e;
+    e.pc = t.first;
+    e.samples = t.second.samples;
+    e.tb_size = t.second.tb_size;
+    w.AppendPOD(e);
+  }
+  w.EndSection(uint16_t(top_.size()));
+}
+
+// One line per (vCPU, pc) in the folded format of flamegraph.pl and
+// speedscope: "cpu0;function;function+0x1c 42". Guest stacks are not
+// unwound, so the function is as deep as it gets.
+bool ProfileView::ExportFolded(const char* path) {
+  FILE* f = fopen(path, "w");
+  if (f == nullptr) {
+    perror("[ProfileView::ExportFolded] fopen");
+    return false;
+  }
+  unsigned lines = 0;
+  for (int cpu=0; cpu<int(per_cpu_.size()); cpu++) {
+    std::vector<std::pair<uint64_t, PCStats> > pcs(per_cpu_[cpu].begin(),
+                                                   per_cpu_[cpu].end());
+    std::sort(pcs.begin(), pcs.end(),
+              [](const std::pair<uint64_t, PCStats>& a,
+                 const std::pair<uint64_t, PCStats>& b) {
+                return a.first < b.first;
+              });
+    for (const std::pair<uint64_t, PCStats>& p : pcs) {
+      uint64_t off = 0;
+      const char* name = symbols_.Lookup(p.first, &off);
+      if (name) {
+        fprintf(f, "cpu%d;%s;%s %u\n", cpu, name, Symbolize(p.first).c_str(),
+                p.second.samples);
+      } else {
+        fprintf(f, "cpu%d;0x%" PRIx64 " %u\n", cpu, p.first, p.second.samples);
       }
+      lines ++;
+    }
+    if (halted_[cpu] > 0) {
+      fprintf(f, "cpu%d;[halted] %" PRIu64 "\n", cpu, halted_[cpu]);
+      lines ++;
     }
   }
+  const bool ok = fclose(f) == 0;
+  char x[300];
+  snprintf(x, sizeof(x), "%s %u stacks (%" PRIu64 " samples) to %s",
+           ok ? "Exported" : "Failed to export", lines, total_, path);
+  AddLogEntry(x);
+  return ok;
 }
 
-class BytesToRGB : public BytesToPixelIntf {
-public:
-	int NumBytesPerPixel() override { return 3; }
-	int NumPixelDataChannels() override { return 3; }
-	void BytesToPixel(unsigned char* byte_ptr, unsigned char* pixel_ptr) override {
-		for (int i=0; i<3; i++) pixel_ptr[i] = byte_ptr[i];
-	}
-	unsigned int Format() override { return GL_RGB; }
-};
+void ProfileView::Render() {
+  const int TEXT_SIZE = 11;
+  DrawBorder();
 
-class BytesToRG : public BytesToPixelIntf {
-public:
-	int NumBytesPerPixel() override { return 2; }
-	int NumPixelDataChannels() override { return 3; }
-	void BytesToPixel(unsigned char* byte_ptr, unsigned char* pixel_ptr) override {
-		for (int i=0; i<2; i++) pixel_ptr[i] = byte_ptr[i];
-	}
-	unsigned int Format() override { return GL_RGB; }
-};
+  int canvas_y = y + TEXT_SIZE;
+  char buf[300];
+  if (applied_hz_ > 0) {
+    snprintf(buf, sizeof(buf), "Profile @%dHz: %" PRIu64 " samples, %.0f%% halted",
+             applied_hz_, total_,
+             total_ > 0 ? halted_total_ * 100.0 / total_ : 0.0);
+  } else if (hz_ > 0) {
+    snprintf(buf, sizeof(buf), "Profile: waiting for TCG");
+  } else {
+    snprintf(buf, sizeof(buf), "Profile off ('p' starts), %" PRIu64 " samples",
+             total_);
+  }
+  GlutBitmapString(x, canvas_y, buf);
+  canvas_y += TEXT_SIZE;
+
+  // Hottest guest pcs, with a bar for their share of the busy samples
+  const uint64_t busy = total_ - halted_total_;
+  const int bar_x0 = x + 2, bar_w = 40;
+  for (const std::pair<uint64_t, PCStats>& t : top_) {
+    if (canvas_y + TEXT_SIZE >= y + h) break;
+    const double share = busy > 0 ? double(t.second.samples) / busy : 0;
+    color(1, 0.5f, 0);
+    const int bw = int(share * bar_w);
+    for (int yy = canvas_y - 7; yy < canvas_y - 2 && bw > 0; yy++) {
+      rect(bar_x0, yy, bar_x0 + bw, yy);
+    }
+    color(1, 1, 1);
+    snprintf(buf, sizeof(buf), "%5.1f%% %08" PRIx64 " %s", share * 100,
+             t.first, Symbolize(t.first).c_str());
+    GlutBitmapString(bar_x0 + bar_w + 4, canvas_y, buf);
+    canvas_y += TEXT_SIZE;
+  }
+}
 
 MemView::MemView() {
   x = 320; y = 80; w = 320; h = 320;
-  bytes2pixel = new BytesToRG();
+  pixel_w = pixel_h = 0;
+  format_ = BYTES_TO_RG;
+  bytes2pixel = CreateBytesToPixel(format_);
+  // Leave a core for the vCPUs; the render thread takes a share too.
+  const int ncores = int(std::thread::hardware_concurrency());
+  pool_ = new BuddyWorkerPool(std::max(0, std::min(3, ncores - 2)));
+  live_ = false;
+  read_io_ = false;
+  last_read_ms_ = 0;
+  tracking_ = false;
+  page_bits_ = 12;
+  last_dirty_pages_ = 0;
+  show_heat_ = true;
+}
+
+void MemView::Update(long ms) {
+  if (!live_ || !g_buddy_gui) return;
+  if (!tracking_) {
+    StartDirtyTracking();
+  } else {
+    RefreshDirtyPages();
+  }
 }
 
 void MemView::Render() {
   rect(x, y, x+w, y+h);
+  char status[200];
+  snprintf(status, sizeof(status), "Memory @0x0 [Space]=read [l]ive:%s [i]o:%s [h]eat:%s "
+           "[f]ormat:%s(%s) %lld dirty pages, %.2f ms",
+           live_ ? "on" : "off", read_io_ ? "on" : "off", show_heat_ ? "on" : "off",
+           bytes2pixel->Name(), bytes2pixel->Isa(),
+           (long long)last_dirty_pages_, last_read_ms_);
+  GlutBitmapString(x+4, y+14, status);
   const int px = x+4, py = y+20;
   rect(px, py, px+2+pixel_w, py+2+pixel_h);
   glWindowPos2i(px+1, WIN_H - (py+1+pixel_h));
   glDrawPixels(pixel_w, pixel_h, bytes2pixel->Format(), GL_UNSIGNED_BYTE, pixels.data());
+  if (show_heat_ && !hot_pages_.empty()) {
+    glPushAttrib(GL_COLOR_BUFFER_BIT);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glDrawPixels(pixel_w, pixel_h, GL_RGBA, GL_UNSIGNED_BYTE, overlay_.data());
+    glPopAttrib();
+  }
 }
 
 void MemView::SetSize(int _w, int _h) {
@@ -753,23 +1706,135 @@ void MemView::SetSize(int _w, int _h) {
   for (int i=0; i<int(pixels.size()); i++) {
     pixels[i] = i % 256;
   }
+  overlay_.assign(pixel_w * pixel_h * 4, 0);
+}
+
+void MemView::SetFormat(int kind) {
+  BytesToPixelIntf* b = CreateBytesToPixel(kind);
+  if (!b) return;
+  delete bytes2pixel;
+  bytes2pixel = b;
+  format_ = kind;
+  SetSize(w, h);
+  // The window now covers a different byte range; start over.
+  StopDirtyTracking();
+  if (!live_) ReadMemoryFromQEMU();
 }
 
 void MemView::ConvertToPixels() {
+  ConvertToPixels(0, pixel_w * pixel_h);
+}
+
+// Converts pixels [first_px, end_px), counted in memory order. Rows are
+// converted with one ConvertRow() call each and, for large ranges, split
+// across the worker pool; the vertical flip is computed once per row.
+void MemView::ConvertToPixels(int first_px, int end_px) {
   const int nc = bytes2pixel->NumPixelDataChannels();
   const int bp = bytes2pixel->NumBytesPerPixel();
-  unsigned char *byte_ptr = bytes.data();
-  int px = 0, py = 0;
-  for (int i=0; i<pixel_w * pixel_h; byte_ptr += bp, i++) {
-    unsigned char *pixel_ptr = pixels.data() + (nc * ((pixel_h - py) * pixel_w + px));
-    bytes2pixel->BytesToPixel(byte_ptr, pixel_ptr);
-    px ++;
-    if (px >= pixel_w) { px = 0; py ++; }
+  const int row0 = first_px / pixel_w;
+  const int nrows = (end_px - 1) / pixel_w - row0 + 1;
+  if (end_px <= first_px) return;
+
+  std::function<void(int, int)> convert_rows = [&](int begin, int end) {
+    for (int r = row0 + begin; r < row0 + end; r++) {
+      const int p0 = std::max(first_px, r * pixel_w);
+      const int p1 = std::min(end_px, (r + 1) * pixel_w);
+      bytes2pixel->ConvertRow(bytes.data() + int64_t(p0) * bp,
+                              pixels.data() + nc * ((pixel_h - 1 - r) * pixel_w + p0 % pixel_w),
+                              p1 - p0);
+    }
+  };
+
+  const int PARALLEL_MIN_PIXELS = 1 << 16;
+  if (end_px - first_px >= PARALLEL_MIN_PIXELS) {
+    pool_->ParallelFor(nrows, convert_rows);
+  } else {
+    convert_rows(0, nrows);
+  }
+}
+
+void MemView::PageToPixels(int page, int* first_px, int* end_px) {
+  const int64_t bp = bytes2pixel->NumBytesPerPixel();
+  const int64_t b0 = int64_t(page) << page_bits_;
+  const int64_t b1 = std::min<int64_t>(b0 + (int64_t(1) << page_bits_), bytes.size());
+  *first_px = int(b0 / bp);
+  *end_px = std::min(int((b1 + bp - 1) / bp), pixel_w * pixel_h);
+}
+
+void MemView::PaintHeat(int page) {
+  int p0, p1;
+  PageToPixels(page, &p0, &p1);
+  for (int i=p0; i<p1; i++) {
+    unsigned char* o = overlay_.data() + 4 * ((pixel_h - 1 - i / pixel_w) * pixel_w + i % pixel_w);
+    o[0] = 255; o[1] = 32; o[2] = 0; o[3] = heat_[page] / 2;
   }
 }
 
 void MemView::ReadMemoryFromQEMU() {
-  std::fill(pixels.begin(), pixels.end(), 0);
-  DumpPhysicalMemoryForMyDebug(0, bytes.size(), bytes.data());
+  const std::chrono::time_point<std::chrono::steady_clock> t0 = std::chrono::steady_clock::now();
+  DumpPhysicalMemoryForMyDebug(0, bytes.size(), bytes.data(), read_io_);
   ConvertToPixels();
+  last_read_ms_ = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - t0).count();
+}
+
+// Clear-then-read so that any write racing with the full read shows up as
+// dirty on the next frame.
+void MemView::StartDirtyTracking() {
+  page_bits_ = GetTargetPageBitsForMyDebug();
+  const int64_t npages = ((int64_t(bytes.size()) - 1) >> page_bits_) + 1;
+  const int bits_per_long = 8 * sizeof(unsigned long);
+  dirty_bitmap_.assign((npages + bits_per_long - 1) / bits_per_long, 0);
+  heat_.assign(npages, 0);
+  hot_pages_.clear();
+  overlay_.assign(pixel_w * pixel_h * 4, 0);
+
+  SetDirtyTrackingForMyDebug(1);
+  GetDirtyPagesForMyDebug(0, bytes.size(), dirty_bitmap_.data());
+  ReadMemoryFromQEMU();
+  tracking_ = true;
+}
+
+// Lets QEMU stop marking DIRTY_MEMORY_DEBUG once nothing reads it.
+void MemView::StopDirtyTracking() {
+  if (!tracking_) return;
+  SetDirtyTrackingForMyDebug(0);
+  tracking_ = false;
+}
+
+void MemView::RefreshDirtyPages() {
+  const std::chrono::time_point<std::chrono::steady_clock> t0 = std::chrono::steady_clock::now();
+  const int bits_per_long = 8 * sizeof(unsigned long);
+  std::fill(dirty_bitmap_.begin(), dirty_bitmap_.end(), 0);
+  last_dirty_pages_ = GetDirtyPagesForMyDebug(0, bytes.size(), dirty_bitmap_.data());
+
+  // Cool down what was hot, then re-read and heat up what was written.
+  std::vector<int> still_hot;
+  for (int page : hot_pages_) {
+    heat_[page] = heat_[page] * 7 / 8;
+    if (heat_[page] > 0) still_hot.push_back(page);
+    PaintHeat(page);
+  }
+  hot_pages_.swap(still_hot);
+
+  const int64_t page_size = int64_t(1) << page_bits_;
+  for (int wi = 0; wi < int(dirty_bitmap_.size()); wi++) {
+    unsigned long word = dirty_bitmap_[wi];
+    while (word) {
+      const int page = wi * bits_per_long + __builtin_ctzl(word);
+      word &= word - 1;
+      if (page >= int(heat_.size())) break;
+
+      const int64_t off = int64_t(page) << page_bits_;
+      const int64_t len = std::min<int64_t>(page_size, bytes.size() - off);
+      DumpPhysicalMemoryForMyDebug(off, len, bytes.data() + off, read_io_);
+      int p0, p1;
+      PageToPixels(page, &p0, &p1);
+      ConvertToPixels(p0, p1);
+
+      if (heat_[page] == 0) hot_pages_.push_back(page);
+      heat_[page] = std::min(255, heat_[page] + 64);
+      PaintHeat(page);
+    }
+  }
+  last_read_ms_ = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - t0).count();
 }
\ No newline at end of file
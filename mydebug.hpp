@@ -3,25 +3,72 @@
 #include "include/qemu/typedefs.h"
 #include <stdint.h>
 
+// What OnWatchdogEvent() reports
+#define BUDDY_WDT_ARM          1  // Enabled, with or without a restart
+#define BUDDY_WDT_DISARM       2  // Disabled; the count is kept
+#define BUDDY_WDT_KICK         3  // Restarted by software while enabled
+#define BUDDY_WDT_EXPIRE       4  // Interrupt stage reached
+#define BUDDY_WDT_RESET        5  // Reset stage reached, reset signal raised
+#define BUDDY_WDT_DEVICE_RESET 6  // The timer module itself was reset
+
+// OnTBSample() flags
+#define BUDDY_SAMPLE_HALTED 1  // The vCPU was halted or stopped, pc is 0
+
+// Per-vCPU accounting, mirrors CPUExecStats in include/hw/core/cpu.h
+typedef struct BuddyCPUExecStats {
+  int64_t cpu_index;
+  uint64_t tbs;
+  uint64_t insns;
+  uint64_t exec_ns;
+  uint64_t translate_ns;
+  uint64_t bql_wait_ns;
+  uint64_t halted_ns;
+} BuddyCPUExecStats;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
   int IsBuddNeedsUpdate(void);
   void* MyBuddyInit(void* x);
   int IsBuddyStarted(void);
+  // Starts the buddy thread. mode is "gui" (GLUT window) or "headless";
+  // if snapshot_path is non-NULL, binary snapshots of the model are
+  // published there every frame. Returns 0 on success.
+  int MyBuddyStart(const char* mode, const char* snapshot_path, int frame_rate);
+  // Where the I2C transaction trace goes on 't' and on MyBuddyStop().
+  // Call before MyBuddyStart().
+  void MyBuddySetI2CTraceFile(const char* path);
+  // Lets the buddy drain the last events and write its exports; call once
+  // the vCPUs are stopped. Waits at most one second.
+  void MyBuddyStop(void);
   void AddLogEntry(const char* x);
   void AddI2CBus(const char*, void*, int);
-  void UpdateCPUICount(CPUState* cpu, int64_t executed);
-  void UpdateWatchdogState(int idx_, const char* irq_, const char* reset_, int64_t rem_ns_, int64_t qemu_ns_);
+  void UpdateCPUICount(int cpu_index, int64_t executed);
+  // Watchdog state changes in QEMU_CLOCK_VIRTUAL ns. kind is a
+  // BUDDY_WDT_*; expires_ns is the next deadline, 0 while disabled.
+  void OnWatchdogEvent(int index, int kind, int64_t now_ns, int64_t expires_ns);
+  // Where the watchdog history goes on 'w' and on MyBuddyStop().
+  // Call before MyBuddyStart().
+  void MyBuddySetWatchdogTraceFile(const char* path);
+  // Sampling profiler: hz samples per second per vCPU (0 leaves it off
+  // until 'p' is pressed), an optional guest ELF to symbolize pcs with,
+  // and where the folded stacks go on 'g' and on MyBuddyStop().
+  // Call before MyBuddyStart().
+  void MyBuddySetProfiler(int hz, const char* symbols, const char* folded_path);
+  // One sample: the guest pc of the block cpu_index was about to run.
+  void OnTBSample(int cpu_index, uint64_t pc, int tb_size, int flags);
 
-  // Count by I2C buses
-  void OnI2CTransactionStart(const char*, char*);
-  void OnI2CWrite(const char*);
-  void OnI2CRead(const char*);
-  void OnI2CTransactionEnd(const char*);
+  // Count by I2C buses, identified by I2CBus::serial_
+  void OnI2CTransactionStart(int serial);
+  void OnI2CWrite(int serial);
+  void OnI2CRead(int serial);
+  // One complete transaction, from the first start condition to
+  // i2c_end_transfer(), timed in QEMU_CLOCK_VIRTUAL ns.
+  void OnI2CTransactionDone(int serial, int address, int is_recv, int nack,
+                            int read_bytes, int write_bytes,
+                            int64_t start_ns, int64_t end_ns);
 
   int GetI2CSerial(void);
-  int ShouldInjectNACK(const char*); // For muxed buses, inject on parent buses(?)
 #ifdef __cplusplus
 }
 #endif
@@ -30,10 +77,19 @@ extern "C" {
 #ifdef __cplusplus
 #include <vector>
 #include <mutex>
+#include <string>
 #include <unordered_map>
+#include "mydebug_ring.hpp"
+#include "mydebug_snapshot.hpp"
+#include "mydebug_pixels.hpp"
+#include "mydebug_symbols.hpp"
 struct MyView {
   bool is_visible;
   virtual void Render() = 0;
+  // Model side, run once per frame on the buddy thread in both GUI and
+  // headless mode before any Render().
+  virtual void Update(long ms) {}
+  virtual void Serialize(BuddySnapshotWriter& w) {}
   MyView() : is_visible(true) {}
   virtual ~MyView() {}
   int x, y, w, h;
@@ -42,14 +98,25 @@ struct MyView {
   void SetSize(int _w, int _h);
 };
 
+// Only touched from the render thread; fed by BUDDY_EV_CPU_ICOUNT events
+// (with -icount) and by polling the vCPUs' CPUExecStats.
 struct CPUStateView : public MyView {
   CPUStateView();
-  std::unordered_map<CPUState*, int64_t> inst_counts_;
-  std::vector<CPUState*> cpus_;  // in creation order
+  std::vector<int64_t> inst_counts_;  // indexed by cpu_index
+  std::vector<bool> seen_;
 
-  void UpdateCPUICount(CPUState* cpu, int64_t executed);
+  // Latest and previous samples, in the order QEMU lists the vCPUs, and
+  // the rates between them: instructions per second and the share of
+  // wall time spent executing, translating, waiting for the BQL, halted.
+  std::vector<BuddyCPUExecStats> exec_, exec_prev_;
+  std::vector<double> ips_;
+  std::vector<float> time_share_;  // 4 per vCPU
+  long exec_prev_ms_;
+
+  void UpdateCPUICount(int cpu_index, int64_t executed);
+  void Update(long ms) override;
   void Render() override;
-  std::mutex mtx_;
+  void Serialize(BuddySnapshotWriter& w) override;
 };
 
 struct LogView : public MyView {
@@ -58,21 +125,49 @@ struct LogView : public MyView {
   int num_entries_;
   int log_idx_;
 
+  // Log lines may come from any thread; they are queued under pending_mtx_
+  // and moved into logs_ by the render thread.
+  std::mutex pending_mtx_;
+  std::vector<std::string> pending_;
+
   void AddLogEntry(const std::string& s);
+  void FlushPending();
   void Render() override;
+  void Serialize(BuddySnapshotWriter& w) override;
 };
 
+// Timeline of the NPCM7xx watchdogs, fed by BUDDY_EV_WDT events.
 struct NPCM7XXStateView : public MyView {
-  struct MyNPCM7XXWDState {
-    std::string irq, reset;
-    int64_t expires_ns;
+  struct WatchdogState {
+    bool armed;
+    int last_kind;
+    int64_t expires_ns;     // 0 while disabled
+    int64_t last_kick_ns;   // Last arm or kick, -1 if none yet
+    uint32_t kicks, expires, resets;
+    // Interval between consecutive kicks (Welford's running variance)
+    uint32_t intervals;
+    int64_t interval_min_ns, interval_max_ns;
+    double interval_mean_ns, interval_m2;
+    WatchdogState();
+    double IntervalStddevNs() const;
   };
   NPCM7XXStateView();
-  std::vector<struct MyNPCM7XXWDState> states_;
+  std::vector<WatchdogState> states_;  // indexed by timer module
 
+  // Latest QEMU_CLOCK_VIRTUAL time known to the buddy; the timeline's
+  // right edge.
   int64_t qemu_ns;
-  void UpdateWatchdogState(int idx_, std::string irq_, std::string reset_, int64_t exp_ns_, int64_t qemu_ns_);
+  int64_t span_ns;  // Width of the timeline
+
+  // Most recent events, overwritten oldest first
+  std::vector<BuddyWatchdogTraceRecord> trace_;
+  uint64_t trace_total_;
+
+  void OnWatchdogEvent(const BuddyEvent& e);
+  void Update(long ms) override;
   void Render() override;
+  void Serialize(BuddySnapshotWriter& w) override;
+  bool ExportTrace(const char* path);
 };
 
 struct I2CBusStateView : public MyView {
@@ -84,31 +179,75 @@ struct I2CBusStateView : public MyView {
     }
   };
 
+  // Log2 histogram of transaction latencies in virtual ns
+  struct LatencyHistogram {
+    uint32_t buckets[BUDDY_I2C_LATENCY_BUCKETS];
+    uint32_t count, nacks;
+    int64_t max_ns;
+    LatencyHistogram();
+    void Add(int64_t ns, bool nack);
+    // Upper bound of the bucket holding the p-th quantile, 0 <= p <= 1
+    int64_t Quantile(double p) const;
+  };
+
   int hovered_i2c_idx;
-  std::vector<bool> pending_i2c_nacks;
 
   std::vector<int> tx_count_last_interval, read_count_last_interval, write_count_last_interval;
-  std::unordered_map<std::string, int> i2c2idx_;
-  std::unordered_map<std::string, void*> i2c2bus_;
-  std::vector<struct I2CBusState> states_;
+  std::vector<struct I2CBusState> states_;  // indexed by bus serial
   I2CBusStateView();
-  void AddI2CBus(const char*, void*, int);
+  void AddI2CBus(int serial);
+  void Update(long ms) override;
   void Render() override;
+  void Serialize(BuddySnapshotWriter& w) override;
   long last_update_millis;
-  void OnI2CTransactionStart(const char*, char*);
-  void OnI2CWrite(const char*);
-  void OnI2CRead(const char*);
+  void OnI2CTransactionStart(int serial);
+  void OnI2CWrite(int serial);
+  void OnI2CRead(int serial);
+  void OnI2CTransactionDone(const BuddyEvent& e);
   void OnMouseDown(int button);
+  bool IsNACKPending(int serial);
+
+  // Latency per bus and per (bus, 7-bit address); the latter is indexed by
+  // serial * 128 + address and allocated on first use.
+  std::vector<LatencyHistogram> bus_latency_;
+  std::vector<LatencyHistogram*> addr_latency_;
+  // Most recent transactions, overwritten oldest first
+  std::vector<BuddyI2CTraceRecord> trace_;
+  uint64_t trace_total_;
+  bool ExportTrace(const char* path);
 };
 
-// How to visualize bytes/words
-class BytesToPixelIntf {
-public:
-	virtual int NumBytesPerPixel() = 0;
-	virtual void BytesToPixel(unsigned char* byte_ptr, unsigned char* pixel_ptr) = 0;
-	virtual unsigned int Format() = 0;
-	virtual ~BytesToPixelIntf() {}
-	virtual int NumPixelDataChannels() = 0;
+// Sampling profiler, fed by BUDDY_EV_TB_SAMPLE events.
+struct ProfileView : public MyView {
+  struct PCStats {
+    uint32_t samples;
+    uint32_t tb_size;  // Of the last block sampled at this pc
+  };
+  typedef std::unordered_map<uint64_t, PCStats> Histogram;
+
+  ProfileView();
+  std::vector<Histogram> per_cpu_;  // indexed by cpu_index
+  std::vector<uint64_t> halted_;    // indexed by cpu_index
+  Histogram all_;
+  uint64_t total_, halted_total_;
+
+  int hz_;          // Requested sampling rate, 0 = off
+  int applied_hz_;  // Rate QEMU last accepted, -1 before that
+  int last_hz_;     // What 'p' turns back on
+  BuddySymbolTable symbols_;
+
+  // Hottest pcs over all vCPUs, refreshed every PROFILE_TOP_MS
+  std::vector<std::pair<uint64_t, PCStats> > top_;
+  long top_ms_;
+
+  void OnTBSample(const BuddyEvent& e);
+  void LoadSymbols(const char* path);
+  void Toggle();
+  std::string Symbolize(uint64_t pc) const;
+  void Update(long ms) override;
+  void Render() override;
+  void Serialize(BuddySnapshotWriter& w) override;
+  bool ExportFolded(const char* path);
 };
 
 struct MemView : public MyView {
@@ -119,9 +258,36 @@ struct MemView : public MyView {
   int pixel_w, pixel_h;
 
   BytesToPixelIntf* bytes2pixel;
+  int format_;
+  BuddyWorkerPool* pool_;
+  bool live_;     // Refresh every frame instead of on Space
+  bool read_io_;  // Also dispatch reads to MMIO regions (takes the BQL)
+  float last_read_ms_;
+
+  // Incremental refresh: once tracking_ is on, live frames only re-read
+  // and re-convert the pages QEMU reports as written (DIRTY_MEMORY_DEBUG).
+  bool tracking_;
+  int page_bits_;
+  int64_t last_dirty_pages_;
+  std::vector<unsigned long> dirty_bitmap_;
+
+  // Write-frequency heat map, one byte per page, decaying every frame.
+  bool show_heat_;
+  std::vector<unsigned char> heat_;
+  std::vector<int> hot_pages_;
+  std::vector<unsigned char> overlay_;  // RGBA, same layout as pixels
+
   void SetSize(int _w, int _h);
+  void SetFormat(int kind);
+  void Update(long ms) override;
   void ReadMemoryFromQEMU();
+  void RefreshDirtyPages();
+  void StartDirtyTracking();
+  void StopDirtyTracking();
   void ConvertToPixels();
+  void ConvertToPixels(int first_px, int end_px);
+  void PaintHeat(int page);
+  void PageToPixels(int page, int* first_px, int* end_px);
 };
 
 #endif
\ No newline at end of file
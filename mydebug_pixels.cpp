@@ -0,0 +1,477 @@
+// Bytes-to-pixel converters and worker pool, see mydebug_pixels.hpp
+
+#include "mydebug_pixels.hpp"
+
+#include <GL/gl.h>
+#include <math.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define BUDDY_HAVE_SSE2 1
+#define BUDDY_HAVE_AVX2 1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define BUDDY_HAVE_NEON 1
+#endif
+
+typedef void (*RowFn)(const uint8_t* src, uint8_t* dst, int n);
+
+// ===================== Scalar kernels (reference + row tails) ==============
+
+struct RGBKernel {
+  enum { BPP = 3, NC = 3 };
+  static inline void Pixel(const uint8_t* s, uint8_t* d) {
+    d[0] = s[0]; d[1] = s[1]; d[2] = s[2];
+  }
+};
+
+struct RGKernel {
+  enum { BPP = 2, NC = 4 };
+  static inline void Pixel(const uint8_t* s, uint8_t* d) {
+    d[0] = s[0]; d[1] = s[1]; d[2] = 0; d[3] = 255;
+  }
+};
+
+struct RGB565Kernel {
+  enum { BPP = 2, NC = 4 };
+  static inline void Pixel(const uint8_t* s, uint8_t* d) {
+    const unsigned v = s[0] | (s[1] << 8);
+    const unsigned r = v >> 11, g = (v >> 5) & 0x3f, b = v & 0x1f;
+    d[0] = (r << 3) | (r >> 2);
+    d[1] = (g << 2) | (g >> 4);
+    d[2] = (b << 3) | (b >> 2);
+    d[3] = 255;
+  }
+};
+
+struct RGBXKernel {
+  enum { BPP = 4, NC = 4 };
+  static inline void Pixel(const uint8_t* s, uint8_t* d) {
+    d[0] = s[0]; d[1] = s[1]; d[2] = s[2]; d[3] = 255;
+  }
+};
+
+// Zero: black, printable: green, \t\n\r: blue, 0xff: white, other: red.
+struct ASCIIKernel {
+  enum { BPP = 1, NC = 4 };
+  static inline void Pixel(const uint8_t* s, uint8_t* d) {
+    const uint8_t c = s[0];
+    if (c == 0) {
+      d[0] = 0x00; d[1] = 0x00; d[2] = 0x00;
+    } else if (c >= 0x20 && c < 0x7f) {
+      d[0] = 0x30; d[1] = 0xe0; d[2] = 0x30;
+    } else if (c == '\t' || c == '\n' || c == '\r') {
+      d[0] = 0x30; d[1] = 0x80; d[2] = 0xe0;
+    } else if (c == 0xff) {
+      d[0] = 0xff; d[1] = 0xff; d[2] = 0xff;
+    } else {
+      d[0] = 0xb0; d[1] = 0x20; d[2] = 0x20;
+    }
+    d[3] = 255;
+  }
+};
+
+// Entropy of a 32-byte block is in [0, 5] bits; shown as a blue (0) to
+// yellow (5) ramp, so code, compressed data and zero-filled areas stand
+// apart at a glance.
+struct EntropyKernel {
+  enum { BPP = 32, NC = 4 };
+  static float clog2c_[BPP + 1];  // c * log2(c)
+  static void InitTables() {
+    clog2c_[0] = 0;
+    for (int c = 1; c <= BPP; c++) clog2c_[c] = c * log2f(float(c));
+  }
+  static inline void Pixel(const uint8_t* s, uint8_t* d) {
+    uint8_t counts[256];
+    uint8_t seen[BPP];
+    int nseen = 0;
+    for (int i = 0; i < BPP; i++) {
+      counts[s[i]] = 0;
+    }
+    for (int i = 0; i < BPP; i++) {
+      if (counts[s[i]]++ == 0) seen[nseen++] = s[i];
+    }
+    float sum = 0;
+    for (int i = 0; i < nseen; i++) sum += clog2c_[counts[seen[i]]];
+    // H = log2(N) - sum(c log2 c) / N
+    const float h = 5.0f - sum / BPP;
+    const int v = int(h * (255.0f / 5.0f) + 0.5f);
+    d[0] = uint8_t(v);
+    d[1] = uint8_t(v * 3 / 4);
+    d[2] = uint8_t(255 - v);
+    d[3] = 255;
+  }
+};
+float EntropyKernel::clog2c_[EntropyKernel::BPP + 1];
+
+template <typename K>
+static void ScalarRow(const uint8_t* src, uint8_t* dst, int n) {
+  for (int i = 0; i < n; i++, src += K::BPP, dst += K::NC) {
+    K::Pixel(src, dst);
+  }
+}
+
+template <>
+void ScalarRow<RGBKernel>(const uint8_t* src, uint8_t* dst, int n) {
+  memcpy(dst, src, size_t(n) * 3);
+}
+
+// ===================== SSE2 / AVX2 =========================================
+
+#ifdef BUDDY_HAVE_SSE2
+static void SSE2RowRG(const uint8_t* src, uint8_t* dst, int n) {
+  const __m128i ba = _mm_set1_epi16(int16_t(0xff00));
+  int i = 0;
+  for (; i + 8 <= n; i += 8, src += 16, dst += 32) {
+    const __m128i v = _mm_loadu_si128((const __m128i*)src);
+    _mm_storeu_si128((__m128i*)dst, _mm_unpacklo_epi16(v, ba));
+    _mm_storeu_si128((__m128i*)(dst + 16), _mm_unpackhi_epi16(v, ba));
+  }
+  ScalarRow<RGKernel>(src, dst, n - i);
+}
+
+static inline __m128i RGB565ToRG(__m128i v, __m128i* ba) {
+  const __m128i m5 = _mm_set1_epi16(0x1f), m6 = _mm_set1_epi16(0x3f);
+  __m128i r = _mm_srli_epi16(v, 11);
+  __m128i g = _mm_and_si128(_mm_srli_epi16(v, 5), m6);
+  __m128i b = _mm_and_si128(v, m5);
+  r = _mm_or_si128(_mm_slli_epi16(r, 3), _mm_srli_epi16(r, 2));
+  g = _mm_or_si128(_mm_slli_epi16(g, 2), _mm_srli_epi16(g, 4));
+  b = _mm_or_si128(_mm_slli_epi16(b, 3), _mm_srli_epi16(b, 2));
+  *ba = _mm_or_si128(b, _mm_set1_epi16(int16_t(0xff00)));
+  return _mm_or_si128(r, _mm_slli_epi16(g, 8));
+}
+
+static void SSE2RowRGB565(const uint8_t* src, uint8_t* dst, int n) {
+  int i = 0;
+  for (; i + 8 <= n; i += 8, src += 16, dst += 32) {
+    __m128i ba;
+    const __m128i rg = RGB565ToRG(_mm_loadu_si128((const __m128i*)src), &ba);
+    _mm_storeu_si128((__m128i*)dst, _mm_unpacklo_epi16(rg, ba));
+    _mm_storeu_si128((__m128i*)(dst + 16), _mm_unpackhi_epi16(rg, ba));
+  }
+  ScalarRow<RGB565Kernel>(src, dst, n - i);
+}
+
+static void SSE2RowRGBX(const uint8_t* src, uint8_t* dst, int n) {
+  const __m128i a = _mm_set1_epi32(int32_t(0xff000000));
+  int i = 0;
+  for (; i + 4 <= n; i += 4, src += 16, dst += 16) {
+    const __m128i v = _mm_loadu_si128((const __m128i*)src);
+    _mm_storeu_si128((__m128i*)dst, _mm_or_si128(v, a));
+  }
+  ScalarRow<RGBXKernel>(src, dst, n - i);
+}
+
+static void SSE2RowASCII(const uint8_t* src, uint8_t* dst, int n) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i ones = _mm_set1_epi8(-1);
+  int i = 0;
+  for (; i + 16 <= n; i += 16, src += 16, dst += 64) {
+    const __m128i c = _mm_loadu_si128((const __m128i*)src);
+    const __m128i is_zero = _mm_cmpeq_epi8(c, zero);
+    const __m128i is_ff = _mm_cmpeq_epi8(c, ones);
+    // 0x80..0xff are negative as int8, so the signed compares work out.
+    const __m128i is_print = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8(0x1f)),
+                                           _mm_cmplt_epi8(c, _mm_set1_epi8(0x7f)));
+    const __m128i is_ws = _mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8('\t')),
+                          _mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8('\n')),
+                                       _mm_cmpeq_epi8(c, _mm_set1_epi8('\r'))));
+    const __m128i is_other = _mm_andnot_si128(
+        _mm_or_si128(_mm_or_si128(is_zero, is_ff), _mm_or_si128(is_print, is_ws)), ones);
+#define SEL(m, v) _mm_and_si128(m, _mm_set1_epi8(char(v)))
+    const __m128i r = _mm_or_si128(_mm_or_si128(SEL(is_print, 0x30), SEL(is_ws, 0x30)),
+                                   _mm_or_si128(is_ff, SEL(is_other, 0xb0)));
+    const __m128i g = _mm_or_si128(_mm_or_si128(SEL(is_print, 0xe0), SEL(is_ws, 0x80)),
+                                   _mm_or_si128(is_ff, SEL(is_other, 0x20)));
+    const __m128i b = _mm_or_si128(_mm_or_si128(SEL(is_print, 0x30), SEL(is_ws, 0xe0)),
+                                   _mm_or_si128(is_ff, SEL(is_other, 0x20)));
+#undef SEL
+    const __m128i rg_lo = _mm_unpacklo_epi8(r, g), rg_hi = _mm_unpackhi_epi8(r, g);
+    const __m128i ba_lo = _mm_unpacklo_epi8(b, ones), ba_hi = _mm_unpackhi_epi8(b, ones);
+    _mm_storeu_si128((__m128i*)dst, _mm_unpacklo_epi16(rg_lo, ba_lo));
+    _mm_storeu_si128((__m128i*)(dst + 16), _mm_unpackhi_epi16(rg_lo, ba_lo));
+    _mm_storeu_si128((__m128i*)(dst + 32), _mm_unpacklo_epi16(rg_hi, ba_hi));
+    _mm_storeu_si128((__m128i*)(dst + 48), _mm_unpackhi_epi16(rg_hi, ba_hi));
+  }
+  ScalarRow<ASCIIKernel>(src, dst, n - i);
+}
+#endif
+
+#ifdef BUDDY_HAVE_AVX2
+// The 256-bit unpacks work within 128-bit lanes, so the source quadwords
+// are first reordered to [q0 q2 | q1 q3]; unpacklo then yields pixels
+// 0..7 and unpackhi pixels 8..15, each in order.
+__attribute__((target("avx2")))
+static void AVX2RowRG(const uint8_t* src, uint8_t* dst, int n) {
+  const __m256i ba = _mm256_set1_epi16(int16_t(0xff00));
+  int i = 0;
+  for (; i + 16 <= n; i += 16, src += 32, dst += 64) {
+    __m256i v = _mm256_loadu_si256((const __m256i*)src);
+    v = _mm256_permute4x64_epi64(v, 0xd8);
+    _mm256_storeu_si256((__m256i*)dst, _mm256_unpacklo_epi16(v, ba));
+    _mm256_storeu_si256((__m256i*)(dst + 32), _mm256_unpackhi_epi16(v, ba));
+  }
+  SSE2RowRG(src, dst, n - i);
+}
+
+__attribute__((target("avx2")))
+static void AVX2RowRGB565(const uint8_t* src, uint8_t* dst, int n) {
+  const __m256i m5 = _mm256_set1_epi16(0x1f), m6 = _mm256_set1_epi16(0x3f);
+  const __m256i a = _mm256_set1_epi16(int16_t(0xff00));
+  int i = 0;
+  for (; i + 16 <= n; i += 16, src += 32, dst += 64) {
+    __m256i v = _mm256_loadu_si256((const __m256i*)src);
+    v = _mm256_permute4x64_epi64(v, 0xd8);
+    __m256i r = _mm256_srli_epi16(v, 11);
+    __m256i g = _mm256_and_si256(_mm256_srli_epi16(v, 5), m6);
+    __m256i b = _mm256_and_si256(v, m5);
+    r = _mm256_or_si256(_mm256_slli_epi16(r, 3), _mm256_srli_epi16(r, 2));
+    g = _mm256_or_si256(_mm256_slli_epi16(g, 2), _mm256_srli_epi16(g, 4));
+    b = _mm256_or_si256(_mm256_slli_epi16(b, 3), _mm256_srli_epi16(b, 2));
+    const __m256i rg = _mm256_or_si256(r, _mm256_slli_epi16(g, 8));
+    const __m256i ba = _mm256_or_si256(b, a);
+    _mm256_storeu_si256((__m256i*)dst, _mm256_unpacklo_epi16(rg, ba));
+    _mm256_storeu_si256((__m256i*)(dst + 32), _mm256_unpackhi_epi16(rg, ba));
+  }
+  SSE2RowRGB565(src, dst, n - i);
+}
+
+__attribute__((target("avx2")))
+static void AVX2RowRGBX(const uint8_t* src, uint8_t* dst, int n) {
+  const __m256i a = _mm256_set1_epi32(int32_t(0xff000000));
+  int i = 0;
+  for (; i + 8 <= n; i += 8, src += 32, dst += 32) {
+    const __m256i v = _mm256_loadu_si256((const __m256i*)src);
+    _mm256_storeu_si256((__m256i*)dst, _mm256_or_si256(v, a));
+  }
+  SSE2RowRGBX(src, dst, n - i);
+}
+
+static bool HostHasAVX2() {
+  static const bool has = __builtin_cpu_supports("avx2");
+  return has;
+}
+#endif
+
+// ===================== NEON ================================================
+
+#ifdef BUDDY_HAVE_NEON
+static void NEONRowRG(const uint8_t* src, uint8_t* dst, int n) {
+  int i = 0;
+  for (; i + 16 <= n; i += 16, src += 32, dst += 64) {
+    const uint8x16x2_t v = vld2q_u8(src);
+    uint8x16x4_t o;
+    o.val[0] = v.val[0]; o.val[1] = v.val[1];
+    o.val[2] = vdupq_n_u8(0); o.val[3] = vdupq_n_u8(255);
+    vst4q_u8(dst, o);
+  }
+  ScalarRow<RGKernel>(src, dst, n - i);
+}
+
+static void NEONRowRGB565(const uint8_t* src, uint8_t* dst, int n) {
+  int i = 0;
+  for (; i + 8 <= n; i += 8, src += 16, dst += 32) {
+    const uint16x8_t v = vld1q_u16((const uint16_t*)src);
+    const uint16x8_t r = vshrq_n_u16(v, 11);
+    const uint16x8_t g = vandq_u16(vshrq_n_u16(v, 5), vdupq_n_u16(0x3f));
+    const uint16x8_t b = vandq_u16(v, vdupq_n_u16(0x1f));
+    uint8x8x4_t o;
+    o.val[0] = vmovn_u16(vorrq_u16(vshlq_n_u16(r, 3), vshrq_n_u16(r, 2)));
+    o.val[1] = vmovn_u16(vorrq_u16(vshlq_n_u16(g, 2), vshrq_n_u16(g, 4)));
+    o.val[2] = vmovn_u16(vorrq_u16(vshlq_n_u16(b, 3), vshrq_n_u16(b, 2)));
+    o.val[3] = vdup_n_u8(255);
+    vst4_u8(dst, o);
+  }
+  ScalarRow<RGB565Kernel>(src, dst, n - i);
+}
+
+static void NEONRowRGBX(const uint8_t* src, uint8_t* dst, int n) {
+  const uint32x4_t a = vdupq_n_u32(0xff000000u);
+  int i = 0;
+  for (; i + 4 <= n; i += 4, src += 16, dst += 16) {
+    vst1q_u32((uint32_t*)dst, vorrq_u32(vld1q_u32((const uint32_t*)src), a));
+  }
+  ScalarRow<RGBXKernel>(src, dst, n - i);
+}
+
+static void NEONRowASCII(const uint8_t* src, uint8_t* dst, int n) {
+  int i = 0;
+  for (; i + 16 <= n; i += 16, src += 16, dst += 64) {
+    const uint8x16_t c = vld1q_u8(src);
+    const uint8x16_t is_zero = vceqq_u8(c, vdupq_n_u8(0));
+    const uint8x16_t is_ff = vceqq_u8(c, vdupq_n_u8(0xff));
+    const uint8x16_t is_print = vandq_u8(vcgeq_u8(c, vdupq_n_u8(0x20)),
+                                         vcltq_u8(c, vdupq_n_u8(0x7f)));
+    const uint8x16_t is_ws = vorrq_u8(vceqq_u8(c, vdupq_n_u8('\t')),
+                             vorrq_u8(vceqq_u8(c, vdupq_n_u8('\n')),
+                                      vceqq_u8(c, vdupq_n_u8('\r'))));
+    const uint8x16_t is_other = vmvnq_u8(vorrq_u8(vorrq_u8(is_zero, is_ff),
+                                                  vorrq_u8(is_print, is_ws)));
+#define SEL(m, v) vandq_u8(m, vdupq_n_u8(v))
+    uint8x16x4_t o;
+    o.val[0] = vorrq_u8(vorrq_u8(SEL(is_print, 0x30), SEL(is_ws, 0x30)),
+                        vorrq_u8(is_ff, SEL(is_other, 0xb0)));
+    o.val[1] = vorrq_u8(vorrq_u8(SEL(is_print, 0xe0), SEL(is_ws, 0x80)),
+                        vorrq_u8(is_ff, SEL(is_other, 0x20)));
+    o.val[2] = vorrq_u8(vorrq_u8(SEL(is_print, 0x30), SEL(is_ws, 0xe0)),
+                        vorrq_u8(is_ff, SEL(is_other, 0x20)));
+#undef SEL
+    o.val[3] = vdupq_n_u8(255);
+    vst4q_u8(dst, o);
+  }
+  ScalarRow<ASCIIKernel>(src, dst, n - i);
+}
+#endif
+
+// ===================== Converter classes ===================================
+
+template <typename K>
+class BytesToPixelT : public BytesToPixelIntf {
+public:
+  BytesToPixelT(const char* name, RowFn row, const char* isa)
+      : name_(name), row_(row), isa_(isa) {}
+  int NumBytesPerPixel() override { return K::BPP; }
+  int NumPixelDataChannels() override { return K::NC; }
+  void BytesToPixel(unsigned char* byte_ptr, unsigned char* pixel_ptr) override {
+    K::Pixel(byte_ptr, pixel_ptr);
+  }
+  unsigned int Format() override { return K::NC == 4 ? GL_RGBA : GL_RGB; }
+  void ConvertRow(const unsigned char* src, unsigned char* dst, int npixels) override {
+    row_(src, dst, npixels);
+  }
+  const char* Name() override { return name_; }
+  const char* Isa() override { return isa_; }
+
+private:
+  const char* name_;
+  RowFn row_;
+  const char* isa_;
+};
+
+template <typename K>
+static BytesToPixelIntf* Make(const char* name, RowFn sse2, RowFn avx2, RowFn neon) {
+#if defined(BUDDY_HAVE_AVX2)
+  if (avx2 && HostHasAVX2()) return new BytesToPixelT<K>(name, avx2, "avx2");
+#else
+  (void)avx2;
+#endif
+#if defined(BUDDY_HAVE_SSE2)
+  if (sse2) return new BytesToPixelT<K>(name, sse2, "sse2");
+#else
+  (void)sse2;
+#endif
+#if defined(BUDDY_HAVE_NEON)
+  if (neon) return new BytesToPixelT<K>(name, neon, "neon");
+#else
+  (void)neon;
+#endif
+  return new BytesToPixelT<K>(name, ScalarRow<K>, "scalar");
+}
+
+#if !defined(BUDDY_HAVE_SSE2)
+#define SSE2RowRG nullptr
+#define SSE2RowRGB565 nullptr
+#define SSE2RowRGBX nullptr
+#define SSE2RowASCII nullptr
+#endif
+#if !defined(BUDDY_HAVE_AVX2)
+#define AVX2RowRG nullptr
+#define AVX2RowRGB565 nullptr
+#define AVX2RowRGBX nullptr
+#endif
+#if !defined(BUDDY_HAVE_NEON)
+#define NEONRowRG nullptr
+#define NEONRowRGB565 nullptr
+#define NEONRowRGBX nullptr
+#define NEONRowASCII nullptr
+#endif
+
+BytesToPixelIntf* CreateBytesToPixel(int kind) {
+  switch (kind) {
+    case BYTES_TO_RGB:
+      return new BytesToPixelT<RGBKernel>("RGB", ScalarRow<RGBKernel>, "memcpy");
+    case BYTES_TO_RG:
+      return Make<RGKernel>("RG", SSE2RowRG, AVX2RowRG, NEONRowRG);
+    case BYTES_TO_RGB565:
+      return Make<RGB565Kernel>("RGB565", SSE2RowRGB565, AVX2RowRGB565, NEONRowRGB565);
+    case BYTES_TO_RGBX:
+      return Make<RGBXKernel>("RGBX32", SSE2RowRGBX, AVX2RowRGBX, NEONRowRGBX);
+    case BYTES_TO_ENTROPY:
+      EntropyKernel::InitTables();
+      return Make<EntropyKernel>("Entropy/32B", nullptr, nullptr, nullptr);
+    case BYTES_TO_ASCII:
+      return Make<ASCIIKernel>("ASCII", SSE2RowASCII, nullptr, NEONRowASCII);
+    default:
+      return nullptr;
+  }
+}
+
+// ===================== Worker pool =========================================
+
+BuddyWorkerPool::BuddyWorkerPool(int nthreads)
+    : job_(nullptr), job_n_(0), pending_(0), generation_(0), stop_(false) {
+  for (int i = 0; i < nthreads; i++) {
+    threads_.push_back(std::thread(&BuddyWorkerPool::WorkerLoop, this, i + 1));
+  }
+}
+
+BuddyWorkerPool::~BuddyWorkerPool() {
+  {
+    std::lock_guard<std::mutex> lk(mtx_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  for (std::thread& t : threads_) t.join();
+}
+
+static void ChunkBounds(int n, int nparts, int part, int* begin, int* end) {
+  *begin = int(int64_t(n) * part / nparts);
+  *end = int(int64_t(n) * (part + 1) / nparts);
+}
+
+void BuddyWorkerPool::WorkerLoop(int idx) {
+  uint64_t seen = 0;
+  for (;;) {
+    const std::function<void(int, int)>* job;
+    int n;
+    {
+      std::unique_lock<std::mutex> lk(mtx_);
+      cv_.wait(lk, [&] { return stop_ || generation_ != seen; });
+      if (stop_) return;
+      seen = generation_;
+      job = job_;
+      n = job_n_;
+    }
+    int begin, end;
+    ChunkBounds(n, NumThreads(), idx, &begin, &end);
+    if (begin < end) (*job)(begin, end);
+    {
+      std::lock_guard<std::mutex> lk(mtx_);
+      if (--pending_ == 0) done_cv_.notify_one();
+    }
+  }
+}
+
+void BuddyWorkerPool::ParallelFor(int n, const std::function<void(int, int)>& fn) {
+  if (threads_.empty() || n < NumThreads()) {
+    fn(0, n);
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lk(mtx_);
+    job_ = &fn;
+    job_n_ = n;
+    pending_ = int(threads_.size());
+    ++ generation_;
+  }
+  cv_.notify_all();
+
+  int begin, end;
+  ChunkBounds(n, NumThreads(), 0, &begin, &end);
+  fn(begin, end);
+
+  std::unique_lock<std::mutex> lk(mtx_);
+  done_cv_.wait(lk, [&] { return pending_ == 0; });
+}
@@ -0,0 +1,72 @@
+// Bytes-to-pixel converters and the worker pool used by MemView
+//
+// Each converter turns a run of guest bytes into a run of pixels one row
+// at a time. The row kernels are specialized per format at compile time
+// and, where it pays off, come in SSE2/AVX2 (x86-64) and NEON (AArch64)
+// flavours picked once at construction; the scalar kernel handles the
+// row tail and every other host.
+
+#ifndef MYDEBUG_PIXELS_HPP
+#define MYDEBUG_PIXELS_HPP
+
+#include <stdint.h>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// How to visualize bytes/words
+class BytesToPixelIntf {
+public:
+	virtual int NumBytesPerPixel() = 0;
+	virtual void BytesToPixel(unsigned char* byte_ptr, unsigned char* pixel_ptr) = 0;
+	virtual unsigned int Format() = 0;
+	virtual ~BytesToPixelIntf() {}
+	virtual int NumPixelDataChannels() = 0;
+	// Converts npixels consecutive pixels; src and dst do not overlap.
+	virtual void ConvertRow(const unsigned char* src, unsigned char* dst, int npixels) {
+		for (int i=0; i<npixels; i++) {
+			BytesToPixel(const_cast<unsigned char*>(src) + i * NumBytesPerPixel(),
+			             dst + i * NumPixelDataChannels());
+		}
+	}
+	virtual const char* Name() = 0;
+	virtual const char* Isa() { return "scalar"; }
+};
+
+enum BytesToPixelKind {
+	BYTES_TO_RGB = 0,   // 3 bytes -> R, G, B
+	BYTES_TO_RG,        // 2 bytes -> R, G
+	BYTES_TO_RGB565,    // 16-bit little-endian RGB565
+	BYTES_TO_RGBX,      // 32-bit little-endian R, G, B, unused
+	BYTES_TO_ENTROPY,   // Shannon entropy of each 32-byte block
+	BYTES_TO_ASCII,     // 1 byte, colored by character class
+	NUM_BYTES_TO_PIXEL_KINDS,
+};
+
+BytesToPixelIntf* CreateBytesToPixel(int kind);
+
+// Fixed set of threads that split a loop with the calling thread.
+class BuddyWorkerPool {
+public:
+	explicit BuddyWorkerPool(int nthreads);
+	~BuddyWorkerPool();
+	int NumThreads() const { return int(threads_.size()) + 1; }
+	// Calls fn(begin, end) on disjoint chunks covering [0, n) and returns
+	// once all of them are done. Not reentrant.
+	void ParallelFor(int n, const std::function<void(int, int)>& fn);
+
+private:
+	void WorkerLoop(int idx);
+	std::vector<std::thread> threads_;
+	std::mutex mtx_;
+	std::condition_variable cv_, done_cv_;
+	const std::function<void(int, int)>* job_;
+	int job_n_;
+	int pending_;
+	uint64_t generation_;
+	bool stop_;
+};
+
+#endif
@@ -0,0 +1,124 @@
+// Lock-free event rings between QEMU threads and the buddy render thread
+//
+// Every QEMU thread that reports to the buddy (vCPU threads, the main loop,
+// I/O threads) gets its own single-producer/single-consumer ring the first
+// time it posts an event. The render thread is the only consumer and drains
+// all rings once per frame. Posting an event is a couple of relaxed loads, a
+// 32-byte store and a release store: no allocation, no lock, no hashing.
+//
+// When a ring is full the event is dropped and counted instead of blocking
+// the producer; the buddy shows the drop count.
+
+#ifndef MYDEBUG_RING_HPP
+#define MYDEBUG_RING_HPP
+
+#include <stdint.h>
+#include <atomic>
+
+enum BuddyEventType : uint16_t {
+  BUDDY_EV_CPU_ICOUNT = 1,  // id = cpu_index, value = instructions executed
+  BUDDY_EV_I2C_BUS_ADD,     // id = bus serial
+  BUDDY_EV_I2C_TX_START,    // id = bus serial
+  BUDDY_EV_I2C_READ,        // id = bus serial
+  BUDDY_EV_I2C_WRITE,       // id = bus serial
+  BUDDY_EV_I2C_TX_DONE,     // id = bus serial, flags = BUDDY_I2C_*,
+                            // value = start ns, value2 = latency ns,
+                            // arg = read bytes | write bytes << 16
+  BUDDY_EV_WDT,             // id = watchdog index, flags = BUDDY_WDT_*,
+                            // value = virtual ns, value2 = deadline ns
+  BUDDY_EV_TB_SAMPLE,       // id = cpu_index, flags = BUDDY_SAMPLE_*,
+                            // value = guest pc, arg = TB size in bytes
+};
+
+// BUDDY_EV_I2C_TX_DONE flags
+#define BUDDY_I2C_ADDR_MASK 0x7f
+#define BUDDY_I2C_RECV      0x100  // Last (repeated) start was a read
+#define BUDDY_I2C_NACK      0x200  // Address or data phase was NACKed
+
+// Fixed-size POD record, two per cache line.
+struct BuddyEvent {
+  uint16_t type;
+  uint16_t flags;
+  int32_t id;
+  int64_t value;
+  int64_t value2;
+  uint32_t arg;
+  uint32_t reserved;
+};
+static_assert(sizeof(BuddyEvent) == 32, "BuddyEvent must stay 32 bytes");
+
+template <typename T, uint32_t kCapacity>
+class SpscRing {
+  static_assert((kCapacity & (kCapacity - 1)) == 0,
+                "capacity must be a power of two");
+public:
+  SpscRing() : head_(0), tail_(0), dropped_(0) {}
+
+  // Producer side.
+  bool Push(const T& item) {
+    const uint32_t head = head_.load(std::memory_order_relaxed);
+    const uint32_t tail = tail_.load(std::memory_order_acquire);
+    if (head - tail >= kCapacity) {
+      dropped_.store(dropped_.load(std::memory_order_relaxed) + 1,
+                     std::memory_order_relaxed);
+      return false;
+    }
+    items_[head & (kCapacity - 1)] = item;
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side. Calls fn(const T&) for every pending item.
+  template <typename Fn>
+  uint32_t Drain(Fn fn) {
+    const uint32_t tail = tail_.load(std::memory_order_relaxed);
+    const uint32_t head = head_.load(std::memory_order_acquire);
+    for (uint32_t i = tail; i != head; i++) {
+      fn(items_[i & (kCapacity - 1)]);
+    }
+    tail_.store(head, std::memory_order_release);
+    return head - tail;
+  }
+
+  uint64_t Dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+  // Keep producer and consumer indices on separate cache lines. Padding
+  // rather than alignas() so that plain C++11 operator new can allocate it.
+  std::atomic<uint32_t> head_;
+  char pad0_[64 - sizeof(std::atomic<uint32_t>)];
+  std::atomic<uint32_t> tail_;
+  char pad1_[64 - sizeof(std::atomic<uint32_t>)];
+  std::atomic<uint64_t> dropped_;
+  char pad2_[64 - sizeof(std::atomic<uint64_t>)];
+  T items_[kCapacity];
+};
+
+// 4096 events (128 KiB) per producer thread; at 20 FPS this absorbs ~80k
+// events/s per thread before anything is dropped.
+typedef SpscRing<BuddyEvent, 4096> BuddyEventRing;
+
+// Posts an event from the calling thread's ring, registering the ring on
+// first use. Safe to call before the buddy is started.
+void BuddyPostEvent(uint16_t type, int32_t id, int64_t value,
+                    int64_t value2 = 0, uint16_t flags = 0, uint32_t arg = 0);
+
+// Render-thread side: drains every registered ring in registration order.
+template <typename Fn> void BuddyDrainEvents(Fn fn);
+uint64_t BuddyDroppedEvents();
+
+// Implementation details shared with mydebug.cpp.
+enum { BUDDY_MAX_PRODUCERS = 64 };
+extern std::atomic<BuddyEventRing*> g_buddy_rings[BUDDY_MAX_PRODUCERS];
+extern std::atomic<int> g_buddy_num_rings;
+
+template <typename Fn>
+void BuddyDrainEvents(Fn fn) {
+  const int n = g_buddy_num_rings.load(std::memory_order_acquire);
+  for (int i = 0; i < n && i < BUDDY_MAX_PRODUCERS; i++) {
+    BuddyEventRing* r = g_buddy_rings[i].load(std::memory_order_acquire);
+    if (r) r->Drain(fn);
+  }
+}
+
+#endif
@@ -0,0 +1,110 @@
+// Binary snapshot encoder and sinks for the buddy, see mydebug_snapshot.hpp
+
+#include "mydebug_snapshot.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+BuddySnapshotWriter::BuddySnapshotWriter() : section_start_(0) {}
+
+void BuddySnapshotWriter::Begin(uint64_t frame, uint64_t host_ms,
+                                uint64_t dropped_events) {
+  buf_.clear();
+  BuddySnapshotHeader h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, BUDDY_SNAPSHOT_MAGIC, 4);
+  h.version = BUDDY_SNAPSHOT_VERSION;
+  h.header_size = sizeof(BuddySnapshotHeader);
+  h.frame = frame;
+  h.host_ms = host_ms;
+  h.dropped_events = dropped_events;
+  AppendPOD(h);
+}
+
+void BuddySnapshotWriter::BeginSection(uint16_t kind) {
+  section_start_ = buf_.size();
+  BuddySnapshotSection s;
+  s.kind = kind;
+  s.count = 0;
+  s.size = 0;
+  AppendPOD(s);
+}
+
+void BuddySnapshotWriter::EndSection(uint16_t count) {
+  BuddySnapshotSection* s =
+      reinterpret_cast<BuddySnapshotSection*>(buf_.data() + section_start_);
+  s->count = count;
+  s->size = uint32_t(buf_.size() - section_start_ - sizeof(*s));
+}
+
+void BuddySnapshotWriter::Append(const void* p, size_t n) {
+  const uint8_t* b = static_cast<const uint8_t*>(p);
+  buf_.insert(buf_.end(), b, b + n);
+}
+
+void BuddySnapshotWriter::AppendString(const std::string& s) {
+  const uint16_t len = uint16_t(std::min<size_t>(s.size(), 0xffff));
+  AppendPOD(len);
+  Append(s.data(), len);
+}
+
+const std::vector<uint8_t>& BuddySnapshotWriter::Finish() {
+  BuddySnapshotHeader* h = reinterpret_cast<BuddySnapshotHeader*>(buf_.data());
+  h->payload_size = uint32_t(buf_.size() - sizeof(*h));
+  return buf_;
+}
+
+BuddyMmapSink* BuddyMmapSink::Create(const char* path, size_t capacity) {
+  int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    perror("[BuddyMmapSink] open");
+    return nullptr;
+  }
+  if (ftruncate(fd, capacity) != 0) {
+    perror("[BuddyMmapSink] ftruncate");
+    close(fd);
+    return nullptr;
+  }
+  void* p = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (p == MAP_FAILED) {
+    perror("[BuddyMmapSink] mmap");
+    close(fd);
+    return nullptr;
+  }
+  BuddyMmapSink* sink = new BuddyMmapSink();
+  sink->fd_ = fd;
+  sink->base_ = static_cast<uint8_t*>(p);
+  sink->capacity_ = capacity;
+  return sink;
+}
+
+BuddyMmapSink::~BuddyMmapSink() {
+  if (base_) munmap(base_, capacity_);
+  if (fd_ >= 0) close(fd_);
+}
+
+void BuddyMmapSink::Publish(const std::vector<uint8_t>& snapshot) {
+  if (snapshot.size() > capacity_) {
+    if (!warned_) {
+      fprintf(stderr, "[BuddyMmapSink] snapshot of %zu bytes exceeds %zu, "
+              "dropping\n", snapshot.size(), capacity_);
+      warned_ = true;
+    }
+    return;
+  }
+  // Readers copy the header and payload, then re-check seq; an odd or
+  // changed value means they raced with us and must retry.
+  BuddySnapshotHeader* h = reinterpret_cast<BuddySnapshotHeader*>(base_);
+  const uint32_t seq = h->seq;
+  __atomic_store_n(&h->seq, seq + 1, __ATOMIC_RELAXED);
+  std::atomic_thread_fence(std::memory_order_release);
+  memcpy(base_ + offsetof(BuddySnapshotHeader, payload_size),
+         snapshot.data() + offsetof(BuddySnapshotHeader, payload_size),
+         snapshot.size() - offsetof(BuddySnapshotHeader, payload_size));
+  memcpy(base_, snapshot.data(), offsetof(BuddySnapshotHeader, seq));
+  __atomic_store_n(&h->seq, seq + 2, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,210 @@
+// Binary snapshot format for the buddy's MyView model
+//
+// Every frame the buddy encodes CPUStateView, I2CBusStateView,
+// NPCM7XXStateView and LogView into one self-describing little-endian
+// blob: a BuddySnapshotHeader followed by sections, each introduced by a
+// BuddySnapshotSection. Unknown section kinds can be skipped using `size`.
+// scripts/qemu-buddy-snapshot.py decodes it.
+//
+// Sinks receive the encoded blob. The mmap sink keeps the latest snapshot
+// in a shared file guarded by a sequence counter (odd while being written)
+// so external readers never block QEMU.
+
+#ifndef MYDEBUG_SNAPSHOT_HPP
+#define MYDEBUG_SNAPSHOT_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#define BUDDY_SNAPSHOT_MAGIC "QBDY"
+#define BUDDY_SNAPSHOT_VERSION 2
+
+struct BuddySnapshotHeader {
+  char magic[4];
+  uint16_t version;
+  uint16_t header_size;
+  uint32_t seq;           // Only meaningful in the mmap sink
+  uint32_t payload_size;  // Bytes following this header
+  uint64_t frame;
+  uint64_t host_ms;
+  uint64_t dropped_events;
+};
+static_assert(sizeof(BuddySnapshotHeader) == 40, "snapshot ABI");
+
+enum BuddySnapshotSectionKind : uint16_t {
+  BUDDY_SEC_CPU = 1,  // BuddySnapshotCPU[count]
+  BUDDY_SEC_I2C = 2,  // BuddySnapshotI2CBus[count]
+  BUDDY_SEC_WDT = 3,  // BuddySnapshotWatchdog[count]
+  BUDDY_SEC_LOG = 4,  // uint32 total entries, then count x {uint16 len, bytes}
+  BUDDY_SEC_I2C_LATENCY = 5,  // BuddySnapshotI2CLatency[count]
+  BUDDY_SEC_CPU_EXEC = 6,  // BuddySnapshotCPUExec[count]
+  BUDDY_SEC_PROFILE = 7,  // uint32 total samples, uint32 halted samples,
+                          // then BuddySnapshotProfileEntry[count]
+};
+
+struct BuddySnapshotSection {
+  uint16_t kind;
+  uint16_t count;
+  uint32_t size;  // Bytes following this section header
+};
+
+struct BuddySnapshotCPU {
+  int32_t cpu_index;
+  int32_t reserved;
+  int64_t icount;
+};
+
+// Cumulative per-vCPU accounting, host ns; see CPUExecStats in
+// include/hw/core/cpu.h.
+struct BuddySnapshotCPUExec {
+  int32_t cpu_index;
+  uint32_t reserved;
+  uint64_t tbs;
+  uint64_t insns;
+  uint64_t exec_ns;
+  uint64_t translate_ns;
+  uint64_t bql_wait_ns;
+  uint64_t halted_ns;
+};
+static_assert(sizeof(BuddySnapshotCPUExec) == 56, "snapshot ABI");
+
+// One of the hottest guest pcs of the sampling profiler, all vCPUs
+// together, hottest first.
+struct BuddySnapshotProfileEntry {
+  uint64_t pc;
+  uint32_t samples;
+  uint32_t tb_size;  // Guest bytes of the last block sampled at pc
+};
+static_assert(sizeof(BuddySnapshotProfileEntry) == 16, "snapshot ABI");
+
+struct BuddySnapshotI2CBus {
+  int32_t serial;
+  uint32_t tx_per_sec;
+  uint32_t reads_per_sec;
+  uint32_t writes_per_sec;
+};
+
+// Transaction latency of one bus since the buddy started, in virtual ns.
+// buckets[i] counts latencies in [2^i, 2^(i+1)); bucket 0 also takes 0 and
+// the last bucket everything above.
+#define BUDDY_I2C_LATENCY_BUCKETS 32
+struct BuddySnapshotI2CLatency {
+  int32_t serial;
+  uint32_t count;
+  uint32_t nacks;
+  uint32_t reserved;
+  int64_t max_ns;
+  uint32_t buckets[BUDDY_I2C_LATENCY_BUCKETS];
+};
+static_assert(sizeof(BuddySnapshotI2CLatency) == 152, "snapshot ABI");
+
+// State of one watchdog, in virtual ns. Kick intervals are the times
+// between consecutive arms/kicks.
+struct BuddySnapshotWatchdog {
+  int32_t index;
+  uint16_t armed;
+  uint16_t last_kind;     // BUDDY_WDT_*
+  int64_t expires_ns;     // 0 while disabled
+  int64_t qemu_ns;
+  int64_t last_kick_ns;   // -1 if never kicked
+  uint32_t kicks;
+  uint32_t expires;
+  uint32_t resets;
+  uint32_t intervals;
+  int64_t interval_min_ns;
+  int64_t interval_max_ns;
+  int64_t interval_mean_ns;
+  int64_t interval_stddev_ns;
+};
+static_assert(sizeof(BuddySnapshotWatchdog) == 80, "snapshot ABI");
+
+// I2C transaction trace file: a BuddyI2CTraceHeader followed by `count`
+// records, oldest first.
+#define BUDDY_I2C_TRACE_MAGIC "QI2C"
+#define BUDDY_I2C_TRACE_VERSION 1
+
+struct BuddyI2CTraceHeader {
+  char magic[4];
+  uint16_t version;
+  uint16_t record_size;
+  uint32_t count;
+  uint32_t reserved;
+  uint64_t total;  // Transactions seen; total - count were overwritten
+};
+static_assert(sizeof(BuddyI2CTraceHeader) == 24, "trace ABI");
+
+#define BUDDY_I2C_TRACE_RECV 0x1  // Last (repeated) start was a read
+#define BUDDY_I2C_TRACE_NACK 0x2
+
+struct BuddyI2CTraceRecord {
+  int64_t start_ns;    // QEMU_CLOCK_VIRTUAL
+  int64_t latency_ns;
+  int32_t serial;
+  uint8_t address;
+  uint8_t flags;       // BUDDY_I2C_TRACE_*
+  uint16_t reserved;
+  uint16_t read_bytes;
+  uint16_t write_bytes;
+  uint32_t reserved2;
+};
+static_assert(sizeof(BuddyI2CTraceRecord) == 32, "trace ABI");
+
+// Watchdog history file: a BuddyWatchdogTraceHeader followed by `count`
+// records, oldest first. Same header layout as the I2C trace.
+#define BUDDY_WDT_TRACE_MAGIC "QWDT"
+#define BUDDY_WDT_TRACE_VERSION 1
+
+typedef BuddyI2CTraceHeader BuddyWatchdogTraceHeader;
+
+struct BuddyWatchdogTraceRecord {
+  int64_t ns;          // QEMU_CLOCK_VIRTUAL
+  int64_t expires_ns;  // Deadline after the event, 0 while disabled
+  int32_t index;
+  uint16_t kind;       // BUDDY_WDT_*
+  uint16_t reserved;
+};
+static_assert(sizeof(BuddyWatchdogTraceRecord) == 24, "trace ABI");
+
+class BuddySnapshotWriter {
+public:
+  BuddySnapshotWriter();
+  void Begin(uint64_t frame, uint64_t host_ms, uint64_t dropped_events);
+  // Sections are written as BeginSection, Append*, EndSection.
+  void BeginSection(uint16_t kind);
+  void EndSection(uint16_t count);
+  void Append(const void* p, size_t n);
+  template <typename T> void AppendPOD(const T& t) { Append(&t, sizeof(T)); }
+  void AppendString(const std::string& s);
+  const std::vector<uint8_t>& Finish();
+
+private:
+  std::vector<uint8_t> buf_;
+  size_t section_start_;
+};
+
+// Where encoded snapshots go.
+class BuddySnapshotSink {
+public:
+  virtual ~BuddySnapshotSink() {}
+  virtual void Publish(const std::vector<uint8_t>& snapshot) = 0;
+};
+
+// Latest snapshot in a MAP_SHARED file, e.g. under /dev/shm.
+class BuddyMmapSink : public BuddySnapshotSink {
+public:
+  static BuddyMmapSink* Create(const char* path, size_t capacity);
+  ~BuddyMmapSink() override;
+  void Publish(const std::vector<uint8_t>& snapshot) override;
+
+private:
+  BuddyMmapSink() : fd_(-1), base_(nullptr), capacity_(0), warned_(false) {}
+  int fd_;
+  uint8_t* base_;
+  size_t capacity_;
+  bool warned_;
+};
+
+#endif
@@ -0,0 +1,190 @@
+// ELF symbol loader for the buddy, see mydebug_symbols.hpp
+
+#include "mydebug_symbols.hpp"
+
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+
+namespace {
+
+// The few ELF constants needed here; <elf.h> is not available on every
+// host the buddy builds on.
+const int EI_CLASS = 4, EI_DATA = 5;
+const int ELFCLASS32 = 1, ELFCLASS64 = 2;
+const int ELFDATA2LSB = 1, ELFDATA2MSB = 2;
+const uint32_t SHT_SYMTAB = 2, SHT_DYNSYM = 11;
+const int STT_NOTYPE = 0, STT_FUNC = 2;
+const uint16_t SHN_UNDEF = 0, SHN_LORESERVE = 0xff00, SHN_ABS = 0xfff1;
+const uint16_t EM_ARM = 40;
+
+struct ElfReader {
+  const std::vector<uint8_t>& buf;
+  bool is64, big_endian;
+
+  ElfReader(const std::vector<uint8_t>& b, bool e64, bool be)
+      : buf(b), is64(e64), big_endian(be) {}
+
+  bool InRange(uint64_t off, uint64_t n) const {
+    return off <= buf.size() && n <= buf.size() - off;
+  }
+  uint64_t Read(uint64_t off, int n) const {
+    uint64_t v = 0;
+    for (int i=0; i<n; i++) {
+      const uint8_t b = buf[off + (big_endian ? i : n - 1 - i)];
+      v = (v << 8) | b;
+    }
+    return v;
+  }
+  // Address-sized field
+  uint64_t Addr(uint64_t off) const { return Read(off, is64 ? 8 : 4); }
+};
+
+}  // namespace
+
+bool BuddySymbolTable::LoadElf(const char* path) {
+  syms_.clear();
+  names_.clear();
+  error_.clear();
+
+  FILE* f = fopen(path, "rb");
+  if (!f) {
+    error_ = std::string("cannot open ") + path;
+    return false;
+  }
+  std::vector<uint8_t> buf;
+  uint8_t chunk[65536];
+  size_t n;
+  while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) {
+    buf.insert(buf.end(), chunk, chunk + n);
+  }
+  fclose(f);
+
+  if (buf.size() < 52 || memcmp(buf.data(), "\x7f" "ELF", 4) != 0) {
+    error_ = "not an ELF file";
+    return false;
+  }
+  const int cls = buf[EI_CLASS], data = buf[EI_DATA];
+  if ((cls != ELFCLASS32 && cls != ELFCLASS64) ||
+      (data != ELFDATA2LSB && data != ELFDATA2MSB)) {
+    error_ = "unsupported ELF class or byte order";
+    return false;
+  }
+  const ElfReader r(buf, cls == ELFCLASS64, data == ELFDATA2MSB);
+  if (r.is64 && buf.size() < 64) {
+    error_ = "truncated ELF header";
+    return false;
+  }
+
+  const uint16_t machine = r.Read(18, 2);
+  const uint64_t shoff = r.Addr(r.is64 ? 0x28 : 0x20);
+  const uint16_t shentsize = r.Read(r.is64 ? 0x3a : 0x2e, 2);
+  const uint16_t shnum = r.Read(r.is64 ? 0x3c : 0x30, 2);
+  const uint64_t min_shentsize = r.is64 ? 64 : 40;
+  if (shnum == 0 || shentsize < min_shentsize ||
+      !r.InRange(shoff, uint64_t(shnum) * shentsize)) {
+    error_ = "no usable section headers";
+    return false;
+  }
+
+  struct Shdr { uint32_t type, link; uint64_t offset, size, entsize; };
+  std::vector<Shdr> sh(shnum);
+  for (int i=0; i<shnum; i++) {
+    const uint64_t o = shoff + uint64_t(i) * shentsize;
+    sh[i].type = r.Read(o + 4, 4);
+    sh[i].offset = r.Addr(o + (r.is64 ? 0x18 : 0x10));
+    sh[i].size = r.Addr(o + (r.is64 ? 0x20 : 0x14));
+    sh[i].link = r.Read(o + (r.is64 ? 0x28 : 0x18), 4);
+    sh[i].entsize = r.Addr(o + (r.is64 ? 0x38 : 0x24));
+  }
+
+  // Prefer the full symbol table; stripped images may still have .dynsym
+  int symtab = -1;
+  for (int i=0; i<shnum; i++) {
+    if (sh[i].type == SHT_SYMTAB) { symtab = i; break; }
+    if (sh[i].type == SHT_DYNSYM && symtab == -1) symtab = i;
+  }
+  if (symtab == -1) {
+    error_ = "no symbol table";
+    return false;
+  }
+  const Shdr& st = sh[symtab];
+  const uint64_t symsize = r.is64 ? 24 : 16;
+  if (st.entsize < symsize || st.link >= shnum ||
+      !r.InRange(st.offset, st.size) ||
+      !r.InRange(sh[st.link].offset, sh[st.link].size)) {
+    error_ = "malformed symbol table";
+    return false;
+  }
+  const Shdr& strtab = sh[st.link];
+
+  for (uint64_t o = st.offset; o + symsize <= st.offset + st.size;
+       o += st.entsize) {
+    uint32_t name;
+    uint64_t value, size;
+    uint8_t info;
+    uint16_t shndx;
+    if (r.is64) {
+      name = r.Read(o, 4);
+      info = buf[o + 4];
+      shndx = r.Read(o + 6, 2);
+      value = r.Read(o + 8, 8);
+      size = r.Read(o + 16, 8);
+    } else {
+      name = r.Read(o, 4);
+      value = r.Read(o + 4, 4);
+      size = r.Read(o + 8, 4);
+      info = buf[o + 12];
+      shndx = r.Read(o + 14, 2);
+    }
+    const int type = info & 0xf;
+    if (type != STT_FUNC && type != STT_NOTYPE) continue;
+    if (shndx == SHN_UNDEF || (shndx >= SHN_LORESERVE && shndx != SHN_ABS)) {
+      continue;
+    }
+    if (name == 0 || name >= strtab.size) continue;
+    const char* s = reinterpret_cast<const char*>(&buf[strtab.offset + name]);
+    const size_t len = strnlen(s, strtab.size - name);
+    if (len == 0 || len == strtab.size - name) continue;
+    // ARM mapping symbols ($a, $t, $d, ...) only mark code/data runs
+    if (s[0] == '$') continue;
+    if (machine == EM_ARM && type == STT_FUNC) {
+      value &= ~uint64_t(1);  // Thumb bit
+    }
+    Symbol sym;
+    sym.addr = value;
+    sym.size = size;
+    sym.name = uint32_t(names_.size());
+    names_.insert(names_.end(), s, s + len + 1);
+    syms_.push_back(sym);
+  }
+  if (syms_.empty()) {
+    error_ = "no function symbols";
+    return false;
+  }
+  std::stable_sort(syms_.begin(), syms_.end());
+  return true;
+}
+
+const char* BuddySymbolTable::Lookup(uint64_t pc, uint64_t* offset) const {
+  Symbol key;
+  key.addr = pc;
+  std::vector<Symbol>::const_iterator it =
+      std::upper_bound(syms_.begin(), syms_.end(), key);
+  if (it == syms_.begin()) return NULL;
+  --it;
+  // Among aliases at the same address, a sized one is more telling
+  const uint64_t addr = it->addr;
+  std::vector<Symbol>::const_iterator best = it;
+  while (best->size == 0 && best != syms_.begin() &&
+         (best - 1)->addr == addr) {
+    --best;
+  }
+  if (best->size == 0) best = it;
+  if (best->size != 0 && pc - best->addr >= best->size) {
+    // pc is past the end of a sized symbol: padding or unnamed code
+    return NULL;
+  }
+  *offset = pc - best->addr;
+  return &names_[best->name];
+}
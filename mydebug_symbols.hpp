@@ -0,0 +1,38 @@
+// Guest symbol table for the buddy's profiler
+//
+// Reads the function symbols of a guest ELF image (ELF32 or ELF64, either
+// byte order) so that sampled pcs can be shown as symbol+offset. Only the
+// section headers and the symbol tables are used; the image does not have
+// to be loadable on the host.
+
+#ifndef MYDEBUG_SYMBOLS_HPP
+#define MYDEBUG_SYMBOLS_HPP
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class BuddySymbolTable {
+public:
+  // Replaces the current symbols. Returns false, leaving the table empty
+  // and the reason in error(), if path is not a usable ELF file.
+  bool LoadElf(const char* path);
+  // Name of the symbol covering pc, or the nearest one below it when
+  // sizes are unknown; NULL if there is none. *offset gets pc - start.
+  const char* Lookup(uint64_t pc, uint64_t* offset) const;
+  size_t size() const { return syms_.size(); }
+  const std::string& error() const { return error_; }
+
+private:
+  struct Symbol {
+    uint64_t addr;
+    uint64_t size;
+    uint32_t name;  // Offset into names_
+    bool operator<(const Symbol& o) const { return addr < o.addr; }
+  };
+  std::vector<Symbol> syms_;  // Sorted by addr
+  std::vector<char> names_;
+  std::string error_;
+};
+
+#endif
@@ -151,6 +151,18 @@ DEF("accel", HAS_ARG, QEMU_OPTION_accel,
     "                kvm-shadow-mem=size of KVM shadow MMU in bytes\n"
     "                split-wx=on|off (enable TCG split w^x mapping)\n"
     "                tb-size=n (TCG translation block cache size)\n"
+    "                code-reclaim=on|off (evict old TCG blocks instead of flushing them all)\n"
+    "                tb-reuse=on|off (revive TCG blocks whose code is rewritten unchanged)\n"
+    "                tier-threshold=n (optimize TCG blocks after n executions, default 0)\n"
+    "                superblocks=on|off (merge hot TCG blocks along their usual path)\n"
+    "                tb-profile=file (remember hot TCG blocks across runs in file)\n"
+    "                jmp-cache-bits=n (log2 of TCG block lookup cache sets, default 12)\n"
+    "                jmp-cache-ways=1|2|4 (TCG block lookup cache associativity)\n"
+    "                spill-heuristic=first|next-use (TCG register to spill)\n"
+    "                tb-counters=on|off (count TCG block executions for info jit hot)\n"
+    "                op-corpus=file (record the TCG ops of every block to file)\n"
+    "                vtlb-size=n (maximum TCG victim TLB entries, default 8)\n"
+    "                tlb-prefetch=n (map n following pages on a TCG TLB miss)\n"
     "                dirty-ring-size=n (KVM dirty ring GFN count, default 0)\n"
     "                thread=single|multi (enable multi-threaded TCG)\n", QEMU_ARCH_ALL)
 SRST
@@ -185,6 +197,138 @@ SRST
     ``tb-size=n``
         Controls the size (in MiB) of the TCG translation block cache.
 
+    ``code-reclaim=on|off``
+        When the translation block cache fills up, TCG normally stops all
+        vCPUs and throws away every translation. With this option the
+        cache is split into many regions, and the regions filled first
+        are freed a few at a time, before the cache runs out, while the
+        vCPUs keep running. Each vCPU only leaves the execution loop once
+        per reclaim. The cache is still flushed if it runs out before
+        enough regions are freed. ``info jit`` reports the number of
+        reclaims and flushes and how long they paused the emulation. It
+        cannot be combined with ``tb-reuse``. The default is off.
+
+    ``tb-reuse=on|off``
+        When guest code is overwritten, TCG normally throws away the
+        translation blocks made from it. With this option it keeps them,
+        with a copy of the guest code, until the translation block cache
+        is flushed, and reuses them without translating again if the
+        same code is written back to the same place. This helps guests
+        that reload an unchanged image, such as firmware copying itself
+        to RAM after every ``system_reset``. It costs memory in the
+        translation block cache. Blocks are not reused while breakpoints
+        are set or plugins instrument translation. ``info jit`` counts
+        the reused blocks. The default is off.
+
+    ``tier-threshold=n``
+        Translates guest code in two tiers. Blocks are first translated
+        quickly, without the TCG optimizer, and are translated again with
+        it once they have executed n times. Since most blocks only run a
+        few times, this cuts translation time for code that is executed
+        once, such as boot code, at the cost of running unoptimized
+        blocks, which count their own executions, until they tier up.
+        Both translations are done by the vCPU that runs the block, so
+        hot blocks are translated twice; whether this pays off depends on
+        how much of the guest code stays cold. ``info jit`` counts the
+        blocks that tiered up. The default, 0, translates every block
+        with the optimizer.
+
+    ``superblocks=on|off``
+        With ``tier-threshold``, each unoptimized block also counts which
+        way it left. When a block is optimized, translation then
+        continues past direct branches along the path the block and its
+        successors took at least three times in four, forming a
+        superblock with exits for the other paths. Hot paths then run
+        without switching translation blocks, and the optimizer and
+        register allocator see across unconditional branches. Branches
+        are followed within the same page; a branch back to a loop head
+        unrolls the loop up to three times. The Arm 32-bit and 64-bit
+        translators form superblocks, except with ``-icount``; ``info
+        jit`` counts the branches followed. The default is off.
+
+    ``tb-profile=file``
+        With ``tier-threshold``, records in file which blocks tiered up,
+        and how their unoptimized versions left them, when QEMU exits.
+        On the next run with the same file, these blocks are translated
+        with the optimizer, and as superblocks with ``superblocks=on``,
+        the first time they run, as long as the guest code at their
+        physical address has not changed. This saves the unoptimized
+        first translation of hot code that tiering adds on every boot of
+        the same firmware; a run still translates as much code as it
+        would without ``tier-threshold``. Translated host code itself is
+        not saved. The file is ignored if it was written
+        by another QEMU version or target. ``info jit`` counts the
+        blocks translated this way. System emulation only; QEMU refuses
+        to start if the option is given without ``tier-threshold`` or in
+        user mode.
+
+    ``jmp-cache-bits=n``
+        Each vCPU looks up the translation block to run next in a small
+        cache before falling back to a global hash table. This sets the
+        number of sets in that cache to 2^n, from 8 to 20. The default
+        is 12.
+
+    ``jmp-cache-ways=1|2|4``
+        Sets how many translation blocks each set of that cache holds.
+        The default, 1, is a direct-mapped cache; guests with large
+        kernels that thrash it may benefit from 2 or 4. ``info jit`` and
+        the ``x-query-vcpu-stats`` QMP command report the cache hits,
+        misses and conflicts of each vCPU.
+
+    ``spill-heuristic=first|next-use``
+        Selects how TCG chooses which value to spill when it runs out of
+        host registers; registers are still assigned one op at a time.
+        ``first``, the default, spills the first register in a fixed
+        order. ``next-use`` finds where each value is read next over the
+        whole translation block, and spills the value that is cheapest to
+        give up: one that is not needed again before the next label,
+        unconditional branch, block exit or helper call, else the one
+        needed furthest ahead, preferring values that need not be stored.
+        ``scripts/performance/tcg_regalloc.py`` compares the code size and
+        run time of both heuristics.
+
+    ``tb-counters=on|off``
+        Makes the code of every translation block count how many times
+        it runs, including when it is reached by a direct jump from
+        another block. ``info jit hot`` and the ``x-query-jit-hot`` QMP
+        command then list the blocks that ran the most, and those that
+        ran the most host code, with the ratio of host code to guest
+        code of each. This tells whether time goes to a few badly
+        translated hot blocks or to translating many blocks that rarely
+        run. Each execution costs a load and a store, and with
+        multi-threaded TCG a few counts may be lost. The default is off.
+
+    ``op-corpus=file``
+        Writes the TCG ops of every translation block to file, as they
+        are before optimization, in a compact binary format. The
+        ``qemu-tcg-bench-<target>`` program, built with ``make
+        qemu-tcg-bench-<target>``, replays such a corpus through the TCG
+        optimizer, the liveness passes and the code generator of the host
+        it runs on, and reports how many ops per second each of them
+        processes and how many bytes of host code they produce. A corpus
+        can only be recorded on a 64-bit host.
+
+    ``vtlb-size=n``
+        Entries evicted from the software TLB of each MMU mode are kept
+        in a small fully associative victim TLB. It starts with 8 entries
+        and doubles when the main TLB is more than 70% full, up to n
+        entries; it shrinks again when the TLB is lightly used. n is a
+        power of 2 from 8 to 256. The default, 8, keeps the victim TLB at
+        a fixed size. Since a victim TLB lookup is a linear search, a
+        larger n makes misses that also miss the victim TLB slower.
+
+    ``tlb-prefetch=n``
+        When a guest load or store misses in the software TLB, also map
+        the n pages that follow it, as if they had been read. This helps
+        guests that stream through large buffers. The prefetched pages
+        are translated through the guest page tables like real reads, so
+        on targets whose page tables have accessed bits, such as x86, the
+        bits get set on pages the guest may never touch. A guest that
+        reclaims memory by these bits then sees those pages as recently
+        used. n is at most 16; the default, 0, disables prefetching. ``info
+        jit`` reports the fills, prefetches and victim TLB hits and
+        misses of each vCPU and MMU mode.
+
     ``thread=single|multi``
         Controls number of TCG threads. When the TCG is multi-threaded
         there will be one thread per vCPU therefore taking advantage of
@@ -4058,6 +4202,68 @@ SRST
     taking into account guest idle time.
 ERST
 
+DEF("buddy", HAS_ARG, QEMU_OPTION_buddy,
+    "-buddy [mode=]gui|headless[,snapshot=file][,rate=fps][,i2c-trace=file]\n"
+    "       [,wdt-trace=file][,profile=hz][,symbols=elf][,profile-out=file]\n"
+    "                start the debug buddy (CPU, I2C, watchdog, profile and log views)\n"
+    "                mode=gui opens a GLUT window, mode=headless needs no display\n"
+    "                snapshot=file publishes binary snapshots to a mmap'd file\n"
+    "                rate=fps sets the update rate (default: 20)\n"
+    "                i2c-trace=file receives the I2C transaction trace on exit\n"
+    "                wdt-trace=file receives the watchdog event history on exit\n"
+    "                profile=hz samples the guest pc of every vCPU hz times a second\n"
+    "                symbols=elf symbolizes the samples with a guest ELF image\n"
+    "                profile-out=file receives the samples as folded stacks on exit\n",
+    QEMU_ARCH_ALL)
+SRST
+``-buddy [mode=]gui|headless[,snapshot=file][,rate=fps][,i2c-trace=file][,wdt-trace=file][,profile=hz][,symbols=elf][,profile-out=file]``
+    Start the debug buddy thread. It is off unless this option is given.
+
+    ``mode=gui`` opens a GLUT/X11 window with the CPU, I2C bus, NPCM7xx
+    watchdog, log and memory views. ``mode=headless`` keeps the same
+    model but never touches the display, which is what CI hosts without
+    X11 want.
+
+    The CPU view shows, for every vCPU, the guest instructions per second
+    and how its host time splits between running guest code, translating,
+    waiting for the BQL and being halted. These counters are kept
+    whether or not ``-icount`` is in use; ``x-query-vcpu-stats`` and
+    ``info jit`` report them as well.
+
+    With ``snapshot=file`` every frame is encoded in a compact binary
+    format (see ``mydebug_snapshot.hpp``) and published to ``file``
+    through a shared memory mapping, typically under ``/dev/shm``.
+    ``scripts/qemu-buddy-snapshot.py`` decodes it.
+
+    The buddy keeps per-bus and per-slave latency histograms of I2C
+    transactions, measured in virtual time from the start condition to
+    the end of the transfer, and a trace of the last 65536 transactions
+    (address, direction, byte counts, NACK). ``i2c-trace=file`` names
+    the file the trace is written to when QEMU exits, or when ``t`` is
+    pressed in the GUI (default ``qemu-i2c-trace.bin``).
+    ``scripts/qemu-buddy-snapshot.py --i2c-trace file`` decodes it.
+
+    The NPCM7xx watchdogs report when they are armed, kicked, disarmed,
+    reach their interrupt and reset stages, and when the timer module is
+    reset. The buddy draws these events on a scrolling virtual-time
+    timeline, keeps kick interval statistics per watchdog, and remembers
+    the last 16384 events. ``wdt-trace=file`` names the file they are
+    written to when QEMU exits, or when ``w`` is pressed in the GUI
+    (default ``qemu-wdt-trace.bin``).
+    ``scripts/qemu-buddy-snapshot.py --wdt-trace file`` decodes it.
+
+    ``profile=hz`` starts a sampling profiler (TCG only): ``hz`` times a
+    second every running vCPU is stopped at its next translation block
+    boundary and the guest pc of that block is counted; halted vCPUs are
+    counted separately. ``p`` in the GUI turns sampling on and off
+    (99 Hz unless ``profile`` says otherwise). The profile view lists the
+    hottest guest pcs, as ``symbol+offset`` when ``symbols=elf`` names an
+    ELF image of the guest firmware or kernel with a symbol table.
+    ``profile-out=file`` names the file the samples are written to, in
+    the folded stack format of ``flamegraph.pl``, when QEMU exits or
+    when ``g`` is pressed (default ``qemu-profile.folded``).
+ERST
+
 DEF("gdb", HAS_ARG, QEMU_OPTION_gdb, \
     "-gdb dev        accept gdb connection on 'dev'. (QEMU defaults to starting\n"
     "                the guest without waiting for gdb to connect; use -S too\n"
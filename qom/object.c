@@ -2811,7 +2811,3 @@ static void register_types(void)
 }
 
 type_init(register_types)
-
-const char* GetObjectTypeName(Object* o) {
-    return o->class->type->name;
-}
@@ -0,0 +1,90 @@
+#!/usr/bin/env python3
+
+#  Measure how misaligned guest atomics scale with the number of MTTCG
+#  vCPUs.
+#  Syntax:
+#  tcg_atomic_scaling.py [-h] [-r <runs>] [-c <cpus>] -- \
+#           <qemu executable> [<qemu executable options>]
+#
+#  [-h] - Print the script arguments help message.
+#  [-r] - Number of runs per vCPU count; the median time is reported.
+#       - If this flag is not specified, the tool defaults to 3.
+#  [-c] - Comma-separated list of vCPU counts.
+#       - If this flag is not specified, the tool defaults to
+#         1,2,4,8,16,32,64.
+#
+#  Every "{n}" in the QEMU command is replaced with the vCPU count, which
+#  must also be the number of guest threads.  Each thread should do the
+#  same amount of work, e.g. tests/tcg/i386/test-i386-atomic-misaligned.
+#  Its misaligned locked instructions run in parallel as compare-and-swap
+#  loops on the aligned 8-byte word around them with the word at offset 2,
+#  and stop all vCPUs with EXCP_ATOMIC with the word at offset 6.  It runs
+#  as is under qemu-i386 or qemu-x86_64, or from the init script of a
+#  system guest as "test-i386-atomic-misaligned $(nproc) 100000 2".
+#
+#  As the work per vCPU is fixed, perfect scaling keeps the run time
+#  constant; the efficiency column is the time with the fewest vCPUs
+#  divided by the time with n vCPUs.
+#
+#  Examples of usage:
+#  tcg_atomic_scaling.py -- ./qemu-x86_64 \
+#           tests/tcg/x86_64-linux-user/test-i386-atomic-misaligned {n} 100000 2
+#  tcg_atomic_scaling.py -- ./qemu-x86_64 \
+#           tests/tcg/x86_64-linux-user/test-i386-atomic-misaligned {n} 100000 6
+#  tcg_atomic_scaling.py -- ./qemu-system-x86_64 -smp {n} \
+#           -accel tcg,thread=multi -m 2G -nographic -kernel bzImage \
+#           -initrd atomics.cpio -append "console=ttyS0 panic=-1" -no-reboot
+#
+#  This program is free software: you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation, either version 2 of the License, or
+#  (at your option) any later version.
+#
+#  This program is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+import statistics
+import sys
+
+import tcgbench
+
+
+# Parse the command line arguments
+parser = tcgbench.argument_parser(
+    'tcg_atomic_scaling.py [-h] [-r <runs>] [-c <cpus>] '
+    '-- <qemu executable> [<qemu executable options>]',
+    3, 'Number of runs per vCPU count.')
+
+parser.add_argument('-c', dest='cpus', type=str,
+                    default='1,2,4,8,16,32,64',
+                    help='Comma-separated list of vCPU counts.')
+
+args = tcgbench.parse_args(parser)
+
+# Extract the needed variables from the args
+command = args.command
+cpus = tcgbench.parse_counts(args.cpus, 'vCPU counts')
+
+if not any('{n}' in arg for arg in command):
+    sys.exit("The QEMU command must contain {n} for the vCPU count!")
+
+
+def run_qemu(ncpus):
+    """Run the QEMU command with ncpus vCPUs, return the time"""
+    cmd = [arg.replace('{n}', str(ncpus)) for arg in command]
+    return tcgbench.run(cmd, '{} vCPUs'.format(ncpus))
+
+
+times = {n: statistics.median(run_qemu(n) for _ in range(args.runs))
+         for n in cpus}
+
+# Print the run times and the scaling efficiency
+tcgbench.print_table(
+    ['vCPUs', 'Time(s)', 'Efficiency'], [6, 12, 10],
+    [[n, '{:.3f}'.format(times[n]),
+      '{:.0f}%'.format(times[cpus[0]] * 100 / times[n])] for n in cpus])
@@ -0,0 +1,100 @@
+#!/usr/bin/env python3
+
+#  Compare the per-element time of guest vector kernels on two QEMU builds.
+#  Syntax:
+#  tcg_gvec_ops.py [-h] [-r <runs>] -b <baseline> -- \
+#           <qemu executable> [<qemu executable options>]
+#
+#  [-h] - Print the script arguments help message.
+#  [-r] - Number of runs per executable; the median time of each kernel
+#         is reported.
+#       - If this flag is not specified, the tool defaults to 3.
+#  [-b] - Another QEMU executable, e.g. a build where these vector
+#         operations still call out-of-line helpers, to run the same
+#         command with.
+#
+#  The guest program must print one line per kernel, with the name of the
+#  kernel followed by its time per element, as tests/tcg/aarch64/gvec-ops
+#  does when given a number of rounds.  Its NEON kernels cover saturating
+#  arithmetic on 32 and 64-bit elements; run with -cpu max to add the SVE
+#  kernels, which also cover the 64-bit multiply.  On x86 hosts without
+#  AVX-512, each of these operations used to be a call to a helper in
+#  accel/tcg/tcg-runtime-gvec.c; the speedup column shows what expanding
+#  them inline gains.
+#
+#  Example of usage, with the kernels from check-tcg:
+#  tcg_gvec_ops.py -b ./qemu-aarch64.old -- ./qemu-aarch64 -cpu max \
+#           tests/tcg/aarch64-linux-user/gvec-ops 2000
+#
+#  This program is free software: you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation, either version 2 of the License, or
+#  (at your option) any later version.
+#
+#  This program is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+import statistics
+import sys
+
+import tcgbench
+
+
+# Parse the command line arguments
+parser = tcgbench.argument_parser(
+    'tcg_gvec_ops.py [-h] [-r <runs>] -b <baseline> '
+    '-- <qemu executable> [<qemu executable options>]',
+    3, 'Number of runs per executable.')
+
+parser.add_argument('-b', dest='baseline', type=str, required=True,
+                    help='QEMU executable to compare with.')
+
+args = tcgbench.parse_args(parser)
+
+# Extract the needed variables from the args
+command = args.command
+binaries = [command[0], args.baseline]
+
+
+def run_qemu(binary):
+    """Run the QEMU command with the given executable, return the
+    dictionary of kernel name -> time per element"""
+    _, output = tcgbench.run([binary] + command[1:], binary, capture=True)
+    times = {}
+    for line in output.splitlines():
+        fields = line.split()
+        if len(fields) >= 2:
+            try:
+                times[fields[0]] = float(fields[1])
+            except ValueError:
+                pass
+    if not times:
+        sys.exit("{} printed no kernel times".format(binary))
+    return times
+
+
+results = tcgbench.alternate(args.runs, binaries, run_qemu)
+
+
+def median(binary, kernel):
+    """Return the median time of a kernel over the runs of a binary"""
+    return statistics.median(run[kernel] for run in results[binary]
+                             if kernel in run)
+
+
+# Print the time per element of each kernel
+rows = []
+for kernel in results[command[0]][0]:
+    if kernel not in results[args.baseline][0]:
+        continue
+    old = median(args.baseline, kernel)
+    new = median(command[0], kernel)
+    rows.append([kernel, '{:.3f}'.format(old), '{:.3f}'.format(new),
+                 '{:.2f}x'.format(old / new)])
+tcgbench.print_table(['Kernel', 'Baseline(ns)', 'QEMU(ns)', 'Speedup'],
+                     [-16, 12, 12, 8], rows)
@@ -0,0 +1,64 @@
+#!/usr/bin/env python3
+
+#  Time a function-call-heavy guest workload on two QEMU builds.
+#  Syntax:
+#  tcg_indirect_branch.py [-h] [-r <runs>] -b <baseline> -- \
+#           <qemu executable> [<qemu executable options>]
+#
+#  [-h] - Print the script arguments help message.
+#  [-r] - Number of runs per executable; the median time is reported.
+#       - If this flag is not specified, the tool defaults to 5.
+#  [-b] - Another QEMU executable, e.g. a build without inline prediction
+#         of indirect branches, to run the same command with.
+#
+#  Every indirect branch and return of the guest used to call
+#  helper_lookup_tb_ptr.  On Arm, the generated code now first checks the
+#  target the branch reached last time and only calls the helper when it
+#  differs, so the gain is largest for code that calls and returns a lot:
+#  interpreters, virtual method dispatch, recursive functions.
+#
+#  The command may run a user-mode or a system emulator, and the guest
+#  must exit by itself.
+#
+#  Example of usage, with the workload from check-tcg:
+#  tcg_indirect_branch.py -b ./qemu-aarch64.old -- ./qemu-aarch64 \
+#           tests/tcg/aarch64-linux-user/indirect-calls 20000
+#
+#  This program is free software: you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation, either version 2 of the License, or
+#  (at your option) any later version.
+#
+#  This program is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+import tcgbench
+
+
+# Parse the command line arguments
+parser = tcgbench.argument_parser(
+    'tcg_indirect_branch.py [-h] [-r <runs>] -b <baseline> '
+    '-- <qemu executable> [<qemu executable options>]',
+    5, 'Number of runs per executable.')
+
+parser.add_argument('-b', dest='baseline', type=str, required=True,
+                    help='QEMU executable to compare with.')
+
+args = tcgbench.parse_args(parser)
+
+# Extract the needed variables from the args
+command = args.command
+binaries = {'baseline': args.baseline, 'qemu': command[0]}
+
+times = tcgbench.alternate(
+    args.runs, binaries,
+    lambda name: tcgbench.run([binaries[name]] + command[1:],
+                              binaries[name]))
+
+# Print the run times
+tcgbench.print_times('Build', times, 'baseline')
@@ -0,0 +1,131 @@
+#!/usr/bin/env python3
+
+#  Compare the TCG spill heuristics on a guest workload.
+#  Syntax:
+#  tcg_regalloc.py [-h] [-r <runs>] [-n <top>] -- \
+#           <qemu-system executable> [<qemu executable options>]
+#
+#  [-h] - Print the script arguments help message.
+#  [-r] - Number of timed runs per heuristic; the median time is reported.
+#       - If this flag is not specified, the tool defaults to 5.
+#  [-n] - Number of translation blocks with the largest code size change
+#         to list.
+#       - If this flag is not specified, the tool defaults to 10.
+#
+#  The QEMU command is run with -accel tcg,spill-heuristic=first and with
+#  -accel tcg,spill-heuristic=next-use added.  It must not select an
+#  accelerator itself, and the guest must exit by itself, e.g. through
+#  semihosting.
+#
+#  For each heuristic, one extra run captures the host code of every
+#  translation block with -d out_asm.  Blocks are matched by guest address
+#  across the two captures, and their host code sizes are compared.
+#
+#  Example of usage, with the integer workload from check-tcg:
+#  tcg_regalloc.py -- qemu-system-arm -M microbit -semihosting \
+#           -kernel tests/tcg/arm-softmmu/test-armv6m-branchy
+#
+#  This program is free software: you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation, either version 2 of the License, or
+#  (at your option) any later version.
+#
+#  This program is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+import os
+import re
+import sys
+import tempfile
+
+import tcgbench
+
+
+# Parse the command line arguments
+parser = tcgbench.argument_parser(
+    'tcg_regalloc.py [-h] [-r <runs>] [-n <top>] -- '
+    '<qemu-system executable> [<qemu executable options>]',
+    5, 'Number of timed runs per heuristic.')
+
+parser.add_argument('-n', dest='top', type=int, default=10,
+                    help='Number of blocks with the largest change to list.')
+
+args = tcgbench.parse_args(parser)
+
+# Extract the needed variables from the args
+command = args.command
+top = args.top
+
+heuristics = ['first', 'next-use']
+
+OUT_RE = re.compile(r'^OUT: \[size=(\d+)\]')
+ADDR_RE = re.compile(r'^\s+-- guest addr (0x[0-9a-fA-F]+) \+ tb prologue')
+
+
+def run_qemu(name, extra):
+    """Run the QEMU command with the given heuristic, return the time"""
+    cmd = command[:1] + ['-accel', 'tcg,spill-heuristic=' + name] + extra + \
+        command[1:]
+    return tcgbench.run(cmd, name + ' run')
+
+
+def capture_sizes(name):
+    """Return a dictionary of guest address -> host code size"""
+    with tempfile.TemporaryDirectory() as tmpdir:
+        log = os.path.join(tmpdir, 'out_asm.log')
+        run_qemu(name, ['-d', 'out_asm', '-D', log])
+        sizes = {}
+        size = None
+        with open(log, 'r', errors='replace') as f:
+            for line in f:
+                match = OUT_RE.match(line)
+                if match:
+                    size = int(match.group(1))
+                    continue
+                match = ADDR_RE.match(line)
+                if match and size is not None:
+                    # Keep the first translation of each block
+                    sizes.setdefault(int(match.group(1), 16), size)
+                    size = None
+        return sizes
+
+
+times = tcgbench.alternate(args.runs, heuristics,
+                           lambda name: run_qemu(name, []))
+sizes = {name: capture_sizes(name) for name in heuristics}
+
+# Print the run times
+tcgbench.print_times('Heuristic', times, 'first')
+
+# Print the code sizes of the blocks translated by both runs
+common = sorted(set(sizes['first']) & set(sizes['next-use']))
+if not common:
+    sys.exit("No translation block was captured by both runs!")
+
+first_total = sum(sizes['first'][pc] for pc in common)
+next_total = sum(sizes['next-use'][pc] for pc in common)
+deltas = [(sizes['next-use'][pc] - sizes['first'][pc], pc)
+          for pc in common]
+
+print()
+print('{} blocks: {} bytes with first, {} bytes with next-use '
+      '({:+.2f}%)'.format(len(common), first_total, next_total,
+                          (next_total - first_total) * 100 / first_total))
+print('smaller: {}  same: {}  larger: {}'.format(
+    sum(1 for d, _ in deltas if d < 0),
+    sum(1 for d, _ in deltas if d == 0),
+    sum(1 for d, _ in deltas if d > 0)))
+
+changed = sorted((d for d in deltas if d[0]), key=lambda d: abs(d[0]),
+                 reverse=True)[:top]
+if changed:
+    print()
+    tcgbench.print_table(
+        ['Guest address', 'first', 'next-use', 'Delta'], [-20, 8, 12, 8],
+        [[hex(pc), sizes['first'][pc], sizes['next-use'][pc],
+          '{:+}'.format(delta)] for delta, pc in changed])
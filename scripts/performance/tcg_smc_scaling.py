@@ -0,0 +1,111 @@
+#!/usr/bin/env python3
+
+#  Measure how a guest JIT workload scales with the number of MTTCG vCPUs.
+#  Syntax:
+#  tcg_smc_scaling.py [-h] [-r <runs>] [-c <cpus>] [-b <baseline>] -- \
+#           <qemu-system executable> [<qemu executable options>]
+#
+#  [-h] - Print the script arguments help message.
+#  [-r] - Number of runs per vCPU count; the median time is reported.
+#       - If this flag is not specified, the tool defaults to 3.
+#  [-c] - Comma-separated list of vCPU counts.
+#       - If this flag is not specified, the tool defaults to 1,2,4,8.
+#  [-b] - Another qemu-system executable, e.g. a build without lock-free
+#         code page writes, to run the same command with for comparison.
+#
+#  The QEMU command is run with -smp <n> -accel tcg,thread=multi added for
+#  each vCPU count.  It must not select an accelerator or a vCPU count
+#  itself, and the guest must power off by itself.  The guest should run
+#  one JIT worker per vCPU, each doing the same amount of work.  JITs keep
+#  writing to data such as inline caches and counters next to the code
+#  they generate; these writes go through the self-modifying code checks
+#  of TCG.  tests/tcg/aarch64/system/smc-workers does this on every CPU
+#  the machine has; beyond 8 vCPUs the virt machine needs GICv3.
+#
+#  As the work per vCPU is fixed, perfect scaling keeps the run time
+#  constant; the efficiency column is the time with the fewest vCPUs
+#  divided by the time with n vCPUs.
+#
+#  Example of usage, with the workload from check-tcg:
+#  tcg_smc_scaling.py -c 1,2,4,8,16 -b ./qemu-system-aarch64.old -- \
+#           ./qemu-system-aarch64 -M virt,gic-version=3 -cpu max \
+#           -display none -semihosting-config enable=on,target=native \
+#           -kernel tests/tcg/aarch64-softmmu/smc-workers
+#
+#  This program is free software: you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation, either version 2 of the License, or
+#  (at your option) any later version.
+#
+#  This program is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+import statistics
+
+import tcgbench
+
+
+# Parse the command line arguments
+parser = tcgbench.argument_parser(
+    'tcg_smc_scaling.py [-h] [-r <runs>] [-c <cpus>] [-b <baseline>] '
+    '-- <qemu-system executable> [<qemu executable options>]',
+    3, 'Number of runs per vCPU count.')
+
+parser.add_argument('-c', dest='cpus', type=str, default='1,2,4,8',
+                    help='Comma-separated list of vCPU counts.')
+
+parser.add_argument('-b', dest='baseline', type=str,
+                    help='qemu-system executable to compare with.')
+
+args = tcgbench.parse_args(parser)
+
+# Extract the needed variables from the args
+command = args.command
+baseline = args.baseline
+cpus = tcgbench.parse_counts(args.cpus, 'vCPU counts')
+
+
+def run_qemu(binary, ncpus):
+    """Run the QEMU command with ncpus vCPUs, return the time"""
+    cmd = [binary, '-smp', str(ncpus), '-accel', 'tcg,thread=multi'] + \
+        command[1:]
+    return tcgbench.run(cmd, '{} with {} vCPUs'.format(binary, ncpus))
+
+
+def measure(binary):
+    """Return a dictionary of vCPU count -> median time"""
+    return {n: statistics.median(run_qemu(binary, n)
+                                 for _ in range(args.runs))
+            for n in cpus}
+
+
+binaries = [command[0]] + ([baseline] if baseline else [])
+times = {binary: measure(binary) for binary in binaries}
+
+# Print the run times and the scaling efficiency of each binary
+titles = ['vCPUs']
+widths = [6]
+for i, _ in enumerate(binaries):
+    titles += [('baseline' if i else 'qemu') + '(s)', 'efficiency']
+    widths += [12, 10]
+if baseline:
+    titles.append('Speedup')
+    widths.append(8)
+
+rows = []
+for n in cpus:
+    row = [n]
+    for binary in binaries:
+        t = times[binary][n]
+        row += ['{:.3f}'.format(t),
+                '{:.0f}%'.format(times[binary][cpus[0]] * 100 / t)]
+    if baseline:
+        row.append('{:.2f}x'.format(times[baseline][n] /
+                                    times[command[0]][n]))
+    rows.append(row)
+tcgbench.print_table(titles, widths, rows)
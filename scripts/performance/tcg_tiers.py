@@ -0,0 +1,110 @@
+#!/usr/bin/env python3
+
+#  Compare TCG translation tiers on a guest workload.
+#  Syntax:
+#  tcg_tiers.py [-h] [-r <runs>] [-t <threshold>] [-e] -- \
+#           <qemu-system executable> [<qemu executable options>]
+#
+#  [-h] - Print the script arguments help message.
+#  [-r] - Number of runs per configuration; the median time is reported.
+#       - If this flag is not specified, the tool defaults to 5.
+#  [-t] - The tier-threshold to use.
+#       - If this flag is not specified, the tool defaults to 16.
+#  [-e] - Also count the blocks that the execution loop dispatched, from
+#         one extra run per configuration with -d exec.
+#
+#  The QEMU command is run as is, and with -accel tcg,tier-threshold=<t>
+#  and -accel tcg,tier-threshold=<t>,superblocks=on added.  It must not
+#  select an accelerator itself, and the guest must exit by itself, e.g.
+#  through semihosting.
+#
+#  The times cover translation and execution together.  Tiering saves
+#  optimizer time on code that runs fewer than <t> times, but translates
+#  hot code twice and runs it unoptimized <t> times first.  For a guest
+#  that keeps running instead, "info jit" splits the host time of each
+#  vCPU into execution and translation.
+#
+#  -d exec logs every block that the execution loop enters, but not the
+#  blocks reached through chained jumps, so with -e the table also shows
+#  how often each configuration went back to the loop.  Superblocks
+#  should lower that count on loops whose blocks cannot be chained.
+#
+#  Examples of usage, with the integer workload and the memory test from
+#  check-tcg, the latter for the loops of the A64 translator:
+#  tcg_tiers.py -- qemu-system-arm -M microbit -semihosting \
+#           -kernel tests/tcg/arm-softmmu/test-armv6m-branchy
+#  tcg_tiers.py -- qemu-system-aarch64 -M virt -cpu max -display none \
+#           -semihosting-config enable=on,target=native \
+#           -kernel tests/tcg/aarch64-softmmu/memory
+#
+#  This program is free software: you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation, either version 2 of the License, or
+#  (at your option) any later version.
+#
+#  This program is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+import os
+import tempfile
+
+import tcgbench
+
+
+# Parse the command line arguments
+parser = tcgbench.argument_parser(
+    'tcg_tiers.py [-h] [-r <runs>] [-t <threshold>] [-e] -- '
+    '<qemu-system executable> [<qemu executable options>]',
+    5, 'Number of runs per configuration.')
+
+parser.add_argument('-t', dest='threshold', type=int, default=16,
+                    help='tier-threshold for the tiered configurations.')
+
+parser.add_argument('-e', dest='dispatches', action='store_true',
+                    help='Also count the blocks the execution loop '
+                    'dispatched, with -d exec.')
+
+args = tcgbench.parse_args(parser)
+
+# Extract the needed variables from the args
+command = args.command
+threshold = args.threshold
+
+configs = {
+    'baseline': [],
+    'tiered': ['-accel', 'tcg,tier-threshold={}'.format(threshold)],
+    'superblocks': ['-accel', 'tcg,tier-threshold={},superblocks=on'
+                    .format(threshold)],
+}
+
+times = tcgbench.alternate(
+    args.runs, configs,
+    lambda name: tcgbench.run(command[:1] + configs[name] + command[1:],
+                              name + ' run'))
+
+
+def count_dispatches(name):
+    """Return the number of blocks the execution loop entered"""
+    with tempfile.TemporaryDirectory() as tmpdir:
+        log = os.path.join(tmpdir, 'exec.log')
+        tcgbench.run(command[:1] + configs[name] + ['-d', 'exec', '-D', log] +
+                     command[1:], name + ' -d exec run')
+        with open(log, 'r', errors='replace') as f:
+            return sum(1 for line in f if line.startswith('Trace '))
+
+
+# Print the results
+tcgbench.print_times('Config', times, 'baseline')
+
+if args.dispatches:
+    dispatches = {name: count_dispatches(name) for name in configs}
+    print()
+    tcgbench.print_table(
+        ['Config', 'Dispatches', 'Ratio'], [-12, 14, 8],
+        [[name, count, '{:.2f}'.format(count / max(dispatches['baseline'], 1))]
+         for name, count in dispatches.items()])
@@ -0,0 +1,108 @@
+#  Helpers shared by the tcg_*.py benchmark scripts in this directory.
+#
+#  Each script runs a QEMU command, given after "--", several times in
+#  a few configurations and prints a table of the results.  This module
+#  parses the options they have in common, runs the commands and prints
+#  the tables.
+#
+#  This program is free software: you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation, either version 2 of the License, or
+#  (at your option) any later version.
+#
+#  This program is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+import argparse
+import statistics
+import subprocess
+import sys
+import time
+
+
+def argument_parser(usage, runs, runs_help):
+    """Return a parser for usage with the -r <runs> option"""
+    parser = argparse.ArgumentParser(usage=usage)
+    parser.add_argument('-r', dest='runs', type=int, default=runs,
+                        help=runs_help)
+    return parser
+
+
+def parse_args(parser):
+    """Add the QEMU command to parser, parse and check the arguments"""
+    parser.add_argument('command', type=str, nargs='+',
+                        help=argparse.SUPPRESS)
+    args = parser.parse_args()
+    if args.runs < 1:
+        sys.exit("The number of runs must be at least 1!")
+    return args
+
+
+def parse_counts(text, what):
+    """Return the sorted counts of a comma-separated list"""
+    try:
+        counts = sorted({int(n) for n in text.split(',')})
+    except ValueError:
+        sys.exit("Invalid list of {}: {}".format(what, text))
+    if counts[0] < 1:
+        sys.exit("{} must be at least 1!".format(what.capitalize()))
+    return counts
+
+
+def run(cmd, what, capture=False):
+    """Run cmd and return the time it took and, with capture, its
+    output; exit with its error output if it fails"""
+    start = time.perf_counter()
+    proc = subprocess.run(cmd, stderr=subprocess.PIPE,
+                          stdout=subprocess.PIPE if capture
+                          else subprocess.DEVNULL)
+    elapsed = time.perf_counter() - start
+    if proc.returncode:
+        sys.exit("{} failed with exit code {}:\n{}".format(
+            what, proc.returncode, proc.stderr.decode()))
+    if capture:
+        return elapsed, proc.stdout.decode()
+    return elapsed
+
+
+def alternate(runs, names, measure):
+    """Call measure(name) runs times for each name, taking turns so that
+    all see the same host noise; return a dictionary of name -> results"""
+    results = {name: [] for name in names}
+    for _ in range(runs):
+        for name in names:
+            results[name].append(measure(name))
+    return results
+
+
+def print_table(titles, widths, rows):
+    """Print rows of formatted cells under titles, in columns of the
+    given widths; a negative width aligns the column to the left"""
+    def line(cells):
+        return ' '.join('{:{}{}}'.format(cell, '<' if width < 0 else '>',
+                                         abs(width))
+                        for cell, width in zip(cells, widths)).rstrip()
+
+    print(line(titles))
+    print(line('-' * abs(width) for width in widths))
+    for row in rows:
+        print(line(row))
+
+
+def print_times(title, times, reference):
+    """Print the median and best of each list of run times in the
+    dictionary times, with the speedup over the reference entry"""
+    base = statistics.median(times[reference])
+    rows = []
+    for name, runs in times.items():
+        median = statistics.median(runs)
+        rows.append([name, '{:.3f}'.format(median),
+                     '{:.3f}'.format(min(runs)),
+                     '{:.2f}x'.format(base / median)])
+    print_table([title, 'Median(s)', 'Best(s)', 'Speedup'],
+                [-12, 10, 10, 8], rows)
@@ -0,0 +1,187 @@
+#!/usr/bin/env python3
+#
+# Decode the binary snapshots published by the headless debug buddy
+# ("-buddy headless,snapshot=FILE"), see mydebug_snapshot.hpp for the format.
+# With --i2c-trace, decode an I2C transaction trace ("-buddy i2c-trace=FILE")
+# instead, one JSON object per transaction; with --wdt-trace, a watchdog
+# event history ("-buddy wdt-trace=FILE"), one JSON object per event.
+#
+# This work is licensed under the terms of the GNU GPL, version 2 or later.
+# See the COPYING file in the top-level directory.
+
+import argparse
+import json
+import struct
+import sys
+import time
+
+HEADER = struct.Struct('<4sHHIIQQQ')
+SECTION = struct.Struct('<HHI')
+CPU = struct.Struct('<iiq')
+I2C = struct.Struct('<iIII')
+WDT = struct.Struct('<iHHqqqIIIIqqqq')
+I2C_LATENCY = struct.Struct('<iIIIq32I')
+CPU_EXEC = struct.Struct('<iIQQQQQQ')
+PROFILE = struct.Struct('<QII')
+TRACE_HEADER = struct.Struct('<4sHHIIQ')
+TRACE_RECORD = struct.Struct('<qqiBBHHHI')
+WDT_RECORD = struct.Struct('<qqiHH')
+
+(SEC_CPU, SEC_I2C, SEC_WDT, SEC_LOG, SEC_I2C_LATENCY, SEC_CPU_EXEC,
+ SEC_PROFILE) = range(1, 8)
+TRACE_RECV, TRACE_NACK = 0x1, 0x2
+# BUDDY_WDT_* in mydebug.hpp
+WDT_KINDS = {1: 'arm', 2: 'disarm', 3: 'kick', 4: 'expire', 5: 'reset',
+             6: 'device-reset'}
+
+
+def read_consistent(path, retries=100):
+    """Copy the snapshot out of the shared file, retrying while the
+    writer holds the sequence counter odd or changes it under us."""
+    with open(path, 'rb') as f:
+        for _ in range(retries):
+            f.seek(0)
+            head = f.read(HEADER.size)
+            seq = HEADER.unpack(head)[3]
+            if seq & 1:
+                time.sleep(0.001)
+                continue
+            payload_size = HEADER.unpack(head)[4]
+            data = head + f.read(payload_size)
+            f.seek(0)
+            if HEADER.unpack(f.read(HEADER.size))[3] == seq:
+                return data
+    raise RuntimeError('could not get a consistent snapshot')
+
+
+def decode(data):
+    (magic, version, header_size, seq, payload_size,
+     frame, host_ms, dropped) = HEADER.unpack_from(data, 0)
+    if magic != b'QBDY':
+        raise ValueError('bad magic %r' % magic)
+    out = {'version': version, 'frame': frame, 'host_ms': host_ms,
+           'dropped_events': dropped}
+    off, end = header_size, header_size + payload_size
+    while off + SECTION.size <= end:
+        kind, count, size = SECTION.unpack_from(data, off)
+        off += SECTION.size
+        body = data[off:off + size]
+        off += size
+        if kind == SEC_CPU:
+            out['cpus'] = [{'cpu_index': c[0], 'icount': c[2]}
+                           for c in CPU.iter_unpack(body)]
+        elif kind == SEC_CPU_EXEC:
+            # tbs and insns are lower bounds, see CPUExecStats
+            out['cpu_exec'] = [{'cpu_index': c[0], 'tbs': c[2],
+                                'insns': c[3], 'exec_ns': c[4],
+                                'translate_ns': c[5], 'bql_wait_ns': c[6],
+                                'halted_ns': c[7]}
+                               for c in CPU_EXEC.iter_unpack(body)]
+        elif kind == SEC_I2C:
+            out['i2c'] = [{'serial': b[0], 'tx_per_sec': b[1],
+                           'reads_per_sec': b[2], 'writes_per_sec': b[3]}
+                          for b in I2C.iter_unpack(body)]
+        elif kind == SEC_WDT:
+            out['watchdogs'] = [{'index': w[0], 'armed': bool(w[1]),
+                                 'last_event': WDT_KINDS.get(w[2], w[2]),
+                                 'expires_ns': w[3], 'qemu_ns': w[4],
+                                 'last_kick_ns': w[5], 'kicks': w[6],
+                                 'expires': w[7], 'resets': w[8],
+                                 'kick_interval': {
+                                     'count': w[9], 'min_ns': w[10],
+                                     'max_ns': w[11], 'mean_ns': w[12],
+                                     'stddev_ns': w[13]}}
+                                for w in WDT.iter_unpack(body)]
+        elif kind == SEC_I2C_LATENCY:
+            # buckets[i] counts latencies in [2^i, 2^(i+1)) virtual ns
+            out['i2c_latency'] = [{'serial': l[0], 'count': l[1],
+                                   'nacks': l[2], 'max_ns': l[4],
+                                   'buckets': list(l[5:])}
+                                  for l in I2C_LATENCY.iter_unpack(body)]
+        elif kind == SEC_PROFILE:
+            total, halted = struct.unpack_from('<II', body, 0)
+            out['profile'] = {'samples': total, 'halted': halted,
+                              'top': [{'pc': p[0], 'samples': p[1],
+                                       'tb_size': p[2]}
+                                      for p in PROFILE.iter_unpack(body[8:])]}
+        elif kind == SEC_LOG:
+            total, = struct.unpack_from('<I', body, 0)
+            pos, lines = 4, []
+            for _ in range(count):
+                n, = struct.unpack_from('<H', body, pos)
+                lines.append(body[pos + 2:pos + 2 + n].decode('utf-8',
+                                                              'replace'))
+                pos += 2 + n
+            out['log'] = {'total_entries': total, 'lines': lines}
+    return out
+
+
+def read_trace(path, expected_magic):
+    """Yield the records of a trace file as (data, offset) pairs."""
+    with open(path, 'rb') as f:
+        data = f.read()
+    magic, version, record_size, count, _, total = \
+        TRACE_HEADER.unpack_from(data, 0)
+    if magic != expected_magic:
+        raise ValueError('bad magic %r' % magic)
+    off = TRACE_HEADER.size
+    for _ in range(count):
+        yield data, off
+        off += record_size
+    if total > count:
+        sys.stderr.write('%d older records were overwritten\n'
+                         % (total - count))
+
+
+def dump_i2c_trace(path):
+    for data, off in read_trace(path, b'QI2C'):
+        (start_ns, latency_ns, serial, address, flags, _, rd, wr,
+         _) = TRACE_RECORD.unpack_from(data, off)
+        json.dump({'start_ns': start_ns, 'latency_ns': latency_ns,
+                   'bus': serial, 'address': address,
+                   'dir': 'read' if flags & TRACE_RECV else 'write',
+                   'nack': bool(flags & TRACE_NACK),
+                   'read_bytes': rd, 'write_bytes': wr}, sys.stdout)
+        sys.stdout.write('\n')
+
+
+def dump_wdt_trace(path):
+    for data, off in read_trace(path, b'QWDT'):
+        ns, expires_ns, index, kind, _ = WDT_RECORD.unpack_from(data, off)
+        json.dump({'ns': ns, 'watchdog': index,
+                   'event': WDT_KINDS.get(kind, kind),
+                   'expires_ns': expires_ns}, sys.stdout)
+        sys.stdout.write('\n')
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument('snapshot', help='file given to -buddy snapshot=')
+    parser.add_argument('--i2c-trace', action='store_true',
+                        help='the file is an I2C trace (-buddy i2c-trace=)')
+    parser.add_argument('--wdt-trace', action='store_true',
+                        help='the file is a watchdog history '
+                        '(-buddy wdt-trace=)')
+    parser.add_argument('-f', '--follow', action='store_true',
+                        help='print a new snapshot every INTERVAL seconds')
+    parser.add_argument('-i', '--interval', type=float, default=1.0)
+    args = parser.parse_args()
+
+    if args.i2c_trace:
+        dump_i2c_trace(args.snapshot)
+        return
+    if args.wdt_trace:
+        dump_wdt_trace(args.snapshot)
+        return
+
+    while True:
+        json.dump(decode(read_consistent(args.snapshot)), sys.stdout)
+        sys.stdout.write('\n')
+        sys.stdout.flush()
+        if not args.follow:
+            break
+        time.sleep(args.interval)
+
+
+if __name__ == '__main__':
+    main()
@@ -34,6 +34,8 @@
 #include "exec/gdbstub.h"
 #include "sysemu/hw_accel.h"
 #include "exec/exec-all.h"
+#include "exec/address-spaces.h"
+#include "qemu/rcu.h"
 #include "qemu/thread.h"
 #include "qemu/plugin.h"
 #include "sysemu/cpus.h"
@@ -47,6 +49,8 @@
 #include "hw/hw.h"
 #include "trace.h"
 
+#include "../mydebug.hpp"
+
 #ifdef CONFIG_LINUX
 
 #include <sys/prctl.h>
@@ -410,15 +414,19 @@ void qemu_wait_io_event_common(CPUState *cpu)
 void qemu_wait_io_event(CPUState *cpu)
 {
     bool slept = false;
+    int64_t halt_start = 0;
 
     while (cpu_thread_is_idle(cpu)) {
         if (!slept) {
             slept = true;
+            halt_start = get_clock();
             qemu_plugin_vcpu_idle_cb(cpu);
         }
         qemu_cond_wait(cpu->halt_cond, &qemu_global_mutex);
     }
     if (slept) {
+        cpu_exec_stats_add(&cpu->exec_stats.halted_ns,
+                           get_clock() - halt_start);
         qemu_plugin_vcpu_resume_cb(cpu);
     }
 
@@ -494,8 +502,23 @@ void qemu_mutex_lock_iothread_impl(const char *file, int line)
 {
     QemuMutexLockFunc bql_lock = qatomic_read(&qemu_bql_mutex_lock_func);
 
+    CPUState *cpu = current_cpu;
+
     g_assert(!qemu_mutex_iothread_locked());
-    bql_lock(&qemu_global_mutex, file, line);
+    if (!cpu) {
+        bql_lock(&qemu_global_mutex, file, line);
+    } else if (bql_lock != qemu_mutex_lock_impl ||
+               qemu_mutex_trylock(&qemu_global_mutex)) {
+        /*
+         * Only read the clock when a vCPU actually has to wait.  The
+         * trylock shortcut would hide uncontended acquisitions from the
+         * -sync-profile hook, so it is not taken while that is active.
+         */
+        int64_t ti = get_clock();
+
+        bql_lock(&qemu_global_mutex, file, line);
+        cpu_exec_stats_add(&cpu->exec_stats.bql_wait_ns, get_clock() - ti);
+    }
     set_iothread_locked(true);
 }
 
@@ -813,12 +836,81 @@ void qmp_inject_nmi(Error **errp)
     nmi_monitor_handle(monitor_get_cpu_index(monitor_cur()), errp);
 }
 
-char g_is_debug_dump = 0;
-void DumpPhysicalMemoryForMyDebug(int64_t addr, int64_t size, unsigned char* outbuf);
-void DumpPhysicalMemoryForMyDebug(int64_t addr, int64_t size, unsigned char* outbuf) {
-    g_is_debug_dump = 1;
-    for (int i=0; i<size; i++) {
-        cpu_physical_memory_read(addr + i, outbuf + i, 1);
+/*
+ * Called from the buddy thread, which QEMU does not otherwise know about:
+ * register it with RCU on first use so the FlatView it walks stays alive.
+ */
+static void my_debug_rcu_register(void)
+{
+    static __thread bool rcu_registered;
+
+    if (!rcu_registered) {
+        rcu_register_thread();
+        rcu_registered = true;
     }
-    g_is_debug_dump = 0;
-}
\ No newline at end of file
+}
+
+void DumpPhysicalMemoryForMyDebug(int64_t addr, int64_t size,
+                                  unsigned char *outbuf, int read_io);
+void DumpPhysicalMemoryForMyDebug(int64_t addr, int64_t size,
+                                  unsigned char *outbuf, int read_io)
+{
+    my_debug_rcu_register();
+    address_space_read_snapshot(&address_space_memory, addr, outbuf, size,
+                                read_io);
+}
+
+int GetTargetPageBitsForMyDebug(void);
+int GetTargetPageBitsForMyDebug(void)
+{
+    return TARGET_PAGE_BITS;
+}
+
+void SetDirtyTrackingForMyDebug(int on);
+void SetDirtyTrackingForMyDebug(int on)
+{
+    qatomic_set(&debug_dirty_tracking, on);
+}
+
+/* @bitmap needs one zeroed bit per target page of the range. */
+int64_t GetDirtyPagesForMyDebug(int64_t addr, int64_t size,
+                                unsigned long *bitmap);
+int64_t GetDirtyPagesForMyDebug(int64_t addr, int64_t size,
+                                unsigned long *bitmap)
+{
+    my_debug_rcu_register();
+    return address_space_get_and_clear_dirty(&address_space_memory, addr, size,
+                                             DIRTY_MEMORY_DEBUG, bitmap);
+}
+int64_t GetVirtualClockNsForMyDebug(void);
+int64_t GetVirtualClockNsForMyDebug(void)
+{
+    return qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+}
+
+/* Fills up to @max entries of @out, returns how many vCPUs there are. */
+int GetCPUExecStatsForMyDebug(BuddyCPUExecStats *out, int max);
+int GetCPUExecStatsForMyDebug(BuddyCPUExecStats *out, int max)
+{
+    CPUState *cpu;
+    int n = 0;
+
+    my_debug_rcu_register();
+    WITH_RCU_READ_LOCK_GUARD() {
+        CPU_FOREACH(cpu) {
+            if (n < max) {
+                CPUExecStats *s = &cpu->exec_stats;
+
+                out[n].cpu_index = cpu->cpu_index;
+                out[n].tbs = qatomic_read_u64(&s->tbs);
+                out[n].insns = qatomic_read_u64(&s->insns);
+                out[n].exec_ns = qatomic_read_u64(&s->exec_ns);
+                out[n].translate_ns = qatomic_read_u64(&s->translate_ns);
+                out[n].bql_wait_ns = qatomic_read_u64(&s->bql_wait_ns);
+                out[n].halted_ns = qatomic_read_u64(&s->halted_ns);
+            }
+            n++;
+        }
+    }
+    return n;
+}
@@ -91,7 +91,7 @@ static void icount_update_locked(CPUState *cpu)
     int64_t executed = icount_get_executed(cpu);
     cpu->icount_budget -= executed;
 
-    UpdateCPUICount(cpu, executed);
+    UpdateCPUICount(cpu->cpu_index, executed);
 
     qatomic_set_i64(&timers_state.qemu_icount,
                     timers_state.qemu_icount + executed);
@@ -40,6 +40,7 @@ static unsigned memory_region_transaction_depth;
 static bool memory_region_update_pending;
 static bool ioeventfd_update_pending;
 unsigned int global_dirty_tracking;
+bool debug_dirty_tracking;
 
 static QTAILQ_HEAD(, MemoryListener) memory_listeners
     = QTAILQ_HEAD_INITIALIZER(memory_listeners);
@@ -1840,6 +1841,10 @@ uint8_t memory_region_get_dirty_log_mask(MemoryRegion *mr)
         /* TCG only cares about dirty memory logging for RAM, not IOMMU.  */
         mask |= (1 << DIRTY_MEMORY_CODE);
     }
+
+    if (debug_dirty_tracking && rb) {
+        mask |= (1 << DIRTY_MEMORY_DEBUG);
+    }
     return mask;
 }
 
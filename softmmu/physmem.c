@@ -2826,7 +2826,6 @@ static MemTxResult flatview_write(FlatView *fv, hwaddr addr, MemTxAttrs attrs,
     return result;
 }
 
-extern char g_is_debug_dump;
 /* Called within RCU critical section.  */
 MemTxResult flatview_read_continue(FlatView *fv, hwaddr addr,
                                    MemTxAttrs attrs, void *ptr,
@@ -2851,9 +2850,6 @@ MemTxResult flatview_read_continue(FlatView *fv, hwaddr addr,
         } else {
             /* RAM case */
             ram_ptr = qemu_ram_ptr_length(mr->ram_block, addr1, &l, false);
-            if (ram_ptr == NULL && g_is_debug_dump == 1) {
-                break;
-            }
             memcpy(buf, ram_ptr, l);
         }
 
@@ -2900,15 +2896,118 @@ MemTxResult address_space_read_full(AddressSpace *as, hwaddr addr,
     if (len > 0) {
         RCU_READ_LOCK_GUARD();
         fv = address_space_to_flatview(as);
-        if (fv == NULL && g_is_debug_dump) {
-            return MEMTX_OK;
-        }
         result = flatview_read(fv, addr, attrs, buf, len);
     }
 
     return result;
 }
 
+MemTxResult address_space_read_snapshot(AddressSpace *as, hwaddr addr,
+                                        void *buf, hwaddr len, bool read_io)
+{
+    MemTxAttrs attrs = MEMTXATTRS_UNSPECIFIED;
+    MemTxResult result = MEMTX_OK;
+    uint8_t *ptr = buf;
+    FlatView *fv;
+
+    RCU_READ_LOCK_GUARD();
+    fv = address_space_to_flatview(as);
+    if (!fv) {
+        /* Address space not populated yet (e.g. before machine init). */
+        memset(buf, 0xff, len);
+        return MEMTX_DECODE_ERROR;
+    }
+
+    while (len > 0) {
+        hwaddr addr1, l = len;
+        MemoryRegion *mr = flatview_translate(fv, addr, &addr1, &l,
+                                              false, attrs);
+        uint8_t *ram_ptr = NULL;
+
+        if (memory_access_is_direct(mr, false) && mr->ram_block) {
+            ram_ptr = qemu_ram_ptr_length(mr->ram_block, addr1, &l, false);
+        }
+        if (ram_ptr) {
+            memcpy(ptr, ram_ptr, l);
+        } else if (read_io && !memory_access_is_direct(mr, false) &&
+                   mr != &io_mem_unassigned) {
+            hwaddr done = 0;
+            bool release_lock = prepare_mmio_access(mr);
+
+            /* One lock round-trip per section, not per access. */
+            while (done < l) {
+                uint64_t val = 0;
+                hwaddr n = memory_access_size(mr, l - done, addr1 + done);
+
+                result |= memory_region_dispatch_read(mr, addr1 + done, &val,
+                                                      size_memop(n), attrs);
+                stn_he_p(ptr + done, n, val);
+                done += n;
+            }
+            if (release_lock) {
+                qemu_mutex_unlock_iothread();
+            }
+        } else {
+            memset(ptr, 0xff, l);
+        }
+
+        len -= l;
+        ptr += l;
+        addr += l;
+    }
+
+    return result;
+}
+
+uint64_t address_space_get_and_clear_dirty(AddressSpace *as, hwaddr addr,
+                                           hwaddr len, unsigned client,
+                                           unsigned long *bitmap)
+{
+    MemTxAttrs attrs = MEMTXATTRS_UNSPECIFIED;
+    hwaddr first_page = addr >> TARGET_PAGE_BITS;
+    uint64_t num_dirty = 0;
+    FlatView *fv;
+
+    RCU_READ_LOCK_GUARD();
+    fv = address_space_to_flatview(as);
+    if (!fv) {
+        return 0;
+    }
+
+    while (len > 0) {
+        hwaddr addr1, l = len;
+        MemoryRegion *mr = flatview_translate(fv, addr, &addr1, &l,
+                                              false, attrs);
+
+        if (memory_region_is_ram(mr) && mr->ram_block) {
+            ram_addr_t ram_addr = memory_region_get_ram_addr(mr) + addr1;
+            DirtyBitmapSnapshot *snap =
+                cpu_physical_memory_snapshot_and_clear_dirty(mr, addr1, l,
+                                                             client);
+            hwaddr page = addr & TARGET_PAGE_MASK;
+
+            for (; page < addr + l; page += TARGET_PAGE_SIZE) {
+                hwaddr start = MAX(page, addr);
+                hwaddr end = MIN(page + TARGET_PAGE_SIZE, addr + l);
+
+                if (cpu_physical_memory_snapshot_get_dirty(
+                        snap, ram_addr + (start - addr), end - start)) {
+                    if (!test_and_set_bit((page >> TARGET_PAGE_BITS) -
+                                          first_page, bitmap)) {
+                        num_dirty++;
+                    }
+                }
+            }
+            g_free(snap);
+        }
+
+        len -= l;
+        addr += l;
+    }
+
+    return num_dirty;
+}
+
 MemTxResult address_space_write(AddressSpace *as, hwaddr addr,
                                 MemTxAttrs attrs,
                                 const void *buf, hwaddr len)
@@ -63,8 +63,6 @@
 
 #include "../mydebug.hpp"
 
-extern void UpdateNPCM7XXDebugTimerStates(void);
-
 static NotifierList exit_notifiers =
     NOTIFIER_LIST_INITIALIZER(exit_notifiers);
 
@@ -732,7 +730,6 @@ void qemu_main_loop(void)
 #ifdef CONFIG_PROFILER
         dev_time += profile_getclock() - ti;
 #endif
-        UpdateNPCM7XXDebugTimerStates();
     }
 }
 
@@ -817,6 +814,7 @@ void qemu_cleanup(void)
     /* No more vcpu or device emulation activity beyond this point */
     vm_shutdown();
     replay_finish();
+    MyBuddyStop();
 
     job_cancel_sync_all();
     bdrv_close_all();
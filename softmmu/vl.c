@@ -130,6 +130,8 @@
 
 #include "config-host.h"
 
+#include "../mydebug.hpp"
+
 #define MAX_VIRTIO_CONSOLES 1
 
 typedef struct BlockdevOptionsQueueEntry {
@@ -351,6 +353,41 @@ static QemuOptsList qemu_overcommit_opts = {
     },
 };
 
+static QemuOptsList qemu_buddy_opts = {
+    .name = "buddy",
+    .implied_opt_name = "mode",
+    .merge_lists = true,
+    .head = QTAILQ_HEAD_INITIALIZER(qemu_buddy_opts.head),
+    .desc = {
+        {
+            .name = "mode",
+            .type = QEMU_OPT_STRING,
+        }, {
+            .name = "snapshot",
+            .type = QEMU_OPT_STRING,
+        }, {
+            .name = "rate",
+            .type = QEMU_OPT_NUMBER,
+        }, {
+            .name = "i2c-trace",
+            .type = QEMU_OPT_STRING,
+        }, {
+            .name = "wdt-trace",
+            .type = QEMU_OPT_STRING,
+        }, {
+            .name = "profile",
+            .type = QEMU_OPT_NUMBER,
+        }, {
+            .name = "symbols",
+            .type = QEMU_OPT_STRING,
+        }, {
+            .name = "profile-out",
+            .type = QEMU_OPT_STRING,
+        },
+        { /* end of list */ }
+    },
+};
+
 static QemuOptsList qemu_msg_opts = {
     .name = "msg",
     .head = QTAILQ_HEAD_INITIALIZER(qemu_msg_opts.head),
@@ -2618,6 +2655,25 @@ static void qemu_maybe_daemonize(const char *pid_file)
     qemu_add_exit_notifier(&qemu_unlink_pidfile_notifier);
 }
 
+static void qemu_start_buddy(QemuOpts *opts)
+{
+    if (!opts) {
+        return;
+    }
+    MyBuddySetI2CTraceFile(qemu_opt_get(opts, "i2c-trace"));
+    MyBuddySetWatchdogTraceFile(qemu_opt_get(opts, "wdt-trace"));
+    MyBuddySetProfiler(qemu_opt_get_number(opts, "profile", 0),
+                       qemu_opt_get(opts, "symbols"),
+                       qemu_opt_get(opts, "profile-out"));
+    if (MyBuddyStart(qemu_opt_get(opts, "mode"),
+                     qemu_opt_get(opts, "snapshot"),
+                     qemu_opt_get_number(opts, "rate", 0)) < 0) {
+        error_report("could not start the debug buddy");
+        exit(1);
+    }
+    AddLogEntry("Debug buddy started from qemu_init()");
+}
+
 static void qemu_init_displays(void)
 {
     DisplayState *ds;
@@ -2804,6 +2860,7 @@ void qemu_init(int argc, char **argv, char **envp)
     qemu_add_opts(&qemu_tpmdev_opts);
     qemu_add_opts(&qemu_overcommit_opts);
     qemu_add_opts(&qemu_msg_opts);
+    qemu_add_opts(&qemu_buddy_opts);
     qemu_add_opts(&qemu_name_opts);
     qemu_add_opts(&qemu_numa_opts);
     qemu_add_opts(&qemu_icount_opts);
@@ -3633,6 +3690,12 @@ void qemu_init(int argc, char **argv, char **envp)
                     visit_free(v);
                     break;
                 }
+            case QEMU_OPTION_buddy:
+                if (!qemu_opts_parse_noisily(qemu_find_opts("buddy"),
+                                             optarg, true)) {
+                    exit(1);
+                }
+                break;
             case QEMU_OPTION_msg:
                 opts = qemu_opts_parse_noisily(qemu_find_opts("msg"), optarg,
                                                false);
@@ -3698,6 +3761,9 @@ void qemu_init(int argc, char **argv, char **envp)
     }
     trace_init_file();
 
+    /* Like the trace thread, the buddy thread must not start before fork. */
+    qemu_start_buddy(qemu_opts_find(qemu_find_opts("buddy"), NULL));
+
     qemu_init_main_loop(&error_fatal);
     cpu_timers_init();
 
@@ -0,0 +1,46 @@
+#include "qemu/osdep.h"
+#include "hw/i2c/i2c-fault.h"
+#include "qapi/error.h"
+#include "qapi/qapi-commands-i2c.h"
+#include "qapi/qmp/qerror.h"
+
+I2CFaultRule *qmp_x_i2c_fault_add(bool has_bus, const char *bus,
+                                  bool has_address, uint8_t address,
+                                  I2CFaultAction action,
+                                  bool has_nth, uint64_t nth,
+                                  bool has_count, uint64_t count,
+                                  bool has_probability, double probability,
+                                  bool has_seed, uint64_t seed,
+                                  bool has_start_ns, int64_t start_ns,
+                                  bool has_end_ns, int64_t end_ns,
+                                  bool has_delay_ns, int64_t delay_ns,
+                                  bool has_mask, uint8_t mask, Error **errp)
+{
+    error_setg(errp, QERR_UNSUPPORTED);
+    return NULL;
+}
+
+void qmp_x_i2c_fault_remove(int64_t id, Error **errp)
+{
+    error_setg(errp, QERR_UNSUPPORTED);
+}
+
+void qmp_x_i2c_fault_clear(Error **errp)
+{
+    error_setg(errp, QERR_UNSUPPORTED);
+}
+
+I2CFaultRuleList *qmp_x_query_i2c_faults(Error **errp)
+{
+    error_setg(errp, QERR_UNSUPPORTED);
+    return NULL;
+}
+
+void i2c_fault_inject_async(int bus_serial, const char *action)
+{
+}
+
+int i2c_fault_bus_armed(int bus_serial)
+{
+    return 0;
+}
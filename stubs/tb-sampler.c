@@ -0,0 +1,8 @@
+#include "qemu/osdep.h"
+
+/* Builds without TCG have nothing to sample */
+int SetTBSamplingForMyDebug(int hz);
+int SetTBSamplingForMyDebug(int hz)
+{
+    return -1;
+}
@@ -1082,18 +1082,18 @@ void HELPER(dc_zva)(CPUARMState *env, uint64_t vaddr_in)
          * that we probe the actual space.  So do both.
          */
         (void) probe_write(env, vaddr_in, 1, mmu_idx, ra);
-        mem = probe_write(env, vaddr, blocklen, mmu_idx, ra);
 
-        if (unlikely(!mem)) {
-            /*
-             * The only remaining reason for mem == NULL is I/O.
-             * Just do a series of byte writes as the architecture demands.
-             */
-            for (int i = 0; i < blocklen; i++) {
-                cpu_stb_mmuidx_ra(env, vaddr + i, 0, mmu_idx, ra);
-            }
-            return;
+        /*
+         * What the bulk store leaves is I/O, or a page with translated
+         * code that must be invalidated as it is written.  Just do a
+         * series of byte writes as the architecture demands.
+         */
+        for (int i = cpu_memset_mmuidx_ra(env, vaddr, 0, blocklen,
+                                          mmu_idx, ra);
+             i < blocklen; i++) {
+            cpu_stb_mmuidx_ra(env, vaddr + i, 0, mmu_idx, ra);
         }
+        return;
     }
 #endif
 
@@ -411,6 +411,71 @@ static inline void gen_goto_tb(DisasContext *s, int n, uint64_t dest)
     }
 }
 
+/*
+ * Direct branch that may continue a superblock rather than end the TB,
+ * see translator_trace_branch().  For a conditional branch, the caller
+ * has just branched to @match if the condition holds; @match is NULL
+ * for an unconditional one.  The usual exits are gen_goto_tb() slot 1
+ * for the taken side of a conditional branch and slot 0 otherwise.
+ */
+static void gen_goto_tb_trace(DisasContext *s, uint64_t dest,
+                              TCGLabel *match)
+{
+    TCGLabel *cont;
+
+    if (s->ss_active || s->base.is_jmp != DISAS_NEXT) {
+        goto end;
+    }
+
+    switch (translator_trace_branch(&s->base, dest, match != NULL,
+                                    match ? 1 : 0)) {
+    case TRACE_TAKEN:
+        if (match) {
+            /* Condition failed: leave the superblock at the next insn */
+            gen_a64_set_pc_im(s->base.pc_next);
+            tcg_gen_lookup_and_goto_ptr();
+            gen_set_label(match);
+        }
+        s->base.pc_next = dest;
+        return;
+    case TRACE_FALLTHROUGH:
+        /* Condition passed: leave for @dest, carry on at the next insn */
+        cont = gen_new_label();
+        tcg_gen_br(cont);
+        gen_set_label(match);
+        gen_a64_set_pc_im(dest);
+        tcg_gen_lookup_and_goto_ptr();
+        gen_set_label(cont);
+        return;
+    default:
+        break;
+    }
+
+ end:
+    if (match) {
+        gen_goto_tb(s, 0, s->base.pc_next);
+        gen_set_label(match);
+        gen_goto_tb(s, 1, dest);
+    } else {
+        gen_goto_tb(s, 0, dest);
+    }
+}
+
+/*
+ * Jump to cpu_pc, as set by the BR, BLR or RET that ends the TB.  Those
+ * change nothing else of the state the TB was translated for but
+ * PSTATE.BTYPE, so the flags of the next TB are known here.
+ */
+static void gen_goto_ptr_indirect(DisasContext *s)
+{
+    TranslationBlock *tb = s->base.tb;
+    uint32_t flags2 = FIELD_DP32(tb->cs_base, TBFLAG_A64, BTYPE,
+                                 s->jump_btype);
+
+    tcg_gen_lookup_and_goto_ptr_cached(s->pc_curr, cpu_pc,
+                                       tcg_constant_tl(flags2), tb->flags);
+}
+
 static void init_tmp_a64_array(DisasContext *s)
 {
 #ifdef CONFIG_DEBUG_TCG
@@ -1312,7 +1377,11 @@ static void disas_uncond_b_imm(DisasContext *s, uint32_t insn)
 
     /* B Branch / BL Branch with link */
     reset_btype(s);
-    gen_goto_tb(s, 0, addr);
+    if (insn & (1U << 31)) {
+        gen_goto_tb(s, 0, addr);
+    } else {
+        gen_goto_tb_trace(s, addr, NULL);
+    }
 }
 
 /* Compare and branch (immediate)
@@ -1340,9 +1409,7 @@ static void disas_comp_b_imm(DisasContext *s, uint32_t insn)
     tcg_gen_brcondi_i64(op ? TCG_COND_NE : TCG_COND_EQ,
                         tcg_cmp, 0, label_match);
 
-    gen_goto_tb(s, 0, s->base.pc_next);
-    gen_set_label(label_match);
-    gen_goto_tb(s, 1, addr);
+    gen_goto_tb_trace(s, addr, label_match);
 }
 
 /* Test and branch (immediate)
@@ -1371,9 +1438,7 @@ static void disas_test_b_imm(DisasContext *s, uint32_t insn)
     tcg_gen_brcondi_i64(op ? TCG_COND_NE : TCG_COND_EQ,
                         tcg_cmp, 0, label_match);
     tcg_temp_free_i64(tcg_cmp);
-    gen_goto_tb(s, 0, s->base.pc_next);
-    gen_set_label(label_match);
-    gen_goto_tb(s, 1, addr);
+    gen_goto_tb_trace(s, addr, label_match);
 }
 
 /* Conditional branch (immediate)
@@ -1399,12 +1464,10 @@ static void disas_cond_b_imm(DisasContext *s, uint32_t insn)
         /* genuinely conditional branches */
         TCGLabel *label_match = gen_new_label();
         arm_gen_test_cc(cond, label_match);
-        gen_goto_tb(s, 0, s->base.pc_next);
-        gen_set_label(label_match);
-        gen_goto_tb(s, 1, addr);
+        gen_goto_tb_trace(s, addr, label_match);
     } else {
         /* 0xe and 0xf are both "always" conditions */
-        gen_goto_tb(s, 0, addr);
+        gen_goto_tb_trace(s, addr, NULL);
     }
 }
 
@@ -2319,17 +2382,20 @@ static void disas_uncond_b_reg(DisasContext *s, uint32_t insn)
         return;
     }
 
+    s->jump_btype = 0;
     switch (btype_mod) {
     case 0: /* BR */
         if (dc_isar_feature(aa64_bti, s)) {
             /* BR to {x16,x17} or !guard -> 1, else 3.  */
-            set_btype(s, rn == 16 || rn == 17 || !s->guarded_page ? 1 : 3);
+            s->jump_btype = rn == 16 || rn == 17 || !s->guarded_page ? 1 : 3;
+            set_btype(s, s->jump_btype);
         }
         break;
 
     case 1: /* BLR */
         if (dc_isar_feature(aa64_bti, s)) {
             /* BLR sets BTYPE to 2, regardless of source guarded page.  */
+            s->jump_btype = 2;
             set_btype(s, 2);
         }
         break;
@@ -14926,10 +14992,11 @@ static void aarch64_tr_tb_stop(DisasContextBase *dcbase, CPUState *cpu)
             break;
         case DISAS_UPDATE_NOCHAIN:
             gen_a64_set_pc_im(dc->base.pc_next);
-            /* fall through */
-        case DISAS_JUMP:
             tcg_gen_lookup_and_goto_ptr();
             break;
+        case DISAS_JUMP:
+            gen_goto_ptr_indirect(dc);
+            break;
         case DISAS_NORETURN:
         case DISAS_SWI:
             break;
@@ -2559,6 +2559,40 @@ static void gen_goto_ptr(void)
     tcg_gen_lookup_and_goto_ptr();
 }
 
+/*
+ * Jump to the pc set by the DISAS_JUMP insn that ends the TB.  Outside
+ * of an IT block, such an insn changes nothing else of the state the TB
+ * was translated for but the Thumb bit, so the flags of the next TB are
+ * known here.  M-profile FP state may change in the middle of a TB.
+ */
+static void gen_goto_ptr_indirect(DisasContext *s)
+{
+    TranslationBlock *tb = s->base.tb;
+    uint32_t flags2;
+    TCGv_i32 tmp;
+    TCGv pc, cs_base;
+
+    if (arm_dc_feature(s, ARM_FEATURE_M) || s->condexec_mask) {
+        gen_goto_ptr();
+        return;
+    }
+
+    flags2 = tb->cs_base & ~(R_TBFLAG_AM32_THUMB_MASK |
+                             R_TBFLAG_AM32_CONDEXEC_MASK);
+    tmp = load_cpu_field(thumb);
+    tcg_gen_shli_i32(tmp, tmp, R_TBFLAG_AM32_THUMB_SHIFT);
+    tcg_gen_ori_i32(tmp, tmp, flags2);
+    cs_base = tcg_temp_new();
+    tcg_gen_extu_i32_tl(cs_base, tmp);
+    tcg_temp_free_i32(tmp);
+    pc = tcg_temp_new();
+    tcg_gen_extu_i32_tl(pc, cpu_R[15]);
+
+    tcg_gen_lookup_and_goto_ptr_cached(s->pc_curr, pc, cs_base, tb->flags);
+    tcg_temp_free(pc);
+    tcg_temp_free(cs_base);
+}
+
 /* This will end the TB but doesn't guarantee we'll return to
  * cpu_loop_exec. Any live exit_requests will be processed as we
  * enter the next TB.
@@ -2625,6 +2659,46 @@ static inline void gen_jmp(DisasContext *s, uint32_t dest)
     gen_jmp_tb(s, dest, 0);
 }
 
+/*
+ * Direct branch that may continue a superblock rather than end the TB,
+ * see translator_trace_branch().  A condition has already been tested by
+ * arm_skip_unless(), which branches to condlabel when it fails.
+ */
+static void gen_jmp_trace(DisasContext *s, uint32_t dest)
+{
+    TCGLabel *cont;
+
+    if (s->ss_active || s->condexec_mask || s->eci ||
+        s->base.is_jmp != DISAS_NEXT) {
+        gen_jmp(s, dest);
+        return;
+    }
+
+    switch (translator_trace_branch(&s->base, dest, s->condjmp, 0)) {
+    case TRACE_TAKEN:
+        if (s->condjmp) {
+            /* Condition failed: leave the superblock at the next insn */
+            cont = gen_new_label();
+            tcg_gen_br(cont);
+            gen_set_label(s->condlabel);
+            s->condjmp = 0;
+            gen_set_pc_im(s, s->base.pc_next);
+            gen_goto_ptr();
+            gen_set_label(cont);
+        }
+        s->base.pc_next = dest;
+        break;
+    case TRACE_FALLTHROUGH:
+        /* Condition passed: leave for @dest; condlabel carries on */
+        gen_set_pc_im(s, dest);
+        gen_goto_ptr();
+        break;
+    default:
+        gen_jmp(s, dest);
+        break;
+    }
+}
+
 static inline void gen_mulxy(TCGv_i32 t0, TCGv_i32 t1, int x, int y)
 {
     if (x)
@@ -8331,7 +8405,7 @@ static bool trans_CLRM(DisasContext *s, arg_CLRM *a)
 
 static bool trans_B(DisasContext *s, arg_i *a)
 {
-    gen_jmp(s, read_pc(s) + a->imm);
+    gen_jmp_trace(s, read_pc(s) + a->imm);
     return true;
 }
 
@@ -8346,7 +8420,7 @@ static bool trans_B_cond_thumb(DisasContext *s, arg_ci *a)
         return true;
     }
     arm_skip_unless(s, a->cond);
-    gen_jmp(s, read_pc(s) + a->imm);
+    gen_jmp_trace(s, read_pc(s) + a->imm);
     return true;
 }
 
@@ -9832,10 +9906,11 @@ static void arm_tr_tb_stop(DisasContextBase *dcbase, CPUState *cpu)
             break;
         case DISAS_UPDATE_NOCHAIN:
             gen_set_pc_im(dc, dc->base.pc_next);
-            /* fall through */
-        case DISAS_JUMP:
             gen_goto_ptr();
             break;
+        case DISAS_JUMP:
+            gen_goto_ptr_indirect(dc);
+            break;
         case DISAS_UPDATE_EXIT:
             gen_set_pc_im(dc, dc->base.pc_next);
             /* fall through */
@@ -107,6 +107,8 @@ typedef struct DisasContext {
      *  < 0, set by the current instruction.
      */
     int8_t btype;
+    /* PSTATE.BTYPE after the A64 indirect branch that ends the TB.  */
+    int8_t jump_btype;
     /* A copy of cpu->dcz_blocksize. */
     uint8_t dcz_blocksize;
     /* True if this page is guarded.  */
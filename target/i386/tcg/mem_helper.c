@@ -18,6 +18,7 @@
  */
 
 #include "qemu/osdep.h"
+#include "qemu/units.h"
 #include "cpu.h"
 #include "exec/helper-proto.h"
 #include "exec/exec-all.h"
@@ -181,3 +182,114 @@ void helper_boundl(CPUX86State *env, target_ulong a0, int v)
         raise_exception_ra(env, EXCP05_BOUND, GETPC());
     }
 }
+
+/*
+ * REP MOVS and REP STOS move up to this many bytes per helper call, so
+ * that interrupts are still taken during long strings.
+ */
+#define REP_BULK_MAX (64 * KiB)
+
+/*
+ * Clamp a string access of BYTES at linear address ADDR, indexed by REG,
+ * so that neither REG nor a 32-bit linear address wraps around.
+ */
+static uint64_t rep_bulk_clamp(CPUX86State *env, uint64_t bytes,
+                               target_ulong addr, int reg, int aflag)
+{
+    if (aflag != MO_64) {
+        uint64_t mask = MAKE_64BIT_MASK(0, 8 << aflag);
+
+        bytes = MIN(bytes, mask - (env->regs[reg] & mask) + 1);
+    }
+    if (!(env->hflags & HF_CS64_MASK)) {
+        bytes = MIN(bytes, (1ULL << 32) - (uint32_t)addr);
+    }
+    return bytes;
+}
+
+static void rep_bulk_advance(CPUX86State *env, int reg, int aflag,
+                             target_ulong delta)
+{
+    target_ulong val = env->regs[reg] + delta;
+
+    switch (aflag) {
+    case MO_16:
+        env->regs[reg] = deposit64(env->regs[reg], 0, 16, val);
+        break;
+#ifdef TARGET_X86_64
+    case MO_32:
+        env->regs[reg] = (uint32_t)val;
+        break;
+#endif
+    default:
+        env->regs[reg] = val;
+        break;
+    }
+}
+
+static uint64_t rep_bulk_bytes(CPUX86State *env, int ot, int aflag)
+{
+    uint64_t count = env->regs[R_ECX] & MAKE_64BIT_MASK(0, 8 << aflag);
+
+    return MIN(count, REP_BULK_MAX >> ot) << ot;
+}
+
+/*
+ * Do as many iterations of REP STOS as possible with bulk stores, for
+ * a forward string of elements whose bytes are all equal, and update
+ * ECX and EDI.  Return the number of elements stored; if none, the
+ * translated code stores one element itself.  A fault restarts the
+ * instruction, which is harmless as it stores the same bytes again.
+ */
+uint32_t helper_rep_stos(CPUX86State *env, target_ulong a0,
+                         uint32_t ot, uint32_t aflag)
+{
+    uint8_t val = env->regs[R_EAX];
+    uint64_t bytes;
+
+    if (env->df != 1 ||
+        ((env->regs[R_EAX] ^ (val * 0x0101010101010101ULL))
+         & MAKE_64BIT_MASK(0, 8 << ot))) {
+        return 0;
+    }
+
+    bytes = rep_bulk_bytes(env, ot, aflag);
+    bytes = rep_bulk_clamp(env, bytes, a0, R_EDI, aflag);
+    bytes = cpu_memset_mmuidx_ra(env, a0, val, bytes,
+                                 cpu_mmu_index(env, false), GETPC());
+    bytes &= -(1 << ot);
+
+    rep_bulk_advance(env, R_EDI, aflag, bytes);
+    rep_bulk_advance(env, R_ECX, aflag, -(target_ulong)(bytes >> ot));
+    return bytes >> ot;
+}
+
+/*
+ * Likewise for REP MOVS, for a forward string whose source and
+ * destination do not overlap, so that a restart copies the same bytes.
+ */
+uint32_t helper_rep_movs(CPUX86State *env, target_ulong a0, target_ulong a1,
+                         uint32_t ot, uint32_t aflag)
+{
+    uint64_t bytes;
+
+    if (env->df != 1) {
+        return 0;
+    }
+
+    bytes = rep_bulk_bytes(env, ot, aflag);
+    bytes = rep_bulk_clamp(env, bytes, a0, R_EDI, aflag);
+    bytes = rep_bulk_clamp(env, bytes, a1, R_ESI, aflag);
+    /* Compare distances in 64 bits: a1 + bytes can wrap a 32-bit address */
+    if ((uint64_t)a0 - a1 < bytes || (uint64_t)a1 - a0 < bytes) {
+        return 0;
+    }
+    bytes = cpu_memcpy_mmuidx_ra(env, a0, a1, bytes,
+                                 cpu_mmu_index(env, false), GETPC());
+    bytes &= -(1 << ot);
+
+    rep_bulk_advance(env, R_EDI, aflag, bytes);
+    rep_bulk_advance(env, R_ESI, aflag, bytes);
+    rep_bulk_advance(env, R_ECX, aflag, -(target_ulong)(bytes >> ot));
+    return bytes >> ot;
+}
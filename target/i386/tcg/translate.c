@@ -1268,8 +1268,49 @@ static inline void gen_repz_ ## op(DisasContext *s, MemOp ot,              \
     gen_jmp(s, cur_eip);                                                      \
 }
 
-GEN_REPZ(movs)
-GEN_REPZ(stos)
+/*
+ * REP MOVS and REP STOS first let a helper move as many elements as it
+ * can with bulk accesses, and only move one element inline if it moved
+ * none.  This needs one TB execution per iteration (jmp_opt), so that
+ * the helper can update ECX, ESI and EDI freely, and no icount.
+ */
+#define GEN_REPZ_BULK(op)                                                     \
+static inline void gen_repz_ ## op(DisasContext *s, MemOp ot,              \
+                                 target_ulong cur_eip, target_ulong next_eip) \
+{                                                                             \
+    TCGLabel *l2, *l3 = gen_new_label();                                      \
+    gen_update_cc_op(s);                                                      \
+    l2 = gen_jz_ecx_string(s, next_eip);                                      \
+    if (s->jmp_opt && !(tb_cflags(s->base.tb) & CF_USE_ICOUNT)) {             \
+        gen_bulk_ ## op(s, ot);                                               \
+        tcg_gen_brcondi_i32(TCG_COND_NE, s->tmp2_i32, 0, l3);                 \
+    }                                                                         \
+    gen_ ## op(s, ot);                                                        \
+    gen_op_add_reg_im(s, s->aflag, R_ECX, -1);                                \
+    gen_set_label(l3);                                                        \
+    if (s->repz_opt)                                                          \
+        gen_op_jz_ecx(s, s->aflag, l2);                                       \
+    gen_jmp(s, cur_eip);                                                      \
+}
+
+static inline void gen_bulk_movs(DisasContext *s, MemOp ot)
+{
+    gen_string_movl_A0_ESI(s);
+    tcg_gen_mov_tl(s->T1, s->A0);
+    gen_string_movl_A0_EDI(s);
+    gen_helper_rep_movs(s->tmp2_i32, cpu_env, s->A0, s->T1,
+                        tcg_constant_i32(ot), tcg_constant_i32(s->aflag));
+}
+
+static inline void gen_bulk_stos(DisasContext *s, MemOp ot)
+{
+    gen_string_movl_A0_EDI(s);
+    gen_helper_rep_stos(s->tmp2_i32, cpu_env, s->A0,
+                        tcg_constant_i32(ot), tcg_constant_i32(s->aflag));
+}
+
+GEN_REPZ_BULK(movs)
+GEN_REPZ_BULK(stos)
 GEN_REPZ(lods)
 GEN_REPZ(ins)
 GEN_REPZ(outs)
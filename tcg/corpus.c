@@ -0,0 +1,637 @@
+/*
+ * Corpus of TCG ops for benchmarking the optimizer and the backends
+ *
+ * With -accel tcg,op-corpus=file, the ops of every translation block are
+ * written to file as they reach tcg_gen_code(), before any pass has run.
+ * tests/bench/tcg-replay-bench.c loads them back into a TCGContext and
+ * times tcg_gen_code() on them without running a guest.
+ *
+ * All integers are LEB128 encoded; signed ones are zigzag encoded first.
+ * The file starts with a header:
+ *
+ *   "QEMUTCGC", version, target name, TCG_TARGET_REG_BITS,
+ *   number of opcodes, then name, nb_oargs, nb_iargs, nb_cargs of each,
+ *   number of globals, then name, kind, base_type of each, followed
+ *   by mem_base index and mem_offset for TEMP_GLOBAL
+ *
+ * and goes on with one record per translation block:
+ *
+ *   'T', payload length,
+ *   pc, cs_base, flags, cflags,
+ *   number of temps, then kind, base_type (and val if TEMP_CONST) of each,
+ *   number of labels, then refs of each,
+ *   number of ops, then for each op its opcode, param1 | param2 << 4,
+ *   its temp arguments as index + 1 (0 for TCG_CALL_DUMMY_ARG), the name
+ *   of the helper for calls, and its constant arguments, with label ids
+ *   in place of label pointers.
+ *
+ * Opcodes and helpers are matched by name on load, so that a corpus
+ * recorded on one host can be replayed by another one; blocks that use an
+ * op the replaying backend does not implement are skipped.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/error-report.h"
+#include "qemu/thread.h"
+#include "qapi/error.h"
+#include "exec/exec-all.h"
+#include "tcg/tcg.h"
+#include "tcg-internal.h"
+
+#define CORPUS_MAGIC    "QEMUTCGC"
+#define CORPUS_VERSION  1
+#define CORPUS_TB       'T'
+
+bool tcg_corpus_enabled;
+
+static FILE *corpus_file;
+static QemuMutex corpus_lock;
+static bool corpus_header_done;
+
+struct TCGCorpus {
+    gchar *data;
+    const uint8_t *start;       /* first record */
+    const uint8_t *p;
+    const uint8_t *end;         /* end of the file or of the record */
+    const uint8_t *file_end;
+    bool bad;
+
+    /* Recorded opcode -> local opcode, or -1 if there is none.  */
+    int *opc_map;
+    uint64_t nb_opcs;
+
+    GHashTable *helpers;        /* name -> TCGHelperInfo, or NULL */
+    TCGLabel **labels;
+    size_t labels_size;
+};
+
+/* Index of the label argument of @opc, or -1 if it has none.  */
+static int corpus_label_arg(TCGOpcode opc)
+{
+    switch (opc) {
+    case INDEX_op_set_label:
+    case INDEX_op_br:
+        return 0;
+    case INDEX_op_brcond_i32:
+    case INDEX_op_brcond_i64:
+        return 3;
+    case INDEX_op_brcond2_i32:
+        return 5;
+    default:
+        return -1;
+    }
+}
+
+static void corpus_put_u(GByteArray *b, uint64_t v)
+{
+    do {
+        uint8_t c = v & 0x7f;
+
+        v >>= 7;
+        if (v) {
+            c |= 0x80;
+        }
+        g_byte_array_append(b, &c, 1);
+    } while (v);
+}
+
+static void corpus_put_s(GByteArray *b, int64_t v)
+{
+    corpus_put_u(b, ((uint64_t)v << 1) ^ (uint64_t)(v >> 63));
+}
+
+static void corpus_put_str(GByteArray *b, const char *str)
+{
+    size_t len = strlen(str);
+
+    corpus_put_u(b, len);
+    g_byte_array_append(b, (const guint8 *)str, len);
+}
+
+static void corpus_put_header(GByteArray *b, TCGContext *s)
+{
+    int i;
+
+    g_byte_array_append(b, (const guint8 *)CORPUS_MAGIC, 8);
+    corpus_put_u(b, CORPUS_VERSION);
+    corpus_put_str(b, TARGET_NAME);
+    corpus_put_u(b, TCG_TARGET_REG_BITS);
+
+    corpus_put_u(b, NB_OPS);
+    for (i = 0; i < NB_OPS; i++) {
+        const TCGOpDef *def = &tcg_op_defs[i];
+
+        corpus_put_str(b, def->name);
+        corpus_put_u(b, def->nb_oargs);
+        corpus_put_u(b, def->nb_iargs);
+        corpus_put_u(b, def->nb_cargs);
+    }
+
+    corpus_put_u(b, s->nb_globals);
+    for (i = 0; i < s->nb_globals; i++) {
+        TCGTemp *ts = &s->temps[i];
+
+        corpus_put_str(b, ts->name);
+        corpus_put_u(b, ts->kind);
+        corpus_put_u(b, ts->base_type);
+        if (ts->kind == TEMP_GLOBAL) {
+            corpus_put_u(b, temp_idx(ts->mem_base));
+            corpus_put_s(b, ts->mem_offset);
+        }
+    }
+}
+
+bool tcg_corpus_open(const char *path, Error **errp)
+{
+    if (TCG_TARGET_REG_BITS != 64) {
+        error_setg(errp, "op-corpus is only supported on 64-bit hosts");
+        return false;
+    }
+
+    corpus_file = fopen(path, "wb");
+    if (!corpus_file) {
+        error_setg_errno(errp, errno, "could not open op corpus '%s'", path);
+        return false;
+    }
+    qemu_mutex_init(&corpus_lock);
+    tcg_corpus_enabled = true;
+    return true;
+}
+
+void tcg_corpus_record(TCGContext *s, const TranslationBlock *tb)
+{
+    GByteArray *b = g_byte_array_new();
+    GByteArray *h = g_byte_array_new();
+    uint8_t tag = CORPUS_TB;
+    TCGLabel *l;
+    TCGOp *op;
+    int i;
+
+    corpus_put_u(b, tb->pc);
+    corpus_put_u(b, tb->cs_base);
+    corpus_put_u(b, tb->flags);
+    corpus_put_u(b, tb->cflags);
+
+    corpus_put_u(b, s->nb_temps - s->nb_globals);
+    for (i = s->nb_globals; i < s->nb_temps; i++) {
+        TCGTemp *ts = &s->temps[i];
+
+        corpus_put_u(b, ts->kind);
+        corpus_put_u(b, ts->base_type);
+        if (ts->kind == TEMP_CONST) {
+            corpus_put_s(b, ts->val);
+        }
+    }
+
+    corpus_put_u(b, s->nb_labels);
+    QSIMPLEQ_FOREACH(l, &s->labels, next) {
+        corpus_put_u(b, l->refs);
+    }
+
+    corpus_put_u(b, s->nb_ops);
+    QTAILQ_FOREACH(op, &s->ops, link) {
+        const TCGOpDef *def = &tcg_op_defs[op->opc];
+        int label = corpus_label_arg(op->opc);
+        int nb_targs, nb_cargs;
+
+        corpus_put_u(b, op->opc);
+        corpus_put_u(b, op->param1 | op->param2 << 4);
+
+        if (op->opc == INDEX_op_call) {
+            nb_targs = TCGOP_CALLO(op) + TCGOP_CALLI(op);
+            nb_cargs = 0;
+        } else {
+            nb_targs = def->nb_oargs + def->nb_iargs;
+            nb_cargs = def->nb_cargs;
+        }
+        for (i = 0; i < nb_targs; i++) {
+            TCGArg arg = op->args[i];
+
+            corpus_put_u(b, arg == TCG_CALL_DUMMY_ARG
+                         ? 0 : temp_idx(arg_temp(arg)) + 1);
+        }
+        if (op->opc == INDEX_op_call) {
+            corpus_put_str(b, tcg_call_info(op)->name);
+        }
+        for (; i < nb_targs + nb_cargs; i++) {
+            if (i == label) {
+                corpus_put_u(b, arg_label(op->args[i])->id);
+            } else {
+                corpus_put_u(b, op->args[i]);
+            }
+        }
+    }
+
+    qemu_mutex_lock(&corpus_lock);
+    if (!corpus_header_done) {
+        /* The globals are all known by the time the first TB is made.  */
+        corpus_put_header(h, s);
+        corpus_header_done = true;
+    }
+    g_byte_array_append(h, &tag, 1);
+    corpus_put_u(h, b->len);
+    if (fwrite(h->data, h->len, 1, corpus_file) != 1 ||
+        fwrite(b->data, b->len, 1, corpus_file) != 1) {
+        /* A truncated last record is ignored by tcg_corpus_next().  */
+        error_report("op corpus write failed, recording stopped");
+        tcg_corpus_enabled = false;
+    }
+    qemu_mutex_unlock(&corpus_lock);
+
+    g_byte_array_free(h, true);
+    g_byte_array_free(b, true);
+}
+
+static uint64_t corpus_get_u(TCGCorpus *c)
+{
+    uint64_t v = 0;
+    int shift;
+
+    for (shift = 0; shift < 64 && c->p < c->end; shift += 7) {
+        uint8_t b = *c->p++;
+
+        v |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            return v;
+        }
+    }
+    c->bad = true;
+    return 0;
+}
+
+static int64_t corpus_get_s(TCGCorpus *c)
+{
+    uint64_t v = corpus_get_u(c);
+
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+static char *corpus_get_str(TCGCorpus *c)
+{
+    uint64_t len = corpus_get_u(c);
+    char *str;
+
+    if (c->bad || len > c->end - c->p) {
+        c->bad = true;
+        return NULL;
+    }
+    str = g_strndup((const char *)c->p, len);
+    c->p += len;
+    return str;
+}
+
+static bool corpus_load_opcodes(TCGCorpus *c, Error **errp)
+{
+    uint64_t i;
+
+    c->nb_opcs = corpus_get_u(c);
+    if (c->bad || c->nb_opcs > c->end - c->p) {
+        error_setg(errp, "truncated op corpus header");
+        return false;
+    }
+    c->opc_map = g_new(int, c->nb_opcs);
+
+    for (i = 0; i < c->nb_opcs; i++) {
+        g_autofree char *name = corpus_get_str(c);
+        uint64_t nb_oargs = corpus_get_u(c);
+        uint64_t nb_iargs = corpus_get_u(c);
+        uint64_t nb_cargs = corpus_get_u(c);
+        int opc;
+
+        if (c->bad) {
+            error_setg(errp, "truncated op corpus header");
+            return false;
+        }
+        c->opc_map[i] = -1;
+        for (opc = 0; opc < NB_OPS; opc++) {
+            const TCGOpDef *def = &tcg_op_defs[opc];
+
+            if (strcmp(def->name, name) == 0) {
+                if (def->nb_oargs == nb_oargs && def->nb_iargs == nb_iargs &&
+                    def->nb_cargs == nb_cargs) {
+                    c->opc_map[i] = opc;
+                }
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+static bool corpus_load_globals(TCGCorpus *c, Error **errp)
+{
+    TCGContext *s = tcg_ctx;
+    uint64_t i, n;
+
+    n = corpus_get_u(c);
+    for (i = 0; i < n && !c->bad; i++) {
+        char *name = corpus_get_str(c);
+        uint64_t kind = corpus_get_u(c);
+        uint64_t type = corpus_get_u(c);
+        uint64_t base = 0;
+        int64_t offset = 0;
+        TCGTemp *ts;
+
+        if (kind == TEMP_GLOBAL) {
+            base = corpus_get_u(c);
+            offset = corpus_get_s(c);
+        }
+        if (c->bad) {
+            g_free(name);
+            break;
+        }
+
+        if (i < s->nb_globals) {
+            /* env and the frame, created by tcg_init().  */
+            ts = &s->temps[i];
+            if (ts->kind != kind || strcmp(ts->name, name) != 0) {
+                error_setg(errp, "op corpus global %s does not match %s",
+                           name, ts->name);
+                g_free(name);
+                return false;
+            }
+            g_free(name);
+            continue;
+        }
+        if (kind != TEMP_GLOBAL || base >= i || type >= TCG_TYPE_COUNT) {
+            error_setg(errp, "op corpus global %s cannot be replayed", name);
+            g_free(name);
+            return false;
+        }
+
+        /* Like the targets' own globals, the name is never freed.  */
+        ts = tcg_global_mem_new_internal(type, temp_tcgv_ptr(&s->temps[base]),
+                                         offset, name);
+        if (temp_idx(ts) != i) {
+            error_setg(errp, "op corpus global %s has the wrong index", name);
+            return false;
+        }
+    }
+    if (c->bad) {
+        error_setg(errp, "truncated op corpus header");
+        return false;
+    }
+    return true;
+}
+
+TCGCorpus *tcg_corpus_load(const char *path, Error **errp)
+{
+    g_autoptr(GError) gerr = NULL;
+    TCGCorpus *c = g_new0(TCGCorpus, 1);
+    g_autofree char *target = NULL;
+    gsize len;
+
+    if (!g_file_get_contents(path, &c->data, &len, &gerr)) {
+        error_setg(errp, "could not read op corpus: %s", gerr->message);
+        goto fail;
+    }
+    c->p = (const uint8_t *)c->data;
+    c->end = c->file_end = c->p + len;
+
+    if (len < 8 || memcmp(c->p, CORPUS_MAGIC, 8) != 0) {
+        error_setg(errp, "%s is not an op corpus", path);
+        goto fail;
+    }
+    c->p += 8;
+    if (corpus_get_u(c) != CORPUS_VERSION || c->bad) {
+        error_setg(errp, "unsupported op corpus version");
+        goto fail;
+    }
+    target = corpus_get_str(c);
+    if (c->bad || strcmp(target, TARGET_NAME) != 0) {
+        error_setg(errp, "op corpus was recorded for target %s, not %s",
+                   target ? target : "?", TARGET_NAME);
+        goto fail;
+    }
+    if (corpus_get_u(c) != TCG_TARGET_REG_BITS || c->bad) {
+        error_setg(errp, "op corpus was recorded on a host with a different "
+                   "register size");
+        goto fail;
+    }
+    if (!corpus_load_opcodes(c, errp) || !corpus_load_globals(c, errp)) {
+        goto fail;
+    }
+
+    c->start = c->p;
+    c->helpers = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    return c;
+
+ fail:
+    tcg_corpus_free(c);
+    return NULL;
+}
+
+void tcg_corpus_rewind(TCGCorpus *c)
+{
+    c->p = c->start;
+    c->end = c->file_end;
+}
+
+void tcg_corpus_free(TCGCorpus *c)
+{
+    if (c->helpers) {
+        g_hash_table_destroy(c->helpers);
+    }
+    g_free(c->labels);
+    g_free(c->opc_map);
+    g_free(c->data);
+    g_free(c);
+}
+
+static const TCGHelperInfo *corpus_helper(TCGCorpus *c, char *name)
+{
+    gpointer info;
+
+    if (g_hash_table_lookup_extended(c->helpers, name, NULL, &info)) {
+        g_free(name);
+    } else {
+        info = (gpointer)tcg_helper_info_by_name(name);
+        g_hash_table_insert(c->helpers, name, info);
+    }
+    return info;
+}
+
+static bool corpus_type_supported(uint64_t type)
+{
+    switch (type) {
+    case TCG_TYPE_I32:
+    case TCG_TYPE_I64:
+        return true;
+    case TCG_TYPE_V64:
+        return TCG_TARGET_HAS_v64;
+    case TCG_TYPE_V128:
+        return TCG_TARGET_HAS_v128;
+    case TCG_TYPE_V256:
+        return TCG_TARGET_HAS_v256;
+    default:
+        return false;
+    }
+}
+
+/* Emit the ops of the current record.  */
+static int corpus_replay_tb(TCGCorpus *c, TCGContext *s, TranslationBlock *tb)
+{
+    uint64_t i, n, nb_labels;
+
+    tb->pc = corpus_get_u(c);
+    tb->cs_base = corpus_get_u(c);
+    tb->flags = corpus_get_u(c);
+    tb->cflags = corpus_get_u(c);
+    s->tb_cflags = tb->cflags;
+
+    n = corpus_get_u(c);
+    if (c->bad || n > TCG_MAX_TEMPS - s->nb_globals) {
+        return -EINVAL;
+    }
+    for (i = 0; i < n; i++) {
+        uint64_t kind = corpus_get_u(c);
+        uint64_t type = corpus_get_u(c);
+        TCGTemp *ts;
+
+        if (c->bad || type >= TCG_TYPE_COUNT) {
+            return -EINVAL;
+        }
+        if (!corpus_type_supported(type)) {
+            return -ENOTSUP;
+        }
+        switch (kind) {
+        case TEMP_NORMAL:
+        case TEMP_LOCAL:
+            ts = tcg_temp_new_internal(type, kind == TEMP_LOCAL);
+            break;
+        case TEMP_CONST:
+            ts = tcg_constant_internal(type, corpus_get_s(c));
+            break;
+        default:
+            return -EINVAL;
+        }
+        if (temp_idx(ts) != s->nb_globals + i) {
+            return -EINVAL;
+        }
+    }
+
+    nb_labels = corpus_get_u(c);
+    if (c->bad || nb_labels > c->end - c->p) {
+        return -EINVAL;
+    }
+    if (nb_labels > c->labels_size) {
+        c->labels_size = nb_labels;
+        c->labels = g_renew(TCGLabel *, c->labels, nb_labels);
+    }
+    for (i = 0; i < nb_labels; i++) {
+        c->labels[i] = gen_new_label();
+        c->labels[i]->refs = corpus_get_u(c);
+    }
+
+    n = corpus_get_u(c);
+    for (i = 0; i < n && !c->bad; i++) {
+        uint64_t opc = corpus_get_u(c);
+        uint64_t params = corpus_get_u(c);
+        const TCGOpDef *def;
+        int label, nb_targs, nb_cargs, j;
+        TCGOp *op;
+
+        if (c->bad || opc >= c->nb_opcs) {
+            return -EINVAL;
+        }
+        if (c->opc_map[opc] < 0 || !tcg_op_supported(c->opc_map[opc])) {
+            return -ENOTSUP;
+        }
+
+        op = tcg_emit_op(c->opc_map[opc]);
+        op->param1 = params & 15;
+        op->param2 = params >> 4;
+        def = &tcg_op_defs[op->opc];
+        label = corpus_label_arg(op->opc);
+
+        if (op->opc == INDEX_op_call) {
+            nb_targs = TCGOP_CALLO(op) + TCGOP_CALLI(op);
+            nb_cargs = 0;
+            if (nb_targs + 2 > MAX_OPC_PARAM) {
+                return -EINVAL;
+            }
+        } else {
+            nb_targs = def->nb_oargs + def->nb_iargs;
+            nb_cargs = def->nb_cargs;
+        }
+        for (j = 0; j < nb_targs; j++) {
+            uint64_t idx = corpus_get_u(c);
+
+            if (idx == 0 && op->opc == INDEX_op_call) {
+                op->args[j] = TCG_CALL_DUMMY_ARG;
+            } else if (idx == 0 || idx > s->nb_temps) {
+                return -EINVAL;
+            } else {
+                op->args[j] = temp_arg(&s->temps[idx - 1]);
+            }
+        }
+        if (op->opc == INDEX_op_call) {
+            char *name = corpus_get_str(c);
+            const TCGHelperInfo *info;
+
+            if (c->bad) {
+                return -EINVAL;
+            }
+            info = corpus_helper(c, name);
+            if (!info) {
+                return -ENOTSUP;
+            }
+            op->args[j] = (uintptr_t)info->func;
+            op->args[j + 1] = (uintptr_t)info;
+        }
+        for (; j < nb_targs + nb_cargs; j++) {
+            uint64_t v = corpus_get_u(c);
+
+            if (j != label) {
+                op->args[j] = v;
+            } else if (v < nb_labels) {
+                op->args[j] = label_arg(c->labels[v]);
+                if (op->opc == INDEX_op_set_label) {
+                    c->labels[v]->present = 1;
+                }
+            } else {
+                return -EINVAL;
+            }
+        }
+    }
+    return c->bad ? -EINVAL : 1;
+}
+
+int tcg_corpus_next(TCGCorpus *c, TranslationBlock *tb, Error **errp)
+{
+    const uint8_t *record_end;
+    uint64_t len;
+    int ret;
+
+    c->end = c->file_end;
+    if (c->p == c->end) {
+        return 0;
+    }
+    if (*c->p++ != CORPUS_TB) {
+        error_setg(errp, "bad op corpus record at offset %td",
+                   c->p - 1 - (const uint8_t *)c->data);
+        return -EINVAL;
+    }
+    len = corpus_get_u(c);
+    if (c->bad || len > c->end - c->p) {
+        /* QEMU was killed while writing the last record.  */
+        c->bad = false;
+        c->p = c->end;
+        return 0;
+    }
+    record_end = c->p + len;
+
+    c->end = record_end;
+    tcg_func_start(tcg_ctx);
+    ret = corpus_replay_tb(c, tcg_ctx, tb);
+    if (ret == -EINVAL || (ret > 0 && c->p != record_end)) {
+        error_setg(errp, "malformed op corpus record at offset %td",
+                   record_end - len - (const uint8_t *)c->data);
+        return -EINVAL;
+    }
+    c->p = record_end;
+    return ret;
+}
@@ -59,8 +59,25 @@ struct tcg_region_state {
     /* fields protected by the lock */
     size_t current; /* current region index */
     size_t agg_size_full; /* aggregate size of full regions */
+
+    /*
+     * With code reclaim, regions are recycled in the order they filled
+     * up: @full is a ring of the regions no context allocates from any
+     * more, oldest first; @victims holds those being reclaimed and @avail
+     * those ready to be handed out again.  All three have region.n slots.
+     */
+    size_t *full;
+    size_t full_head;
+    size_t nb_full;
+    size_t *victims;
+    size_t nb_victims;
+    size_t *avail;
+    size_t nb_avail;
+    bool reclaim_wanted;
 };
 
+bool tcg_region_reclaim;
+
 static struct tcg_region_state region;
 
 /*
@@ -166,10 +183,23 @@ static void tcg_region_trees_init(void)
     }
 }
 
-static struct tcg_region_tree *tc_ptr_to_region_tree(const void *p)
+/* @p must be within the code gen buffer */
+static size_t tcg_region_index(const void *p)
 {
-    size_t region_idx;
+    ptrdiff_t offset;
+
+    if (p < region.start_aligned) {
+        return 0;
+    }
+    offset = p - region.start_aligned;
+    if (offset > region.stride * (region.n - 1)) {
+        return region.n - 1;
+    }
+    return offset / region.stride;
+}
 
+static struct tcg_region_tree *tc_ptr_to_region_tree(const void *p)
+{
     /*
      * Like tcg_splitwx_to_rw, with no assert.  The pc may come from
      * a signal handler over which the caller has no control.
@@ -180,19 +210,7 @@ static struct tcg_region_tree *tc_ptr_to_region_tree(const void *p)
             return NULL;
         }
     }
-
-    if (p < region.start_aligned) {
-        region_idx = 0;
-    } else {
-        ptrdiff_t offset = p - region.start_aligned;
-
-        if (offset > region.stride * (region.n - 1)) {
-            region_idx = region.n - 1;
-        } else {
-            region_idx = offset / region.stride;
-        }
-    }
-    return region_trees + region_idx * tree_size;
+    return region_trees + tcg_region_index(p) * tree_size;
 }
 
 void tcg_tb_insert(TranslationBlock *tb)
@@ -286,17 +304,20 @@ size_t tcg_nb_tbs(void)
     return nb_tbs;
 }
 
+static void tcg_region_tree_reset(struct tcg_region_tree *rt)
+{
+    /* Increment the refcount first so that destroy acts as a reset */
+    g_tree_ref(rt->tree);
+    g_tree_destroy(rt->tree);
+}
+
 static void tcg_region_tree_reset_all(void)
 {
     size_t i;
 
     tcg_region_tree_lock_all();
     for (i = 0; i < region.n; i++) {
-        struct tcg_region_tree *rt = region_trees + i * tree_size;
-
-        /* Increment the refcount first so that destroy acts as a reset */
-        g_tree_ref(rt->tree);
-        g_tree_destroy(rt->tree);
+        tcg_region_tree_reset(region_trees + i * tree_size);
     }
     tcg_region_tree_unlock_all();
 }
@@ -332,13 +353,32 @@ static void tcg_region_assign(TCGContext *s, size_t curr_region)
     s->code_gen_highwater = end - TCG_HIGHWATER;
 }
 
+/* Number of regions evicted at a time by code reclaim */
+static size_t tcg_region_reclaim_batch(void)
+{
+    return MAX(region.n / 8, 1);
+}
+
 static bool tcg_region_alloc__locked(TCGContext *s)
 {
-    if (region.current == region.n) {
+    if (region.current < region.n) {
+        tcg_region_assign(s, region.current);
+        region.current++;
+    } else if (region.nb_avail) {
+        tcg_region_assign(s, region.avail[--region.nb_avail]);
+    } else {
         return true;
     }
-    tcg_region_assign(s, region.current);
-    region.current++;
+
+    /*
+     * Ask for the oldest regions to be reclaimed while there is still
+     * room to translate into until they are.
+     */
+    if (region.full && !region.nb_victims &&
+        region.n - region.current + region.nb_avail <
+        tcg_region_reclaim_batch()) {
+        qatomic_set(&region.reclaim_wanted, true);
+    }
     return false;
 }
 
@@ -351,11 +391,16 @@ bool tcg_region_alloc(TCGContext *s)
     bool err;
     /* read the region size now; alloc__locked will overwrite it on success */
     size_t size_full = s->code_gen_buffer_size;
+    size_t idx = tcg_region_index(s->code_gen_buffer);
 
     qemu_mutex_lock(&region.lock);
     err = tcg_region_alloc__locked(s);
     if (!err) {
         region.agg_size_full += size_full - TCG_HIGHWATER;
+        if (region.full) {
+            region.full[(region.full_head + region.nb_full) % region.n] = idx;
+            region.nb_full++;
+        }
     }
     qemu_mutex_unlock(&region.lock);
     return err;
@@ -387,6 +432,11 @@ void tcg_region_reset_all(void)
     qemu_mutex_lock(&region.lock);
     region.current = 0;
     region.agg_size_full = 0;
+    region.full_head = 0;
+    region.nb_full = 0;
+    region.nb_victims = 0;
+    region.nb_avail = 0;
+    qatomic_set(&region.reclaim_wanted, false);
 
     for (i = 0; i < n_ctxs; i++) {
         TCGContext *s = qatomic_read(&tcg_ctxs[i]);
@@ -397,6 +447,92 @@ void tcg_region_reset_all(void)
     tcg_region_tree_reset_all();
 }
 
+static gboolean tcg_region_collect_tb(gpointer key, gpointer value,
+                                      gpointer data)
+{
+    g_ptr_array_add(data, value);
+    return FALSE;
+}
+
+/*
+ * Code reclaim (-accel tcg,code-reclaim=on) recycles the regions that
+ * filled up first instead of flushing the whole buffer once it is full;
+ * translate-all.c unlinks their TBs and waits for the vCPUs to let go of
+ * them, see tb_reclaim_code().
+ */
+bool tcg_region_reclaim_wanted(void)
+{
+    return qatomic_read(&region.reclaim_wanted);
+}
+
+/*
+ * Pick the oldest full regions for reclaim and return their TBs, or NULL
+ * if there is nothing to do or a reclaim is already under way.  The TBs
+ * remain in the region trees until tcg_region_reclaim_finish().
+ */
+GPtrArray *tcg_region_reclaim_start(void)
+{
+    GPtrArray *tbs = NULL;
+    size_t i;
+
+    qemu_mutex_lock(&region.lock);
+    if (!region.full || region.nb_victims ||
+        !qatomic_read(&region.reclaim_wanted)) {
+        goto out;
+    }
+    qatomic_set(&region.reclaim_wanted, false);
+
+    while (region.nb_full && region.nb_victims < tcg_region_reclaim_batch()) {
+        region.victims[region.nb_victims++] = region.full[region.full_head];
+        region.full_head = (region.full_head + 1) % region.n;
+        region.nb_full--;
+    }
+    if (region.nb_victims == 0) {
+        goto out;
+    }
+
+    tbs = g_ptr_array_new();
+    for (i = 0; i < region.nb_victims; i++) {
+        struct tcg_region_tree *rt = region_trees +
+                                     region.victims[i] * tree_size;
+
+        qemu_mutex_lock(&rt->lock);
+        g_tree_foreach(rt->tree, tcg_region_collect_tb, tbs);
+        qemu_mutex_unlock(&rt->lock);
+    }
+ out:
+    qemu_mutex_unlock(&region.lock);
+    return tbs;
+}
+
+/*
+ * Hand out the regions picked by tcg_region_reclaim_start() again.
+ * Nothing may use their TBs any more.  Returns the number of regions.
+ */
+size_t tcg_region_reclaim_finish(void)
+{
+    size_t i, n;
+
+    qemu_mutex_lock(&region.lock);
+    for (i = 0; i < region.nb_victims; i++) {
+        size_t idx = region.victims[i];
+        struct tcg_region_tree *rt = region_trees + idx * tree_size;
+        void *start, *end;
+
+        qemu_mutex_lock(&rt->lock);
+        tcg_region_tree_reset(rt);
+        qemu_mutex_unlock(&rt->lock);
+
+        tcg_region_bounds(idx, &start, &end);
+        region.agg_size_full -= end - start - TCG_HIGHWATER;
+        region.avail[region.nb_avail++] = idx;
+    }
+    n = region.nb_victims;
+    region.nb_victims = 0;
+    qemu_mutex_unlock(&region.lock);
+    return n;
+}
+
 static size_t tcg_n_regions(size_t tb_size, unsigned max_cpus)
 {
 #ifdef CONFIG_USER_ONLY
@@ -410,6 +546,11 @@ static size_t tcg_n_regions(size_t tb_size, unsigned max_cpus)
      * being of reasonable size. If that's not possible we make do by evenly
      * dividing the code_gen_buffer among the vCPUs.
      */
+    /* Code reclaim evicts whole regions, a few at a time */
+    if (tcg_region_reclaim) {
+        return MAX(tb_size / (2 * MiB), MAX(max_cpus, 4) * 2);
+    }
+
     /* Use a single region if all we have is one vCPU thread */
     if (max_cpus == 1 || !qemu_tcg_mttcg_enabled()) {
         return 1;
@@ -825,6 +966,12 @@ void tcg_region_init(size_t tb_size, int splitwx, unsigned max_cpus)
 
     tcg_region_trees_init();
 
+    if (tcg_region_reclaim && region.n > 1) {
+        region.full = g_new(size_t, region.n);
+        region.victims = g_new(size_t, region.n);
+        region.avail = g_new(size_t, region.n);
+    }
+
     /*
      * Leave the initial context initialized to the first region.
      * This will be the context into which we generate the prologue.
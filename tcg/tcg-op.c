@@ -2722,8 +2722,8 @@ void tcg_gen_exit_tb(const TranslationBlock *tb, unsigned idx)
         tcg_debug_assert(tcg_ctx->goto_tb_issue_mask & (1 << idx));
 #endif
     } else {
-        /* This is an exit via the exitreq label.  */
-        tcg_debug_assert(idx == TB_EXIT_REQUESTED);
+        /* This is an exit via the exitreq label or the tier-up check.  */
+        tcg_debug_assert(idx == TB_EXIT_REQUESTED || idx == TB_EXIT_TIER_UP);
     }
 
     plugin_gen_disable_mem_helpers();
@@ -2741,6 +2741,17 @@ void tcg_gen_goto_tb(unsigned idx)
     tcg_debug_assert((tcg_ctx->goto_tb_issue_mask & (1 << idx)) == 0);
     tcg_ctx->goto_tb_issue_mask |= 1 << idx;
 #endif
+    if (tcg_ctx->tb_exit_count) {
+        /* Racy like gen_tb_count(); the counts only guide superblocks */
+        TCGv_i32 val = tcg_temp_new_i32();
+        TCGv_ptr ptr = tcg_const_ptr(&tcg_ctx->tb_exit_count[idx]);
+
+        tcg_gen_ld_i32(val, ptr, 0);
+        tcg_gen_addi_i32(val, val, 1);
+        tcg_gen_st_i32(val, ptr, 0);
+        tcg_temp_free_ptr(ptr);
+        tcg_temp_free_i32(val);
+    }
     plugin_gen_disable_mem_helpers();
     tcg_gen_op1i(INDEX_op_goto_tb, idx);
 }
@@ -2761,6 +2772,94 @@ void tcg_gen_lookup_and_goto_ptr(void)
     tcg_temp_free_ptr(ptr);
 }
 
+/* Slot of CPUState.tb_ibtc for the indirect branch at @site */
+static unsigned int tb_ibtc_slot(target_ulong site)
+{
+    /* Instructions are at least 2-byte aligned on most guests */
+    target_ulong h = site >> 1;
+
+    return (h ^ (h >> TB_IBTC_BITS)) & (TB_IBTC_SIZE - 1);
+}
+
+void tcg_gen_lookup_and_goto_ptr_cached(target_ulong site, TCGv pc,
+                                        TCGv cs_base, uint32_t flags)
+{
+    uint32_t cflags = tcg_ctx->tb_cflags;
+    unsigned int slot = tb_ibtc_slot(site);
+    intptr_t dstate_ofs = offsetof(ArchCPU, parent_obj.trace_dstate) -
+                          offsetof(ArchCPU, env);
+    TCGLabel *miss;
+    TCGv_ptr tb, ptr;
+    TCGv_i32 t32, dstate;
+    TCGv diff, t;
+
+    /* Single-stepping and -d nochain want every TB through the helper */
+    if (cflags & (CF_NO_GOTO_TB | CF_NO_GOTO_PTR | CF_COUNT_MASK)) {
+        tcg_gen_lookup_and_goto_ptr();
+        return;
+    }
+#ifdef HOST_WORDS_BIGENDIAN
+    dstate_ofs += sizeof(unsigned long) - sizeof(uint32_t);
+#endif
+
+    plugin_gen_disable_mem_helpers();
+    tb = tcg_temp_new_ptr();
+    tcg_gen_ld_ptr(tb, cpu_env, offsetof(ArchCPU, parent_obj.tb_ibtc[slot]) -
+                   offsetof(ArchCPU, env));
+
+    /* diff = 0 iff the key of the predicted TB is the one we want */
+    diff = tcg_temp_new();
+    t = tcg_temp_new();
+    t32 = tcg_temp_new_i32();
+    tcg_gen_ld_tl(diff, tb, offsetof(TranslationBlock, pc));
+    tcg_gen_xor_tl(diff, diff, pc);
+    tcg_gen_ld_tl(t, tb, offsetof(TranslationBlock, cs_base));
+    tcg_gen_xor_tl(t, t, cs_base);
+    tcg_gen_or_tl(diff, diff, t);
+    tcg_gen_ld_i32(t32, tb, offsetof(TranslationBlock, flags));
+    tcg_gen_xori_i32(t32, t32, flags);
+    tcg_gen_extu_i32_tl(t, t32);
+    tcg_gen_or_tl(diff, diff, t);
+    tcg_gen_ld_i32(t32, tb, offsetof(TranslationBlock, cflags));
+    tcg_gen_xori_i32(t32, t32, cflags);
+    tcg_gen_extu_i32_tl(t, t32);
+    tcg_gen_or_tl(diff, diff, t);
+
+    /*
+     * As in tb_lookup(), the TB must also have been translated for the
+     * current trace dstate; all its events fit in the low 32 bits of the
+     * first word of the bitmap.
+     */
+    dstate = tcg_temp_new_i32();
+    tcg_gen_ld_i32(t32, tb, offsetof(TranslationBlock, trace_vcpu_dstate));
+    tcg_gen_ld_i32(dstate, cpu_env, dstate_ofs);
+    tcg_gen_xor_i32(t32, t32, dstate);
+    tcg_gen_extu_i32_tl(t, t32);
+    tcg_gen_or_tl(diff, diff, t);
+    tcg_temp_free_i32(dstate);
+    tcg_temp_free_i32(t32);
+    tcg_temp_free(t);
+
+    /*
+     * Load the code pointer before branching, from the same TB that was
+     * checked: the slot may be cleared by another thread meanwhile.
+     */
+    ptr = tcg_temp_local_new_ptr();
+    tcg_gen_ld_ptr(ptr, tb, offsetof(TranslationBlock, tc.ptr));
+    tcg_temp_free_ptr(tb);
+
+    miss = gen_new_label();
+    tcg_gen_brcondi_tl(TCG_COND_NE, diff, 0, miss);
+    tcg_temp_free(diff);
+    tcg_gen_op1i(INDEX_op_goto_ptr, tcgv_ptr_arg(ptr));
+
+    gen_set_label(miss);
+    gen_helper_lookup_tb_ptr_cached(ptr, cpu_env, tcg_constant_i32(slot),
+                                    tcg_constant_i32(cflags));
+    tcg_gen_op1i(INDEX_op_goto_ptr, tcgv_ptr_arg(ptr));
+    tcg_temp_free_ptr(ptr);
+}
+
 static inline MemOp tcg_canonicalize_memop(MemOp op, bool is64, bool st)
 {
     /* Trigger the asserts within as early as possible.  */
@@ -169,6 +169,7 @@ unsigned int tcg_max_ctxs;
 TCGv_env cpu_env = 0;
 const void *tcg_code_gen_epilogue;
 uintptr_t tcg_splitwx_diff;
+bool tcg_spill_next_use;
 
 #ifndef CONFIG_TCG_INTERPRETER
 tcg_prologue_fn *tcg_qemu_tb_exec;
@@ -550,6 +551,18 @@ static const TCGHelperInfo all_helpers[] = {
 };
 static GHashTable *helper_table;
 
+const TCGHelperInfo *tcg_helper_info_by_name(const char *name)
+{
+    size_t i;
+
+    for (i = 0; i < ARRAY_SIZE(all_helpers); ++i) {
+        if (strcmp(all_helpers[i].name, name) == 0) {
+            return &all_helpers[i];
+        }
+    }
+    return NULL;
+}
+
 #ifdef CONFIG_TCG_INTERPRETER
 static GHashTable *ffi_table;
 
@@ -2972,6 +2985,140 @@ static bool liveness_pass_2(TCGContext *s)
     return changes;
 }
 
+/* One read of a temp, in a list ordered by position.  */
+typedef struct TCGLiveUse {
+    int pos;
+    struct TCGLiveUse *next;
+} TCGLiveUse;
+
+/*
+ * Compute the next uses for spill-heuristic=next-use.  Number the ops of
+ * the whole TB, and hang off each temp's state_ptr the positions of the
+ * ops that read it, across labels and branches.  Also record for each
+ * position the next op that ends a basic block other than a conditional
+ * branch (a label, br, goto_tb, exit_tb or goto_ptr), where the register
+ * state is saved and dropped, and the next helper call, which clobbers
+ * the call-clobbered registers.
+ */
+static void next_use_pass(TCGContext *s)
+{
+    int next_drop = INT_MAX, next_call = INT_MAX;
+    int nb_ops = 0, nb_uses = 0, pos, i;
+    TCGLiveUse *uses;
+    TCGOp *op;
+
+    QTAILQ_FOREACH(op, &s->ops, link) {
+        nb_ops++;
+        if (op->opc == INDEX_op_call) {
+            nb_uses += TCGOP_CALLI(op);
+        } else {
+            nb_uses += tcg_op_defs[op->opc].nb_iargs;
+        }
+    }
+
+    s->spill_next_drop = tcg_malloc(nb_ops * sizeof(int));
+    s->spill_next_call = tcg_malloc(nb_ops * sizeof(int));
+    uses = tcg_malloc(nb_uses * sizeof(TCGLiveUse));
+    for (i = 0; i < s->nb_temps; i++) {
+        s->temps[i].state_ptr = NULL;
+    }
+
+    pos = nb_ops;
+    QTAILQ_FOREACH_REVERSE(op, &s->ops, link) {
+        int nb_oargs, nb_iargs;
+
+        pos--;
+        s->spill_next_drop[pos] = next_drop;
+        s->spill_next_call[pos] = next_call;
+
+        if (op->opc == INDEX_op_call) {
+            nb_oargs = TCGOP_CALLO(op);
+            nb_iargs = TCGOP_CALLI(op);
+            next_call = pos;
+        } else {
+            const TCGOpDef *def = &tcg_op_defs[op->opc];
+
+            nb_oargs = def->nb_oargs;
+            nb_iargs = def->nb_iargs;
+            if ((def->flags & (TCG_OPF_BB_END | TCG_OPF_COND_BRANCH))
+                == TCG_OPF_BB_END) {
+                next_drop = pos;
+            }
+        }
+
+        for (i = nb_oargs; i < nb_oargs + nb_iargs; i++) {
+            TCGTemp *ts = arg_temp(op->args[i]);
+
+            if (ts) {
+                uses->pos = pos;
+                uses->next = ts->state_ptr;
+                ts->state_ptr = uses++;
+            }
+        }
+    }
+}
+
+/* Return the position of the next read of TS after the current op.  */
+static int temp_next_use(TCGContext *s, TCGTemp *ts)
+{
+    TCGLiveUse *u = ts->state_ptr;
+
+    while (u && u->pos <= s->spill_pos) {
+        u = u->next;
+    }
+    ts->state_ptr = u;
+    return u ? u->pos : INT_MAX;
+}
+
+/*
+ * Pick the register of SET to spill with the lowest cost.  A value that
+ * is not read again before the register state is next dropped, or before
+ * the next helper call if it lives in a call-clobbered register, leaves
+ * its register there anyway and costs nothing.  Otherwise it must be
+ * reloaded, and stored first if memory is out of date; the sooner it is
+ * read again, the more it costs to spill.
+ */
+static TCGReg tcg_reg_spill_choice(TCGContext *s, TCGRegSet set,
+                                   const int *order)
+{
+    int i, n = ARRAY_SIZE(tcg_target_reg_alloc_order);
+    int pos = s->spill_pos;
+    uint32_t best_cost = UINT32_MAX;
+    TCGReg best = order[0];
+
+    for (i = 0; i < n; i++) {
+        TCGReg reg = order[i];
+        TCGTemp *ts = s->reg_to_temp[reg];
+        uint32_t cost;
+        int next;
+
+        if (!tcg_regset_test_reg(set, reg)) {
+            continue;
+        }
+
+        next = temp_next_use(s, ts);
+        /* goto_ptr reads its operand before dropping the state */
+        if (next > s->spill_next_drop[pos] ||
+            (tcg_regset_test_reg(tcg_target_call_clobber_regs, reg) &&
+             next > s->spill_next_call[pos])) {
+            cost = 0;
+        } else {
+            bool dirty = !ts->mem_coherent && !temp_readonly(ts);
+
+            cost = ((1 + dirty) << 16) / (next - pos) + 1;
+        }
+
+        if (cost < best_cost) {
+            best_cost = cost;
+            best = reg;
+            if (cost == 0) {
+                break;
+            }
+        }
+    }
+    return best;
+}
+
 #ifdef CONFIG_DEBUG_TCG
 static void dump_regs(TCGContext *s)
 {
@@ -3238,6 +3385,10 @@ static TCGReg tcg_reg_alloc(TCGContext *s, TCGRegSet required_regs,
             TCGReg reg = tcg_regset_first(set);
             tcg_reg_free(s, reg, allocated_regs);
             return reg;
+        } else if (tcg_spill_next_use) {
+            TCGReg reg = tcg_reg_spill_choice(s, set, order);
+            tcg_reg_free(s, reg, allocated_regs);
+            return reg;
         } else {
             for (i = 0; i < n; i++) {
                 TCGReg reg = order[i];
@@ -4174,6 +4325,7 @@ int tcg_gen_code(TCGContext *s, TranslationBlock *tb)
 #ifdef CONFIG_PROFILER
     TCGProfile *prof = &s->prof;
 #endif
+    int64_t pass_start = 0;
     int i, num_insns;
     TCGOp *op;
 
@@ -4225,14 +4377,30 @@ int tcg_gen_code(TCGContext *s, TranslationBlock *tb)
     }
 #endif
 
+    if (unlikely(tcg_corpus_enabled)) {
+        tcg_corpus_record(s, tb);
+    }
+
 #ifdef CONFIG_PROFILER
     qatomic_set(&prof->opt_time, prof->opt_time - profile_getclock());
 #endif
+    if (unlikely(s->pass_times)) {
+        pass_start = get_clock();
+    }
 
 #ifdef USE_TCG_OPTIMIZATIONS
-    tcg_optimize(s);
+    if (!s->tb_cold) {
+        tcg_optimize(s);
+    }
 #endif
 
+    if (unlikely(s->pass_times)) {
+        int64_t now = get_clock();
+
+        s->pass_times->opt_ns += now - pass_start;
+        pass_start = now;
+    }
+
 #ifdef CONFIG_PROFILER
     qatomic_set(&prof->opt_time, prof->opt_time + profile_getclock());
     qatomic_set(&prof->la_time, prof->la_time - profile_getclock());
@@ -4259,6 +4427,17 @@ int tcg_gen_code(TCGContext *s, TranslationBlock *tb)
         }
     }
 
+    if (tcg_spill_next_use) {
+        next_use_pass(s);
+    }
+
+    if (unlikely(s->pass_times)) {
+        int64_t now = get_clock();
+
+        s->pass_times->la_ns += now - pass_start;
+        pass_start = now;
+    }
+
 #ifdef CONFIG_PROFILER
     qatomic_set(&prof->la_time, prof->la_time + profile_getclock());
 #endif
@@ -4292,9 +4471,12 @@ int tcg_gen_code(TCGContext *s, TranslationBlock *tb)
 #endif
 
     num_insns = -1;
+    s->spill_pos = -1;
     QTAILQ_FOREACH(op, &s->ops, link) {
         TCGOpcode opc = op->opc;
 
+        s->spill_pos++;
+
 #ifdef CONFIG_PROFILER
         qatomic_set(&prof->table_op_count[opc], prof->table_op_count[opc] + 1);
 #endif
@@ -4392,6 +4574,10 @@ int tcg_gen_code(TCGContext *s, TranslationBlock *tb)
                         tcg_ptr_byte_diff(s->code_ptr, s->code_buf));
 #endif
 
+    if (unlikely(s->pass_times)) {
+        s->pass_times->code_ns += get_clock() - pass_start;
+    }
+
     return tcg_current_code_size(s);
 }
 
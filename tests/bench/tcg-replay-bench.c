@@ -0,0 +1,137 @@
+/*
+ * Replay a TCG op corpus through the optimizer and the host backend
+ *
+ * The corpus is recorded with -accel tcg,op-corpus=file.  Each block is
+ * rebuilt in a TCGContext and handed to tcg_gen_code(), which reports the
+ * time spent in the optimizer, the liveness passes and the code generator.
+ * The code is generated over and over at the same place of the buffer and
+ * never run.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/error-report.h"
+#include "qapi/error.h"
+#include "exec/exec-all.h"
+#include "tcg/tcg.h"
+
+static const char commands_string[] =
+    " -n = number of passes over the corpus (default: 10)\n"
+    " -h = show this help message.\n";
+
+static void usage_complete(char *argv[])
+{
+    fprintf(stderr, "Usage: %s [options] <corpus>\n", argv[0]);
+    fprintf(stderr, "options:\n%s\n", commands_string);
+}
+
+static void report_pass(const char *name, int64_t ns, uint64_t ops)
+{
+    printf("%-10s %12.3f %14.0f\n", name, ns / 1e6,
+           ns ? ops * 1e9 / ns : 0.0);
+}
+
+int main(int argc, char *argv[])
+{
+    TCGPassTimes times = {}, saved;
+    TranslationBlock tb = {};
+    uint64_t nb_tbs = 0, nb_ops = 0, code_size = 0;
+    uint64_t unsupported = 0, too_large = 0;
+    unsigned iterations = 10, i;
+    TCGCorpus *corpus;
+    TCGContext *s;
+    int c;
+
+    error_init(argv[0]);
+
+    for (;;) {
+        c = getopt(argc, argv, "hn:");
+        if (c < 0) {
+            break;
+        }
+        switch (c) {
+        case 'n':
+            iterations = atoi(optarg);
+            break;
+        case 'h':
+            usage_complete(argv);
+            exit(0);
+        default:
+            usage_complete(argv);
+            exit(1);
+        }
+    }
+    if (optind != argc - 1 || iterations == 0) {
+        usage_complete(argv);
+        exit(1);
+    }
+
+    tcg_init(0, 0, 1);
+    tcg_prologue_init(tcg_ctx);
+    corpus = tcg_corpus_load(argv[optind], &error_fatal);
+    tcg_register_thread();
+    s = tcg_ctx;
+
+    for (i = 0; i < iterations; i++) {
+        tcg_corpus_rewind(corpus);
+        for (;;) {
+            int ret = tcg_corpus_next(corpus, &tb, &error_fatal);
+            int ops, size;
+
+            if (ret == 0) {
+                break;
+            }
+            if (ret < 0) {
+                unsupported++;
+                continue;
+            }
+
+            /* Set up the block as tb_gen_code() does.  */
+            tb.tc.ptr = tcg_splitwx_to_rx(s->code_gen_ptr);
+            tb.jmp_reset_offset[0] = TB_JMP_RESET_OFFSET_INVALID;
+            tb.jmp_reset_offset[1] = TB_JMP_RESET_OFFSET_INVALID;
+            s->tb_jmp_reset_offset = tb.jmp_reset_offset;
+            if (TCG_TARGET_HAS_direct_jump) {
+                s->tb_jmp_insn_offset = tb.jmp_target_arg;
+                s->tb_jmp_target_addr = NULL;
+            } else {
+                s->tb_jmp_insn_offset = NULL;
+                s->tb_jmp_target_addr = tb.jmp_target_arg;
+            }
+
+            saved = times;
+            s->pass_times = &times;
+            ops = s->nb_ops;
+            size = tcg_gen_code(s, &tb);
+            s->pass_times = NULL;
+            if (size < 0) {
+                /* QEMU retried these with fewer guest instructions.  */
+                times = saved;
+                too_large++;
+                continue;
+            }
+            nb_tbs++;
+            nb_ops += ops;
+            code_size += size;
+        }
+    }
+
+    printf("corpus:   %s, %" PRIu64 " blocks replayed %u times\n",
+           argv[optind], nb_tbs / iterations, iterations);
+    printf("skipped:  %" PRIu64 " unsupported, %" PRIu64 " too large\n",
+           unsupported / iterations, too_large / iterations);
+    printf("backend:  %s\n", TCG_BACKEND);
+    printf("\n%-10s %12s %14s\n", "pass", "time (ms)", "ops/s");
+    report_pass("optimize", times.opt_ns, nb_ops);
+    report_pass("liveness", times.la_ns, nb_ops);
+    report_pass("codegen", times.code_ns, nb_ops);
+    report_pass("total", times.opt_ns + times.la_ns + times.code_ns, nb_ops);
+    printf("\nhost code: %" PRIu64 " bytes, %.1f per block, %.2f per op\n",
+           code_size / iterations, nb_tbs ? (double)code_size / nb_tbs : 0.0,
+           nb_ops ? (double)code_size / nb_ops : 0.0);
+
+    tcg_corpus_free(corpus);
+    return 0;
+}
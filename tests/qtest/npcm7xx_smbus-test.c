@@ -19,6 +19,8 @@
 #include "libqos/i2c.h"
 #include "libqos/libqtest.h"
 #include "hw/sensor/tmp105_regs.h"
+#include "qapi/qmp/qdict.h"
+#include "qapi/qmp/qlist.h"
 
 #define NR_SMBUS_DEVICES    16
 #define SMBUS_ADDR(x)       (0xf0080000 + 0x1000 * (x))
@@ -466,6 +468,111 @@ static void test_fifo_mode(gconstpointer data)
     qtest_quit(qts);
 }
 
+/* Check an injected NACK fails exactly the picked transaction. */
+static void test_fault_nack(gconstpointer data)
+{
+    intptr_t index = (intptr_t)data;
+    uint64_t base_addr = SMBUS_ADDR(index);
+    QTestState *qts = qtest_init("-machine npcm750-evb");
+    QDict *resp, *rule;
+    QList *rules;
+
+    qtest_qmp_assert_success(qts,
+        "{ 'execute': 'x-i2c-fault-add', 'arguments': {"
+        " 'address': %d, 'action': 'nack', 'nth': 2 } }", EVB_DEVICE_ADDR);
+    enable_bus(qts, base_addr);
+
+    /* The first transaction is not picked */
+    start_transfer(qts, base_addr);
+    send_address(qts, base_addr, EVB_DEVICE_ADDR, false, true);
+    stop_transfer(qts, base_addr);
+    check_stopped(qts, base_addr);
+
+    /* The second one is */
+    start_transfer(qts, base_addr);
+    send_address(qts, base_addr, EVB_DEVICE_ADDR, false, false);
+    stop_transfer(qts, base_addr);
+    check_running(qts, base_addr);
+    qtest_writeb(qts, base_addr + OFFSET_ST, ST_NEGACK);
+    check_stopped(qts, base_addr);
+
+    /* The rule only fires once */
+    start_transfer(qts, base_addr);
+    send_address(qts, base_addr, EVB_DEVICE_ADDR, false, true);
+    stop_transfer(qts, base_addr);
+    check_stopped(qts, base_addr);
+
+    /* It stops matching once used up, but is still listed */
+    resp = qtest_qmp(qts, "{ 'execute': 'x-query-i2c-faults' }");
+    rules = qdict_get_qlist(resp, "return");
+    g_assert_cmpuint(qlist_size(rules), ==, 1);
+    rule = qobject_to(QDict, qlist_peek(rules));
+    g_assert_cmpint(qdict_get_int(rule, "matched"), ==, 2);
+    g_assert_cmpint(qdict_get_int(rule, "fired"), ==, 1);
+    qobject_unref(resp);
+    qtest_quit(qts);
+}
+
+/* Check an injected arbitration loss shows up as a bus error. */
+static void test_fault_arbitration_lost(gconstpointer data)
+{
+    intptr_t index = (intptr_t)data;
+    uint64_t base_addr = SMBUS_ADDR(index);
+    int irq = SMBUS_IRQ(index);
+    QTestState *qts = qtest_init("-machine npcm750-evb");
+
+    qtest_irq_intercept_in(qts, "/machine/soc/a9mpcore/gic");
+    qtest_qmp_assert_success(qts,
+        "{ 'execute': 'x-i2c-fault-add', 'arguments': {"
+        " 'address': %d, 'action': 'arbitration-lost' } }", EVB_DEVICE_ADDR);
+    enable_bus(qts, base_addr);
+
+    start_transfer(qts, base_addr);
+    qtest_writeb(qts, base_addr + OFFSET_SDA, EVB_DEVICE_ADDR << 1);
+    g_assert_cmphex(qtest_readb(qts, base_addr + OFFSET_ST), ==,
+                    ST_XMIT | ST_BER);
+    g_assert_false(qtest_readb(qts, base_addr + OFFSET_CST) & CST_BUSY);
+    g_assert_true(qtest_get_irq(qts, irq));
+    qtest_writeb(qts, base_addr + OFFSET_ST, ST_BER);
+    g_assert_false(qtest_readb(qts, base_addr + OFFSET_ST) & ST_BER);
+
+    /* Retrying wins the bus */
+    start_transfer(qts, base_addr);
+    send_address(qts, base_addr, EVB_DEVICE_ADDR, false, true);
+    stop_transfer(qts, base_addr);
+    check_stopped(qts, base_addr);
+    qtest_quit(qts);
+}
+
+/* Check an injected clock stretch holds the address phase in virtual time. */
+static void test_fault_stretch(gconstpointer data)
+{
+    intptr_t index = (intptr_t)data;
+    uint64_t base_addr = SMBUS_ADDR(index);
+    QTestState *qts = qtest_init("-machine npcm750-evb");
+
+    qtest_qmp_assert_success(qts,
+        "{ 'execute': 'x-i2c-fault-add', 'arguments': {"
+        " 'address': %d, 'action': 'stretch', 'delay-ns': 1000000 } }",
+        EVB_DEVICE_ADDR);
+    enable_bus(qts, base_addr);
+
+    start_transfer(qts, base_addr);
+    qtest_writeb(qts, base_addr + OFFSET_SDA, EVB_DEVICE_ADDR << 1);
+    g_assert_cmphex(qtest_readb(qts, base_addr + OFFSET_ST), ==,
+                    ST_MODE | ST_XMIT);
+    qtest_clock_step(qts, 999999);
+    g_assert_cmphex(qtest_readb(qts, base_addr + OFFSET_ST), ==,
+                    ST_MODE | ST_XMIT);
+    qtest_clock_step(qts, 1);
+    g_assert_cmphex(qtest_readb(qts, base_addr + OFFSET_ST), ==,
+                    ST_MODE | ST_XMIT | ST_SDAST | ST_STASTR);
+    qtest_writeb(qts, base_addr + OFFSET_ST, ST_STASTR);
+    stop_transfer(qts, base_addr);
+    check_stopped(qts, base_addr);
+    qtest_quit(qts);
+}
+
 static void smbus_add_test(const char *name, int index, GTestDataFunc fn)
 {
     g_autofree char *full_name = g_strdup_printf(
@@ -489,6 +596,9 @@ int main(int argc, char **argv)
     for (i = 0; i < ARRAY_SIZE(evb_bus_list); ++i) {
         add_test(single_mode, evb_bus_list[i]);
         add_test(fifo_mode, evb_bus_list[i]);
+        add_test(fault_nack, evb_bus_list[i]);
+        add_test(fault_arbitration_lost, evb_bus_list[i]);
+        add_test(fault_stretch, evb_bus_list[i]);
     }
 
     return g_test_run();
@@ -0,0 +1,230 @@
+/*
+ * Saturating arithmetic and 64-bit multiplies on 32 and 64-bit elements
+ *
+ * On x86 hosts these vector operations used to call out-of-line helpers;
+ * they are now expanded inline into short SSE, AVX2 or AVX-512 sequences.
+ * Check each kernel against scalar code.
+ *
+ * With an argument, the number of rounds to run, also print the time per
+ * element of each kernel, for scripts/performance/tcg_gvec_ops.py.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include <arm_neon.h>
+#include <asm/hwcap.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/auxv.h>
+#include <time.h>
+
+#ifndef HWCAP_SVE
+#define HWCAP_SVE (1 << 22)
+#endif
+
+/* A multiple of any SVE vector length */
+#define SIZE 8192
+#define MUL_IMM 77
+
+static uint8_t a[SIZE] __attribute__((aligned(16)));
+static uint8_t b[SIZE] __attribute__((aligned(16)));
+static uint8_t d[SIZE] __attribute__((aligned(16)));
+
+enum { SQADD, UQADD, SQSUB, UQSUB, MULI };
+
+#define NEON(NAME, T, Q, OP)                                                \
+static void NAME(void)                                                      \
+{                                                                           \
+    for (size_t i = 0; i < SIZE; i += 16) {                                 \
+        vst1q_##Q((T *)(d + i), OP##_##Q(vld1q_##Q((T *)(a + i)),           \
+                                         vld1q_##Q((T *)(b + i))));         \
+    }                                                                       \
+}
+
+NEON(neon_sqadd_s, int32_t, s32, vqaddq)
+NEON(neon_sqadd_d, int64_t, s64, vqaddq)
+NEON(neon_uqadd_s, uint32_t, u32, vqaddq)
+NEON(neon_uqadd_d, uint64_t, u64, vqaddq)
+NEON(neon_sqsub_s, int32_t, s32, vqsubq)
+NEON(neon_sqsub_d, int64_t, s64, vqsubq)
+NEON(neon_uqsub_s, uint32_t, u32, vqsubq)
+NEON(neon_uqsub_d, uint64_t, u64, vqsubq)
+
+#ifdef __ARM_FEATURE_SVE
+#define SVE(NAME, INSN)                                                     \
+static void NAME(void)                                                      \
+{                                                                           \
+    uint64_t vl;                                                            \
+                                                                            \
+    asm("cntb %0" : "=r"(vl));                                              \
+    for (size_t i = 0; i < SIZE; i += vl) {                                 \
+        asm volatile("ptrue p0.b\n\t"                                       \
+                     "ld1b {z0.b}, p0/z, [%0]\n\t"                          \
+                     "ld1b {z1.b}, p0/z, [%1]\n\t"                          \
+                     INSN "\n\t"                                            \
+                     "st1b {z0.b}, p0, [%2]"                                \
+                     : : "r"(a + i), "r"(b + i), "r"(d + i)                 \
+                     : "z0", "z1", "p0", "memory");                         \
+    }                                                                       \
+}
+
+SVE(sve_sqadd_s, "sqadd z0.s, z0.s, z1.s")
+SVE(sve_sqadd_d, "sqadd z0.d, z0.d, z1.d")
+SVE(sve_uqadd_s, "uqadd z0.s, z0.s, z1.s")
+SVE(sve_uqadd_d, "uqadd z0.d, z0.d, z1.d")
+SVE(sve_sqsub_s, "sqsub z0.s, z0.s, z1.s")
+SVE(sve_sqsub_d, "sqsub z0.d, z0.d, z1.d")
+SVE(sve_uqsub_s, "uqsub z0.s, z0.s, z1.s")
+SVE(sve_uqsub_d, "uqsub z0.d, z0.d, z1.d")
+SVE(sve_mul_d, "mul z0.d, z0.d, #77")
+#endif
+
+typedef struct {
+    const char *name;
+    void (*fn)(void);
+    int op;
+    int bits;
+    bool sve;
+} Kernel;
+
+static const Kernel kernels[] = {
+    { "neon-sqadd.4s", neon_sqadd_s, SQADD, 32 },
+    { "neon-sqadd.2d", neon_sqadd_d, SQADD, 64 },
+    { "neon-uqadd.4s", neon_uqadd_s, UQADD, 32 },
+    { "neon-uqadd.2d", neon_uqadd_d, UQADD, 64 },
+    { "neon-sqsub.4s", neon_sqsub_s, SQSUB, 32 },
+    { "neon-sqsub.2d", neon_sqsub_d, SQSUB, 64 },
+    { "neon-uqsub.4s", neon_uqsub_s, UQSUB, 32 },
+    { "neon-uqsub.2d", neon_uqsub_d, UQSUB, 64 },
+#ifdef __ARM_FEATURE_SVE
+    { "sve-sqadd.s", sve_sqadd_s, SQADD, 32, true },
+    { "sve-sqadd.d", sve_sqadd_d, SQADD, 64, true },
+    { "sve-uqadd.s", sve_uqadd_s, UQADD, 32, true },
+    { "sve-uqadd.d", sve_uqadd_d, UQADD, 64, true },
+    { "sve-sqsub.s", sve_sqsub_s, SQSUB, 32, true },
+    { "sve-sqsub.d", sve_sqsub_d, SQSUB, 64, true },
+    { "sve-uqsub.s", sve_uqsub_s, UQSUB, 32, true },
+    { "sve-uqsub.d", sve_uqsub_d, UQSUB, 64, true },
+    { "sve-mul.d", sve_mul_d, MULI, 64, true },
+#endif
+};
+
+static uint64_t ref_op(int op, int bits, uint64_t x, uint64_t y)
+{
+    uint64_t mask = bits == 64 ? UINT64_MAX : (1ull << bits) - 1;
+    __int128 smax = mask >> 1, smin = -smax - 1;
+    __int128 sx = (int64_t)(x << (64 - bits)) >> (64 - bits);
+    __int128 sy = (int64_t)(y << (64 - bits)) >> (64 - bits);
+    __int128 r;
+
+    switch (op) {
+    case SQADD:
+        r = sx + sy;
+        break;
+    case SQSUB:
+        r = sx - sy;
+        break;
+    case UQADD:
+        r = (__int128)(x & mask) + (y & mask);
+        return r > mask ? mask : (uint64_t)r;
+    case UQSUB:
+        return (x & mask) < (y & mask) ? 0 : (x - y) & mask;
+    case MULI:
+        return x * MUL_IMM;
+    default:
+        abort();
+    }
+    r = r > smax ? smax : r < smin ? smin : r;
+    return (uint64_t)r & mask;
+}
+
+static bool check(const Kernel *k)
+{
+    size_t esize = k->bits / 8;
+
+    for (size_t i = 0; i < SIZE; i += esize) {
+        uint64_t x = 0, y = 0, r = 0, exp;
+
+        memcpy(&x, a + i, esize);
+        memcpy(&y, b + i, esize);
+        memcpy(&r, d + i, esize);
+        exp = ref_op(k->op, k->bits, x, y);
+        if (r != exp) {
+            fprintf(stderr, "%s: element %zu: op(%#" PRIx64 ", %#" PRIx64
+                    ") = %#" PRIx64 ", expected %#" PRIx64 "\n", k->name,
+                    i / esize, x, y, r, exp);
+            return false;
+        }
+    }
+    return true;
+}
+
+static void fill(void)
+{
+    static const uint64_t extremes[] = {
+        0, 1, INT64_MAX, INT64_MIN, UINT64_MAX, INT32_MAX, INT32_MIN,
+        UINT32_MAX, 0x7fffffff7fffffffull, 0x8000000080000000ull,
+    };
+    uint64_t seed = 1;
+
+    for (size_t i = 0; i < SIZE; i += 8) {
+        uint64_t x, y;
+
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        x = seed;
+        y = seed * 0x9e3779b97f4a7c15ull;
+        if (i % 64 < 16) {
+            x = extremes[seed % 10];
+            y = extremes[(seed >> 8) % 10];
+        }
+        memcpy(a + i, &x, 8);
+        memcpy(b + i, &y, 8);
+    }
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned long rounds = argc > 1 ? strtoul(argv[1], NULL, 0) : 0;
+    bool have_sve = getauxval(AT_HWCAP) & HWCAP_SVE;
+    int ret = EXIT_SUCCESS;
+
+    fill();
+    for (size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++) {
+        const Kernel *k = &kernels[i];
+        double start;
+
+        if (k->sve && !have_sve) {
+            continue;
+        }
+        memset(d, 0, SIZE);
+        k->fn();
+        if (!check(k)) {
+            ret = EXIT_FAILURE;
+            continue;
+        }
+        if (rounds) {
+            start = now();
+            for (unsigned long r = 0; r < rounds; r++) {
+                k->fn();
+            }
+            printf("%-16s %10.3f ns/element\n", k->name,
+                   (now() - start) * 1e9 / rounds / (SIZE * 8 / k->bits));
+        }
+    }
+    return ret;
+}
@@ -0,0 +1,140 @@
+/*
+ * JIT-like workers, one per vCPU
+ *
+ * Every CPU the virt machine has is started with PSCI and runs the same
+ * loop: write a tiny function into its own code page, call it a number
+ * of times, and count the calls in a word next to the code, the way a
+ * JIT patches code and updates inline caches and counters beside it.
+ * Most guest writes to those pages miss the translated code; with
+ * MTTCG they should not serialize the vCPUs.
+ *
+ * The work per CPU is fixed, so this doubles as the workload for
+ * scripts/performance/tcg_smc_scaling.py, e.g. with -smp 8.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include <inttypes.h>
+#include <minilib.h>
+
+#define MAX_CPUS    64
+#define ROUNDS      2000
+#define CALLS       64
+#define STACK_SIZE  8192
+
+#define PSCI_CPU_ON 0xc4000003
+
+#define stringify(s) xstringify(s)
+#define xstringify(s) #s
+
+/*
+ * One writable and executable page per CPU: .text is mapped read-write
+ * at EL1 by boot.S.  The function goes at the start, the counter in the
+ * second half.
+ */
+asm(".pushsection .text\n"
+    ".balign 4096\n"
+    "jit_pages:\n"
+    ".space 4096 * " stringify(MAX_CPUS) "\n"
+    ".popsection");
+extern uint32_t jit_pages[][1024];
+
+/* What __secondary_start in boot.S expects x0 to point to */
+struct cpu_context {
+    uint64_t sp;
+    void (*fn)(struct cpu_context *ctx);
+    int cpu;
+    uint32_t result;
+};
+
+extern char __secondary_start[];
+
+static struct cpu_context contexts[MAX_CPUS];
+static uint8_t stacks[MAX_CPUS][STACK_SIZE] __attribute__((aligned(16)));
+static int done;
+
+static int64_t psci_cpu_on(uint64_t mpidr, uint64_t entry, uint64_t ctx)
+{
+    register uint64_t x0 asm("x0") = PSCI_CPU_ON;
+    register uint64_t x1 asm("x1") = mpidr;
+    register uint64_t x2 asm("x2") = entry;
+    register uint64_t x3 asm("x3") = ctx;
+
+    asm volatile("hvc #0" : "+r"(x0) : "r"(x1), "r"(x2), "r"(x3) : "memory");
+    return x0;
+}
+
+static uint32_t imm_for(int cpu, int round)
+{
+    return (round * 7 + cpu) & 0xfff;
+}
+
+static uint32_t work(int cpu)
+{
+    uint32_t *page = jit_pages[cpu];
+    volatile uint32_t *calls = &page[512];
+    uint32_t (*fn)(uint32_t) = (void *)page;
+    uint32_t x = 0;
+    int round, i;
+
+    for (round = 0; round < ROUNDS; round++) {
+        /* add w0, w0, #imm; ret */
+        page[0] = 0x11000000 | imm_for(cpu, round) << 10;
+        page[1] = 0xd65f03c0;
+        __builtin___clear_cache((char *)page, (char *)&page[2]);
+
+        for (i = 0; i < CALLS; i++) {
+            x = fn(x);
+            *calls += 1;
+        }
+    }
+    return x;
+}
+
+static void secondary_main(struct cpu_context *ctx)
+{
+    ctx->result = work(ctx->cpu);
+    __atomic_fetch_add(&done, 1, __ATOMIC_RELEASE);
+}
+
+int main(void)
+{
+    uint32_t expected, result;
+    int ncpus, cpu, round, ok = 1;
+
+    /* virt numbers CPUs with Aff0 in clusters of 8 */
+    for (ncpus = 1; ncpus < MAX_CPUS; ncpus++) {
+        struct cpu_context *ctx = &contexts[ncpus];
+        uint64_t mpidr = (ncpus / 8) << 8 | ncpus % 8;
+
+        ctx->sp = (uintptr_t)&stacks[ncpus][STACK_SIZE];
+        ctx->fn = secondary_main;
+        ctx->cpu = ncpus;
+        if (psci_cpu_on(mpidr, (uintptr_t)__secondary_start,
+                        (uintptr_t)ctx)) {
+            break;
+        }
+    }
+    ml_printf("%d CPUs\n", ncpus);
+
+    contexts[0].result = work(0);
+    while (__atomic_load_n(&done, __ATOMIC_ACQUIRE) != ncpus - 1) {
+        /* spin */
+    }
+
+    for (cpu = 0; cpu < ncpus; cpu++) {
+        expected = 0;
+        for (round = 0; round < ROUNDS; round++) {
+            expected += imm_for(cpu, round) * CALLS;
+        }
+        result = contexts[cpu].result;
+        if (result != expected || jit_pages[cpu][512] != ROUNDS * CALLS) {
+            ml_printf("CPU %d: result %x, expected %x, %d calls\n",
+                      cpu, result, expected, jit_pages[cpu][512]);
+            ok = 0;
+        }
+    }
+    ml_printf("%s\n", ok ? "PASS" : "FAIL");
+    return !ok;
+}
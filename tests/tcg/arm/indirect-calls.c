@@ -0,0 +1,118 @@
+/*
+ * Indirect calls and returns whose targets change from call to call
+ *
+ * Each indirect branch site remembers the TB it reached last, and the
+ * generated code jumps there directly while the guest keeps going to
+ * the same place.  Check that a changing target, including a switch
+ * between A32 and T32 code, is never answered with a stale TB.
+ *
+ * With an argument, the number of rounds to run, this doubles as a
+ * call-heavy workload for scripts/performance/tcg_indirect_branch.py.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef __arm__
+#define A32 __attribute__((noinline, target("arm")))
+#define T32 __attribute__((noinline, target("thumb")))
+#else
+#define A32 __attribute__((noinline))
+#define T32 __attribute__((noinline))
+#endif
+
+typedef uint32_t op_fn(uint32_t, uint32_t);
+
+static A32 uint32_t op_add(uint32_t a, uint32_t b)
+{
+    return a + b;
+}
+
+static T32 uint32_t op_sub(uint32_t a, uint32_t b)
+{
+    return a - b;
+}
+
+static A32 uint32_t op_xor(uint32_t a, uint32_t b)
+{
+    return a ^ (b << 3);
+}
+
+static T32 uint32_t op_mul(uint32_t a, uint32_t b)
+{
+    return a * (b | 1);
+}
+
+static op_fn *const ops[] = { op_add, op_sub, op_xor, op_mul };
+
+/* The same computation without calls, to check against */
+static uint32_t op_direct(unsigned int i, uint32_t a, uint32_t b)
+{
+    switch (i) {
+    case 0:
+        return a + b;
+    case 1:
+        return a - b;
+    case 2:
+        return a ^ (b << 3);
+    default:
+        return a * (b | 1);
+    }
+}
+
+/* Recursion through a pointer: every return goes to one of two sites */
+static op_fn *volatile fib_fn;
+
+static A32 uint32_t fib(uint32_t n, uint32_t unused)
+{
+    if (n < 2) {
+        return n;
+    }
+    return fib_fn(n - 1, 0) + fib_fn(n - 2, 0);
+}
+
+static uint32_t xorshift(uint32_t x)
+{
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return x;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned long rounds = argc > 1 ? strtoul(argv[1], NULL, 0) : 20;
+    uint32_t seed = 1, acc = 0, expected = 0;
+    unsigned long r;
+    unsigned int i;
+
+    fib_fn = fib;
+    for (r = 0; r < rounds; r++) {
+        /* One call site, a target that changes every few calls */
+        for (i = 0; i < 4096; i++) {
+            unsigned int n;
+
+            seed = xorshift(seed);
+            n = (seed >> 8) % 4;
+            if (i & 16) {
+                n = i % 4;
+            }
+            acc = ops[n](acc, seed);
+            expected = op_direct(n, expected, seed);
+        }
+        if (acc != expected) {
+            fprintf(stderr, "round %lu: got %08x, expected %08x\n",
+                    r, acc, expected);
+            return EXIT_FAILURE;
+        }
+        if (fib_fn(20, 0) != 6765) {
+            fprintf(stderr, "round %lu: wrong fib(20)\n", r);
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,119 @@
+/*
+ * Misaligned locked instructions racing with aligned ones
+ *
+ * A locked insn whose operand is not aligned to its size cannot be done
+ * with a host atomic of that size.  TCG does it as a compare-and-swap of
+ * the aligned 8-byte word around it when there is one, and otherwise
+ * replays it with EXCP_ATOMIC while the other vCPUs are stopped.  Each
+ * thread adds to the high half of a misaligned 32-bit word with LOCK ADD
+ * or a LOCK CMPXCHG loop, while every thread also increments its low
+ * half with an aligned LOCK ADDW, which runs in parallel.  Each half only
+ * ever changes on its own, so a misaligned path that is not atomic
+ * against the parallel increments loses some of them.  The word is at
+ * offset 2 for the widened path and at offset 6, across an 8-byte
+ * boundary, for EXCP_ATOMIC.
+ *
+ * With arguments, the number of threads and of updates per thread, this
+ * doubles as a guest workload for scripts/performance/tcg_atomic_scaling.py;
+ * a third one picks the offset of the word.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define MAX_THREADS 256
+
+/* The words at offsets 2 and 6 share their cache line with nothing else */
+static uint8_t line[64] __attribute__((aligned(64)));
+static uint8_t *word;
+static unsigned long updates;
+
+static void add_low(void)
+{
+    asm volatile("lock addw $1, %0" : "+m"(*(uint16_t *)word));
+}
+
+static void add_high(void)
+{
+    asm volatile("lock addl $0x10000, %0" : "+m"(*(uint32_t *)word));
+}
+
+static void add_high_cmpxchg(void)
+{
+    uint32_t *p = (uint32_t *)word;
+    uint32_t old = *(volatile uint32_t *)p, prev;
+
+    for (;;) {
+        asm volatile("lock cmpxchgl %2, %1"
+                     : "=a"(prev), "+m"(*p)
+                     : "r"(old + 0x10000), "0"(old));
+        if (prev == old) {
+            break;
+        }
+        old = prev;
+    }
+}
+
+static void *worker(void *arg)
+{
+    void (*add)(void) = (uintptr_t)arg & 1 ? add_high_cmpxchg : add_high;
+
+    for (unsigned long i = 0; i < updates; i++) {
+        add_low();
+        add();
+    }
+    return NULL;
+}
+
+static int run(unsigned long nthreads, unsigned long offset)
+{
+    pthread_t threads[MAX_THREADS];
+    uint32_t value, expected;
+
+    word = line + offset;
+    for (unsigned long i = 0; i < nthreads; i++) {
+        if (pthread_create(&threads[i], NULL, worker, (void *)i)) {
+            perror("pthread_create");
+            return EXIT_FAILURE;
+        }
+    }
+    for (unsigned long i = 0; i < nthreads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    value = *(uint32_t *)word;
+    expected = (uint16_t)(nthreads * updates) * 0x10001u;
+    if (value != expected) {
+        fprintf(stderr, "word at offset %lu is %#x, expected %#x\n",
+                offset, value, expected);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/* Arguments: number of threads, updates per thread, offset of the word */
+int main(int argc, char *argv[])
+{
+    unsigned long nthreads = argc > 1 ? strtoul(argv[1], NULL, 0) : 4;
+
+    updates = argc > 2 ? strtoul(argv[2], NULL, 0) : 20000;
+    if (nthreads < 1 || nthreads > MAX_THREADS) {
+        fprintf(stderr, "between 1 and %d threads\n", MAX_THREADS);
+        return EXIT_FAILURE;
+    }
+    if (argc > 3) {
+        unsigned long offset = strtoul(argv[3], NULL, 0);
+
+        if (offset == 0 || offset > sizeof(line) - 4) {
+            fprintf(stderr, "offset between 1 and %zu\n", sizeof(line) - 4);
+            return EXIT_FAILURE;
+        }
+        return run(nthreads, offset);
+    }
+    return run(nthreads, 2) || run(nthreads, 6);
+}
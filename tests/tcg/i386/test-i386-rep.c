@@ -0,0 +1,110 @@
+/*
+ * REP MOVS and REP STOS over several pages
+ *
+ * Long forward strings are moved with bulk accesses a page at a time;
+ * check the memory and the final ECX, ESI and EDI against a byte loop,
+ * including the cases that must still go element by element.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LEN (5 * 4096 + 123)
+
+static uint8_t buf[3 * LEN];
+static uint8_t ref[3 * LEN];
+static int err;
+
+static void check(const char *name, uintptr_t c, uintptr_t c_exp,
+                  void *s, void *s_exp, void *d, void *d_exp)
+{
+    if (c != c_exp || s != s_exp || d != d_exp) {
+        fprintf(stderr, "%s: registers %lx %p %p, expected %lx %p %p\n",
+                name, (unsigned long)c, s, d, (unsigned long)c_exp,
+                s_exp, d_exp);
+        err = 1;
+    }
+    if (memcmp(buf, ref, sizeof(buf))) {
+        fprintf(stderr, "%s: wrong memory contents\n", name);
+        err = 1;
+    }
+}
+
+static void fill(void)
+{
+    for (int i = 0; i < sizeof(buf); i++) {
+        buf[i] = ref[i] = i * 7 + (i >> 8);
+    }
+}
+
+static void test_movsb(const char *name, int dst, int src, uintptr_t n)
+{
+    void *d = buf + dst, *s = buf + src;
+    uintptr_t c = n;
+
+    fill();
+    for (uintptr_t i = 0; i < n; i++) {
+        ref[dst + i] = ref[src + i];
+    }
+    asm volatile("cld; rep movsb" : "+c"(c), "+S"(s), "+D"(d) : : "memory");
+    check(name, c, 0, s, buf + src + n, d, buf + dst + n);
+}
+
+static void test_movsl(const char *name, int dst, int src, uintptr_t n)
+{
+    void *d = buf + dst, *s = buf + src;
+    uintptr_t c = n;
+
+    fill();
+    for (uintptr_t i = 0; i < n; i++) {
+        memcpy(ref + dst + 4 * i, ref + src + 4 * i, 4);
+    }
+    asm volatile("cld; rep movsl" : "+c"(c), "+S"(s), "+D"(d) : : "memory");
+    check(name, c, 0, s, buf + src + 4 * n, d, buf + dst + 4 * n);
+}
+
+static void test_stosl(const char *name, int dst, uint32_t val, uintptr_t n)
+{
+    void *d = buf + dst;
+    uintptr_t c = n;
+
+    fill();
+    for (uintptr_t i = 0; i < n; i++) {
+        memcpy(ref + dst + 4 * i, &val, 4);
+    }
+    asm volatile("cld; rep stosl" : "+c"(c), "+D"(d) : "a"(val) : "memory");
+    check(name, c, 0, NULL, NULL, d, buf + dst + 4 * n);
+}
+
+static void test_movsb_down(const char *name, int dst, int src, uintptr_t n)
+{
+    uint8_t *d = buf + dst + n - 1, *s = buf + src + n - 1;
+    uintptr_t c = n;
+
+    fill();
+    for (uintptr_t i = n; i-- > 0; ) {
+        ref[dst + i] = ref[src + i];
+    }
+    asm volatile("std; rep movsb; cld"
+                 : "+c"(c), "+S"(s), "+D"(d) : : "memory");
+    check(name, c, 0, s + 1, buf + src, d + 1, buf + dst);
+}
+
+int main(void)
+{
+    test_movsb("movsb", LEN + 1, 3, LEN);
+    test_movsl("movsl", 2 * LEN, 0, LEN / 4);
+    test_movsb("movsb overlapping", 100, 0, LEN);
+    test_movsl("movsl overlapping", 6, 0, LEN / 4);
+    test_movsb("movsb overlapping down", 0, 100, LEN);
+    test_movsb_down("movsb backwards", 50, 0, LEN);
+    test_stosl("stosl zero", 1, 0, LEN / 4);
+    test_stosl("stosl pattern", 2, 0x12345678, LEN / 4);
+    test_stosl("stosl ones", LEN, 0xffffffff, LEN / 4);
+    return err ? EXIT_FAILURE : EXIT_SUCCESS;
+}